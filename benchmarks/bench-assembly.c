@@ -0,0 +1,261 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2021 Airbus SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/**
+ * Benchmark of the clustering, of the creation of the block structure and of
+ * the assembly of synthetic kernels, for each compression algorithm.
+ *
+ * Usage: bench-assembly [options]
+ *   -n N           number of points (default 4000)
+ *   -t TYPES       arithmetics, among SDCZ (default DZ)
+ *   -k KERNELS     laplace,helmholtz,gaussian,matern or all (default all)
+ *   -g GEOMETRIES  cylinder,sphere,plate,cube or all (default cylinder,cube)
+ *   -a ALGORITHMS  svd,aca_full,aca_partial,aca_plus,aca_random,rrqr or all
+ *                  (default aca_partial,aca_plus,aca_random)
+ *   -e EPSILON     compression epsilon (default 1e-4)
+ *   -l SIZE        maximum leaf size (default 100)
+ *   -r REPEAT      number of runs of each case, the minimum times are reported (default 3)
+ *   -o FILE        JSON output file, - for stdout (default bench-assembly.json)
+ *
+ * Each run of the JSON file gives the times of the steps, the time spent in
+ * the kernel and in the compression, and the compression ratio. The times of
+ * the steps are measured without the assembly statistics, whose bookkeeping
+ * would be counted in the assembly time. The kernel and compression times
+ * come from the statistics of one more assembly.
+ */
+#include "bench.h"
+
+enum { SVD, ACA_FULL, ACA_PARTIAL, ACA_PLUS, ACA_RANDOM, RRQR, NB_ALGORITHM };
+
+static const char ** algorithm_names(void) {
+  static const char * names[NB_ALGORITHM] = {"svd", "aca_full", "aca_partial", "aca_plus", "aca_random", "rrqr"};
+  return names;
+}
+
+static hmat_compression_algorithm_t * create_compression(int algorithm, double epsilon) {
+  switch (algorithm) {
+  case SVD: return hmat_create_compression_svd(epsilon);
+  case ACA_FULL: return hmat_create_compression_aca_full(epsilon);
+  case ACA_PARTIAL: return hmat_create_compression_aca_partial(epsilon);
+  case ACA_PLUS: return hmat_create_compression_aca_plus(epsilon);
+  case ACA_RANDOM: return hmat_create_compression_aca_random(epsilon);
+  default: return hmat_create_compression_rrqr(epsilon);
+  }
+}
+
+typedef struct {
+  double clustering;
+  double structure;
+  double assembly;
+  double kernel;
+  double compression;
+  double truncate;
+  size_t calls;
+  int max_rank;
+  hmat_info_t info;
+} timings_t;
+
+static void keep_min(double * min, double value, int first) {
+  if (first || value < *min)
+    *min = value;
+}
+
+static void usage(const char * program) {
+  fprintf(stderr, "Usage: %s [-n points] [-t SDCZ] [-k kernels] [-g geometries] [-a algorithms]"
+          " [-e epsilon] [-l leaf_size] [-r repeat] [-o output.json]\n", program);
+  exit(1);
+}
+
+/**
+  Cluster the points, create the matrix and assemble it.
+  \param stats if not 0, the kernel and compression times, the number of
+  kernel calls and the largest rank are computed from the assembly statistics
+  \return 0 on success
+ */
+static int run(hmat_interface_t * hmat, double * points, int n, int leaf_size, double epsilon,
+               int algorithm, bench_problem_t * problem, int stats, timings_t * time) {
+  Time start;
+  hmat_clustering_algorithm_t * median, * clustering;
+  hmat_cluster_tree_t * tree;
+  hmat_admissibility_t * admissibility;
+  hmat_matrix_t * matrix;
+  hmat_assemble_context_t ctx;
+  int i, error;
+
+  start = now();
+  median = hmat_create_clustering_median();
+  clustering = hmat_create_clustering_max_dof(median, leaf_size);
+  tree = hmat_create_cluster_tree(points, 3, n, clustering);
+  time->clustering = bench_elapsed(start);
+  hmat_delete_clustering(clustering);
+  hmat_delete_clustering(median);
+
+  start = now();
+  admissibility = hmat_create_admissibility_standard(3.0);
+  matrix = hmat->create_empty_hmatrix_admissibility(tree, tree, 0, admissibility);
+  hmat->set_low_rank_epsilon(matrix, epsilon);
+  time->structure = bench_elapsed(start);
+  hmat_delete_admissibility(admissibility);
+
+  hmat_assembly_stats_enable(stats);
+  hmat_assembly_stats_clear();
+  hmat_assemble_context_init(&ctx);
+  ctx.compression = create_compression(algorithm, epsilon);
+  ctx.user_context = problem;
+  ctx.prepare = bench_prepare;
+  ctx.block_compute = bench_compute;
+  ctx.progress = NULL;
+  start = now();
+  error = hmat->assemble_generic(matrix, &ctx);
+  time->assembly = bench_elapsed(start);
+  hmat_assembly_stats_enable(0);
+  hmat_delete_compression(ctx.compression);
+
+  time->kernel = time->compression = time->truncate = 0;
+  time->calls = 0;
+  time->max_rank = 0;
+  for (i = 0; stats && i < hmat_assembly_stats_count(); i++) {
+    hmat_block_stats_t s;
+    hmat_assembly_stats_get(i, &s);
+    time->kernel += s.kernel_time;
+    time->compression += s.compression_time;
+    time->truncate += s.truncate_time;
+    time->calls += s.get_row_count + s.get_col_count + s.get_element_count + s.assemble_count;
+    if (s.rank > time->max_rank)
+      time->max_rank = s.rank;
+  }
+  hmat_assembly_stats_clear();
+  if (!error)
+    hmat->get_info(matrix, &time->info);
+  hmat->destroy(matrix);
+  hmat_delete_cluster_tree(tree);
+  return error;
+}
+
+int main(int argc, char **argv) {
+  int n = 4000, leaf_size = 100, repeat = 3;
+  double epsilon = 1e-4;
+  const char * types = "DZ", * output = NULL;
+  int kernels, geometries, algorithms;
+  int t, g, k, a, r, i, first = 1;
+  FILE * out;
+
+  bench_parse_list("all", bench_kernel_names(), BENCH_NB_KERNEL, &kernels);
+  bench_parse_list("cylinder,cube", bench_geometry_names(), BENCH_NB_GEOMETRY, &geometries);
+  bench_parse_list("aca_partial,aca_plus,aca_random", algorithm_names(), NB_ALGORITHM, &algorithms);
+  for (i = 1; i < argc; i++) {
+    const char * v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (argv[i][0] != '-' || strlen(argv[i]) != 2 || v == NULL)
+      usage(argv[0]);
+    switch (argv[i][1]) {
+    case 'n': n = atoi(v); break;
+    case 't': types = v; break;
+    case 'k': if (bench_parse_list(v, bench_kernel_names(), BENCH_NB_KERNEL, &kernels)) return 1; break;
+    case 'g': if (bench_parse_list(v, bench_geometry_names(), BENCH_NB_GEOMETRY, &geometries)) return 1; break;
+    case 'a': if (bench_parse_list(v, algorithm_names(), NB_ALGORITHM, &algorithms)) return 1; break;
+    case 'e': epsilon = atof(v); break;
+    case 'l': leaf_size = atoi(v); break;
+    case 'r': repeat = atoi(v); break;
+    case 'o': output = v; break;
+    default: usage(argv[0]);
+    }
+    i++;
+  }
+  if (n <= 0 || leaf_size <= 0 || repeat <= 0)
+    usage(argv[0]);
+
+  out = bench_open(output, "assembly");
+  for (t = 0; types[t]; t++) {
+    hmat_value_t type;
+    hmat_interface_t hmat;
+    if (bench_parse_type(types[t], &type))
+      return 1;
+    hmat_init_default_interface(&hmat, type);
+    if (hmat.init() != 0) {
+      fprintf(stderr, "Unable to initialize HMat library\n");
+      return 1;
+    }
+    for (g = 0; g < BENCH_NB_GEOMETRY; g++) {
+      double * points;
+      if (!(geometries & (1 << g)))
+        continue;
+      points = bench_create_points(g, n);
+      for (k = 0; k < BENCH_NB_KERNEL; k++) {
+        bench_problem_t problem;
+        if (!(kernels & (1 << k)))
+          continue;
+        bench_problem_init(&problem, k, type, g, points, n);
+        for (a = 0; a < NB_ALGORITHM; a++) {
+          timings_t min, time;
+          char code[2] = {types[t], 0};
+          if (!(algorithms & (1 << a)))
+            continue;
+          fprintf(stderr, "%c %s %s %s\n", types[t], bench_geometry_names()[g],
+                  bench_kernel_names()[k], algorithm_names()[a]);
+          for (r = 0; r < repeat; r++) {
+            if (run(&hmat, points, n, leaf_size, epsilon, a, &problem, 0, &time) != 0) {
+              fprintf(stderr, "Error during assembly, aborting\n");
+              return 1;
+            }
+            keep_min(&min.clustering, time.clustering, r == 0);
+            keep_min(&min.structure, time.structure, r == 0);
+            keep_min(&min.assembly, time.assembly, r == 0);
+          }
+          /* Breakdown of the assembly */
+          if (run(&hmat, points, n, leaf_size, epsilon, a, &problem, 1, &time) != 0) {
+            fprintf(stderr, "Error during assembly, aborting\n");
+            return 1;
+          }
+          bench_begin_run(out, &first, "assembly");
+          bench_string(out, "type", code);
+          bench_string(out, "geometry", bench_geometry_names()[g]);
+          bench_string(out, "kernel", bench_kernel_names()[k]);
+          bench_string(out, "algorithm", algorithm_names()[a]);
+          bench_int(out, "n", n);
+          bench_double(out, "epsilon", epsilon);
+          bench_int(out, "maxLeafSize", leaf_size);
+          bench_int(out, "repeat", repeat);
+          bench_double(out, "clusteringTime", min.clustering);
+          bench_double(out, "structureTime", min.structure);
+          bench_double(out, "assemblyTime", min.assembly);
+          bench_double(out, "kernelTime", time.kernel);
+          bench_double(out, "compressionTime", time.compression);
+          bench_double(out, "truncateTime", time.truncate);
+          bench_int(out, "kernelCalls", (long) time.calls);
+          bench_int(out, "compressedSize", (long) time.info.compressed_size);
+          bench_int(out, "compressedBytes", (long) time.info.compressed_bytes);
+          bench_int(out, "uncompressedSize", (long) time.info.uncompressed_size);
+          bench_double(out, "compressionRatio", (double) time.info.compressed_size / time.info.uncompressed_size);
+          bench_int(out, "rkCount", (long) time.info.rk_count);
+          bench_int(out, "fullCount", (long) time.info.full_count);
+          bench_int(out, "maxRank", time.max_rank);
+          bench_double(out, "entriesPerSecond", time.info.uncompressed_size / min.assembly);
+          bench_end_run(out);
+        }
+      }
+      free(points);
+    }
+    hmat.finalize();
+  }
+  bench_close(out);
+  return 0;
+}
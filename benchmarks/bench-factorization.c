@@ -0,0 +1,372 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2021 Airbus SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/**
+ * Benchmark of the H-matrix product and of the factorizations followed by a
+ * solve, for a sweep of sizes, epsilons, leaf sizes and thread counts.
+ *
+ * Usage: bench-factorization [options]
+ *   -n SIZES       comma separated numbers of points (default 1000,4000)
+ *   -t TYPES       arithmetics, among SDCZ (default D)
+ *   -f OPERATIONS  gemm,lu,ldlt,llt,hodlr,hodlrsym or all (default all)
+ *   -k KERNEL      laplace, helmholtz, gaussian or matern (default matern)
+ *   -g GEOMETRY    cylinder, sphere, plate or cube (default cylinder)
+ *   -e EPSILONS    comma separated compression epsilons (default 1e-3,1e-5)
+ *   -l SIZES       comma separated maximum leaf sizes (default 100)
+ *   -T THREADS     comma separated OpenMP thread counts (default 1)
+ *   -c SIZE        largest size for which the accuracy is checked against the
+ *                  dense matrix (default 2000)
+ *   -r REPEAT      number of runs of each case, the minimum times are reported (default 3)
+ *   -o FILE        JSON output file, - for stdout (default bench-factorization.json)
+ *
+ * The factorizations are timed with a solve of one right-hand side b = A x,
+ * and the accuracy is the residual \|A y - b\| / \|b\| of the solution y. The
+ * product is timed for C = A * A, and its accuracy is the error on C v. Up to
+ * the -c size A is the dense kernel, for larger sizes it is the assembled
+ * H-matrix. The memory peak is the largest memory used by the matrices
+ * during the product or the factorization (see hmat_memory_report).
+ */
+#include "bench.h"
+#include "common/my_assert.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+enum { GEMM, LU, LDLT, LLT, HODLR, HODLRSYM, NB_OPERATION };
+
+static const char ** operation_names(void) {
+  static const char * names[NB_OPERATION] = {"gemm", "lu", "ldlt", "llt", "hodlr", "hodlrsym"};
+  return names;
+}
+
+static hmat_factorization_t operation_factorization(int operation) {
+  switch (operation) {
+  case LU: return hmat_factorization_lu;
+  case LDLT: return hmat_factorization_ldlt;
+  case LLT: return hmat_factorization_llt;
+  case HODLR: return hmat_factorization_hodlr;
+  case HODLRSYM: return hmat_factorization_hodlrsym;
+  default: return hmat_factorization_none;
+  }
+}
+
+/** The HODLR factorizations need a lower stored matrix too */
+static int operation_symmetric(int operation) {
+  return operation != GEMM && operation != LU;
+}
+
+#define MAX_VALUES 16
+
+typedef struct {
+  double operation;
+  double solve;
+  size_t memory_before;
+  size_t memory_peak;
+  double accuracy;
+  double compression_ratio;
+} result_t;
+
+static void usage(const char * program) {
+  fprintf(stderr, "Usage: %s [-n sizes] [-t SDCZ] [-f operations] [-k kernel] [-g geometry]"
+          " [-e epsilons] [-l leaf_sizes] [-T threads] [-c check_size] [-r repeat] [-o output.json]\n", program);
+  exit(1);
+}
+
+/** y = A x, with the H-matrix A */
+static void hmatrix_apply(hmat_interface_t * hmat, hmat_value_t type, hmat_matrix_t * a,
+                          const double complex * x, double complex * y, int n) {
+  const double complex one = 1, zero = 0;
+  double alpha[2], beta[2];
+  void * vx = bench_vector_to(type, x, n, NULL);
+  void * vy = malloc(bench_scalar_size(type) * n);
+  bench_vector_to(type, &one, 1, alpha);
+  bench_vector_to(type, &zero, 1, beta);
+  HMAT_ASSERT(hmat->gemv('N', alpha, a, vx, beta, vy, 1) == 0);
+  bench_vector_from(type, vy, n, y);
+  free(vx);
+  free(vy);
+}
+
+/**
+  Run an operation on a copy of the assembled matrix a.
+  \param reference b = A x for a factorization, A A x for the product
+  \return 0 on success
+ */
+static int run(hmat_interface_t * hmat, hmat_value_t type, int operation, hmat_matrix_t * a,
+               const double complex * x, const double complex * reference, const bench_problem_t * dense,
+               result_t * result) {
+  const int n = dense->n;
+  hmat_matrix_t * m = hmat->copy(a);
+  double complex * y = (double complex *) malloc(sizeof(double complex) * n);
+  double complex * ay = (double complex *) malloc(sizeof(double complex) * n);
+  hmat_info_t info;
+  size_t live;
+  Time start;
+  int error;
+
+  hmat_memory_reset_peaks();
+  hmat_memory_usage(&result->memory_before, &live);
+  start = now();
+  if (operation == GEMM) {
+    const double complex one = 1, zero = 0;
+    double alpha[2], beta[2];
+    bench_vector_to(type, &one, 1, alpha);
+    bench_vector_to(type, &zero, 1, beta);
+    error = hmat->gemm('N', 'N', alpha, a, a, beta, m);
+  } else {
+    hmat_factorization_context_t context;
+    hmat_factorization_context_init(&context);
+    context.factorization = operation_factorization(operation);
+    context.progress = NULL;
+    error = hmat->factorize_generic(m, &context);
+  }
+  result->operation = bench_elapsed(start);
+  hmat_memory_usage(&live, &result->memory_peak);
+  if (error) {
+    hmat->destroy(m);
+    free(y);
+    free(ay);
+    return 1;
+  }
+
+  result->solve = 0;
+  if (operation == GEMM) {
+    /* Error on A A x */
+    hmatrix_apply(hmat, type, m, x, ay, n);
+  } else {
+    /* Residual of the solution y of A y = b */
+    void * b = bench_vector_to(type, reference, n, NULL);
+    start = now();
+    error = hmat->solve_systems(m, b, 1);
+    result->solve = bench_elapsed(start);
+    bench_vector_from(type, b, n, y);
+    free(b);
+    if (dense->points)
+      bench_dense_apply(dense, y, ay, 1);
+    else
+      hmatrix_apply(hmat, type, a, y, ay, n);
+  }
+  result->accuracy = bench_relative_error(ay, reference, n);
+  hmat->get_info(m, &info);
+  result->compression_ratio = (double) info.compressed_size / info.uncompressed_size;
+  hmat->destroy(m);
+  free(y);
+  free(ay);
+  return error;
+}
+
+int main(int argc, char **argv) {
+  double sizes[MAX_VALUES] = {1000, 4000}, epsilons[MAX_VALUES] = {1e-3, 1e-5};
+  double leaf_sizes[MAX_VALUES] = {100}, threads[MAX_VALUES] = {1};
+  int nb_size = 2, nb_epsilon = 2, nb_leaf_size = 1, nb_threads = 1;
+  int kernel = BENCH_MATERN, geometry = BENCH_CYLINDER, check_size = 2000, repeat = 3;
+  const char * types = "D", * output = NULL;
+  int operations, t, s, e, l, p, o, r, i, first = 1;
+  FILE * out;
+
+  bench_parse_list("all", operation_names(), NB_OPERATION, &operations);
+  for (i = 1; i < argc; i++) {
+    const char * v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (argv[i][0] != '-' || strlen(argv[i]) != 2 || v == NULL)
+      usage(argv[0]);
+    switch (argv[i][1]) {
+    case 'n': if (!(nb_size = bench_parse_numbers(v, sizes, MAX_VALUES))) return 1; break;
+    case 't': types = v; break;
+    case 'f': if (bench_parse_list(v, operation_names(), NB_OPERATION, &operations)) return 1; break;
+    case 'k': if (bench_parse_name(v, bench_kernel_names(), BENCH_NB_KERNEL, &kernel)) return 1; break;
+    case 'g': if (bench_parse_name(v, bench_geometry_names(), BENCH_NB_GEOMETRY, &geometry)) return 1; break;
+    case 'e': if (!(nb_epsilon = bench_parse_numbers(v, epsilons, MAX_VALUES))) return 1; break;
+    case 'l': if (!(nb_leaf_size = bench_parse_numbers(v, leaf_sizes, MAX_VALUES))) return 1; break;
+    case 'T': if (!(nb_threads = bench_parse_numbers(v, threads, MAX_VALUES))) return 1; break;
+    case 'c': check_size = atoi(v); break;
+    case 'r': repeat = atoi(v); break;
+    case 'o': output = v; break;
+    default: usage(argv[0]);
+    }
+    i++;
+  }
+  if (repeat <= 0)
+    usage(argv[0]);
+#ifndef _OPENMP
+  for (p = 0; p < nb_threads; p++) {
+    if (threads[p] != 1) {
+      fprintf(stderr, "This benchmark is built without OpenMP, only 1 thread is supported\n");
+      return 1;
+    }
+  }
+#endif
+
+  /* Account the memory of the matrices before any of them is created */
+  hmat_memory_enable(1);
+  out = bench_open(output, "factorization");
+  for (t = 0; types[t]; t++) {
+    hmat_value_t type;
+    hmat_interface_t hmat;
+    if (bench_parse_type(types[t], &type))
+      return 1;
+    hmat_init_default_interface(&hmat, type);
+    if (hmat.init() != 0) {
+      fprintf(stderr, "Unable to initialize HMat library\n");
+      return 1;
+    }
+    for (s = 0; s < nb_size; s++) {
+      const int n = (int) sizes[s];
+      const int dense_check = n <= check_size;
+      unsigned long long state = 42;
+      double * points = bench_create_points(geometry, n);
+      bench_problem_t problem, dense;
+      double complex * x, * b = NULL, * aax = NULL;
+      bench_problem_init(&problem, kernel, type, geometry, points, n);
+      /* dense.points is NULL when the H-matrix is the reference */
+      dense = problem;
+      if (!dense_check)
+        dense.points = NULL;
+      x = bench_random_vector(type, n, &state);
+      if (dense_check) {
+        b = (double complex *) malloc(sizeof(double complex) * n);
+        bench_dense_apply(&problem, x, b, 1);
+        if (operations & (1 << GEMM)) {
+          aax = (double complex *) malloc(sizeof(double complex) * n);
+          bench_dense_apply(&problem, b, aax, 1);
+        }
+      }
+      for (e = 0; e < nb_epsilon; e++) {
+        for (l = 0; l < nb_leaf_size; l++) {
+          for (p = 0; p < nb_threads; p++) {
+#ifdef _OPENMP
+            omp_set_num_threads((int) threads[p]);
+#endif
+            for (o = 0; o < NB_OPERATION; o++) {
+              const int symmetric = operation_symmetric(o);
+              char code[2] = {types[t], 0};
+              hmat_clustering_algorithm_t * median, * clustering;
+              hmat_cluster_tree_t * tree;
+              hmat_admissibility_t * admissibility;
+              hmat_matrix_t * matrix;
+              hmat_assemble_context_t ctx;
+              hmat_info_t info;
+              result_t min;
+              double assembly;
+              Time start;
+              double complex * reference;
+              int failed = 0;
+              memset(&min, 0, sizeof(min));
+              if (!(operations & (1 << o)))
+                continue;
+              if (o == HODLRSYM && (type == HMAT_SIMPLE_COMPLEX || type == HMAT_DOUBLE_COMPLEX)) {
+                fprintf(stderr, "hodlrsym is not supported in complex arithmetics, skipping\n");
+                continue;
+              }
+              fprintf(stderr, "%c n=%d epsilon=%g leaf=%d threads=%d %s\n", types[t], n, epsilons[e],
+                      (int) leaf_sizes[l], (int) threads[p], operation_names()[o]);
+
+              median = hmat_create_clustering_median();
+              clustering = hmat_create_clustering_max_dof(median, (int) leaf_sizes[l]);
+              tree = hmat_create_cluster_tree(points, 3, n, clustering);
+              hmat_delete_clustering(clustering);
+              hmat_delete_clustering(median);
+              admissibility = o == HODLR || o == HODLRSYM ? hmat_create_admissibility_hodlr()
+                : hmat_create_admissibility_standard(3.0);
+              matrix = hmat.create_empty_hmatrix_admissibility(tree, tree, symmetric, admissibility);
+              hmat_delete_admissibility(admissibility);
+              hmat.set_low_rank_epsilon(matrix, epsilons[e]);
+              hmat_assemble_context_init(&ctx);
+              ctx.compression = hmat_create_compression_aca_plus(epsilons[e]);
+              ctx.user_context = &problem;
+              ctx.prepare = bench_prepare;
+              ctx.block_compute = bench_compute;
+              ctx.lower_symmetric = symmetric;
+              ctx.progress = NULL;
+              start = now();
+              if (hmat.assemble_generic(matrix, &ctx) != 0) {
+                fprintf(stderr, "Error during assembly, aborting\n");
+                return 1;
+              }
+              assembly = bench_elapsed(start);
+              hmat_delete_compression(ctx.compression);
+              hmat.get_info(matrix, &info);
+
+              /* Without dense reference, the right-hand sides are computed with the H-matrix */
+              if (dense_check) {
+                reference = o == GEMM ? aax : b;
+              } else {
+                reference = (double complex *) malloc(sizeof(double complex) * n);
+                hmatrix_apply(&hmat, type, matrix, x, reference, n);
+                if (o == GEMM)
+                  hmatrix_apply(&hmat, type, matrix, reference, reference, n);
+              }
+
+              for (r = 0; r < repeat && !failed; r++) {
+                result_t res;
+                if (run(&hmat, type, o, matrix, x, reference, &dense, &res)) {
+                  fprintf(stderr, "%s failed, skipping\n", operation_names()[o]);
+                  failed = 1;
+                } else if (r == 0) {
+                  min = res;
+                } else {
+                  if (res.operation < min.operation)
+                    min.operation = res.operation;
+                  if (res.solve < min.solve)
+                    min.solve = res.solve;
+                }
+              }
+              if (!dense_check)
+                free(reference);
+              hmat.destroy(matrix);
+              hmat_delete_cluster_tree(tree);
+              if (failed)
+                continue;
+
+              bench_begin_run(out, &first, operation_names()[o]);
+              bench_string(out, "type", code);
+              bench_string(out, "geometry", bench_geometry_names()[geometry]);
+              bench_string(out, "kernel", bench_kernel_names()[kernel]);
+              bench_int(out, "n", n);
+              bench_double(out, "epsilon", epsilons[e]);
+              bench_int(out, "maxLeafSize", (int) leaf_sizes[l]);
+              bench_int(out, "threads", (int) threads[p]);
+              bench_int(out, "repeat", repeat);
+              bench_double(out, "assemblyTime", assembly);
+              bench_double(out, "time", min.operation);
+              if (o != GEMM)
+                bench_double(out, "solveTime", min.solve);
+              bench_int(out, "memoryBefore", (long) min.memory_before);
+              bench_int(out, "memoryPeak", (long) min.memory_peak);
+              bench_double(out, "compressionRatio", (double) info.compressed_size / info.uncompressed_size);
+              bench_double(out, "resultCompressionRatio", min.compression_ratio);
+              bench_double(out, "accuracy", min.accuracy);
+              bench_string(out, "accuracyReference", dense_check ? "dense" : "hmatrix");
+              bench_end_run(out);
+            }
+          }
+        }
+      }
+      free(x);
+      free(b);
+      free(aax);
+      free(points);
+    }
+    hmat.finalize();
+  }
+  bench_close(out);
+  return 0;
+}
@@ -0,0 +1,291 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2021 Airbus SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/**
+ * Latency of the products and of the solves used by iterative solvers, for
+ * several numbers of right-hand sides and of threads.
+ *
+ * Usage: bench-latency [options]
+ *   -n N           number of points (default 4000)
+ *   -t TYPES       arithmetics, among SDCZ (default D)
+ *   -f OPERATIONS  gemv,gemm_scalar,solve_systems,solve_lower_triangular or all (default all)
+ *   -F FACTO       factorization of the solves, lu, ldlt or llt (default llt)
+ *   -k KERNEL      laplace, helmholtz, gaussian or matern (default matern)
+ *   -g GEOMETRY    cylinder, sphere, plate or cube (default cylinder)
+ *   -e EPSILON     compression epsilon (default 1e-4)
+ *   -l SIZE        maximum leaf size (default 100)
+ *   -R NRHS        comma separated numbers of right-hand sides (default 1,8,64)
+ *   -T THREADS     comma separated OpenMP thread counts (default 1)
+ *   -i ITERATIONS  number of timed calls of each case (default 100)
+ *   -w WARMUP      number of calls before the timed ones (default 3)
+ *   -o FILE        JSON output file, - for stdout (default bench-latency.json)
+ *
+ * Each run gives the percentiles of the latency of one call. The bandwidth is
+ * the size of the compressed matrix (the factors for the solves) divided by
+ * the median latency, as each call reads the whole matrix. The speedup is
+ * relative to the first thread count of the -T list.
+ *
+ * The products always use a matrix with both triangles stored, so that their
+ * results do not depend on -F. The solves use a separate matrix, stored lower
+ * symmetric for ldlt and llt. The lowerSymmetric field of each run tells which
+ * storage was used.
+ */
+#include "bench.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+enum { GEMV, GEMM_SCALAR, SOLVE_SYSTEMS, SOLVE_LOWER_TRIANGULAR, NB_OPERATION };
+
+static const char ** operation_names(void) {
+  static const char * names[NB_OPERATION] = {"gemv", "gemm_scalar", "solve_systems", "solve_lower_triangular"};
+  return names;
+}
+
+enum { LU, LDLT, LLT, NB_FACTORIZATION };
+
+static const char ** factorization_names(void) {
+  static const char * names[NB_FACTORIZATION] = {"lu", "ldlt", "llt"};
+  return names;
+}
+
+#define MAX_VALUES 16
+
+static void usage(const char * program) {
+  fprintf(stderr, "Usage: %s [-n points] [-t SDCZ] [-f operations] [-F factorization] [-k kernel]"
+          " [-g geometry] [-e epsilon] [-l leaf_size] [-R nrhs] [-T threads] [-i iterations]"
+          " [-w warmup] [-o output.json]\n", program);
+  exit(1);
+}
+
+/** Size of the data read by a call */
+static size_t matrix_bytes(hmat_interface_t * hmat, hmat_matrix_t * m) {
+  hmat_info_t info;
+  hmat->get_info(m, &info);
+  return info.compressed_bytes;
+}
+
+/** Assemble the matrix of the problem, stored lower symmetric or not */
+static hmat_matrix_t * assemble(hmat_interface_t * hmat, hmat_cluster_tree_t * tree,
+                                bench_problem_t * problem, double epsilon, int symmetric) {
+  hmat_admissibility_t * admissibility = hmat_create_admissibility_standard(3.0);
+  hmat_matrix_t * matrix = hmat->create_empty_hmatrix_admissibility(tree, tree, symmetric, admissibility);
+  hmat_assemble_context_t ctx;
+  hmat_delete_admissibility(admissibility);
+  hmat->set_low_rank_epsilon(matrix, epsilon);
+  hmat_assemble_context_init(&ctx);
+  ctx.compression = hmat_create_compression_aca_plus(epsilon);
+  ctx.user_context = problem;
+  ctx.prepare = bench_prepare;
+  ctx.block_compute = bench_compute;
+  ctx.lower_symmetric = symmetric;
+  ctx.progress = NULL;
+  if (hmat->assemble_generic(matrix, &ctx) != 0) {
+    fprintf(stderr, "Error during assembly, aborting\n");
+    exit(1);
+  }
+  hmat_delete_compression(ctx.compression);
+  return matrix;
+}
+
+int main(int argc, char **argv) {
+  double nrhs_list[MAX_VALUES] = {1, 8, 64}, threads[MAX_VALUES] = {1};
+  int nb_nrhs = 3, nb_threads = 1;
+  int n = 4000, leaf_size = 100, iterations = 100, warmup = 3;
+  int kernel = BENCH_MATERN, geometry = BENCH_CYLINDER, factorization = LLT;
+  double epsilon = 1e-4;
+  const char * types = "D", * output = NULL;
+  int operations, t, o, q, p, i, first = 1;
+  FILE * out;
+
+  bench_parse_list("all", operation_names(), NB_OPERATION, &operations);
+  for (i = 1; i < argc; i++) {
+    const char * v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (argv[i][0] != '-' || strlen(argv[i]) != 2 || v == NULL)
+      usage(argv[0]);
+    switch (argv[i][1]) {
+    case 'n': n = atoi(v); break;
+    case 't': types = v; break;
+    case 'f': if (bench_parse_list(v, operation_names(), NB_OPERATION, &operations)) return 1; break;
+    case 'F': if (bench_parse_name(v, factorization_names(), NB_FACTORIZATION, &factorization)) return 1; break;
+    case 'k': if (bench_parse_name(v, bench_kernel_names(), BENCH_NB_KERNEL, &kernel)) return 1; break;
+    case 'g': if (bench_parse_name(v, bench_geometry_names(), BENCH_NB_GEOMETRY, &geometry)) return 1; break;
+    case 'e': epsilon = atof(v); break;
+    case 'l': leaf_size = atoi(v); break;
+    case 'R': if (!(nb_nrhs = bench_parse_numbers(v, nrhs_list, MAX_VALUES))) return 1; break;
+    case 'T': if (!(nb_threads = bench_parse_numbers(v, threads, MAX_VALUES))) return 1; break;
+    case 'i': iterations = atoi(v); break;
+    case 'w': warmup = atoi(v); break;
+    case 'o': output = v; break;
+    default: usage(argv[0]);
+    }
+    i++;
+  }
+  if (n <= 0 || leaf_size <= 0 || iterations <= 0 || warmup < 0)
+    usage(argv[0]);
+#ifndef _OPENMP
+  for (p = 0; p < nb_threads; p++) {
+    if (threads[p] != 1) {
+      fprintf(stderr, "This benchmark is built without OpenMP, only 1 thread is supported\n");
+      return 1;
+    }
+  }
+#endif
+  if (factorization == LU && (operations & (1 << SOLVE_LOWER_TRIANGULAR))) {
+    fprintf(stderr, "solve_lower_triangular needs a LDLT or LLT factorization, skipping it\n");
+    operations &= ~(1 << SOLVE_LOWER_TRIANGULAR);
+  }
+
+  out = bench_open(output, "latency");
+  for (t = 0; types[t]; t++) {
+    const double complex one = 1, zero = 0;
+    double alpha[2], beta[2];
+    char code[2] = {types[t], 0};
+    hmat_value_t type;
+    hmat_interface_t hmat;
+    hmat_clustering_algorithm_t * median, * clustering;
+    hmat_cluster_tree_t * tree;
+    hmat_matrix_t * matrix = NULL, * factors = NULL;
+    bench_problem_t problem;
+    double * points;
+    size_t scalar_size;
+
+    if (bench_parse_type(types[t], &type))
+      return 1;
+    scalar_size = bench_scalar_size(type);
+    bench_vector_to(type, &one, 1, alpha);
+    bench_vector_to(type, &zero, 1, beta);
+    hmat_init_default_interface(&hmat, type);
+    if (hmat.init() != 0) {
+      fprintf(stderr, "Unable to initialize HMat library\n");
+      return 1;
+    }
+    points = bench_create_points(geometry, n);
+    bench_problem_init(&problem, kernel, type, geometry, points, n);
+    median = hmat_create_clustering_median();
+    clustering = hmat_create_clustering_max_dof(median, leaf_size);
+    tree = hmat_create_cluster_tree(points, 3, n, clustering);
+    hmat_delete_clustering(clustering);
+    hmat_delete_clustering(median);
+    if (operations & ((1 << GEMV) | (1 << GEMM_SCALAR)))
+      matrix = assemble(&hmat, tree, &problem, epsilon, 0);
+    if (operations & ((1 << SOLVE_SYSTEMS) | (1 << SOLVE_LOWER_TRIANGULAR))) {
+      static const hmat_factorization_t factorizations[NB_FACTORIZATION] = {
+        hmat_factorization_lu, hmat_factorization_ldlt, hmat_factorization_llt};
+      hmat_factorization_context_t context;
+      hmat_factorization_context_init(&context);
+      context.factorization = factorizations[factorization];
+      context.progress = NULL;
+      factors = assemble(&hmat, tree, &problem, epsilon, factorization != LU);
+      if (hmat.factorize_generic(factors, &context) != 0) {
+        fprintf(stderr, "Error during factorization, aborting\n");
+        return 1;
+      }
+    }
+
+    for (o = 0; o < NB_OPERATION; o++) {
+      hmat_matrix_t * m = o == GEMV || o == GEMM_SCALAR ? matrix : factors;
+      size_t bytes;
+      if (!(operations & (1 << o)))
+        continue;
+      bytes = matrix_bytes(&hmat, m);
+      for (q = 0; q < nb_nrhs; q++) {
+        const int nrhs = (int) nrhs_list[q];
+        unsigned long long state = 42;
+        double complex * x = bench_random_vector(type, n * nrhs, &state);
+        void * b = bench_vector_to(type, x, n * nrhs, NULL);
+        void * c = malloc(scalar_size * n * nrhs);
+        double * latencies = (double *) malloc(sizeof(double) * iterations);
+        double base = 0;
+        for (p = 0; p < nb_threads; p++) {
+          double mean = 0, p50;
+#ifdef _OPENMP
+          omp_set_num_threads((int) threads[p]);
+#endif
+          fprintf(stderr, "%c %s nrhs=%d threads=%d\n", types[t], operation_names()[o], nrhs, (int) threads[p]);
+          for (i = -warmup; i < iterations; i++) {
+            Time start;
+            int error = 0;
+            /* The solves overwrite their right-hand sides */
+            if (o == SOLVE_SYSTEMS || o == SOLVE_LOWER_TRIANGULAR)
+              memcpy(c, b, scalar_size * n * nrhs);
+            start = now();
+            switch (o) {
+            case GEMV: error = hmat.gemv('N', alpha, m, b, beta, c, nrhs); break;
+            case GEMM_SCALAR: error = hmat.gemm_scalar('N', alpha, m, b, beta, c, nrhs); break;
+            case SOLVE_SYSTEMS: error = hmat.solve_systems(m, c, nrhs); break;
+            default: error = hmat.solve_lower_triangular(m, 0, c, nrhs);
+            }
+            if (error) {
+              fprintf(stderr, "Error during %s, aborting\n", operation_names()[o]);
+              return 1;
+            }
+            if (i >= 0)
+              latencies[i] = bench_elapsed(start);
+          }
+          for (i = 0; i < iterations; i++)
+            mean += latencies[i] / iterations;
+          bench_sort(latencies, iterations);
+          p50 = bench_percentile(latencies, iterations, 50);
+          if (p == 0)
+            base = p50;
+
+          bench_begin_run(out, &first, operation_names()[o]);
+          bench_string(out, "type", code);
+          bench_string(out, "geometry", bench_geometry_names()[geometry]);
+          bench_string(out, "kernel", bench_kernel_names()[kernel]);
+          bench_int(out, "n", n);
+          bench_double(out, "epsilon", epsilon);
+          bench_int(out, "maxLeafSize", leaf_size);
+          if (m == factors)
+            bench_string(out, "factorization", factorization_names()[factorization]);
+          bench_int(out, "lowerSymmetric", m == factors && factorization != LU);
+          bench_int(out, "nrhs", nrhs);
+          bench_int(out, "threads", (int) threads[p]);
+          bench_int(out, "iterations", iterations);
+          bench_double(out, "min", latencies[0]);
+          bench_double(out, "p50", p50);
+          bench_double(out, "p99", bench_percentile(latencies, iterations, 99));
+          bench_double(out, "max", latencies[iterations - 1]);
+          bench_double(out, "mean", mean);
+          bench_int(out, "matrixBytes", (long) bytes);
+          bench_double(out, "bandwidth", bytes / p50);
+          bench_double(out, "speedup", base / p50);
+          bench_end_run(out);
+        }
+        free(x);
+        free(b);
+        free(c);
+        free(latencies);
+      }
+    }
+    if (factors)
+      hmat.destroy(factors);
+    if (matrix)
+      hmat.destroy(matrix);
+    hmat_delete_cluster_tree(tree);
+    free(points);
+    hmat.finalize();
+  }
+  bench_close(out);
+  return 0;
+}
@@ -0,0 +1,466 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2021 Airbus SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/** Common functions of the benchmarks: geometries, kernels, timers and JSON output */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <complex.h>
+#include "hmat/hmat.h"
+#include "common/chrono.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/** Seconds elapsed since start */
+inline static double bench_elapsed(Time start) {
+  return time_diff_in_nanos(start, now()) * 1e-9;
+}
+
+inline static int bench_compare_doubles(const void * a, const void * b) {
+  const double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+/** Sort n values, for bench_percentile */
+inline static void bench_sort(double * values, int n) {
+  qsort(values, n, sizeof(double), bench_compare_doubles);
+}
+
+/** Percentile p (between 0 and 100) of n sorted values, with the nearest rank method */
+inline static double bench_percentile(const double * sorted, int n, double p) {
+  int rank = (int) ceil(p / 100 * n);
+  if (rank < 1)
+    rank = 1;
+  return sorted[rank - 1];
+}
+
+/* ========================
+   Geometries
+   ======================== */
+
+enum { BENCH_CYLINDER, BENCH_SPHERE, BENCH_PLATE, BENCH_CUBE, BENCH_NB_GEOMETRY };
+
+inline static const char ** bench_geometry_names(void) {
+  static const char * names[BENCH_NB_GEOMETRY] = {"cylinder", "sphere", "plate", "cube"};
+  return names;
+}
+
+/** Deterministic uniform random numbers in [0, 1[, so runs are reproducible */
+inline static double bench_random(unsigned long long * state) {
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (*state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/** Create n points of a geometry, see bench_point_spacing for the distance between neighbours */
+inline static double * bench_create_points(int geometry, int n) {
+  double * p = (double *) malloc(3 * sizeof(double) * n);
+  unsigned long long state = 42;
+  int i;
+  for (i = 0; i < n; i++) {
+    double * x = p + 3 * i;
+    switch (geometry) {
+    case BENCH_CYLINDER: {
+      /* Same cylinder as the examples */
+      const double step = 1.75 * M_PI / sqrt((double) n);
+      const int perCircle = (int) (2 * M_PI / step);
+      const double angle = 2 * M_PI / perCircle;
+      x[0] = cos(angle * i);
+      x[1] = sin(angle * i);
+      x[2] = (step * i) / perCircle;
+      break;
+    }
+    case BENCH_SPHERE: {
+      /* Fibonacci sphere */
+      const double z = 1 - (2 * i + 1.) / n;
+      const double r = sqrt(1 - z * z);
+      const double phi = i * M_PI * (3 - sqrt(5.));
+      x[0] = r * cos(phi);
+      x[1] = r * sin(phi);
+      x[2] = z;
+      break;
+    }
+    case BENCH_PLATE: {
+      const int side = (int) ceil(sqrt((double) n));
+      x[0] = (double) (i % side) / side;
+      x[1] = (double) (i / side) / side;
+      x[2] = 0;
+      break;
+    }
+    default:
+      x[0] = bench_random(&state);
+      x[1] = bench_random(&state);
+      x[2] = bench_random(&state);
+    }
+  }
+  return p;
+}
+
+/** Mean distance between neighbouring points created by bench_create_points */
+inline static double bench_point_spacing(int geometry, int n) {
+  switch (geometry) {
+  case BENCH_CYLINDER:
+    return 1.75 * M_PI / sqrt((double) n);
+  case BENCH_SPHERE:
+    /* Unit sphere, of area 4 pi */
+    return sqrt(4 * M_PI / n);
+  case BENCH_PLATE:
+    return 1. / ceil(sqrt((double) n));
+  default:
+    /* Unit cube */
+    return pow((double) n, -1. / 3);
+  }
+}
+
+/* ========================
+   Kernels
+   ======================== */
+
+enum { BENCH_LAPLACE, BENCH_HELMHOLTZ, BENCH_GAUSSIAN, BENCH_MATERN, BENCH_NB_KERNEL };
+
+inline static const char ** bench_kernel_names(void) {
+  static const char * names[BENCH_NB_KERNEL] = {"laplace", "helmholtz", "gaussian", "matern"};
+  return names;
+}
+
+/** A kernel on a point cloud */
+typedef struct {
+  int kernel;
+  hmat_value_t type;
+  int n;
+  double * points;
+  /** Wave number of the Helmholtz kernel */
+  double k;
+  /** Correlation length of the covariance kernels */
+  double l;
+  /** Added to the diagonal, for the covariance kernels to be positive definite */
+  double nugget;
+} bench_problem_t;
+
+/** The points must have been created by bench_create_points(geometry, n) */
+inline static void bench_problem_init(bench_problem_t * p, int kernel, hmat_value_t type, int geometry,
+                                      double * points, int n) {
+  p->kernel = kernel;
+  p->type = type;
+  p->n = n;
+  p->points = points;
+  /* 10 points per wavelength */
+  p->k = 2 * M_PI / (10 * bench_point_spacing(geometry, n));
+  p->l = 0.1;
+  p->nugget = 1e-2;
+}
+
+/**
+  Value of the kernel between 2 degrees of freedom.
+  The real arithmetics use the real part of the Helmholtz kernel.
+ */
+inline static double complex bench_interaction(const bench_problem_t * p, int i, int j) {
+  const double * x = p->points + 3 * i;
+  const double * y = p->points + 3 * j;
+  const double dx = x[0] - y[0], dy = x[1] - y[1], dz = x[2] - y[2];
+  const double r = sqrt(dx * dx + dy * dy + dz * dz);
+  switch (p->kernel) {
+  case BENCH_LAPLACE:
+    return 1. / (4 * M_PI * (r + 1e-10));
+  case BENCH_HELMHOLTZ:
+    return cexp(I * p->k * r) / (4 * M_PI * (r + 1e-10));
+  case BENCH_GAUSSIAN:
+    return exp(-r * r / (p->l * p->l)) + (i == j ? p->nugget : 0);
+  default: {
+    /* Matern nu = 3/2 */
+    const double s = sqrt(3.) * r / p->l;
+    return (1 + s) * exp(-s) + (i == j ? p->nugget : 0);
+  }
+  }
+}
+
+/** Value of the kernel in the arithmetic of the problem, with a null imaginary part for the real ones */
+inline static double complex bench_value(const bench_problem_t * p, int i, int j) {
+  const double complex v = bench_interaction(p, i, j);
+  return p->type == HMAT_SIMPLE_PRECISION || p->type == HMAT_DOUBLE_PRECISION ? creal(v) : v;
+}
+
+/** Data of a block, for bench_compute */
+typedef struct {
+  int row_start;
+  int col_start;
+  int * row_hmat2client;
+  int * col_hmat2client;
+  bench_problem_t * problem;
+} bench_block_t;
+
+inline static void bench_prepare(int row_start, int row_count, int col_start, int col_count,
+                                 int * row_hmat2client, int * row_client2hmat,
+                                 int * col_hmat2client, int * col_client2hmat,
+                                 void * user_context, hmat_block_info_t * block_info) {
+  bench_block_t * b = (bench_block_t *) calloc(1, sizeof(bench_block_t));
+  (void) row_count; (void) col_count; (void) row_client2hmat; (void) col_client2hmat;
+  b->row_start = row_start;
+  b->col_start = col_start;
+  b->row_hmat2client = row_hmat2client;
+  b->col_hmat2client = col_hmat2client;
+  b->problem = (bench_problem_t *) user_context;
+  block_info->user_data = b;
+  block_info->release_user_data = free;
+}
+
+/** Compute a block in column-major order, in double precision as required by the assembly */
+inline static void bench_compute(void * data, int row_begin, int row_count, int col_begin, int col_count, void * values) {
+  const bench_block_t * b = (const bench_block_t *) data;
+  const int real = b->problem->type == HMAT_SIMPLE_PRECISION || b->problem->type == HMAT_DOUBLE_PRECISION;
+  double * d = (double *) values;
+  double complex * z = (double complex *) values;
+  int i, j, pos = 0;
+  for (j = 0; j < col_count; j++) {
+    const int col = b->col_hmat2client[j + col_begin + b->col_start];
+    for (i = 0; i < row_count; i++, pos++) {
+      const double complex v = bench_value(b->problem, b->row_hmat2client[i + row_begin + b->row_start], col);
+      if (real)
+        d[pos] = creal(v);
+      else
+        z[pos] = v;
+    }
+  }
+}
+
+/* ========================
+   Vectors
+   ======================== */
+
+/*
+  The vectors are computed in double complex precision, and converted to the
+  arithmetic of the matrix to call the library. They are in the client
+  numbering, with the right-hand sides stored one after the other.
+ */
+
+inline static size_t bench_scalar_size(hmat_value_t type) {
+  static const size_t sizes[] = {sizeof(float), sizeof(double), 2 * sizeof(float), 2 * sizeof(double)};
+  return sizes[type];
+}
+
+/** Convert n values to the arithmetic of the matrix, in a new buffer (or in out if not NULL) */
+inline static void * bench_vector_to(hmat_value_t type, const double complex * v, int n, void * out) {
+  int i;
+  if (out == NULL)
+    out = malloc(bench_scalar_size(type) * n);
+  for (i = 0; i < n; i++) {
+    switch (type) {
+    case HMAT_SIMPLE_PRECISION: ((float *) out)[i] = creal(v[i]); break;
+    case HMAT_DOUBLE_PRECISION: ((double *) out)[i] = creal(v[i]); break;
+    case HMAT_SIMPLE_COMPLEX: ((float complex *) out)[i] = v[i]; break;
+    default: ((double complex *) out)[i] = v[i];
+    }
+  }
+  return out;
+}
+
+/** Convert n values from the arithmetic of the matrix */
+inline static void bench_vector_from(hmat_value_t type, const void * v, int n, double complex * out) {
+  int i;
+  for (i = 0; i < n; i++) {
+    switch (type) {
+    case HMAT_SIMPLE_PRECISION: out[i] = ((const float *) v)[i]; break;
+    case HMAT_DOUBLE_PRECISION: out[i] = ((const double *) v)[i]; break;
+    case HMAT_SIMPLE_COMPLEX: out[i] = ((const float complex *) v)[i]; break;
+    default: out[i] = ((const double complex *) v)[i];
+    }
+  }
+}
+
+/** Random vector, with a null imaginary part for the real arithmetics */
+inline static double complex * bench_random_vector(hmat_value_t type, int n, unsigned long long * state) {
+  double complex * v = (double complex *) malloc(sizeof(double complex) * n);
+  const int real = type == HMAT_SIMPLE_PRECISION || type == HMAT_DOUBLE_PRECISION;
+  int i;
+  for (i = 0; i < n; i++) {
+    v[i] = bench_random(state) - 0.5;
+    if (!real)
+      v[i] += I * (bench_random(state) - 0.5);
+  }
+  return v;
+}
+
+/** Relative difference \|a - b\| / \|b\| of 2 vectors */
+inline static double bench_relative_error(const double complex * a, const double complex * b, int n) {
+  double diff = 0, norm = 0;
+  int i;
+  for (i = 0; i < n; i++) {
+    diff += cabs(a[i] - b[i]) * cabs(a[i] - b[i]);
+    norm += cabs(b[i]) * cabs(b[i]);
+  }
+  return sqrt(diff / norm);
+}
+
+/** y = A x with the dense kernel, for nrhs vectors. This is O(n^2) so for small problems only. */
+inline static void bench_dense_apply(const bench_problem_t * p, const double complex * x, double complex * y, int nrhs) {
+  int i, j, k;
+  memset(y, 0, sizeof(double complex) * p->n * nrhs);
+  for (j = 0; j < p->n; j++) {
+    for (i = 0; i < p->n; i++) {
+      const double complex a = bench_value(p, i, j);
+      for (k = 0; k < nrhs; k++)
+        y[i + k * p->n] += a * x[j + k * p->n];
+    }
+  }
+}
+
+/* ========================
+   Arguments
+   ======================== */
+
+inline static int bench_parse_type(char c, hmat_value_t * type) {
+  switch (c) {
+  case 'S': *type = HMAT_SIMPLE_PRECISION; return 0;
+  case 'D': *type = HMAT_DOUBLE_PRECISION; return 0;
+  case 'C': *type = HMAT_SIMPLE_COMPLEX; return 0;
+  case 'Z': *type = HMAT_DOUBLE_COMPLEX; return 0;
+  }
+  fprintf(stderr, "Unknown arithmetic code %c\n", c);
+  return 1;
+}
+
+inline static char bench_type_code(hmat_value_t type) {
+  return "SDCZ"[type];
+}
+
+/**
+  Parse a comma separated list of names into a bit mask.
+  \return 0 on success, 1 if a name is unknown
+ */
+inline static int bench_parse_list(const char * list, const char ** names, int count, int * mask) {
+  const char * s = list;
+  *mask = 0;
+  if (strcmp(list, "all") == 0) {
+    *mask = (1 << count) - 1;
+    return 0;
+  }
+  while (*s) {
+    size_t len = strcspn(s, ",");
+    int i, found = 0;
+    for (i = 0; i < count; i++) {
+      if (strlen(names[i]) == len && strncmp(s, names[i], len) == 0) {
+        *mask |= 1 << i;
+        found = 1;
+      }
+    }
+    if (!found) {
+      fprintf(stderr, "Unknown name %.*s in %s\n", (int) len, s, list);
+      return 1;
+    }
+    s += len;
+    if (*s == ',')
+      s++;
+  }
+  return 0;
+}
+
+/** Parse a single name, into its index in names */
+inline static int bench_parse_name(const char * name, const char ** names, int count, int * index) {
+  int mask;
+  if (bench_parse_list(name, names, count, &mask) || mask == 0 || (mask & (mask - 1))) {
+    fprintf(stderr, "Expected one name, got %s\n", name);
+    return 1;
+  }
+  for (*index = 0; !(mask & (1 << *index)); (*index)++)
+    ;
+  return 0;
+}
+
+/**
+  Parse a comma separated list of numbers.
+  \return the number of values, or 0 if the list is invalid or longer than max_count
+ */
+inline static int bench_parse_numbers(const char * list, double * values, int max_count) {
+  const char * s = list;
+  int count = 0;
+  while (*s) {
+    char * end;
+    if (count == max_count) {
+      fprintf(stderr, "Too many values in %s\n", list);
+      return 0;
+    }
+    values[count++] = strtod(s, &end);
+    if (end == s || (*end != ',' && *end != 0)) {
+      fprintf(stderr, "Invalid number in %s\n", list);
+      return 0;
+    }
+    s = *end ? end + 1 : end;
+  }
+  return count;
+}
+
+/* ========================
+   JSON output
+   ======================== */
+
+/**
+  Start the output file, "-" for stdout, NULL for bench-<benchmark>.json.
+  The library may write warnings to stdout, so a file is safer.
+ */
+inline static FILE * bench_open(const char * filename, const char * benchmark) {
+  char name[256];
+  FILE * out;
+  if (filename == NULL) {
+    snprintf(name, sizeof(name), "bench-%s.json", benchmark);
+    filename = name;
+  }
+  out = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot open %s\n", filename);
+    exit(1);
+  }
+  fprintf(out, "{\"benchmark\": \"%s\", \"version\": \"%s\", \"runs\": [", benchmark, hmat_get_version());
+  return out;
+}
+
+inline static void bench_close(FILE * out) {
+  fprintf(out, "\n]}\n");
+  if (out != stdout)
+    fclose(out);
+}
+
+/** Start a run object, first is 1 for the first run of the file */
+inline static void bench_begin_run(FILE * out, int * first, const char * name) {
+  fprintf(out, "%s\n{\"name\": \"%s\"", *first ? "" : ",", name);
+  *first = 0;
+}
+
+inline static void bench_end_run(FILE * out) {
+  fprintf(out, "}");
+  fflush(out);
+}
+
+/** Fields of the current run */
+inline static void bench_string(FILE * out, const char * name, const char * value) {
+  fprintf(out, ", \"%s\": \"%s\"", name, value);
+}
+
+inline static void bench_int(FILE * out, const char * name, long value) {
+  fprintf(out, ", \"%s\": %ld", name, value);
+}
+
+inline static void bench_double(FILE * out, const char * name, double value) {
+  fprintf(out, ", \"%s\": %.6g", name, value);
+}
@@ -0,0 +1,169 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hmat/hmat.h"
+#include "examples.h"
+
+/** Check that reassembling the blocks touching moved DoFs gives a full reassembly.
+
+    A matrix of interactions between points of a cylinder is assembled,
+    then the points of the top of the cylinder are moved up. The cluster
+    tree is moved with hmat_move_cluster_tree, the dirty blocks are
+    emptied by reset_dirty_blocks and computed again by a partial
+    assemble_generic. The product of this matrix by a vector must match the
+    one of a matrix fully assembled on the moved points, while the product
+    of the matrix before the move must not.
+ */
+
+static const double EPSILON = 1e-5;
+
+/** 1 / (r + 0.1), the diagonal must not hide the other terms in the errors */
+static void interaction(void* data, int i, int j, void* result) {
+  double* points = *(double**) data;
+  double dx = points[3*i+0] - points[3*j+0];
+  double dy = points[3*i+1] - points[3*j+1];
+  double dz = points[3*i+2] - points[3*j+2];
+  *((double*)result) = 1. / (sqrt(dx*dx + dy*dy + dz*dz) + 0.1);
+}
+
+static void assemble(hmat_interface_t * hmat, hmat_matrix_t * m, double ** points, int partial) {
+  hmat_assemble_context_t ctx;
+  hmat_assemble_context_init(&ctx);
+  ctx.user_context = points;
+  ctx.compression = hmat_create_compression_aca_plus(EPSILON);
+  ctx.simple_compute = interaction;
+  ctx.progress = NULL;
+  ctx.partial = partial;
+  hmat->assemble_generic(m, &ctx);
+  hmat_delete_compression(ctx.compression);
+}
+
+/** Return |m.x - y| / |y| */
+static double error(hmat_interface_t * hmat, hmat_matrix_t * m, const double * x, const double * y, int n) {
+  double one = 1., zero = 0., diff = 0., norm = 0.;
+  double * mx = (double *) malloc(n * sizeof(double));
+  int i;
+  memcpy(mx, x, n * sizeof(double));
+  hmat->gemv('N', &one, m, (void *) x, &zero, mx, 1);
+  for (i = 0; i < n; i++) {
+    diff += (mx[i] - y[i]) * (mx[i] - y[i]);
+    norm += y[i] * y[i];
+  }
+  free(mx);
+  return sqrt(diff / norm);
+}
+
+int main(int argc, char **argv) {
+  int n, i, dirty_blocks, errors = 0;
+  double * points, * moved, * x, * y, one = 1., zero = 0., partial_error, stale_error;
+  char * dirty;
+  hmat_interface_t hmat;
+  hmat_clustering_algorithm_t * median, * clustering;
+  hmat_cluster_tree_builder_t * builder;
+  hmat_cluster_tree_t * tree;
+  hmat_admissibility_t * admissibility;
+  hmat_matrix_t * m, * stale, * reference;
+  struct hmat_cluster_tree_create_context_t ctx;
+
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s n_points\n", argv[0]);
+    return 1;
+  }
+  n = atoi(argv[1]);
+  hmat_init_default_interface(&hmat, HMAT_DOUBLE_PRECISION);
+  if (0 != hmat.init()) {
+    fprintf(stderr, "Unable to initialize HMat library\n");
+    return 1;
+  }
+  points = createCylinder(1., 1.75 * M_PI / sqrt((double) n), n);
+  median = hmat_create_clustering_median();
+  clustering = hmat_create_clustering_max_dof(median, 50);
+  builder = hmat_create_cluster_tree_builder(clustering);
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.dimension = 3;
+  ctx.number_of_points = n;
+  ctx.coordinates = points;
+  ctx.number_of_dof = n;
+  ctx.builder = builder;
+  tree = hmat_create_cluster_tree_generic(&ctx);
+  admissibility = hmat_create_admissibility_standard(3.0);
+  m = hmat.create_empty_hmatrix_admissibility(tree, tree, 0, admissibility);
+  assemble(&hmat, m, &points, 0);
+  stale = hmat.copy(m);
+
+  /* The points are created ring by ring along z: move the top tenth up */
+  moved = (double *) malloc(3 * n * sizeof(double));
+  dirty = (char *) calloc(n, 1);
+  memcpy(moved, points, 3 * n * sizeof(double));
+  for (i = n - n / 10; i < n; i++) {
+    moved[3 * i + 2] += 0.5;
+    dirty[i] = 1;
+  }
+  ctx.coordinates = moved;
+  hmat_move_cluster_tree(tree, &ctx);
+  dirty_blocks = hmat.reset_dirty_blocks(m, dirty, dirty, admissibility);
+  assemble(&hmat, m, &moved, 1);
+  printf("%d dirty blocks\n", dirty_blocks);
+
+  reference = hmat.create_empty_hmatrix_admissibility(tree, tree, 0, admissibility);
+  assemble(&hmat, reference, &moved, 0);
+
+  x = (double *) malloc(n * sizeof(double));
+  y = (double *) malloc(n * sizeof(double));
+  for (i = 0; i < n; i++)
+    x[i] = y[i] = 1. + (i % 7);
+  hmat.gemv('N', &one, reference, x, &zero, y, 1);
+  partial_error = error(&hmat, m, x, y, n);
+  stale_error = error(&hmat, stale, x, y, n);
+  printf("Error of the partial reassembly: %g, without reassembly: %g\n", partial_error, stale_error);
+  if (dirty_blocks <= 0) {
+    fprintf(stderr, "No block was reset\n");
+    errors++;
+  }
+  if (partial_error > 10 * EPSILON) {
+    fprintf(stderr, "The partial reassembly differs from the full one\n");
+    errors++;
+  }
+  if (stale_error < 100 * EPSILON) {
+    fprintf(stderr, "The move does not change the matrix\n");
+    errors++;
+  }
+
+  hmat.destroy(m);
+  hmat.destroy(stale);
+  hmat.destroy(reference);
+  hmat_delete_admissibility(admissibility);
+  hmat_delete_cluster_tree(tree);
+  hmat_delete_cluster_tree_builder(builder);
+  hmat_delete_clustering(clustering);
+  hmat_delete_clustering(median);
+  free(dirty);
+  free(moved);
+  free(points);
+  free(x);
+  free(y);
+  hmat.finalize();
+  return errors != 0;
+}
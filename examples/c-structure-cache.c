@@ -0,0 +1,165 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hmat/hmat.h"
+#include "examples.h"
+
+/** Check that the structure cache gives the same matrix as a fresh build.
+
+    The DoFs are segments between consecutive points of a cylinder, so they
+    have spans. The structure is built without cache, then by
+    create_empty_hmatrix_cached with an empty cache (which writes it), then
+    again (which reads it). The three matrices must have the same cluster
+    tree, bounding boxes and blocks, which is checked by comparing their
+    dump_info files. A clustering with another leaf size must not be read
+    from the cache of the first one.
+ */
+
+static const char * CACHE_FILE = "structure-cache.bin";
+
+/** Return 1 if both files have the same content */
+static int same_files(const char * a, const char * b) {
+  FILE * fa = fopen(a, "rb"), * fb = fopen(b, "rb");
+  int ca, cb, result = fa != NULL && fb != NULL;
+  while (result) {
+    ca = fgetc(fa);
+    cb = fgetc(fb);
+    result = ca == cb;
+    if (ca == EOF)
+      break;
+  }
+  if (fa) fclose(fa);
+  if (fb) fclose(fb);
+  return result;
+}
+
+/** Dump the matrix to prefix.json and destroy it, return its number of blocks */
+static int dump(hmat_interface_t * hmat, hmat_matrix_t * m, char * prefix) {
+  hmat_info_t info;
+  if (m == NULL) {
+    fprintf(stderr, "Cannot create the %s matrix\n", prefix);
+    exit(1);
+  }
+  hmat->get_info(m, &info);
+  hmat->dump_info(m, prefix);
+  hmat->destroy(m);
+  printf("%s: %d blocks, %d rk leaves, %d full leaves\n", prefix, info.nr_block_clusters,
+         (int) info.rk_count, (int) info.full_count);
+  return info.nr_block_clusters;
+}
+
+/** Build the structure of ctx, with the cache or not, and dump it */
+static int build(hmat_interface_t * hmat, struct hmat_cluster_tree_create_context_t * ctx, int cached, char * prefix) {
+  hmat_admissibility_t * admissibility = hmat_create_admissibility_standard(2.0);
+  hmat_matrix_t * m;
+  if (cached) {
+    m = hmat->create_empty_hmatrix_cached(CACHE_FILE, ctx, 0, admissibility);
+  } else {
+    hmat_cluster_tree_t * tree = hmat_create_cluster_tree_generic(ctx);
+    m = hmat->create_empty_hmatrix_admissibility(tree, tree, 0, admissibility);
+    hmat->own_cluster_trees(m, 1, 0);
+  }
+  hmat_delete_admissibility(admissibility);
+  return dump(hmat, m, prefix);
+}
+
+static int check(const char * what, char * reference, char * prefix) {
+  char a[64], b[64];
+  sprintf(a, "%s.json", reference);
+  sprintf(b, "%s.json", prefix);
+  if (!same_files(a, b)) {
+    fprintf(stderr, "%s differs from the fresh build\n", what);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int n, i, errors = 0;
+  double * points;
+  unsigned * spans, * span_offsets;
+  hmat_interface_t hmat;
+  hmat_clustering_algorithm_t * median, * clustering;
+  hmat_cluster_tree_builder_t * builder;
+  struct hmat_cluster_tree_create_context_t ctx;
+
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s n_points\n", argv[0]);
+    return 1;
+  }
+  n = atoi(argv[1]);
+  hmat_init_default_interface(&hmat, HMAT_DOUBLE_PRECISION);
+  if (0 != hmat.init()) {
+    fprintf(stderr, "Unable to initialize HMat library\n");
+    return 1;
+  }
+  points = createCylinder(1., 1.75 * M_PI / sqrt((double) n), n);
+  /* DoF i is the segment from point i to point i + 1 */
+  spans = (unsigned *) malloc(2 * (n - 1) * sizeof(unsigned));
+  span_offsets = (unsigned *) malloc((n - 1) * sizeof(unsigned));
+  for (i = 0; i < n - 1; i++) {
+    spans[2 * i] = i;
+    spans[2 * i + 1] = i + 1;
+    span_offsets[i] = 2 * (i + 1);
+  }
+  median = hmat_create_clustering_median();
+  clustering = hmat_create_clustering_max_dof(median, 50);
+  builder = hmat_create_cluster_tree_builder(clustering);
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.dimension = 3;
+  ctx.number_of_points = n;
+  ctx.coordinates = points;
+  ctx.number_of_dof = n - 1;
+  ctx.span_offsets = span_offsets;
+  ctx.spans = spans;
+  ctx.builder = builder;
+
+  remove(CACHE_FILE);
+  build(&hmat, &ctx, 0, "structure-fresh");
+  build(&hmat, &ctx, 1, "structure-miss");
+  build(&hmat, &ctx, 1, "structure-hit");
+  errors += check("The structure built with an empty cache", "structure-fresh", "structure-miss");
+  errors += check("The structure read from the cache", "structure-fresh", "structure-hit");
+  hmat_delete_cluster_tree_builder(builder);
+  hmat_delete_clustering(clustering);
+
+  /* Another leaf size must give another key */
+  clustering = hmat_create_clustering_max_dof(median, 20);
+  builder = hmat_create_cluster_tree_builder(clustering);
+  ctx.builder = builder;
+  build(&hmat, &ctx, 0, "structure-fresh-20");
+  build(&hmat, &ctx, 1, "structure-hit-20");
+  errors += check("The structure of another clustering", "structure-fresh-20", "structure-hit-20");
+  hmat_delete_cluster_tree_builder(builder);
+  hmat_delete_clustering(clustering);
+  hmat_delete_clustering(median);
+
+  remove(CACHE_FILE);
+  free(spans);
+  free(span_offsets);
+  free(points);
+  hmat.finalize();
+  return errors != 0;
+}
@@ -0,0 +1,148 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/** Check that the block structure does not depend on how it is built.
+
+    For each admissibility condition of the library, in the symmetric and
+    non symmetric cases, the structure built with the batched methods of the
+    condition, in parallel, is compared to the one built in a single thread
+    and to the one built with its scalar methods only.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "h_matrix.hpp"
+#include "admissibility.hpp"
+#include "clustering.hpp"
+#include "cluster_tree.hpp"
+#include "coordinates.hpp"
+#include "hmat_cpp_interface.hpp"
+#include "disable_threading.hpp"
+#include "examples.h"
+
+using namespace hmat;
+
+namespace {
+
+/** Condition calling the scalar methods of another one: its batched methods are the defaults */
+class ScalarAdmissibilityCondition : public ProxyAdmissibilityCondition {
+public:
+  explicit ScalarAdmissibilityCondition(AdmissibilityCondition * admissibility)
+    : ProxyAdmissibilityCondition(admissibility) {}
+};
+
+/** Return true if a and b have the same blocks */
+bool sameStructure(const HMatrix<D_t> * a, const HMatrix<D_t> * b) {
+  if (a == NULL || b == NULL)
+    return a == b;
+  if (!(*a->rows() == *b->rows()) || !(*a->cols() == *b->cols()) || a->isLeaf() != b->isLeaf() ||
+      a->isUpper != b->isUpper || a->isLower != b->isLower ||
+      a->keepSameRows != b->keepSameRows || a->keepSameCols != b->keepSameCols ||
+      a->approximateRank() != b->approximateRank())
+    return false;
+  if (a->isLeaf())
+    return a->isRkMatrix() == b->isRkMatrix();
+  if (a->nrChild() != b->nrChild())
+    return false;
+  for (int i = 0; i < a->nrChild(); i++)
+    if (!sameStructure(a->getChild(i), b->getChild(i)))
+      return false;
+  return true;
+}
+
+HMatrix<D_t> * build(const ClusterTree * tree, AdmissibilityCondition * admissibility, SymmetryFlag sym) {
+  admissibility->prepare(*tree, *tree);
+  HMatrix<D_t> * h = new HMatrix<D_t>(tree, tree, &HMatSettings::getInstance(), 0, sym, admissibility);
+  admissibility->clean(*tree, *tree);
+  return h;
+}
+
+HMatrix<D_t> * buildSequential(const ClusterTree * tree, AdmissibilityCondition * admissibility, SymmetryFlag sym) {
+  DISABLE_THREADING_IN_BLOCK;
+  return build(tree, admissibility, sym);
+}
+
+/** Compare the structures built in parallel, in a single thread and with the scalar methods */
+int check(const ClusterTree * tree, AdmissibilityCondition * admissibility) {
+  int errors = 0;
+  if (!admissibility->isThreadSafe()) {
+    printf("%s: not thread safe\n", admissibility->str().c_str());
+    errors++;
+  }
+  for (int s = 0; s < 2; s++) {
+    const SymmetryFlag sym = s == 0 ? kNotSymmetric : kLowerSymmetric;
+    ScalarAdmissibilityCondition scalar(admissibility);
+    HMatrix<D_t> * parallel = build(tree, admissibility, sym);
+    HMatrix<D_t> * sequential = buildSequential(tree, admissibility, sym);
+    HMatrix<D_t> * reference = build(tree, &scalar, sym);
+    const bool sameSequential = sameStructure(parallel, sequential);
+    const bool sameScalar = sameStructure(parallel, reference);
+    printf("%s%s: sequential %s, scalar %s\n", admissibility->str().c_str(), s == 0 ? "" : " (symmetric)",
+           sameSequential ? "ok" : "differs", sameScalar ? "ok" : "differs");
+    errors += (sameSequential ? 0 : 1) + (sameScalar ? 0 : 1);
+    delete parallel;
+    delete sequential;
+    delete reference;
+  }
+  return errors;
+}
+
+}  // end anonymous namespace
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s n_points\n", argv[0]);
+    return 1;
+  }
+  const int n = atoi(argv[1]);
+  double * points = createCylinder(1., 1.75 * M_PI / sqrt((double) n), n);
+  DofCoordinates coordinates(points, 3, n, true);
+  MedianBisectionAlgorithm median;
+  median.setMaxLeafSize(30);
+  ClusterTree * tree = ClusterTreeBuilder(median).build(coordinates);
+
+  std::vector<AdmissibilityCondition *> conditions;
+  conditions.push_back(new StandardAdmissibilityCondition(2.0));
+  StandardAdmissibilityCondition * tall = new StandardAdmissibilityCondition(3.0, 0.5);
+  tall->setMaxWidth(n / 4);
+  conditions.push_back(tall);
+  conditions.push_back(new OrientedAdmissibilityCondition(2.0));
+  conditions.push_back(new AlwaysAdmissibilityCondition((size_t) n * n / 64, 4));
+  AlwaysAdmissibilityCondition * never = new AlwaysAdmissibilityCondition((size_t) n * n / 64, 4, true, true);
+  never->never(true);
+  conditions.push_back(never);
+  conditions.push_back(new HODLRAdmissibilityCondition());
+  StandardAdmissibilityCondition standard(2.0);
+  conditions.push_back(new CostAdmissibilityCondition(&standard));
+
+  int errors = 0;
+  for (size_t i = 0; i < conditions.size(); i++) {
+    errors += check(tree, conditions[i]);
+    delete conditions[i];
+  }
+  delete tree;
+  free(points);
+  return errors != 0;
+}
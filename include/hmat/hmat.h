@@ -194,6 +194,12 @@ HMAT_API hmat_clustering_algorithm_t* hmat_create_clustering_ntilesrecursive(int
 HMAT_API hmat_clustering_algorithm_t* hmat_create_clustering_geometric(void);
 /* Hybrid clustering */
 HMAT_API hmat_clustering_algorithm_t* hmat_create_clustering_hybrid(void);
+/* Morton (Z-order) clustering, without group index support */
+HMAT_API hmat_clustering_algorithm_t* hmat_create_clustering_morton(void);
+/* Median clustering along the principal axis of each cluster, without group index support */
+HMAT_API hmat_clustering_algorithm_t* hmat_create_clustering_principal_axis(void);
+/* Clustering balancing the work estimated by a pilot admissibility pass with the given eta, without group index support */
+HMAT_API hmat_clustering_algorithm_t* hmat_create_clustering_work_balanced(double eta);
 /* Create a new clustering algorithm by setting the maximum number of degrees of freedom in a leaf */
 HMAT_API hmat_clustering_algorithm_t* hmat_create_clustering_max_dof(const hmat_clustering_algorithm_t* algo, int max_dof);
 
@@ -276,6 +282,31 @@ struct hmat_cluster_tree_create_context_t {
 
 HMAT_API hmat_cluster_tree_t * hmat_create_cluster_tree_generic(struct hmat_cluster_tree_create_context_t*);
 
+/*! \brief Create the ClusterTree of a modified set of DoFs from the tree of the previous ones.
+
+  The partition of tree is kept: the remaining DoFs stay in their leaf and
+  the new ones are added to the nearest leaf, which is split again only if it
+  becomes too large. The clusters left untouched keep the same DoFs in the
+  same order, so the blocks built on them can be moved from the previous
+  matrix with reuse_blocks.
+  \param tree the cluster tree of the previous DoFs, without group index
+  \param old_to_new new index of each previous DoF, or -1 if it has been removed
+  \param ctx the new coordinates and the cluster tree builder, group_index must be NULL
+  \return an opaque pointer to a ClusterTree, or NULL in case of error.
+*/
+HMAT_API hmat_cluster_tree_t * hmat_update_cluster_tree(const hmat_cluster_tree_t * tree, const int * old_to_new,
+                                                        struct hmat_cluster_tree_create_context_t * ctx);
+
+/*! \brief Move the DoFs of a cluster tree, keeping its partition.
+
+  Only the coordinates are replaced, so that reset_dirty_blocks can check
+  the admissibility of the blocks against the new geometry.
+  \param tree a cluster tree, which must be a root
+  \param ctx the new coordinates, with the same number of DoFs. builder and group_index are ignored.
+  \return 1 on failure, 0 otherwise.
+*/
+HMAT_API int hmat_move_cluster_tree(hmat_cluster_tree_t * tree, const struct hmat_cluster_tree_create_context_t * ctx);
+
 /*!
  * Return the number of nodes in a cluster tree
  */
@@ -334,6 +365,9 @@ HMAT_API void hmat_update_admissibility(hmat_admissibility_t*, hmat_admissibilit
 /* Create a standard (Hackbusch) admissibility condition, with a given eta */
 HMAT_API hmat_admissibility_t* hmat_create_admissibility_standard(double eta);
 
+/* Create a Hackbusch admissibility condition using oriented bounding boxes, with a given eta */
+HMAT_API hmat_admissibility_t* hmat_create_admissibility_oriented(double eta);
+
 /**
  * @brief Create an admissibility which will generate a HODLR matrix.
  *
@@ -363,6 +397,18 @@ HMAT_API hmat_admissibility_t* hmat_create_admissibility_always(
 HMAT_API hmat_admissibility_t* hmat_create_admissibility_never(
         size_t max_size, unsigned int min_block, int split_rows, int split_cols);
 
+/**
+ * @brief Create an admissibility condition which stores each admissible block
+ * the cheapest way (Rk, full or split) according to its predicted rank.
+ * @param cond The condition telling which blocks may be compressed. It is copied.
+ * @param rank_history A file written by hmat_interface_t.write_rank_history, or NULL.
+ * Ranks of the blocks it does not hold are predicted by cond.
+ * @param block_overhead The cost of a block, in number of stored values
+ * @return the condition, or NULL if rank_history cannot be read
+ */
+HMAT_API hmat_admissibility_t* hmat_create_admissibility_cost(
+        hmat_admissibility_t* cond, const char* rank_history, double block_overhead);
+
 /* Delete admissibility condition */
 HMAT_API void hmat_delete_admissibility(hmat_admissibility_t * cond);
 
@@ -416,17 +462,41 @@ typedef struct
   int largest_rk_mem_cols;
   /*! Rank of the largest Rk matrice with memory criteria */
   int largest_rk_mem_rank;
+
+  /**
+   * Total number of bytes stored in the leaves of the HMatrix. Unlike
+   * compressed_size it accounts for the packed Rk factors (see
+   * hmat_interface_t::pack_rk) at their quantized size.
+   */
+  size_t compressed_bytes;
 } hmat_info_t;
 
 typedef struct hmat_matrix_struct hmat_matrix_t;
 
-/** Allow to implement a progress bar associated to assemble or factorize */
+/**
+ * Allow to implement a progress bar associated to assemble or factorize.
+ *
+ * max and current count the leaves of the assembly and the rows of the
+ * factorizations, whose costs differ a lot. The work fields weight them with
+ * the work of each leaf, estimated from its dimensions and rank, so they give
+ * a time estimate. They are set by the library before each call of update.
+ */
 typedef struct hmat_progress_struct {
     int max;
     int current;
     /** Called each time assembling or factorization progress */
     void (*update)(struct hmat_progress_struct* context);
     void * user_data;
+    /** Estimated work of the operation, 0 if it is not estimated. It is refined during the assembly. */
+    double max_work;
+    /** Work done */
+    double current_work;
+    /** Seconds since the start of the operation */
+    double elapsed;
+    /** Work done per second */
+    double throughput;
+    /** Estimated remaining seconds, -1 if unknown */
+    double eta;
 } hmat_progress_t;
 
 /**
@@ -443,6 +513,38 @@ hmat_progress_t * hmat_default_progress(void);
  */
 typedef void (*hmat_iostream)(void * buffer, size_t n, void *user_data);
 
+/**
+ * Header of the matrix files written by write_matrix.
+ *
+ * It is stored with a fixed little endian encoding, so it can be read on any
+ * host. The two sections which follow it are stored in the byte order of the
+ * writer, as the stream of write_struct and write_data.
+ * @see hmat_read_header
+ */
+typedef struct {
+    /*! Version of the file format */
+    int version;
+    hmat_value_t value_type;
+    /*! sizeof of a scalar, an int and a double on the writer */
+    int scalar_size;
+    int int_size;
+    int double_size;
+    /*! 1 if the sections are little endian, 0 if they are big endian */
+    int little_endian;
+    hmat_factorization_t factorization;
+    /*! Settings used to build the matrix (see hmat_settings_t) */
+    int max_leaf_size;
+    int compression_min_leaf_size;
+    int coarsening;
+    double coarsening_epsilon;
+    /*! Size in bytes of the structure section (as written by write_struct) */
+    unsigned long long struct_size;
+    /*! Size in bytes of the data section (as written by write_data) */
+    unsigned long long data_size;
+    /*! Low rank epsilon of the matrix (see set_low_rank_epsilon), 0 if the file does not record it */
+    double low_rank_epsilon;
+} hmat_file_header_t;
+
 /** */
 struct hmat_block_compute_context_t {
 	/**
@@ -572,16 +674,40 @@ typedef struct {
     hmat_factorization_t factorization;
     /** NULL disable progress display. The default is to use the hmat progress internal implementation. */
     hmat_progress_t * progress;
+    /** Only compute the blocks which hold no data, keeping the others (see reuse_blocks). The default is 0. */
+    int partial;
 } hmat_assemble_context_t;
 
 /** Init a hmat_assemble_context_t with default values */
 HMAT_API void hmat_assemble_context_init(hmat_assemble_context_t * context);
 
+/**
+ * Periodic save of a factorization in progress (LU, LDLT and LLT only).
+ *
+ * A checkpoint is written to a new stream, so a failure while writing does
+ * not corrupt the previous one. It can be loaded with read_checkpoint and the
+ * factorization resumed with factorize_generic.
+ */
+typedef struct {
+    /** Minimum time in seconds between two checkpoints */
+    double interval;
+    /** Open a new checkpoint stream. Return the user_data to pass to write, or NULL to skip this checkpoint. */
+    void * (*open)(void * user_data);
+    /** Write to a stream returned by open */
+    hmat_iostream write;
+    /** Close a stream returned by open. The checkpoint is complete only once close is called. */
+    void (*close)(void * stream, void * user_data);
+    /** Passed to open and close */
+    void * user_data;
+} hmat_checkpoint_t;
+
 typedef struct {
     /** The type of factorization to do after this assembling. The default is hmat_factorization_lu. */
     hmat_factorization_t factorization;
     /** NULL disable progress display. The default is to use the hmat progress internal implementation. */
     hmat_progress_t * progress;
+    /** NULL (the default) disable checkpointing */
+    const hmat_checkpoint_t * checkpoint;
 } hmat_factorization_context_t;
 
 /** Init a hmat_factorization_context_t with default values */
@@ -1039,10 +1165,147 @@ typedef struct
      */
     int (*extract_diagonal_block)(hmat_matrix_t* holder, int components, void* diag);
 
+    /**
+     * @brief Quantize the Rk leaves in memory, or restore them.
+     *
+     * The mantissa width of each column of the Rk factors is chosen from the
+     * leaf epsilon and the column norms, so the error on each block stays
+     * below the compression epsilon. A packed matrix can only be used with
+     * gemv, get_info, write_data and destroy.
+     * \param hmatrix A hmatrix
+     * \param pack 1 to quantize, 0 to restore the full precision factors
+     */
+    int (*pack_rk)(hmat_matrix_t* hmatrix, int pack);
+    /** @brief Same as write_data but the Rk leaves are written quantized (see pack_rk) */
+    void (*write_data_quantized)(hmat_matrix_t* matrix, hmat_iostream writefunc, void * user_data);
+    /**
+     * @brief Read a checkpoint written during a factorization.
+     *
+     * Calling factorize_generic on the returned matrix, with the same
+     * factorization type, resumes the factorization where the checkpoint was
+     * taken. The matrix cannot be used for anything else before.
+     * @see hmat_checkpoint_t
+     */
+    hmat_matrix_t * (*read_checkpoint)(hmat_iostream readfunc, void * user_data);
+    /**
+     * @brief Copy a matrix to a new POSIX shared memory segment.
+     *
+     * Other processes of the node can then use attach_shared instead of
+     * holding their own copy of the matrix.
+     * \param hmatrix an assembled, and possibly factorized, matrix
+     * \param name the segment name, as in shm_open. The segment must not exist.
+     * @see hmat_unlink_shared
+     */
+    int (*publish_shared)(hmat_matrix_t* hmatrix, const char * name);
+    /**
+     * @brief Map a matrix published with publish_shared.
+     *
+     * The leaves of the returned matrix point to the read-only shared memory,
+     * so it can only be used by read-only functions such as gemv,
+     * gemm_scalar, solve_systems and get_info.
+     * \return the matrix, or NULL on failure
+     */
+    hmat_matrix_t * (*attach_shared)(const char * name);
+    /**
+     * @brief Create an empty matrix, reusing the cluster tree and block structure of a previous run.
+     *
+     * The structure is identified by a hash of the coordinates, spans, group
+     * index, clustering algorithms, admissibility condition, symmetry and
+     * scalar type. If filename holds a structure with the same hash, it is
+     * loaded and clustering and admissibility are skipped. Else the cluster
+     * tree and the matrix are built and saved to filename.
+     * The clustering algorithms and the admissibility condition are
+     * identified by all their parameters (for a cost model condition, its
+     * rank history too). Algorithms and conditions which cannot be
+     * identified, such as user defined ones, are never cached: a warning is
+     * printed and the structure is built.
+     * Rows and columns share the same cluster tree, which is owned by the
+     * returned matrix (see get_cluster_trees).
+     * \param filename the cache file
+     * \param ctx the coordinates and cluster tree builder, as in hmat_create_cluster_tree_generic
+     * \return the matrix, or NULL on failure
+     */
+    hmat_matrix_t * (*create_empty_hmatrix_cached)(const char * filename,
+        const struct hmat_cluster_tree_create_context_t * ctx, int lower_symmetric,
+        hmat_admissibility_t * condition);
+    /**
+     * @brief Write a matrix and its factorization in a self-describing stream.
+     *
+     * The stream holds a hmat_file_header_t followed by the structure and data
+     * sections, whose sizes are recorded in the header.
+     * \return 1 on failure, 0 otherwise.
+     */
+    int (*write_matrix)(hmat_matrix_t* hmatrix, hmat_iostream writefunc, void * user_data);
+    /**
+     * @brief Read a stream written by write_matrix.
+     *
+     * The header is validated against this interface (scalar type, sizes and
+     * byte order) before anything else is read, and the size of each section
+     * is checked once it has been read.
+     * \return the matrix, or NULL on failure
+     */
+    hmat_matrix_t * (*read_matrix)(hmat_iostream readfunc, void * user_data);
+    /**
+     * @brief Write the ranks of the Rk blocks of an assembled matrix, to be
+     * used by hmat_create_admissibility_cost for a matrix with the same
+     * cluster trees.
+     * \return 1 on failure, 0 otherwise.
+     */
+    int (*write_rank_history)(hmat_matrix_t* hmatrix, const char * filename);
+    /**
+     * @brief Move the blocks of a previous matrix which are still valid into an empty matrix.
+     *
+     * This is meant for a matrix built on cluster trees returned by
+     * hmat_update_cluster_tree: the blocks whose rows and columns hold the
+     * same DoFs, in the same order, are moved from previous, which must then
+     * only be destroyed. The remaining blocks are computed by assemble_generic
+     * with hmat_assemble_context_t.partial set to 1.
+     * \param hmatrix an empty matrix
+     * \param previous an assembled, not factorized, matrix
+     * \param rows_old_to_new new index of each row DoF of previous, or -1 if it has been removed
+     * \param cols_old_to_new the same for the columns
+     * \return the number of moved blocks, or -1 on failure
+     */
+    int (*reuse_blocks)(hmat_matrix_t* hmatrix, hmat_matrix_t* previous,
+                        const int * rows_old_to_new, const int * cols_old_to_new);
+    /**
+     * @brief Empty the blocks touching moved DoFs, to compute them again.
+     *
+     * The admissibility of these blocks is checked against the current
+     * coordinates of the cluster trees (see hmat_move_cluster_tree) and only
+     * the blocks whose admissibility changed are split or merged. The emptied
+     * blocks are then computed by assemble_generic with
+     * hmat_assemble_context_t.partial set to 1. Other blocks are kept.
+     * \param hmatrix an assembled, not factorized, matrix
+     * \param rows_dirty rows_dirty[i] is not 0 if the row DoF i moved
+     * \param cols_dirty the same for the columns
+     * \param cond the admissibility condition the matrix was created with
+     * \return the number of blocks to assemble, or -1 on failure
+     */
+    int (*reset_dirty_blocks)(hmat_matrix_t* hmatrix, const char * rows_dirty, const char * cols_dirty,
+                              hmat_admissibility_t * cond);
+
 }  hmat_interface_t;
 
 HMAT_API void hmat_init_default_interface(hmat_interface_t * i, hmat_value_t type);
 
+/*! \brief Remove a shared memory segment created by publish_shared.
+
+  Attached matrices remain valid until they are destroyed.
+  \return 1 on failure, 0 otherwise.
+*/
+HMAT_API int hmat_unlink_shared(const char * name);
+
+/*! \brief Read and validate the header of a stream written by write_matrix.
+
+  This only reads the header. A loader can then choose the interface from
+  header->value_type, or skip the matrix by skipping
+  header->struct_size + header->data_size bytes.
+  \return 1 if the header is invalid or the matrix cannot be read on this
+  host, 0 otherwise.
+*/
+HMAT_API int hmat_read_header(hmat_iostream readfunc, void * user_data, hmat_file_header_t * header);
+
 typedef struct
 {
   /*! \brief svd compression if max(rows->n, cols->n) < compressionMinLeafSize.*/
@@ -1099,6 +1362,114 @@ HMAT_API void hmat_get_build_date(const char**, const char**);
 */
 HMAT_API void hmat_tracing_dump(char *filename) ;
 
+/*!
+ \brief Convert a timeline file to the Chrome trace event format
+
+ Timeline files are written when hmat is built with HMAT_TIMELINE and the
+ HMAT_TIMELINE environment variable is set to a file prefix. The output can be
+ opened with chrome://tracing or https://ui.perfetto.dev.
+\param timeline the binary timeline file, <HMAT_TIMELINE><rank>.bin
+\param filename the name of the output json file
+\return 1 on failure, 0 otherwise.
+*/
+HMAT_API int hmat_timeline_to_trace(const char *timeline, const char *filename);
+
+/*!
+ \brief Write the flops and bytes of the BLAS and LAPACK calls by phase
+
+ For each phase (assembly, compression, truncation, gemm, trsm, factorization)
+ the report gives the number of calls, the time, the flops, the bytes and the
+ achieved rate and arithmetic intensity, to be compared to the roofline of the
+ machine. The flops and bytes are also added to the trace info of
+ hmat_tracing_dump and to the timeline. Hmat library must be compiled with
+ -DHAVE_CONTEXT (HMAT_CONTEXT cmake option) for this to work.
+\param filename the name of the output text file, or NULL for stdout
+\return 1 on failure, 0 otherwise.
+*/
+HMAT_API int hmat_flops_report(const char *filename);
+
+/*! \brief Clear the counters of hmat_flops_report */
+HMAT_API void hmat_flops_reset(void);
+
+/*!
+ \brief Write the memory used by the matrices by category, in JSON
+
+ The categories are the Rk factors and the full blocks of the leaves, and the
+ temporaries of the compression, of the products and of the serialization. For
+ each of them the report gives the live bytes, the peak bytes and the phase
+ (see hmat_flops_report) in which the peak happened. The memory is only
+ accounted if the HMAT_MEMORY_REPORT environment variable is set to a file
+ name, where this report is also written at exit.
+\param filename the name of the output JSON file
+\return 1 on failure, 0 otherwise.
+*/
+HMAT_API int hmat_memory_report(const char *filename);
+
+/*! \brief Enable or disable the accounting of hmat_memory_report
+
+ The accounting should be enabled before the matrices are created, otherwise
+ the memory they free is not balanced by their allocations.
+ */
+HMAT_API void hmat_memory_enable(int enabled);
+
+/*! \brief Get the live and the peak bytes of all the categories of hmat_memory_report */
+HMAT_API void hmat_memory_usage(size_t * live, size_t * peak);
+
+/*! \brief Restart the peaks of hmat_memory_report from the live bytes */
+HMAT_API void hmat_memory_reset_peaks(void);
+
+/** Statistics of the assembly of a leaf, see hmat_assembly_stats_enable */
+typedef struct
+{
+  /*! Offsets and sizes of the block, in the cluster tree numbering */
+  int rows_offset;
+  int rows_size;
+  int cols_offset;
+  int cols_size;
+  /*! Rank of the block, -1 for a full block */
+  int rank;
+  /*! Compression algorithm ("svd", "aca_partial", ...), "full" for a full block */
+  const char * algorithm;
+  /*! Time in seconds spent in the user assembly functions */
+  double kernel_time;
+  /*! Time in seconds spent in the compression, without the kernel and truncation times */
+  double compression_time;
+  /*! Time in seconds spent in the truncation of the compressed block */
+  double truncate_time;
+  /*! Number of calls to the user functions */
+  size_t get_row_count;
+  size_t get_col_count;
+  size_t get_element_count;
+  size_t assemble_count;
+  /*! Size of the assembled block in bytes */
+  size_t bytes;
+} hmat_block_stats_t;
+
+/*!
+ \brief Enable or disable the statistics of the leaves assembly
+
+ When enabled, the assembly of each leaf records its timings, the number of
+ calls to the user functions, its rank and size. They are also written by
+ the dump_info function of hmat_interface_t in the json file, for each leaf.
+ Enabling clears the previous statistics.
+\param enabled 0 to disable, 1 to enable
+*/
+HMAT_API void hmat_assembly_stats_enable(int enabled);
+
+/*! \brief Number of leaves in the assembly statistics */
+HMAT_API int hmat_assembly_stats_count(void);
+
+/*!
+ \brief Get the assembly statistics of a leaf
+\param index the index of the leaf, in [0, hmat_assembly_stats_count()[
+\param stats the statistics of the leaf
+\return 1 if index is out of range, 0 otherwise.
+*/
+HMAT_API int hmat_assembly_stats_get(int index, hmat_block_stats_t * stats);
+
+/*! \brief Clear the assembly statistics */
+HMAT_API void hmat_assembly_stats_clear(void);
+
 /** \brief Set the function used to get the worker index.
 
     The function f() must return the worker Id (between 0 and nbWorkers-1) or -1 in a sequential section.
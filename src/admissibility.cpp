@@ -22,10 +22,15 @@
 #include "config.h"
 #include "admissibility.hpp"
 #include "cluster_tree.hpp"
+#include "coordinates.hpp"
 
 #include "common/my_assert.h"
 #include <sstream>
 #include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <typeinfo>
 
 namespace hmat {
 
@@ -35,6 +40,117 @@ AdmissibilityCondition::forceRecursion(const ClusterTree& rows, const ClusterTre
     return rows.data.size() > maxWidth_ || cols.data.size() > maxWidth_;
 }
 
+std::string
+AdmissibilityCondition::classCacheKey(const std::type_info& cls, const std::string& parameters) const
+{
+  if (typeid(*this) != cls)
+    return std::string();
+  std::ostringstream oss;
+  oss.precision(17);
+  oss << parameters << " ratio=" << ratio_ << " maxWidth=" << maxWidth_;
+  return oss.str();
+}
+
+AdmissibilityBatch::AdmissibilityBatch(int _count, const ClusterTree* const* _rows, const ClusterTree* const* _cols)
+  : count(_count), rows(_rows), cols(_cols),
+    rowsOffset(_count), rowsSize(_count), colsOffset(_count), colsSize(_count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    rowsOffset[i] = rows[i]->data.offset();
+    rowsSize[i] = rows[i]->data.size();
+    colsOffset[i] = cols[i]->data.offset();
+    colsSize[i] = cols[i]->data.size();
+  }
+}
+
+void
+AdmissibilityBatch::computeBoxes(const AdmissibilityCondition& condition)
+{
+  // The boxes are gathered axis by axis so the loops on the blocks vectorize.
+  // The sums are done in the same order as AxisAlignedBoundingBox::diameterSqr
+  // and distanceToSqr.
+  std::vector<const AxisAlignedBoundingBox*> rowsBox(count), colsBox(count);
+  rowsDiameterSqr.assign(count, 0.0);
+  colsDiameterSqr.assign(count, 0.0);
+  distanceSqr.assign(count, 0.0);
+  if (count == 0)
+    return;
+  for (int i = 0; i < count; ++i)
+  {
+    rowsBox[i] = condition.getAxisAlignedBoundingBox(*rows[i], true);
+    colsBox[i] = condition.getAxisAlignedBoundingBox(*cols[i], false);
+  }
+  const unsigned dimension = rowsBox[0]->dimension();
+  for (int i = 0; i < count; ++i)
+  {
+    if (rowsBox[i]->dimension() != dimension || colsBox[i]->dimension() != dimension)
+    {
+      // Not expected, use the generic code
+      for (int j = 0; j < count; ++j)
+      {
+        rowsDiameterSqr[j] = rowsBox[j]->diameterSqr();
+        colsDiameterSqr[j] = colsBox[j]->diameterSqr();
+        distanceSqr[j] = rowsBox[j]->distanceToSqr(*colsBox[j]);
+      }
+      return;
+    }
+  }
+  std::vector<double> rowsMin(count), rowsMax(count), colsMin(count), colsMax(count);
+  double* rowsDiameter = &rowsDiameterSqr[0];
+  double* colsDiameter = &colsDiameterSqr[0];
+  double* distance = &distanceSqr[0];
+  for (unsigned d = 0; d < dimension; ++d)
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      rowsMin[i] = rowsBox[i]->bbMin()[d];
+      rowsMax[i] = rowsBox[i]->bbMax()[d];
+      colsMin[i] = colsBox[i]->bbMin()[d];
+      colsMax[i] = colsBox[i]->bbMax()[d];
+    }
+    const double* rMin = &rowsMin[0];
+    const double* rMax = &rowsMax[0];
+    const double* cMin = &colsMin[0];
+    const double* cMax = &colsMax[0];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for (int i = 0; i < count; ++i)
+    {
+      const double rowsDelta = rMax[i] - rMin[i];
+      rowsDiameter[i] += rowsDelta * rowsDelta;
+      const double colsDelta = cMax[i] - cMin[i];
+      colsDiameter[i] += colsDelta * colsDelta;
+      double gap = std::max(0., rMin[i] - cMax[i]);
+      distance[i] += gap * gap;
+      gap = std::max(0., cMin[i] - rMax[i]);
+      distance[i] += gap * gap;
+    }
+  }
+}
+
+void
+AdmissibilityCondition::isLowRankBatch(const AdmissibilityBatch& batch, bool* result) const
+{
+  for (int i = 0; i < batch.count; ++i)
+    result[i] = isLowRank(*batch.rows[i], *batch.cols[i]);
+}
+
+void
+AdmissibilityCondition::stopRecursionBatch(const AdmissibilityBatch& batch, bool* result) const
+{
+  for (int i = 0; i < batch.count; ++i)
+    result[i] = stopRecursion(*batch.rows[i], *batch.cols[i]);
+}
+
+void
+AdmissibilityCondition::forceFullBatch(const AdmissibilityBatch& batch, bool* result) const
+{
+  for (int i = 0; i < batch.count; ++i)
+    result[i] = forceFull(*batch.rows[i], *batch.cols[i]);
+}
+
 std::pair<bool, bool>
 AdmissibilityCondition::splitRowsCols(const ClusterTree& rows, const ClusterTree& cols) const
 {
@@ -58,17 +174,74 @@ StandardAdmissibilityCondition::StandardAdmissibilityCondition(double eta, doubl
     eta_(eta) { ratio_ = ratio; }
 
 namespace {
+/** Nodes smaller than this do not spawn a task to compute their boxes */
+const int BOUNDING_BOX_TASK_MIN_SIZE = 8192;
+
+/** Return true if the children of current are contiguous and cover it */
+bool children_cover(const ClusterTree& current)
+{
+  int offset = current.data.offset();
+  for (int i = 0; i < current.nrChild(); ++i)
+  {
+    const ClusterTree* child = current.getChild(i);
+    if (child == NULL || child->data.size() == 0 || child->data.offset() != offset)
+      return false;
+    offset += child->data.size();
+  }
+  return offset == current.data.offset() + current.data.size();
+}
+
+/**
+ * Compute the boxes bottom-up: the box of a node is built from the boxes of
+ * its children instead of scanning all its DOFs again. The result is the same
+ * as AxisAlignedBoundingBox(current.data), where only the first point of the
+ * first DOF is taken, so the spans of the first DOF of the other children are
+ * added.
+ */
 void
 recursive_compute_bounding_box(const ClusterTree& current)
 {
   if (current.cache_)
     return;
-  current.cache_ = new AxisAlignedBoundingBox(current.data);
   for (int i = 0; i < current.nrChild(); ++i)
   {
-    if (current.getChild(i))
-      recursive_compute_bounding_box(*((ClusterTree*)current.getChild(i)));
+    const ClusterTree* child = current.getChild(i);
+    if (child)
+    {
+#ifdef _OPENMP
+#pragma omp task firstprivate(child) if(child->data.size() > BOUNDING_BOX_TASK_MIN_SIZE)
+#endif
+      recursive_compute_bounding_box(*child);
+    }
   }
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
+  if (current.isLeaf() || !children_cover(current))
+  {
+    current.cache_ = new AxisAlignedBoundingBox(current.data);
+    return;
+  }
+  const DofCoordinates& coordinates = *current.data.coordinates();
+  AxisAlignedBoundingBox* bbox = new AxisAlignedBoundingBox(coordinates.dimension());
+  for (int i = 0; i < current.nrChild(); ++i)
+  {
+    const ClusterTree* child = current.getChild(i);
+    bbox->merge(*static_cast<const AxisAlignedBoundingBox*>(child->cache_));
+    if (i > 0)
+      bbox->merge(coordinates, child->data.indices() + child->data.offset(), 1);
+  }
+  current.cache_ = bbox;
+}
+
+void
+compute_bounding_box(const ClusterTree& root)
+{
+#ifdef _OPENMP
+#pragma omp parallel if(root.data.size() > BOUNDING_BOX_TASK_MIN_SIZE)
+#pragma omp single
+#endif
+  recursive_compute_bounding_box(root);
 }
 
 void
@@ -87,9 +260,9 @@ recursive_delete_bounding_box(const ClusterTree& current)
 void
 StandardAdmissibilityCondition::prepare(const ClusterTree& rows, const ClusterTree& cols) const
 {
-  recursive_compute_bounding_box(rows);
+  compute_bounding_box(rows);
   if (&rows != &cols)
-    recursive_compute_bounding_box(cols);
+    compute_bounding_box(cols);
 }
 
 bool
@@ -106,14 +279,83 @@ StandardAdmissibilityCondition::forceFull(const ClusterTree& rows, const Cluster
     return (rows.data.size() < 2 || cols.data.size() < 2);
 }
 
+namespace {
+/** Hackbusch condition from the squared diameters and distance of the boxes */
+inline bool
+hackbusch_condition(double eta, double rowsDiameterSqr, double colsDiameterSqr, double distanceSqr)
+{
+  const double min_diameter = std::min(sqrt(rowsDiameterSqr), sqrt(colsDiameterSqr));
+  return min_diameter > 0.0 && min_diameter <= eta * sqrt(distanceSqr);
+}
+}
+
 bool
 StandardAdmissibilityCondition::isLowRank(const ClusterTree& rows, const ClusterTree& cols) const
 {
   const AxisAlignedBoundingBox* rows_bbox = getAxisAlignedBoundingBox(rows, true);
   const AxisAlignedBoundingBox* cols_bbox = getAxisAlignedBoundingBox(cols, false);
+  return hackbusch_condition(eta_, rows_bbox->diameterSqr(), cols_bbox->diameterSqr(),
+                             rows_bbox->distanceToSqr(*cols_bbox));
+}
 
-  const double min_diameter = std::min(rows_bbox->diameter(), cols_bbox->diameter());
-  return min_diameter > 0.0 && min_diameter <= eta_ * rows_bbox->distanceTo(*cols_bbox);
+void
+StandardAdmissibilityCondition::prepareBatch(AdmissibilityBatch& batch) const
+{
+  // Without boxes, isLowRankBatch calls isLowRank
+  if (!hasScalarOverrides())
+    batch.computeBoxes(*this);
+}
+
+void
+StandardAdmissibilityCondition::isLowRankBatch(const AdmissibilityBatch& batch, bool* result) const
+{
+  if (!batch.hasBoxes())
+  {
+    AdmissibilityCondition::isLowRankBatch(batch, result);
+    return;
+  }
+  const double* rowsDiameterSqr = &batch.rowsDiameterSqr[0];
+  const double* colsDiameterSqr = &batch.colsDiameterSqr[0];
+  const double* distanceSqr = &batch.distanceSqr[0];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for (int i = 0; i < batch.count; ++i)
+    result[i] = hackbusch_condition(eta_, rowsDiameterSqr[i], colsDiameterSqr[i], distanceSqr[i]);
+}
+
+void
+StandardAdmissibilityCondition::stopRecursionBatch(const AdmissibilityBatch& batch, bool* result) const
+{
+  if (hasScalarOverrides())
+  {
+    AdmissibilityCondition::stopRecursionBatch(batch, result);
+    return;
+  }
+  const int* rowsSize = &batch.rowsSize[0];
+  const int* colsSize = &batch.colsSize[0];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for (int i = 0; i < batch.count; ++i)
+    result[i] = rowsSize[i] < 2 || colsSize[i] < 2;
+}
+
+void
+StandardAdmissibilityCondition::forceFullBatch(const AdmissibilityBatch& batch, bool* result) const
+{
+  if (hasScalarOverrides())
+  {
+    AdmissibilityCondition::forceFullBatch(batch, result);
+    return;
+  }
+  const int* rowsSize = &batch.rowsSize[0];
+  const int* colsSize = &batch.colsSize[0];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for (int i = 0; i < batch.count; ++i)
+    result[i] = rowsSize[i] < 2 || colsSize[i] < 2;
 }
 
 void
@@ -132,6 +374,15 @@ StandardAdmissibilityCondition::str() const
   return oss.str();
 }
 
+std::string
+StandardAdmissibilityCondition::cacheKey() const
+{
+  std::ostringstream oss;
+  oss.precision(17);
+  oss << "Standard eta=" << eta_;
+  return classCacheKey(typeid(StandardAdmissibilityCondition), oss.str());
+}
+
 void StandardAdmissibilityCondition::setEta(double eta) {
     eta_ = eta;
 }
@@ -140,6 +391,113 @@ double StandardAdmissibilityCondition::getEta() const {
     return eta_;
 }
 
+namespace {
+/** ClusterTree::cache_ of OrientedAdmissibilityCondition */
+struct OrientedBoxes {
+  AxisAlignedBoundingBox aabb;
+  OrientedBoundingBox obb;
+  explicit OrientedBoxes(const ClusterData& data) : aabb(data), obb(data) {}
+};
+
+void
+recursive_compute_oriented_boxes(const ClusterTree& current)
+{
+  if (current.cache_)
+    return;
+  current.cache_ = new OrientedBoxes(current.data);
+  for (int i = 0; i < current.nrChild(); ++i)
+  {
+    const ClusterTree* child = current.getChild(i);
+    if (child)
+    {
+#ifdef _OPENMP
+#pragma omp task firstprivate(child) if(child->data.size() > BOUNDING_BOX_TASK_MIN_SIZE)
+#endif
+      recursive_compute_oriented_boxes(*child);
+    }
+  }
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
+}
+
+void
+compute_oriented_boxes(const ClusterTree& root)
+{
+#ifdef _OPENMP
+#pragma omp parallel if(root.data.size() > BOUNDING_BOX_TASK_MIN_SIZE)
+#pragma omp single
+#endif
+  recursive_compute_oriented_boxes(root);
+}
+
+void
+recursive_delete_oriented_boxes(const ClusterTree& current)
+{
+  delete static_cast<OrientedBoxes*>(current.cache_);
+  current.cache_ = NULL;
+  for (int i = 0; i < current.nrChild(); ++i)
+  {
+    if (current.getChild(i))
+      recursive_delete_oriented_boxes(*current.getChild(i));
+  }
+}
+}
+
+OrientedAdmissibilityCondition::OrientedAdmissibilityCondition(double eta, double ratio):
+    StandardAdmissibilityCondition(eta, ratio) {}
+
+void
+OrientedAdmissibilityCondition::prepare(const ClusterTree& rows, const ClusterTree& cols) const
+{
+  compute_oriented_boxes(rows);
+  if (&rows != &cols)
+    compute_oriented_boxes(cols);
+}
+
+void
+OrientedAdmissibilityCondition::clean(const ClusterTree& rows, const ClusterTree& cols) const
+{
+  recursive_delete_oriented_boxes(rows);
+  if (&rows != &cols)
+    recursive_delete_oriented_boxes(cols);
+}
+
+const AxisAlignedBoundingBox*
+OrientedAdmissibilityCondition::getAxisAlignedBoundingBox(const ClusterTree& current, bool) const
+{
+  return &static_cast<const OrientedBoxes*>(current.cache_)->aabb;
+}
+
+bool
+OrientedAdmissibilityCondition::isLowRank(const ClusterTree& rows, const ClusterTree& cols) const
+{
+  const OrientedBoxes* rows_boxes = static_cast<const OrientedBoxes*>(rows.cache_);
+  const OrientedBoxes* cols_boxes = static_cast<const OrientedBoxes*>(cols.cache_);
+  const double min_diameter = std::min(std::min(rows_boxes->aabb.diameter(), rows_boxes->obb.diameter()),
+                                       std::min(cols_boxes->aabb.diameter(), cols_boxes->obb.diameter()));
+  const double distance = std::max(rows_boxes->aabb.distanceTo(cols_boxes->aabb),
+                                   rows_boxes->obb.distanceTo(cols_boxes->obb));
+  return min_diameter > 0.0 && min_diameter <= eta_ * distance;
+}
+
+std::string
+OrientedAdmissibilityCondition::str() const
+{
+  std::ostringstream oss;
+  oss << "Hackbusch formula with oriented bounding boxes, with eta = " << eta_;
+  return oss.str();
+}
+
+std::string
+OrientedAdmissibilityCondition::cacheKey() const
+{
+  std::ostringstream oss;
+  oss.precision(17);
+  oss << "Oriented eta=" << eta_;
+  return classCacheKey(typeid(OrientedAdmissibilityCondition), oss.str());
+}
+
 struct DefaultBlockSizeDetector: public AlwaysAdmissibilityCondition::BlockSizeDetector {
   static DefaultBlockSizeDetector& instance()
   {
@@ -174,6 +532,13 @@ std::string AlwaysAdmissibilityCondition::str() const {
     return oss.str();
 }
 
+std::string AlwaysAdmissibilityCondition::cacheKey() const {
+    std::ostringstream oss;
+    oss << "Always max_block_size=" << max_block_size_ << " min_nr_block=" << min_nr_block_
+        << " split=" << split_rows_cols_.first << split_rows_cols_.second << " never=" << never_;
+    return classCacheKey(typeid(AlwaysAdmissibilityCondition), oss.str());
+}
+
 void AlwaysAdmissibilityCondition::never(bool n) {
   never_ = n;
   blockSizeDetector_->compute(max_block_size_, min_nr_block_, never_);
@@ -228,14 +593,230 @@ bool AlwaysAdmissibilityCondition::forceFull(const ClusterTree& rows, const Clus
     return never_ || rows.data.size() <= 2 || cols.data.size() <= 2;
 }
 
+void AlwaysAdmissibilityCondition::isLowRankBatch(const AdmissibilityBatch& batch, bool* result) const {
+    if (hasScalarOverrides()) {
+        AdmissibilityCondition::isLowRankBatch(batch, result);
+        return;
+    }
+    std::fill(result, result + batch.count, !never_);
+}
+
+void AlwaysAdmissibilityCondition::stopRecursionBatch(const AdmissibilityBatch& batch, bool* result) const {
+    if (hasScalarOverrides()) {
+        AdmissibilityCondition::stopRecursionBatch(batch, result);
+        return;
+    }
+    for (int i = 0; i < batch.count; ++i) {
+        // Same lazy initialization as stopRecursion
+        if (batch.rows[i]->father == NULL && batch.cols[i]->father == NULL)
+            max_block_size_impl_ = std::min(((size_t)batch.rowsSize[i]) * batch.colsSize[i] / min_nr_block_,
+                                            max_block_size_);
+    }
+    const int* rowsSize = &batch.rowsSize[0];
+    const int* colsSize = &batch.colsSize[0];
+    const size_t maxBlockSize = max_block_size_impl_;
+    const bool never = never_;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for (int i = 0; i < batch.count; ++i)
+        result[i] = never && ((size_t)rowsSize[i]) * colsSize[i] <= maxBlockSize;
+}
+
+void AlwaysAdmissibilityCondition::forceFullBatch(const AdmissibilityBatch& batch, bool* result) const {
+    if (hasScalarOverrides()) {
+        AdmissibilityCondition::forceFullBatch(batch, result);
+        return;
+    }
+    const int* rowsSize = &batch.rowsSize[0];
+    const int* colsSize = &batch.colsSize[0];
+    const bool never = never_;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for (int i = 0; i < batch.count; ++i)
+        result[i] = never || rowsSize[i] <= 2 || colsSize[i] <= 2;
+}
+
+void RankHistory::add(const IndexSet& rows, const IndexSet& cols, int rank) {
+  ranks_[Key(std::make_pair(rows.offset(), rows.size()), std::make_pair(cols.offset(), cols.size()))] = rank;
+}
+
+int RankHistory::get(const IndexSet& rows, const IndexSet& cols) const {
+  std::map<Key, int>::const_iterator it =
+      ranks_.find(Key(std::make_pair(rows.offset(), rows.size()), std::make_pair(cols.offset(), cols.size())));
+  return it == ranks_.end() ? -1 : it->second;
+}
+
+void RankHistory::read(const char * filename) {
+  std::ifstream in(filename);
+  HMAT_ASSERT_MSG(in, "Cannot open %s", filename);
+  int rowOffset, rowSize, colOffset, colSize, rank;
+  while (in >> rowOffset >> rowSize >> colOffset >> colSize >> rank)
+    add(IndexSet(rowOffset, rowSize), IndexSet(colOffset, colSize), rank);
+  HMAT_ASSERT_MSG(in.eof(), "Invalid rank history %s", filename);
+}
+
+void RankHistory::write(const char * filename) const {
+  std::ofstream out(filename);
+  write(out);
+  out.close();
+  HMAT_ASSERT_MSG(out, "Cannot write %s", filename);
+}
+
+void RankHistory::write(std::ostream & out) const {
+  for (std::map<Key, int>::const_iterator it = ranks_.begin(); it != ranks_.end(); ++it)
+    out << it->first.first.first << " " << it->first.first.second << " "
+        << it->first.second.first << " " << it->first.second.second << " " << it->second << "\n";
+}
+
+CostAdmissibilityCondition::CostAdmissibilityCondition(AdmissibilityCondition * admissibility, double blockOverhead)
+  : ProxyAdmissibilityCondition(admissibility), blockOverhead_(blockOverhead), estimator_(NULL) {}
+
+CostAdmissibilityCondition * CostAdmissibilityCondition::clone() const {
+  CostAdmissibilityCondition * r = new CostAdmissibilityCondition(getProxy(), blockOverhead_);
+  r->history_ = history_;
+  r->estimator_ = estimator_;
+  return r;
+}
+
+int CostAdmissibilityCondition::predictedRank(const ClusterTree& rows, const ClusterTree& cols) const {
+  return predictedRank(rows, cols, -1);
+}
+
+int CostAdmissibilityCondition::predictedRank(const ClusterTree& rows, const ClusterTree& cols, int defaultRank) const {
+  int rank = history_.get(rows.data, cols.data);
+  if (rank < 0 && estimator_ != NULL)
+    rank = estimator_->rank(rows, cols);
+  if (rank < 0)
+    rank = defaultRank >= 0 ? defaultRank : ProxyAdmissibilityCondition::getApproximateRank(rows, cols);
+  return std::min(rank, std::min(rows.data.size(), cols.data.size()));
+}
+
+double CostAdmissibilityCondition::leafCost(const ClusterTree& rows, const ClusterTree& cols, int defaultRank) const {
+  const double m = rows.data.size();
+  const double n = cols.data.size();
+  double cost = m * n;
+  if (ProxyAdmissibilityCondition::isLowRank(rows, cols))
+    cost = std::min(cost, predictedRank(rows, cols, defaultRank) * (m + n));
+  return cost + blockOverhead_;
+}
+
+CostAdmissibilityCondition::Storage
+CostAdmissibilityCondition::cheapest(const ClusterTree& rows, const ClusterTree& cols) const {
+  const double m = rows.data.size();
+  const double n = cols.data.size();
+  const int rank = predictedRank(rows, cols);
+  const double rkCost = rank * (m + n) + blockOverhead_;
+  const double fullCost = m * n + blockOverhead_;
+  double splitCost = std::numeric_limits<double>::infinity();
+  if (!(rows.isLeaf() && cols.isLeaf()) && !ProxyAdmissibilityCondition::stopRecursion(rows, cols)) {
+    // Same children as HMatrix::split. The rank of a sub-block is at most the
+    // rank of the block, which is used when the rank of a child is unknown.
+    const std::pair<bool, bool> splitRC = splitRowsCols(rows, cols);
+    const int nrChildRow = splitRC.first ? rows.nrChild() : 1;
+    const int nrChildCol = splitRC.second ? cols.nrChild() : 1;
+    splitCost = 0;
+    for (int i = 0; i < nrChildRow; ++i) {
+      const ClusterTree* rowChild = splitRC.first ? rows.getChild(i) : &rows;
+      for (int j = 0; j < nrChildCol; ++j) {
+        const ClusterTree* colChild = splitRC.second ? cols.getChild(j) : &cols;
+        if (rowChild && colChild && rowChild->data.size() > 0 && colChild->data.size() > 0)
+          splitCost += leafCost(*rowChild, *colChild, rank);
+      }
+    }
+  }
+  if (rkCost <= fullCost && rkCost <= splitCost)
+    return RK_STORAGE;
+  return splitCost < fullCost ? SPLIT_STORAGE : FULL_STORAGE;
+}
+
+bool CostAdmissibilityCondition::forceRecursion(const ClusterTree& rows, const ClusterTree& cols,
+                                                size_t elemSize) const {
+  if (ProxyAdmissibilityCondition::forceRecursion(rows, cols, elemSize))
+    return true;
+  return ProxyAdmissibilityCondition::isLowRank(rows, cols) && cheapest(rows, cols) == SPLIT_STORAGE;
+}
+
+bool CostAdmissibilityCondition::forceFull(const ClusterTree& rows, const ClusterTree& cols) const {
+  if (ProxyAdmissibilityCondition::forceFull(rows, cols))
+    return true;
+  return ProxyAdmissibilityCondition::isLowRank(rows, cols) && !ProxyAdmissibilityCondition::forceRk(rows, cols)
+      && cheapest(rows, cols) == FULL_STORAGE;
+}
+
+int CostAdmissibilityCondition::getApproximateRank(const ClusterTree& rows, const ClusterTree& cols) const {
+  return predictedRank(rows, cols);
+}
+
+std::string CostAdmissibilityCondition::str() const {
+  std::ostringstream oss;
+  oss << "Cost model with block overhead = " << blockOverhead_
+      << " and " << history_.size() << " known ranks, on " << ProxyAdmissibilityCondition::str();
+  return oss.str();
+}
+
+std::string CostAdmissibilityCondition::cacheKey() const {
+  const std::string proxyKey = getProxy()->cacheKey();
+  const std::string estimatorKey = estimator_ == NULL ? "none" : estimator_->cacheKey();
+  if (proxyKey.empty() || estimatorKey.empty())
+    return std::string();
+  std::ostringstream oss;
+  oss.precision(17);
+  oss << "Cost blockOverhead=" << blockOverhead_
+      << " estimator=" << estimatorKey << " proxy=" << proxyKey << " history=\n";
+  history_.write(oss);
+  return classCacheKey(typeid(CostAdmissibilityCondition), oss.str());
+}
+
+bool CostAdmissibilityCondition::isThreadSafe() const {
+  return getProxy()->isThreadSafe() && (estimator_ == NULL || estimator_->isThreadSafe());
+}
+
 std::string HODLRAdmissibilityCondition::str() const {
   return "HODLRAdmissibilityCondition";
 }
 
+std::string HODLRAdmissibilityCondition::cacheKey() const {
+  return classCacheKey(typeid(HODLRAdmissibilityCondition), "HODLR");
+}
+
 bool HODLRAdmissibilityCondition::isLowRank(const ClusterTree& row, const ClusterTree& col) const {
   return !(row.data == col.data);
 }
 
+void HODLRAdmissibilityCondition::isLowRankBatch(const AdmissibilityBatch& batch, bool* result) const {
+  if (hasScalarOverrides()) {
+    AdmissibilityCondition::isLowRankBatch(batch, result);
+    return;
+  }
+  const int* rowsOffset = &batch.rowsOffset[0];
+  const int* rowsSize = &batch.rowsSize[0];
+  const int* colsOffset = &batch.colsOffset[0];
+  const int* colsSize = &batch.colsSize[0];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for (int i = 0; i < batch.count; ++i)
+    result[i] = !(rowsOffset[i] == colsOffset[i] && rowsSize[i] == colsSize[i]);
+}
+
+void HODLRAdmissibilityCondition::stopRecursionBatch(const AdmissibilityBatch& batch, bool* result) const {
+  if (hasScalarOverrides()) {
+    AdmissibilityCondition::stopRecursionBatch(batch, result);
+    return;
+  }
+  std::fill(result, result + batch.count, false);
+}
+
+void HODLRAdmissibilityCondition::forceFullBatch(const AdmissibilityBatch& batch, bool* result) const {
+  if (hasScalarOverrides()) {
+    AdmissibilityCondition::forceFullBatch(batch, result);
+    return;
+  }
+  std::fill(result, result + batch.count, false);
+}
+
 HODLRAdmissibilityCondition* HODLRAdmissibilityCondition::clone() const {
   return new HODLRAdmissibilityCondition();
 }
@@ -28,14 +28,47 @@
 #define _ADMISSIBLITY_HPP
 
 #include <cstddef>
+#include <iosfwd>
+#include <map>
 #include <string>
+#include <typeinfo>
+#include <vector>
 
 namespace hmat {
 
 // Forward declarations
 class ClusterTree;
+class IndexSet;
 class AxisAlignedBoundingBox;
 
+class AdmissibilityCondition;
+
+/*! \brief Blocks evaluated at once by the batched methods of AdmissibilityCondition.
+
+  The data tested by the conditions are stored as a structure of arrays, so
+  the tests are loops on the blocks which can be vectorized. The offsets and
+  sizes of the clusters are always set. The squared diameters and distance
+  of the bounding boxes are only set by computeBoxes(), which is called by
+  the prepareBatch() of the conditions using them.
+ */
+class AdmissibilityBatch {
+public:
+  AdmissibilityBatch(int count, const ClusterTree* const* rows, const ClusterTree* const* cols);
+  /*! \brief Set the bounding box arrays, using AdmissibilityCondition::getAxisAlignedBoundingBox */
+  void computeBoxes(const AdmissibilityCondition& condition);
+  bool hasBoxes() const { return !distanceSqr.empty(); }
+
+  /// Number of blocks
+  int count;
+  const ClusterTree* const* rows;
+  const ClusterTree* const* cols;
+  std::vector<int> rowsOffset, rowsSize;
+  std::vector<int> colsOffset, colsSize;
+  std::vector<double> rowsDiameterSqr, colsDiameterSqr;
+  /// Square of the distance between the boxes of the rows and the columns
+  std::vector<double> distanceSqr;
+};
+
 class AdmissibilityCondition
 {
 public:
@@ -56,6 +89,34 @@ public:
     \return true  if the block should be Rk.
    */
   virtual bool isLowRank(const ClusterTree& rows, const ClusterTree& cols) const = 0;
+
+  /*! \brief Fill the optional arrays of a batch needed by the batched methods.
+
+    The structure creation calls it on chunks of blocks of the same level,
+    then the batched methods. The default does nothing.
+   */
+  virtual void prepareBatch(AdmissibilityBatch& /*batch*/) const {}
+  /*! \brief Returns true if the methods used to build a block structure may be
+      called concurrently by several threads.
+
+    The structure creation then processes the chunks of a level in parallel,
+    else it calls this condition from one thread only. The conditions of this
+    library only read the data computed by prepare() (the root block, which is
+    alone on its level, excepted), so they return true. The default is false,
+    because a user condition may keep a state or call non reentrant code.
+    A subclass of a condition of this library which does so must return false.
+   */
+  virtual bool isThreadSafe() const { return false; }
+  /*! \brief Evaluate isLowRank() on a batch of blocks.
+
+    The default calls isLowRank() on each block.
+    \param result result[i] is set to isLowRank(*batch.rows[i], *batch.cols[i])
+   */
+  virtual void isLowRankBatch(const AdmissibilityBatch& batch, bool* result) const;
+  /*! \brief Evaluate stopRecursion() on a batch of blocks, the default calls stopRecursion() */
+  virtual void stopRecursionBatch(const AdmissibilityBatch& batch, bool* result) const;
+  /*! \brief Evaluate forceFull() on a batch of blocks, the default calls forceFull() */
+  virtual void forceFullBatch(const AdmissibilityBatch& batch, bool* result) const;
   /*! \brief Returns a boolean telling if the block of interaction between 2 nodes
       is too small to recurse.
       Note: stopRecursion and forceRecursion must not both return true.
@@ -128,6 +189,18 @@ public:
 
   virtual std::string str() const = 0;
 
+  /**
+   * @brief Identify the block structure created by this condition.
+   *
+   * Two conditions with the same key must create the same blocks from the
+   * same cluster trees, so the key holds every parameter used by the
+   * decisions (unlike str(), which is only a description). It is used by the
+   * structure cache (see structureKey()). The default returns an empty
+   * string, which means the condition cannot be identified and its
+   * structures are never cached.
+   */
+  virtual std::string cacheKey() const { return std::string(); }
+
   /**
    * @brief Set ratio to cut tall and skinny matrices
    * @param ratio  allows to cut tall and skinny matrices along only one direction:
@@ -143,6 +216,26 @@ public:
   void setMaxWidth(size_t maxWidth) { maxWidth_ = maxWidth; }
 
 protected:
+  /**
+   * @brief cacheKey() of the conditions of this library
+   * @param cls the class defining cacheKey()
+   * @param parameters the parameters of this class
+   * @return parameters followed by the ratio and the maximum width, or an
+   * empty string if this object is a subclass of cls, which may create other
+   * blocks unless it defines its own cacheKey()
+   */
+  std::string classCacheKey(const std::type_info& cls, const std::string& parameters) const;
+  /**
+   * @brief Return true if the batched methods must call the scalar tests.
+   *
+   * The batched methods of the conditions of this library are vectorized
+   * versions of their isLowRank(), stopRecursion() and forceFull(). A
+   * subclass which overrides one of these scalar tests without overriding
+   * the batched method must return true, so that the batched methods call
+   * the scalar tests. The default is false: subclasses which only change
+   * other methods, such as str(), keep the vectorized tests.
+   */
+  virtual bool hasScalarOverrides() const { return false; }
   double ratio_;
   size_t maxWidth_;
 };
@@ -168,13 +261,46 @@ public:
   bool stopRecursion(const ClusterTree& rows, const ClusterTree& cols) const;
   // Returns true when there is less than 2 rows or cols
   bool forceFull(const ClusterTree& rows, const ClusterTree& cols) const;
+  // Same tests on a batch, vectorized on the blocks (see hasScalarOverrides())
+  void prepareBatch(AdmissibilityBatch& batch) const;
+  void isLowRankBatch(const AdmissibilityBatch& batch, bool* result) const;
+  void stopRecursionBatch(const AdmissibilityBatch& batch, bool* result) const;
+  void forceFullBatch(const AdmissibilityBatch& batch, bool* result) const;
   std::string str() const;
+  std::string cacheKey() const;
+  bool isThreadSafe() const { return true; }
   void setEta(double eta);
   double getEta() const;
 protected:
   double eta_;
 };
 
+/**
+ * @brief Hackbusch admissibility with oriented bounding boxes.
+ *
+ * The diameter of a cluster is the smallest of the diameters of its axis
+ * aligned and oriented (principal axes) bounding boxes, and the distance
+ * between clusters the largest of the lower bounds given by both kinds of
+ * boxes, so it admits at least the blocks of StandardAdmissibilityCondition.
+ * It is best used with PrincipalAxisBisectionAlgorithm.
+ */
+class OrientedAdmissibilityCondition : public StandardAdmissibilityCondition
+{
+public:
+  explicit OrientedAdmissibilityCondition(double eta, double ratio = 0);
+  OrientedAdmissibilityCondition * clone() const { return new OrientedAdmissibilityCondition(*this); }
+  // Precompute axis aligned and oriented bounding boxes
+  void prepare(const ClusterTree& rows, const ClusterTree& cols) const;
+  void clean(const ClusterTree& rows, const ClusterTree& cols) const;
+  bool isLowRank(const ClusterTree& rows, const ClusterTree& cols) const;
+  const AxisAlignedBoundingBox* getAxisAlignedBoundingBox(const ClusterTree& current, bool is_rows) const;
+  std::string str() const;
+  std::string cacheKey() const;
+protected:
+  // isLowRank() is not the one vectorized by StandardAdmissibilityCondition
+  bool hasScalarOverrides() const { return true; }
+};
+
 class AlwaysAdmissibilityCondition : public AdmissibilityCondition {
 public:
     struct BlockSizeDetector {
@@ -202,11 +328,16 @@ public:
                                  bool split_rows = true, bool split_cols = false);
     AlwaysAdmissibilityCondition * clone() const { return new AlwaysAdmissibilityCondition(*this); }
     std::string str() const;
+    std::string cacheKey() const;
+    bool isThreadSafe() const { return true; }
     bool isLowRank(const ClusterTree&, const ClusterTree&) const;
     std::pair<bool, bool> splitRowsCols(const ClusterTree& rows, const ClusterTree&) const;
     bool forceRecursion(const ClusterTree& rows, const ClusterTree& cols, size_t elemSize) const;
     bool stopRecursion(const ClusterTree& rows, const ClusterTree& cols) const;
     bool forceFull(const ClusterTree& rows, const ClusterTree& cols) const;
+    void isLowRankBatch(const AdmissibilityBatch& batch, bool* result) const;
+    void stopRecursionBatch(const AdmissibilityBatch& batch, bool* result) const;
+    void forceFullBatch(const AdmissibilityBatch& batch, bool* result) const;
     /** @Brief Let this admissibility condition always create full blocks */
     void never(bool n);
     static void setBlockSizeDetector(BlockSizeDetector * b) { blockSizeDetector_ = b; }
@@ -261,15 +392,102 @@ public:
   std::string str() const {
     return proxy_->str();
   }
+  // cacheKey() is not delegated: subclasses change the decisions of the proxy
 
 private:
   AdmissibilityCondition * proxy_;
 };
 
+/**
+ * @brief Ranks of the Rk blocks of a previous run, identified by their
+ * row and column index sets.
+ */
+class RankHistory {
+public:
+  void add(const IndexSet& rows, const IndexSet& cols, int rank);
+  /** Return the rank of a block, or -1 if it is unknown */
+  int get(const IndexSet& rows, const IndexSet& cols) const;
+  size_t size() const { return ranks_.size(); }
+  /** Read a file written by write(), throw on error */
+  void read(const char * filename);
+  /** Write one "row_offset row_size col_offset col_size rank" line per block, throw on error */
+  void write(const char * filename) const;
+  /** Same as write(filename), to a stream */
+  void write(std::ostream & out) const;
+private:
+  typedef std::pair<std::pair<int, int>, std::pair<int, int> > Key;
+  std::map<Key, int> ranks_;
+};
+
+/**
+ * @brief Choose between Rk, full and subdivided blocks with a cost model.
+ *
+ * The proxy condition tells which blocks may be compressed. For those blocks,
+ * the rank is predicted and the block is stored the cheapest way: Rk
+ * (k * (m + n) values), full (m * n values) or split, the children being
+ * stored the cheapest of Rk or full. Both the memory and the gemv flops are
+ * proportional to the number of stored values; blockOverhead is the extra
+ * cost of a block (recursion, BLAS call), counted in values.
+ *
+ * The rank of a block is taken from the rank history if it holds this block,
+ * else from the rank estimator if any (e.g. a pilot compression of the
+ * block), else from the proxy getApproximateRank().
+ */
+class CostAdmissibilityCondition : public ProxyAdmissibilityCondition
+{
+public:
+  struct RankEstimator {
+    /** Return the predicted rank of a block, or a negative value if unknown */
+    virtual int rank(const ClusterTree& rows, const ClusterTree& cols) const = 0;
+    /**
+     * Identify the ranks returned by this estimator, as
+     * AdmissibilityCondition::cacheKey(). The default empty string disables
+     * the structure cache.
+     */
+    virtual std::string cacheKey() const { return std::string(); }
+    /** Return true if rank() may be called concurrently, the default is false */
+    virtual bool isThreadSafe() const { return false; }
+    virtual ~RankEstimator() {}
+  };
+  explicit CostAdmissibilityCondition(AdmissibilityCondition * admissibility, double blockOverhead = 64);
+  CostAdmissibilityCondition * clone() const;
+  bool forceRecursion(const ClusterTree& rows, const ClusterTree& cols, size_t elemSize) const;
+  bool forceFull(const ClusterTree& rows, const ClusterTree& cols) const;
+  int getApproximateRank(const ClusterTree& rows, const ClusterTree& cols) const;
+  std::string str() const;
+  /** Empty if the proxy condition or the rank estimator cannot be identified */
+  std::string cacheKey() const;
+  /** False if the proxy condition or the rank estimator is not thread safe */
+  bool isThreadSafe() const;
+
+  /** @brief Predicted rank of a block, at most min(rows, cols) */
+  int predictedRank(const ClusterTree& rows, const ClusterTree& cols) const;
+  RankHistory & rankHistory() { return history_; }
+  /** @brief Set the rank estimator, which is not owned */
+  void setRankEstimator(const RankEstimator * estimator) { estimator_ = estimator; }
+
+private:
+  enum Storage { RK_STORAGE, FULL_STORAGE, SPLIT_STORAGE };
+  /** Cheapest storage of a block which may be compressed */
+  Storage cheapest(const ClusterTree& rows, const ClusterTree& cols) const;
+  /** Same as predictedRank(rows, cols), with defaultRank instead of getApproximateRank() if it is not negative */
+  int predictedRank(const ClusterTree& rows, const ClusterTree& cols, int defaultRank) const;
+  /** Cost of the cheapest of Rk and full */
+  double leafCost(const ClusterTree& rows, const ClusterTree& cols, int defaultRank) const;
+  double blockOverhead_;
+  RankHistory history_;
+  const RankEstimator * estimator_;
+};
+
 class HODLRAdmissibilityCondition : public AdmissibilityCondition {
 public:
   std::string str() const override;
+  std::string cacheKey() const override;
+  bool isThreadSafe() const override { return true; }
   bool isLowRank(const ClusterTree&, const ClusterTree&) const override;
+  void isLowRankBatch(const AdmissibilityBatch& batch, bool* result) const override;
+  void stopRecursionBatch(const AdmissibilityBatch& batch, bool* result) const override;
+  void forceFullBatch(const AdmissibilityBatch& batch, bool* result) const override;
   HODLRAdmissibilityCondition* clone() const override;
 };
 
@@ -29,6 +29,7 @@
 #include "h_matrix.hpp"
 #include "rk_matrix.hpp"
 #include "fromdouble.hpp"
+#include "assembly_stats.hpp"
 
 #include <cstdlib>
 #include <cstring>
@@ -66,7 +67,13 @@ void AssemblyFunction<T, F>::assemble(const LocalSettings &,
       if (method != compression_)
         delete method;
     } else if (rows.data.size() && cols.data.size()) {
-      fullMatrix = fromDoubleFull<T>(function_.assemble(&(rows.data), &(cols.data), NULL, allocationObserver));
+      FullMatrix<typename Types<T>::dp> * m;
+      {
+        AssemblyStats::countCall(AssemblyStats::ASSEMBLE);
+        AssemblyStats::Timer timer(AssemblyStats::KERNEL);
+        m = function_.assemble(&(rows.data), &(cols.data), NULL, allocationObserver);
+      }
+      fullMatrix = fromDoubleFull<T>(m);
     }
 }
 
@@ -0,0 +1,181 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "assembly_stats.hpp"
+#include "cluster_tree.hpp"
+#include "common/chrono.h"
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace hmat {
+
+namespace {
+
+/** rows offset, rows size, cols offset, cols size */
+typedef std::pair<std::pair<int, int>, std::pair<int, int> > BlockKey;
+
+BlockKey blockKey(int rowsOffset, int rowsSize, int colsOffset, int colsSize) {
+  return BlockKey(std::make_pair(rowsOffset, rowsSize), std::make_pair(colsOffset, colsSize));
+}
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<hmat_block_stats_t> leaves;
+  /// Index in leaves of the last assembly of each block
+  std::map<BlockKey, size_t> index;
+};
+
+Registry & registry() {
+  static Registry r;
+  return r;
+}
+
+int64_t nanoseconds() {
+  Time t = now();
+  return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+}
+
+// The leaf being assembled by the calling thread
+static thread_local AssemblyStats::Leaf * currentLeaf = NULL;
+
+bool AssemblyStats::enabled_ = false;
+
+AssemblyStats::Leaf::Leaf(const IndexSet * rows, const IndexSet * cols)
+  : category_(OTHER), previous_(NULL), active_(enabled_) {
+  if (!active_)
+    return;
+  memset(&stats_, 0, sizeof(stats_));
+  memset(times_, 0, sizeof(times_));
+  stats_.rows_offset = rows->offset();
+  stats_.rows_size = rows->size();
+  stats_.cols_offset = cols->offset();
+  stats_.cols_size = cols->size();
+  stats_.rank = -1;
+  stats_.algorithm = "full";
+  since_ = nanoseconds();
+  previous_ = currentLeaf;
+  currentLeaf = this;
+}
+
+AssemblyStats::Leaf::~Leaf() {
+  if (!active_)
+    return;
+  times_[category_] += nanoseconds() - since_;
+  currentLeaf = previous_;
+  stats_.kernel_time = times_[KERNEL] * 1e-9;
+  stats_.compression_time = times_[COMPRESSION] * 1e-9;
+  stats_.truncate_time = times_[TRUNCATE] * 1e-9;
+  Registry & r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.index[blockKey(stats_.rows_offset, stats_.rows_size, stats_.cols_offset, stats_.cols_size)] = r.leaves.size();
+  r.leaves.push_back(stats_);
+}
+
+void AssemblyStats::Leaf::setResult(int rank, size_t bytes) {
+  if (!active_)
+    return;
+  stats_.rank = rank;
+  stats_.bytes = bytes;
+}
+
+AssemblyStats::Timer::Timer(Category category) : previous_(OTHER), active_(currentLeaf != NULL) {
+  if (!active_)
+    return;
+  Leaf & l = *currentLeaf;
+  const int64_t t = nanoseconds();
+  l.times_[l.category_] += t - l.since_;
+  l.since_ = t;
+  previous_ = l.category_;
+  l.category_ = category;
+}
+
+AssemblyStats::Timer::~Timer() {
+  if (!active_)
+    return;
+  Leaf & l = *currentLeaf;
+  const int64_t t = nanoseconds();
+  l.times_[l.category_] += t - l.since_;
+  l.since_ = t;
+  l.category_ = previous_;
+}
+
+void AssemblyStats::enable(bool enabled) {
+  if (enabled)
+    clear();
+  enabled_ = enabled;
+}
+
+void AssemblyStats::clear() {
+  Registry & r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.leaves.clear();
+  r.index.clear();
+}
+
+void AssemblyStats::countCall(Call call) {
+  if (currentLeaf == NULL)
+    return;
+  hmat_block_stats_t & s = currentLeaf->stats_;
+  switch (call) {
+  case GET_ROW: s.get_row_count++; break;
+  case GET_COL: s.get_col_count++; break;
+  case GET_ELEMENT: s.get_element_count++; break;
+  case ASSEMBLE: s.assemble_count++; break;
+  }
+}
+
+void AssemblyStats::setAlgorithm(const char * name) {
+  if (currentLeaf != NULL)
+    currentLeaf->stats_.algorithm = name;
+}
+
+size_t AssemblyStats::count() {
+  Registry & r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  return r.leaves.size();
+}
+
+bool AssemblyStats::get(size_t index, hmat_block_stats_t & result) {
+  Registry & r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  if (index >= r.leaves.size())
+    return false;
+  result = r.leaves[index];
+  return true;
+}
+
+bool AssemblyStats::find(const IndexSet * rows, const IndexSet * cols, hmat_block_stats_t & result) {
+  Registry & r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  std::map<BlockKey, size_t>::const_iterator it =
+      r.index.find(blockKey(rows->offset(), rows->size(), cols->offset(), cols->size()));
+  if (it == r.index.end())
+    return false;
+  result = r.leaves[it->second];
+  return true;
+}
+
+}  // end namespace hmat
@@ -0,0 +1,94 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Statistics of the assembly of each leaf.
+*/
+#pragma once
+
+#include "hmat/hmat.h"
+#include <stdint.h>
+
+namespace hmat {
+
+class IndexSet;
+
+/*! \brief Timings and user function calls of the assembly of each leaf.
+
+  A Leaf is created by HMatrix::assemble around the assembly of a leaf. It is
+  the current leaf of the thread until its destruction, when its statistics
+  are appended to the global list. ClusterAssemblyFunction and the compression
+  account their work to the current leaf, if any, with Timer and countCall.
+ */
+class AssemblyStats {
+public:
+  enum Category { OTHER, KERNEL, COMPRESSION, TRUNCATE, NB_CATEGORY };
+  enum Call { GET_ROW, GET_COL, GET_ELEMENT, ASSEMBLE };
+
+  class Leaf {
+    hmat_block_stats_t stats_;
+    int64_t times_[NB_CATEGORY];
+    Category category_;
+    int64_t since_;
+    Leaf * previous_;
+    /// False when the statistics are disabled
+    bool active_;
+    friend class AssemblyStats;
+  public:
+    Leaf(const IndexSet * rows, const IndexSet * cols);
+    ~Leaf();
+    /** Set the result of the assembly, rank is -1 for full blocks */
+    void setResult(int rank, size_t bytes);
+  };
+
+  /** Account the time until the end of the scope to a category of the current leaf */
+  class Timer {
+    Category previous_;
+    bool active_;
+  public:
+    explicit Timer(Category category);
+    ~Timer();
+  };
+
+  static bool enabled() { return enabled_; }
+  /** Enable or disable the collection, enabling clears the previous statistics */
+  static void enable(bool enabled);
+  static void clear();
+  static void countCall(Call call);
+  /** Set the compression algorithm of the current leaf, must be a static string */
+  static void setAlgorithm(const char * name);
+  /** Number of leaves assembled since the statistics were enabled */
+  static size_t count();
+  /** Statistics of the index-th assembled leaf, false if index is out of range */
+  static bool get(size_t index, hmat_block_stats_t & result);
+  /**
+   * Find the statistics of a block. If a block was assembled several times,
+   * the last assembly is returned.
+   * @return false if the block was not assembled
+   */
+  static bool find(const IndexSet * rows, const IndexSet * cols, hmat_block_stats_t & result);
+private:
+  static bool enabled_;
+};
+
+}  // end namespace hmat
@@ -28,6 +28,7 @@
 
 #include <assert.h>
 #include "data_types.hpp"
+#include "common/flop_counter.hpp"
 
 #ifdef HAVE_MKL_CBLAS_H
   #define MKL_Complex8 hmat::C_t
@@ -68,14 +69,17 @@ void axpy(const int n, const T& alpha, const T* x, const int incx, T* y, const i
 
 inline
 void axpy(const int n, const hmat::S_t& alpha, const hmat::S_t* x, const int incx, hmat::S_t* y, const int incy) {
+  hmat::flops::axpy<hmat::S_t>(n);
   cblas_saxpy(n, alpha, x, incx, y, incy);
 }
 inline
 void axpy(const int n, const hmat::D_t& alpha, const hmat::D_t* x, const int incx, hmat::D_t* y, const int incy) {
+  hmat::flops::axpy<hmat::D_t>(n);
   cblas_daxpy(n, alpha, x, incx, y, incy);
 }
 inline
 void axpy(const int n, const hmat::C_t& alpha, const hmat::C_t* x, const int incx, hmat::C_t* y, const int incy) {
+  hmat::flops::axpy<hmat::C_t>(n);
   // WARNING: &alpha instead of alpha for complex values
   #define _C_T hmat::C_t
   cblas_caxpy(n, _C(&alpha), _C(x), incx, _C(y), incy);
@@ -83,6 +87,7 @@ void axpy(const int n, const hmat::C_t& alpha, const hmat::C_t* x, const int inc
 }
 inline
 void axpy(const int n, const hmat::Z_t& alpha, const hmat::Z_t* x, const int incx, hmat::Z_t* y, const int incy) {
+  hmat::flops::axpy<hmat::Z_t>(n);
   #define _C_T hmat::Z_t
   // WARNING: &alpha instead of alpha for complex values
   cblas_zaxpy(n, _C(&alpha), _C(x), incx, _C(y), incy);
@@ -94,15 +99,18 @@ T dot(const int n, const T* x, const int incx, const T* y, const int incy);
 
 inline
 hmat::S_t dot(const int n, const hmat::S_t* x, const int incx, const hmat::S_t* y, const int incy) {
+  hmat::flops::dot<hmat::S_t>(n);
   return cblas_sdot(n, x, incx, y, incy);
 }
 inline
 hmat::D_t dot(const int n, const hmat::D_t* x, const int incx, const hmat::D_t* y, const int incy) {
+  hmat::flops::dot<hmat::D_t>(n);
   return cblas_ddot(n, x, incx, y, incy);
 }
 
 inline hmat::C_t dot(const int n, const hmat::C_t *x, const int incx,
                      const hmat::C_t *y, const int incy) {
+    hmat::flops::dot<hmat::C_t>(n);
     hmat::C_t result = 0;
 #define _C_T hmat::C_t
     cblas_cdotu_sub(n, _C(x), incx, _C(y), incy,
@@ -113,6 +121,7 @@ inline hmat::C_t dot(const int n, const hmat::C_t *x, const int incx,
 
 inline hmat::Z_t dot(const int n, const hmat::Z_t *x, const int incx,
                      const hmat::Z_t *y, const int incy) {
+    hmat::flops::dot<hmat::Z_t>(n);
     hmat::Z_t result = 0;
 #define _C_T hmat::Z_t
     cblas_zdotu_sub(n, _C(x), incx, _C(y), incy,
@@ -126,6 +135,7 @@ T dotc(const int n, const T* x, const int incx, const T* y, const int incy);
 
 inline
 hmat::C_t dotc(const int n, const hmat::C_t* x, const int incx, const hmat::C_t* y, const int incy) {
+  hmat::flops::dot<hmat::C_t>(n);
 #ifdef HAVE_CBLAS_CDOTC
   return cblas_cdotc(n, x, incx, y, incy);
 #else
@@ -138,6 +148,7 @@ hmat::C_t dotc(const int n, const hmat::C_t* x, const int incx, const hmat::C_t*
 }
 inline
 hmat::Z_t dotc(const int n, const hmat::Z_t* x, const int incx, const hmat::Z_t* y, const int incy) {
+  hmat::flops::dot<hmat::Z_t>(n);
 #ifdef HAVE_CBLAS_CDOTC
   return cblas_zdotc(n, x, incx, y, incy);
 #else
@@ -154,20 +165,24 @@ int i_amax(const int n, const T* x, const int incx);
 
 inline
 int i_amax(const int n, const hmat::S_t* x, const int incx) {
+  hmat::flops::iamax<hmat::S_t>(n);
   return cblas_isamax(n, x, incx);
 }
 inline
 int i_amax(const int n, const hmat::D_t* x, const int incx) {
+  hmat::flops::iamax<hmat::D_t>(n);
   return cblas_idamax(n, x, incx);
 }
 inline
 int i_amax(const int n, const hmat::C_t* x, const int incx) {
+  hmat::flops::iamax<hmat::C_t>(n);
   #define _C_T hmat::C_t
   return cblas_icamax(n, _C(x), incx);
   #undef _C_T
 }
 inline
 int i_amax(const int n, const hmat::Z_t* x, const int incx) {
+  hmat::flops::iamax<hmat::Z_t>(n);
   #define _C_T hmat::Z_t
   return cblas_izamax(n, _C(x), incx);
   #undef _C_T
@@ -178,14 +193,17 @@ void scal(const int n, const T& alpha, T* x, const int incx);
 
 inline
 void scal(const int n, const hmat::S_t& alpha, hmat::S_t* x, const int incx) {
+  hmat::flops::scal<hmat::S_t>(n);
   cblas_sscal(n, alpha, x, incx);
 }
 inline
 void scal(const int n, const hmat::D_t& alpha, hmat::D_t* x, const int incx) {
+  hmat::flops::scal<hmat::D_t>(n);
   cblas_dscal(n, alpha, x, incx);
 }
 inline
 void scal(const int n, const hmat::C_t& alpha, hmat::C_t* x, const int incx) {
+  hmat::flops::scal<hmat::C_t>(n);
   // WARNING: &alpha instead of alpha for complex values
   #define _C_T hmat::C_t
   cblas_cscal(n, _C(&alpha), _C(x), incx);
@@ -193,6 +211,7 @@ void scal(const int n, const hmat::C_t& alpha, hmat::C_t* x, const int incx) {
 }
 inline
 void scal(const int n, const hmat::Z_t& alpha, hmat::Z_t* x, const int incx) {
+  hmat::flops::scal<hmat::Z_t>(n);
   // WARNING: &alpha instead of alpha for complex values
   #define _C_T hmat::Z_t
   cblas_zscal(n, _C(&alpha), _C(x), incx);
@@ -207,18 +226,21 @@ void gemv(const char trans, const int m, const int n, const T& alpha, const T* a
 inline
 void gemv(const char trans, const int m, const int n, const hmat::S_t& alpha, const hmat::S_t* a, const int lda,
           const hmat::S_t* x, const int incx, const hmat::S_t& beta, hmat::S_t* y, const int incy) {
+  hmat::flops::gemv<hmat::S_t>(m, n);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
   cblas_sgemv(CblasColMajor, t, m, n, alpha, a, lda, x, incx, beta, y, incy);
 }
 inline
 void gemv(const char trans, const int m, const int n, const hmat::D_t& alpha, const hmat::D_t* a, const int lda,
           const hmat::D_t* x, const int incx, const hmat::D_t& beta, hmat::D_t* y, const int incy) {
+  hmat::flops::gemv<hmat::D_t>(m, n);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
   cblas_dgemv(CblasColMajor, t, m, n, alpha, a, lda, x, incx, beta, y, incy);
 }
 inline
 void gemv(const char trans, const int m, const int n, const hmat::C_t& alpha, const hmat::C_t* a, const int lda,
           const hmat::C_t* x, const int incx, const hmat::C_t& beta, hmat::C_t* y, const int incy) {
+  hmat::flops::gemv<hmat::C_t>(m, n);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
   // WARNING: &alpha/&beta instead of alpha/beta for complex values
   #define _C_T hmat::C_t
@@ -228,6 +250,7 @@ void gemv(const char trans, const int m, const int n, const hmat::C_t& alpha, co
 inline
 void gemv(const char trans, const int m, const int n, const hmat::Z_t& alpha, const hmat::Z_t* a, const int lda,
           const hmat::Z_t* x, const int incx, const hmat::Z_t& beta, hmat::Z_t* y, const int incy) {
+  hmat::flops::gemv<hmat::Z_t>(m, n);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
   // WARNING: &alpha/&beta instead of alpha/beta for complex values
   #define _C_T hmat::Z_t
@@ -242,16 +265,19 @@ void ger(const int m, const int n, const T& alpha, const T* x, const int incx,
 inline
 void ger(const int m, const int n, const hmat::S_t& alpha, const hmat::S_t* x, const int incx,
          const hmat::S_t* y, const int incy, hmat::S_t* a, const int lda) {
+  hmat::flops::ger<hmat::S_t>(m, n);
   cblas_sger(CblasColMajor, m, n, alpha, x, incx, y, incy, a, lda);
 }
 inline
 void ger(const int m, const int n, const hmat::D_t& alpha, const hmat::D_t* x, const int incx,
          const hmat::D_t* y, const int incy, hmat::D_t* a, const int lda) {
+  hmat::flops::ger<hmat::D_t>(m, n);
   cblas_dger(CblasColMajor, m, n, alpha, x, incx, y, incy, a, lda);
 }
 inline
 void ger(const int m, const int n, const hmat::C_t& alpha, const hmat::C_t* x, const int incx,
          const hmat::C_t* y, const int incy, hmat::C_t* a, const int lda) {
+  hmat::flops::ger<hmat::C_t>(m, n);
   // WARNING: &alpha instead of alpha for complex values
   #define _C_T hmat::C_t
   cblas_cgeru(CblasColMajor, m, n, _C(&alpha), _C(x), incx, _C(y), incy, _C(a), lda);
@@ -260,6 +286,7 @@ void ger(const int m, const int n, const hmat::C_t& alpha, const hmat::C_t* x, c
 inline
 void ger(const int m, const int n, const hmat::Z_t& alpha, const hmat::Z_t* x, const int incx,
          const hmat::Z_t* y, const int incy, hmat::Z_t* a, const int lda) {
+  hmat::flops::ger<hmat::Z_t>(m, n);
   // WARNING: &alpha instead of alpha for complex values
   #define _C_T hmat::Z_t
   cblas_zgeru(CblasColMajor, m, n, _C(&alpha), _C(x), incx, _C(y), incy, _C(a), lda);
@@ -276,6 +303,7 @@ inline
 void gemm(const char transA, const char transB, const int m, const int n, const int k,
           const hmat::S_t& alpha, const hmat::S_t* a, const int lda, const hmat::S_t* b, const int ldb,
           const hmat::S_t& beta, hmat::S_t* c, const int ldc) {
+  hmat::flops::gemm<hmat::S_t>(m, n, k);
   const CBLAS_TRANSPOSE tA = (transA == 'C' ? CblasConjTrans : (transA == 'T' ? CblasTrans : CblasNoTrans));
   const CBLAS_TRANSPOSE tB = (transB == 'C' ? CblasConjTrans : (transB == 'T' ? CblasTrans : CblasNoTrans));
   cblas_sgemm(CblasColMajor, tA, tB, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
@@ -284,6 +312,7 @@ inline
 void gemm(const char transA, const char transB, const int m, const int n, const int k,
           const hmat::D_t& alpha, const hmat::D_t* a, const int lda, const hmat::D_t* b, const int ldb,
           const hmat::D_t& beta, hmat::D_t* c, const int ldc) {
+  hmat::flops::gemm<hmat::D_t>(m, n, k);
   const CBLAS_TRANSPOSE tA = (transA == 'C' ? CblasConjTrans : (transA == 'T' ? CblasTrans : CblasNoTrans));
   const CBLAS_TRANSPOSE tB = (transB == 'C' ? CblasConjTrans : (transB == 'T' ? CblasTrans : CblasNoTrans));
   cblas_dgemm(CblasColMajor, tA, tB, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
@@ -292,6 +321,7 @@ inline
 void gemm(const char transA, const char transB, const int m, const int n, const int k,
           const hmat::C_t& alpha, const hmat::C_t* a, const int lda, const hmat::C_t* b, const int ldb,
           const hmat::C_t& beta, hmat::C_t* c, const int ldc) {
+  hmat::flops::gemm<hmat::C_t>(m, n, k);
   const CBLAS_TRANSPOSE tA = (transA == 'C' ? CblasConjTrans : (transA == 'T' ? CblasTrans : CblasNoTrans));
   const CBLAS_TRANSPOSE tB = (transB == 'C' ? CblasConjTrans : (transB == 'T' ? CblasTrans : CblasNoTrans));
   // WARNING: &alpha/&beta instead of alpha/beta for complex values
@@ -309,6 +339,7 @@ inline
 void gemm(const char transA, const char transB, const int m, const int n, int k,
           const hmat::Z_t& alpha, const hmat::Z_t* a, const int lda, const hmat::Z_t* b, const int ldb,
           const hmat::Z_t& beta, hmat::Z_t* c, const int ldc) {
+  hmat::flops::gemm<hmat::Z_t>(m, n, k);
   const CBLAS_TRANSPOSE tA = (transA == 'C' ? CblasConjTrans : (transA == 'T' ? CblasTrans : CblasNoTrans));
   const CBLAS_TRANSPOSE tB = (transB == 'C' ? CblasConjTrans : (transB == 'T' ? CblasTrans : CblasNoTrans));
   // WARNING: &alpha/&beta instead of alpha/beta for complex values
@@ -332,6 +363,7 @@ inline
 void trmm(const char side, const char uplo, const char trans, const char diag,
           const int m, const int n, const hmat::S_t& alpha, const hmat::S_t* a, const int lda,
           hmat::S_t* b, const int ldb) {
+  hmat::flops::triangular<hmat::S_t>(side, m, n);
   const CBLAS_SIDE s = (side == 'L' ? CblasLeft : CblasRight);
   const CBLAS_UPLO u = (uplo == 'U' ? CblasUpper : CblasLower);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
@@ -342,6 +374,7 @@ inline
 void trmm(const char side, const char uplo, const char trans, const char diag,
           const int m, const int n, const hmat::D_t& alpha, const hmat::D_t* a, const int lda,
           hmat::D_t* b, const int ldb) {
+  hmat::flops::triangular<hmat::D_t>(side, m, n);
   const CBLAS_SIDE s = (side == 'L' ? CblasLeft : CblasRight);
   const CBLAS_UPLO u = (uplo == 'U' ? CblasUpper : CblasLower);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
@@ -352,6 +385,7 @@ inline
 void trmm(const char side, const char uplo, const char trans, const char diag,
           const int m, const int n, const hmat::C_t& alpha, const hmat::C_t* a, const int lda,
           hmat::C_t* b, const int ldb) {
+  hmat::flops::triangular<hmat::C_t>(side, m, n);
   const CBLAS_SIDE s = (side == 'L' ? CblasLeft : CblasRight);
   const CBLAS_UPLO u = (uplo == 'U' ? CblasUpper : CblasLower);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
@@ -365,6 +399,7 @@ inline
 void trmm(const char side, const char uplo, const char trans, const char diag,
           const int m, const int n, const hmat::Z_t& alpha, const hmat::Z_t* a, const int lda,
           hmat::Z_t* b, const int ldb) {
+  hmat::flops::triangular<hmat::Z_t>(side, m, n);
   const CBLAS_SIDE s = (side == 'L' ? CblasLeft : CblasRight);
   const CBLAS_UPLO u = (uplo == 'U' ? CblasUpper : CblasLower);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
@@ -384,6 +419,7 @@ inline
 void trsm(const char side, const char uplo, const char trans, const char diag,
           const int m, const int n, const hmat::S_t& alpha, const hmat::S_t* a, const int lda,
           hmat::S_t* b, const int ldb) {
+  hmat::flops::triangular<hmat::S_t>(side, m, n);
   assert(lda >= m || side != 'L');
   const CBLAS_SIDE s = (side == 'L' ? CblasLeft : CblasRight);
   const CBLAS_UPLO u = (uplo == 'U' ? CblasUpper : CblasLower);
@@ -395,6 +431,7 @@ inline
 void trsm(const char side, const char uplo, const char trans, const char diag,
           const int m, const int n, const hmat::D_t& alpha, const hmat::D_t* a, const int lda,
           hmat::D_t* b, const int ldb) {
+  hmat::flops::triangular<hmat::D_t>(side, m, n);
   const CBLAS_SIDE s = (side == 'L' ? CblasLeft : CblasRight);
   const CBLAS_UPLO u = (uplo == 'U' ? CblasUpper : CblasLower);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
@@ -405,6 +442,7 @@ inline
 void trsm(const char side, const char uplo, const char trans, const char diag,
           const int m, const int n, const hmat::C_t& alpha, const hmat::C_t* a, const int lda,
           hmat::C_t* b, const int ldb) {
+  hmat::flops::triangular<hmat::C_t>(side, m, n);
   const CBLAS_SIDE s = (side == 'L' ? CblasLeft : CblasRight);
   const CBLAS_UPLO u = (uplo == 'U' ? CblasUpper : CblasLower);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
@@ -418,6 +456,7 @@ inline
 void trsm(const char side, const char uplo, const char trans, const char diag,
           const int m, const int n, const hmat::Z_t& alpha, const hmat::Z_t* a, const int lda,
           hmat::Z_t* b, const int ldb) {
+  hmat::flops::triangular<hmat::Z_t>(side, m, n);
   const CBLAS_SIDE s = (side == 'L' ? CblasLeft : CblasRight);
   const CBLAS_UPLO u = (uplo == 'U' ? CblasUpper : CblasLower);
   const CBLAS_TRANSPOSE t = (trans == 'C' ? CblasConjTrans : (trans == 'T' ? CblasTrans : CblasNoTrans));
@@ -466,19 +505,23 @@ void imatcopy(const size_t rows, const size_t cols, T* m);
 
 inline
 void imatcopy(const size_t rows, const size_t cols, hmat::S_t* m) {
+  hmat::flops::copy<hmat::S_t>(rows * cols);
   mkl_simatcopy('C', 'T', rows, cols, 1, m, rows, cols);
 }
 inline
 void imatcopy(const size_t rows, const size_t cols, hmat::D_t* m) {
+  hmat::flops::copy<hmat::D_t>(rows * cols);
   mkl_dimatcopy('C', 'T', rows, cols, 1, m, rows, cols);
 }
 inline
 void imatcopy(const size_t rows, const size_t cols, hmat::C_t* m) {
+  hmat::flops::copy<hmat::C_t>(rows * cols);
   const MKL_Complex8 pone = {1., 0.};
   mkl_cimatcopy('C', 'T', rows, cols, pone, (MKL_Complex8*) m, rows, cols);
 }
 inline
 void imatcopy(const size_t rows, const size_t cols, hmat::Z_t* m) {
+  hmat::flops::copy<hmat::Z_t>(rows * cols);
   const MKL_Complex16 pone = {1., 0.};
   mkl_zimatcopy('C', 'T', rows, cols, pone, (MKL_Complex16*) m, rows, cols);
 }
@@ -488,19 +531,23 @@ void omatcopy(size_t rows, size_t cols, const T* m, T* copy);
 
 inline
 void omatcopy(size_t rows, size_t cols, const hmat::S_t* m, hmat::S_t* copy) {
+  hmat::flops::copy<hmat::S_t>(rows * cols);
   mkl_somatcopy('C', 'T', rows, cols, 1, m, rows, copy, cols);
 }
 inline
 void omatcopy(size_t rows, size_t cols, const hmat::D_t* m, hmat::D_t* copy) {
+  hmat::flops::copy<hmat::D_t>(rows * cols);
   mkl_domatcopy('C', 'T', rows, cols, 1, m, rows, copy, cols);
 }
 inline
 void omatcopy(size_t rows, size_t cols, const hmat::C_t* m, hmat::C_t* copy) {
+  hmat::flops::copy<hmat::C_t>(rows * cols);
   const MKL_Complex8 pone = {1., 0.};
   mkl_comatcopy('C', 'T', rows, cols, pone, (const MKL_Complex8*) m, rows, (MKL_Complex8*) copy, cols);
 }
 inline
 void omatcopy(size_t rows, size_t cols, const hmat::Z_t* m, hmat::Z_t* copy) {
+  hmat::flops::copy<hmat::Z_t>(rows * cols);
   const MKL_Complex16 pone = {1., 0.};
   mkl_zomatcopy('C', 'T', rows, cols, pone, (const MKL_Complex16*) m, rows, (MKL_Complex16*) copy, cols);
 }
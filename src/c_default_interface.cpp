@@ -28,7 +28,13 @@
 #include "clustering.hpp"
 #include "admissibility.hpp"
 #include "c_wrapping.hpp"
+#include "shared_matrix.hpp"
+#include "serialization.hpp"
+#include "assembly_stats.hpp"
 #include "common/my_assert.h"
+#include "common/flop_counter.hpp"
+#include "common/memory_instrumentation.hpp"
+#include "common/timeline.hpp"
 
 using namespace hmat;
 
@@ -53,6 +59,21 @@ hmat_clustering_algorithm_t * hmat_create_clustering_hybrid()
     return (hmat_clustering_algorithm_t*) new HybridBisectionAlgorithm();
 }
 
+hmat_clustering_algorithm_t * hmat_create_clustering_morton()
+{
+    return (hmat_clustering_algorithm_t*) new MortonClusteringAlgorithm();
+}
+
+hmat_clustering_algorithm_t * hmat_create_clustering_principal_axis()
+{
+    return (hmat_clustering_algorithm_t*) new PrincipalAxisBisectionAlgorithm();
+}
+
+hmat_clustering_algorithm_t * hmat_create_clustering_work_balanced(double eta)
+{
+    return (hmat_clustering_algorithm_t*) new WorkBalancedClusteringAlgorithm(eta);
+}
+
 void hmat_delete_clustering(hmat_clustering_algorithm_t* algo)
 {
     delete (ClusteringAlgorithm*) algo;
@@ -115,6 +136,33 @@ hmat_cluster_tree_t * hmat_create_cluster_tree_generic(struct hmat_cluster_tree_
     return reinterpret_cast<hmat_cluster_tree_t *>(r);
 }
 
+hmat_cluster_tree_t * hmat_update_cluster_tree(const hmat_cluster_tree_t * tree, const int * old_to_new,
+                                               struct hmat_cluster_tree_create_context_t * ctx) {
+    try {
+        HMAT_ASSERT_MSG(ctx->group_index == NULL, "A ClusterTree with a group index cannot be updated");
+        DofCoordinates dofs(ctx->coordinates, ctx->dimension, ctx->number_of_points, true,
+                            ctx->number_of_dof, ctx->span_offsets, ctx->spans);
+        ClusterTree * r = reinterpret_cast<const ClusterTreeBuilder*>(ctx->builder)->update(
+            *reinterpret_cast<const ClusterTree*>(tree), dofs, old_to_new);
+        return reinterpret_cast<hmat_cluster_tree_t *>(r);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return NULL;
+    }
+}
+
+int hmat_move_cluster_tree(hmat_cluster_tree_t * tree, const struct hmat_cluster_tree_create_context_t * ctx) {
+    try {
+        DofCoordinates dofs(ctx->coordinates, ctx->dimension, ctx->number_of_points, true,
+                            ctx->number_of_dof, ctx->span_offsets, ctx->spans);
+        reinterpret_cast<ClusterTree*>(tree)->coordinates(dofs);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
+
 hmat_cluster_tree_builder_t* hmat_create_cluster_tree_builder(const hmat_clustering_algorithm_t* algo)
 {
     ClusterTreeBuilder* result = new ClusterTreeBuilder(*static_cast<const ClusteringAlgorithm*>((void*) algo));
@@ -211,6 +259,11 @@ hmat_admissibility_t* hmat_create_admissibility_standard(double eta)
     return static_cast<hmat_admissibility_t*>((void*) new hmat::StandardAdmissibilityCondition(eta));
 }
 
+hmat_admissibility_t* hmat_create_admissibility_oriented(double eta)
+{
+    return static_cast<hmat_admissibility_t*>((void*) new hmat::OrientedAdmissibilityCondition(eta));
+}
+
 hmat_admissibility_t* hmat_create_admissibility_hodlr() {
   return reinterpret_cast<hmat_admissibility_t*>(new hmat::HODLRAdmissibilityCondition());
 }
@@ -229,6 +282,22 @@ hmat_admissibility_t* hmat_create_admissibility_never(
     return reinterpret_cast<hmat_admissibility_t*>(r);
 }
 
+hmat_admissibility_t* hmat_create_admissibility_cost(
+        hmat_admissibility_t* cond, const char* rank_history, double block_overhead) {
+    hmat::CostAdmissibilityCondition * r = new hmat::CostAdmissibilityCondition(
+        reinterpret_cast<AdmissibilityCondition*>(cond), block_overhead);
+    if (rank_history != NULL) {
+        try {
+            r->rankHistory().read(rank_history);
+        } catch (const std::exception& e) {
+            fprintf(stderr, "%s\n", e.what());
+            delete r;
+            return NULL;
+        }
+    }
+    return reinterpret_cast<hmat_admissibility_t*>(r);
+}
+
 void hmat_delete_admissibility(hmat_admissibility_t * cond) {
     delete static_cast<AdmissibilityCondition*>((void*)cond);
 }
@@ -281,6 +350,29 @@ int hmat_set_parameters(hmat_settings_t* settings)
     return rc;
 }
 
+int hmat_unlink_shared(const char * name)
+{
+    try {
+        unlinkShared(name);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
+
+int hmat_read_header(hmat_iostream readfunc, void * user_data, hmat_file_header_t * header)
+{
+    try {
+        readFileHeader(readfunc, user_data, header);
+        checkFileHeader(*header);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
+
 const char * hmat_get_version()
 {
     return HMAT_VERSION;
@@ -308,11 +400,13 @@ void hmat_assemble_context_init(hmat_assemble_context_t * context) {
     context->lower_symmetric = 0;
     context->factorization = hmat_factorization_none;
     context->progress = DefaultProgress::getInstance();
+    context->partial = 0;
 }
 
 void hmat_factorization_context_init(hmat_factorization_context_t *context) {
     context->factorization = hmat_factorization_lu;
     context->progress = DefaultProgress::getInstance();
+    context->checkpoint = NULL;
 }
 
 void hmat_solve_context_init(hmat_solve_context_t * context) {
@@ -373,6 +467,78 @@ void hmat_tracing_dump(char *filename) {
   tracing_dump(filename);
 }
 
+int hmat_timeline_to_trace(const char *timeline, const char *filename) {
+  try {
+    Timeline::writeTrace(timeline, filename);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+
+int hmat_flops_report(const char *filename) {
+  FILE * out = filename ? fopen(filename, "w") : stdout;
+  if (out == NULL) {
+    fprintf(stderr, "Cannot open %s\n", filename);
+    return 1;
+  }
+  FlopCounter::report(out);
+  if (filename && fclose(out) != 0) {
+    fprintf(stderr, "Cannot write %s\n", filename);
+    return 1;
+  }
+  return 0;
+}
+
+void hmat_flops_reset(void) {
+  FlopCounter::reset();
+}
+
+int hmat_memory_report(const char *filename) {
+  try {
+    MemoryInstrumenter::instance().writeReport(filename);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+
+void hmat_memory_enable(int enabled) {
+  MemoryInstrumenter::instance().enableReport(enabled != 0);
+}
+
+void hmat_memory_usage(size_t * live, size_t * peak) {
+  MemoryInstrumenter::mem_t l, p;
+  MemoryInstrumenter::instance().usage(l, p);
+  // Arrays allocated before the accounting was enabled may be freed later
+  *live = l > 0 ? l : 0;
+  *peak = p > 0 ? p : 0;
+}
+
+void hmat_memory_reset_peaks(void) {
+  MemoryInstrumenter::instance().resetPeaks();
+}
+
+void hmat_assembly_stats_enable(int enabled) {
+  AssemblyStats::enable(enabled != 0);
+}
+
+int hmat_assembly_stats_count(void) {
+  return AssemblyStats::count();
+}
+
+int hmat_assembly_stats_get(int index, hmat_block_stats_t * stats) {
+  if (index < 0 || !AssemblyStats::get(index, *stats))
+    return 1;
+  return 0;
+}
+
+void hmat_assembly_stats_clear(void) {
+  AssemblyStats::clear();
+}
+
 hmat_progress_t * hmat_default_progress() {
     return DefaultProgress::getInstance();
 }
@@ -32,6 +32,12 @@
 #include "h_matrix.hpp"
 #include "uncompressed_values.hpp"
 #include "serialization.hpp"
+#include "checkpoint.hpp"
+#include "shared_matrix.hpp"
+#include "structure_cache.hpp"
+#include "admissibility.hpp"
+#include "clustering.hpp"
+#include "coordinates.hpp"
 #include "hmat_cpp_interface.hpp"
 #include "disable_threading.hpp"
 
@@ -53,6 +59,48 @@ hmat_matrix_t * create_empty_hmatrix_admissibility(
             sym, (hmat::AdmissibilityCondition*)condition);
 }
 
+template<typename T, template <typename> class E>
+hmat_matrix_t * create_empty_hmatrix_cached(const char * filename,
+  const hmat_cluster_tree_create_context_t * ctx, int lower_sym,
+  hmat_admissibility_t* condition)
+{
+  DECLARE_CONTEXT;
+  try {
+    hmat::SymmetryFlag sym = lower_sym ? hmat::kLowerSymmetric : hmat::kNotSymmetric;
+    hmat::DofCoordinates dofs(ctx->coordinates, ctx->dimension, ctx->number_of_points, true,
+                              ctx->number_of_dof, ctx->span_offsets, ctx->spans);
+    const hmat::ClusterTreeBuilder * builder = reinterpret_cast<const hmat::ClusterTreeBuilder*>(ctx->builder);
+    hmat::AdmissibilityCondition * cond = (hmat::AdmissibilityCondition*)condition;
+    // Without a key, another condition or clustering could share the key of a cached structure
+    const bool cached = !cond->cacheKey().empty() && !builder->cacheKey().empty();
+    uint64_t key = 0;
+    if (cached) {
+      key = hmat::structureKey(hmat::Types<T>::TYPE, dofs, ctx->group_index, *builder, *cond, sym);
+      hmat::HMatrix<T> * m = hmat::readStructureCache<T>(&hmat::HMatSettings::getInstance(), filename, key, dofs);
+      if (m != NULL)
+        return (hmat_matrix_t*) new hmat::HMatInterface<T>(new E<T>(), m);
+    } else {
+      fprintf(stderr, "%s cannot be identified, the structure cache %s is not used\n",
+              cond->cacheKey().empty() ? cond->str().c_str() : builder->str().c_str(), filename);
+    }
+    hmat::ClusterTree * tree = builder->build(dofs, ctx->group_index);
+    hmat::HMatInterface<T> * r = new hmat::HMatInterface<T>(new E<T>(), tree, tree, sym, cond);
+    r->engine().hmat->ownClusterTrees(true, false);
+    if (cached) {
+      try {
+        hmat::writeStructureCache(r->engine().hmat, filename, key);
+      } catch (const std::exception& e) {
+        // The matrix is usable, only the next run will be slower
+        fprintf(stderr, "%s\n", e.what());
+      }
+    }
+    return (hmat_matrix_t*) r;
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return NULL;
+  }
+}
+
 template<typename T, template <typename> class E>
 int assemble_generic(hmat_matrix_t* matrix, hmat_assemble_context_t * ctx) {
     DECLARE_CONTEXT;
@@ -65,26 +113,28 @@ int assemble_generic(hmat_matrix_t* matrix, hmat_assemble_context_t * ctx) {
         }
         HMAT_ASSERT_MSG(ctx->compression, "No compression algorithm defined in hmat_assemble_context_t");
         hmat::CompressionAlgorithm* compression = (hmat::CompressionAlgorithm*)ctx->compression;
+        hmat::Assembly<T> * f = NULL;
+        bool ownAssembly = true;
         if(ctx->assembly != NULL) {
             HMAT_ASSERT(ctx->block_compute == NULL && ctx->advanced_compute == NULL && ctx->simple_compute == NULL);
-            hmat::Assembly<T> * cppAssembly = (hmat::Assembly<T> *)ctx->assembly;
-            hmat->assemble(*cppAssembly, sf, ctx->progress);
+            f = (hmat::Assembly<T> *)ctx->assembly;
+            ownAssembly = false;
         } else if(ctx->block_compute != NULL || ctx->advanced_compute != NULL) {
             HMAT_ASSERT(ctx->simple_compute == NULL && ctx->assembly == NULL);
             HMAT_ASSERT(ctx->prepare != NULL);
             hmat::BlockFunction<T> blockFunction(hmat->rows(), hmat->cols(),
                 ctx->user_context, ctx->prepare, ctx->block_compute, ctx->advanced_compute);
-            hmat::AssemblyFunction<T, hmat::BlockFunction> * f =
-                new hmat::AssemblyFunction<T, hmat::BlockFunction>(blockFunction, compression);
-            hmat->assemble(*f, sf, true, ctx->progress, true);
+            f = new hmat::AssemblyFunction<T, hmat::BlockFunction>(blockFunction, compression);
         } else if(ctx->simple_compute != NULL) {
             HMAT_ASSERT(ctx->block_compute == NULL && ctx->advanced_compute == NULL && ctx->assembly == NULL);
-            hmat::AssemblyFunction<T, hmat::SimpleFunction> * f =
-                new hmat::AssemblyFunction<T, hmat::SimpleFunction>(
+            f = new hmat::AssemblyFunction<T, hmat::SimpleFunction>(
                 hmat::SimpleFunction<T>(ctx->simple_compute, ctx->user_context), compression);
-            hmat->assemble(*f, sf, true, ctx->progress, true);
         } else
           HMAT_ASSERT_MSG(0, "No valid assembly method in assemble_generic()");
+        if(ctx->partial)
+            hmat->assemblePartial(*f, sf, ctx->progress, ownAssembly);
+        else
+            hmat->assemble(*f, sf, true, ctx->progress, ownAssembly);
 
         if(!assembleOnly)
             hmat->factorize(hmat::convert_int_to_factorization(ctx->factorization), ctx->progress);
@@ -140,7 +190,8 @@ int factorize_generic(hmat_matrix_t* holder, hmat_factorization_context_t * ctx)
     DECLARE_CONTEXT;
     hmat::HMatInterface<T>* hmat = (hmat::HMatInterface<T>*) holder;
     try {
-        hmat->factorize(hmat::convert_int_to_factorization(ctx->factorization), ctx->progress);
+        hmat->factorize(hmat::convert_int_to_factorization(ctx->factorization), ctx->progress,
+                        ctx->checkpoint);
     } catch (const std::exception& e) {
         fprintf(stderr, "%s\n", e.what());
         return 1;
@@ -827,6 +878,53 @@ hmat_matrix_t * read_struct(hmat_iostream readfunc, void * user_data) {
     return (hmat_matrix_t*) r;
 }
 
+template <typename T, template <typename> class E>
+hmat_matrix_t * read_checkpoint(hmat_iostream readfunc, void * user_data) {
+  DECLARE_CONTEXT;
+  try {
+    int resumeRow;
+    hmat::Factorization factorization;
+    hmat::HMatrix<T> * m = hmat::readCheckpoint<T>(&hmat::HMatSettings::getInstance(), readfunc, user_data,
+                                                   &resumeRow, &factorization);
+    hmat::HMatInterface<T> * r = new hmat::HMatInterface<T>(new E<T>(), m);
+    r->resumeFactorization(factorization, resumeRow);
+    return (hmat_matrix_t*) r;
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return NULL;
+  }
+}
+
+template <typename T, template <typename> class E>
+int publish_shared(hmat_matrix_t* holder, const char * name) {
+  DECLARE_CONTEXT;
+  try {
+    hmat::HMatInterface<T> * hmi = (hmat::HMatInterface<T> *) holder;
+    hmat::publishShared(hmi->engine().hmat, hmi->factorization(), name);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+
+template <typename T, template <typename> class E>
+hmat_matrix_t * attach_shared(const char * name) {
+  DECLARE_CONTEXT;
+  try {
+    hmat::SharedSegment * segment;
+    hmat::Factorization factorization;
+    hmat::HMatrix<T> * m = hmat::attachShared<T>(&hmat::HMatSettings::getInstance(), name,
+                                                 &segment, &factorization);
+    hmat::HMatInterface<T> * r = new hmat::HMatInterface<T>(new E<T>(), m, factorization);
+    r->ownSegment(segment);
+    return (hmat_matrix_t*) r;
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return NULL;
+  }
+}
+
 template <typename T, template <typename> class E>
 void read_data(hmat_matrix_t * matrix, hmat_iostream readfunc, void * user_data) {
     hmat::HMatInterface<T> * hmi = (hmat::HMatInterface<T> *) matrix;
@@ -846,6 +944,97 @@ void write_data(hmat_matrix_t* matrix, hmat_iostream writefunc, void * user_data
     hmat::MatrixDataMarshaller<T>(writefunc, user_data).write(hmi->engine().hmat);
 }
 
+template <typename T, template <typename> class E>
+int write_matrix(hmat_matrix_t* matrix, hmat_iostream writefunc, void * user_data) {
+  DECLARE_CONTEXT;
+  try {
+    hmat::HMatInterface<T> * hmi = (hmat::HMatInterface<T> *) matrix;
+    hmat::writeMatrixFile(hmi->engine().hmat, hmi->factorization(), writefunc, user_data);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+
+template <typename T, template <typename> class E>
+hmat_matrix_t * read_matrix(hmat_iostream readfunc, void * user_data) {
+  DECLARE_CONTEXT;
+  try {
+    hmat::Factorization factorization;
+    hmat::HMatrix<T> * m = hmat::readMatrixFile<T>(&hmat::HMatSettings::getInstance(), readfunc, user_data,
+                                                   &factorization);
+    return (hmat_matrix_t*) new hmat::HMatInterface<T>(new E<T>(), m, factorization);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return NULL;
+  }
+}
+
+template <typename T, template <typename> class E>
+int write_rank_history(hmat_matrix_t* matrix, const char * filename) {
+  DECLARE_CONTEXT;
+  try {
+    hmat::HMatInterface<T> * hmi = (hmat::HMatInterface<T> *) matrix;
+    std::deque<const hmat::HMatrix<T> *> leaves;
+    hmi->engine().hmat->listAllLeaves(leaves);
+    hmat::RankHistory history;
+    for (size_t i = 0; i < leaves.size(); ++i) {
+      if (leaves[i]->isRkMatrix())
+        history.add(*leaves[i]->rows(), *leaves[i]->cols(), leaves[i]->rank());
+    }
+    history.write(filename);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+
+template <typename T, template <typename> class E>
+int reuse_blocks(hmat_matrix_t* matrix, hmat_matrix_t* previous,
+                 const int * rows_old_to_new, const int * cols_old_to_new) {
+  DECLARE_CONTEXT;
+  try {
+    hmat::HMatInterface<T> * hmi = (hmat::HMatInterface<T> *) matrix;
+    return hmi->reuseBlocks(*(hmat::HMatInterface<T> *) previous, rows_old_to_new, cols_old_to_new);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return -1;
+  }
+}
+
+template <typename T, template <typename> class E>
+int reset_dirty_blocks(hmat_matrix_t* matrix, const char * rows_dirty, const char * cols_dirty,
+                       hmat_admissibility_t * cond) {
+  DECLARE_CONTEXT;
+  try {
+    hmat::HMatInterface<T> * hmi = (hmat::HMatInterface<T> *) matrix;
+    return hmi->resetDirtyBlocks(rows_dirty, cols_dirty, (hmat::AdmissibilityCondition*) cond);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return -1;
+  }
+}
+
+template <typename T, template <typename> class E>
+void write_data_quantized(hmat_matrix_t* matrix, hmat_iostream writefunc, void * user_data) {
+    hmat::HMatInterface<T> * hmi = (hmat::HMatInterface<T> *) matrix;
+    hmat::MatrixDataMarshaller<T>(writefunc, user_data, true).write(hmi->engine().hmat);
+}
+
+template <typename T, template <typename> class E>
+int pack_rk(hmat_matrix_t* holder, int pack) {
+  DECLARE_CONTEXT;
+  try {
+      ((hmat::HMatInterface<T>*)holder)->engine().hmat->packRk(pack != 0);
+  } catch (const std::exception& e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+  }
+  return 0;
+}
+
 template <typename T>
 void set_progressbar(hmat_matrix_t * matrix, hmat_progress_t * progress) {
     reinterpret_cast<hmat::HMatInterface<T> *>(matrix)->progress(progress);
@@ -901,6 +1090,17 @@ static void createCInterface(hmat_interface_t * i)
     i->write_struct = write_struct<T, E>;
     i->write_data = write_data<T, E>;
     i->read_data = read_data<T, E>;
+    i->write_data_quantized = write_data_quantized<T, E>;
+    i->pack_rk = pack_rk<T, E>;
+    i->read_checkpoint = read_checkpoint<T, E>;
+    i->publish_shared = publish_shared<T, E>;
+    i->attach_shared = attach_shared<T, E>;
+    i->create_empty_hmatrix_cached = create_empty_hmatrix_cached<T, E>;
+    i->write_matrix = write_matrix<T, E>;
+    i->read_matrix = read_matrix<T, E>;
+    i->write_rank_history = write_rank_history<T, E>;
+    i->reuse_blocks = reuse_blocks<T, E>;
+    i->reset_dirty_blocks = reset_dirty_blocks<T, E>;
     i->apply_on_leaf = apply_on_leaf<T, E>;
     i->axpy = axpy<T, E>;
     i->trsm = trsm<T, E>;
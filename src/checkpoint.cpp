@@ -0,0 +1,83 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "checkpoint.hpp"
+#include "serialization.hpp"
+#include "common/context.hpp"
+#include "common/my_assert.h"
+
+namespace hmat {
+
+template<typename T>
+StreamCheckpoint<T>::StreamCheckpoint(const HMatrix<T> * root, Factorization algo,
+                                      const hmat_checkpoint_t * hooks, int resumeRow)
+    : root_(root), algo_(algo), hooks_(hooks), resumeRow_(resumeRow), last_(now()) {
+    HMAT_ASSERT_MSG(hooks == NULL || (hooks->open && hooks->write && hooks->close),
+                    "Checkpoint open, write and close functions must be set");
+}
+
+template<typename T> void StreamCheckpoint<T>::stepDone(int rowEnd) {
+    if (hooks_ == NULL || time_diff(last_, now()) < hooks_->interval)
+        return;
+    write(rowEnd);
+    // Do not count the time spent writing in the interval
+    last_ = now();
+}
+
+template<typename T> void StreamCheckpoint<T>::write(int rowEnd) const {
+    DECLARE_CONTEXT;
+    void * stream = hooks_->open(hooks_->user_data);
+    if (stream == NULL)
+        return;
+    // The matrix is not factorized yet, only the trailer tells how far it is
+    MatrixStructMarshaller<T>(hooks_->write, stream).write(root_, Factorization::NONE);
+    MatrixDataMarshaller<T>(hooks_->write, stream).write(root_);
+    int algo = convert_factorization_to_int(algo_);
+    hooks_->write(&algo, sizeof(algo), stream);
+    hooks_->write(&rowEnd, sizeof(rowEnd), stream);
+    hooks_->close(stream, hooks_->user_data);
+}
+
+template<typename T>
+HMatrix<T> * readCheckpoint(MatrixSettings * settings, hmat_iostream readfunc, void * user_data,
+                            int * resumeRow, Factorization * factorization) {
+    DECLARE_CONTEXT;
+    HMatrix<T> * m = MatrixStructUnmarshaller<T>(settings, readfunc, user_data).read();
+    MatrixDataUnmarshaller<T>(readfunc, user_data).read(m);
+    int algo;
+    readfunc(&algo, sizeof(algo), user_data);
+    readfunc(resumeRow, sizeof(*resumeRow), user_data);
+    *factorization = convert_int_to_factorization(algo);
+    return m;
+}
+
+// Templates declaration
+template class StreamCheckpoint<S_t>;
+template class StreamCheckpoint<D_t>;
+template class StreamCheckpoint<C_t>;
+template class StreamCheckpoint<Z_t>;
+template HMatrix<S_t> * readCheckpoint(MatrixSettings *, hmat_iostream, void *, int *, Factorization *);
+template HMatrix<D_t> * readCheckpoint(MatrixSettings *, hmat_iostream, void *, int *, Factorization *);
+template HMatrix<C_t> * readCheckpoint(MatrixSettings *, hmat_iostream, void *, int *, Factorization *);
+template HMatrix<Z_t> * readCheckpoint(MatrixSettings *, hmat_iostream, void *, int *, Factorization *);
+
+}  // end namespace hmat
@@ -0,0 +1,74 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Checkpoint and resume of the factorizations.
+*/
+#pragma once
+
+#include "h_matrix.hpp"
+#include "common/chrono.h"
+
+namespace hmat {
+
+/*! \brief FactorizationCheckpoint writing the whole matrix to user streams.
+
+  A checkpoint is the matrix structure (as an unfactorized matrix), the
+  matrix data, the factorization type and the row at which the
+  factorization must be resumed, in that order. It can be read back with
+  readCheckpoint().
+ */
+template<typename T> class StreamCheckpoint : public FactorizationCheckpoint {
+  const HMatrix<T> * root_;
+  Factorization algo_;
+  const hmat_checkpoint_t * hooks_;
+  int resumeRow_;
+  Time last_;
+public:
+  /**
+   * @param root the matrix being factorized
+   * @param algo the factorization
+   * @param hooks where and how often to write the checkpoints, NULL to only resume
+   * @param resumeRow the row returned by readCheckpoint(), or 0 to start from scratch
+   */
+  StreamCheckpoint(const HMatrix<T> * root, Factorization algo,
+                   const hmat_checkpoint_t * hooks, int resumeRow);
+  bool skip(int rowEnd) const override {
+      return rowEnd <= resumeRow_;
+  }
+  void stepDone(int rowEnd) override;
+  /** Write a checkpoint now */
+  void write(int rowEnd) const;
+};
+
+/**
+ * Read a checkpoint written by StreamCheckpoint.
+ * @param resumeRow set to the row at which the factorization must be resumed
+ * @param factorization set to the factorization in progress
+ * @return the partially factorized matrix
+ */
+template<typename T>
+HMatrix<T> * readCheckpoint(MatrixSettings * settings, hmat_iostream readfunc, void * user_data,
+                            int * resumeRow, Factorization * factorization);
+
+}  // end namespace hmat
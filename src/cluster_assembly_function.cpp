@@ -27,12 +27,15 @@
 #include "cluster_assembly_function.hpp"
 #include "scalar_array.hpp"
 #include "h_matrix.hpp"
+#include "assembly_stats.hpp"
 
 namespace hmat {
 
 
   template<typename T>
   void hmat::ClusterAssemblyFunction<T>::getRow(int index, Vector<typename Types<T>::dp> &result) const {
+    AssemblyStats::countCall(AssemblyStats::GET_ROW);
+    AssemblyStats::Timer timer(AssemblyStats::KERNEL);
     if (!HMatrix<T>::validateNullRowCol) {
       // Normal mode: we compute except if a function is_guaranteed_null_row() is provided and tells it's null
       if (!info.is_guaranteed_null_row || !info.is_guaranteed_null_row(&info, index, stratum))
@@ -48,6 +51,8 @@ namespace hmat {
 
   template<typename T>
   void hmat::ClusterAssemblyFunction<T>::getCol(int index, Vector<typename Types<T>::dp> &result) const {
+    AssemblyStats::countCall(AssemblyStats::GET_COL);
+    AssemblyStats::Timer timer(AssemblyStats::KERNEL);
     if (!HMatrix<T>::validateNullRowCol) {
       // Normal mode: we compute except if a function is_guaranteed_null_col() is provided and tells it's null
       if (!info.is_guaranteed_null_col || !info.is_guaranteed_null_col(&info, index, stratum))
@@ -62,6 +67,8 @@ namespace hmat {
 
   template<typename T>
   typename Types<T>::dp hmat::ClusterAssemblyFunction<T>::getElement(int rowIndex, int colIndex) const {
+    AssemblyStats::countCall(AssemblyStats::GET_ELEMENT);
+    AssemblyStats::Timer timer(AssemblyStats::KERNEL);
     if (!HMatrix<T>::validateNullRowCol) {
       // Normal mode: we compute except if a function is_guaranteed_null_col/row() is provided and tells it's null
       bool colNotGuaranteedNull =
@@ -92,8 +99,11 @@ namespace hmat {
       }
       return new FullMatrix<typename Types<T>::dp>(mat, rows, cols);
     }
-    if (info.block_type != hmat_block_null)
+    if (info.block_type != hmat_block_null) {
+      AssemblyStats::countCall(AssemblyStats::ASSEMBLE);
+      AssemblyStats::Timer timer(AssemblyStats::KERNEL);
       return f.assemble(rows, cols, &info, allocationObserver_) ;
+    }
     else
       // TODO return NULL
       return new FullMatrix<typename Types<T>::dp>(rows, cols);
@@ -102,6 +112,7 @@ namespace hmat {
 
   template<typename T>
   ClusterAssemblyFunction<T>::~ClusterAssemblyFunction() {
+    AssemblyStats::Timer timer(AssemblyStats::KERNEL);
     f.releaseBlock(&info, allocationObserver_);
   }
 
@@ -110,6 +121,7 @@ namespace hmat {
                                                       const ClusterData *_cols,
                                                       const AllocationObserver &allocationObserver)
       : f(_f), rows(_rows), cols(_cols), stratum(-1), allocationObserver_(allocationObserver) {
+    AssemblyStats::Timer timer(AssemblyStats::KERNEL);
     f.prepareBlock(rows, cols, &info, allocationObserver_);
     assert((info.user_data == NULL) == (info.release_user_data == NULL));
   }
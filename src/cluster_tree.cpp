@@ -33,6 +33,62 @@
 
 #include <algorithm>
 #include <cstring>
+#include <limits>
+
+namespace {
+/**
+ * Eigenvectors of the symmetric n x n matrix a (overwritten) with the cyclic
+ * Jacobi method. v[k * n + d] is the coordinate d of the k-th eigenvector, by
+ * decreasing eigenvalue.
+ */
+void symmetricEigenvectors(int n, double * a, double * v) {
+  std::vector<double> rotations(n * n, 0.0);
+  for (int i = 0; i < n; i++)
+    rotations[i * n + i] = 1;
+  for (int sweep = 0; sweep < 50; sweep++) {
+    double offDiagonal = 0, diagonal = 0;
+    for (int i = 0; i < n; i++) {
+      diagonal += a[i * n + i] * a[i * n + i];
+      for (int j = i + 1; j < n; j++)
+        offDiagonal += a[i * n + j] * a[i * n + j];
+    }
+    if (offDiagonal <= 1e-30 * diagonal)
+      break;
+    for (int p = 0; p < n; p++) {
+      for (int q = p + 1; q < n; q++) {
+        if (a[p * n + q] == 0)
+          continue;
+        const double theta = (a[q * n + q] - a[p * n + p]) / (2 * a[p * n + q]);
+        const double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+        const double c = 1 / sqrt(t * t + 1);
+        const double s = t * c;
+        for (int k = 0; k < n; k++) {
+          const double akp = a[k * n + p], akq = a[k * n + q];
+          a[k * n + p] = c * akp - s * akq;
+          a[k * n + q] = s * akp + c * akq;
+        }
+        for (int k = 0; k < n; k++) {
+          const double apk = a[p * n + k], aqk = a[q * n + k];
+          a[p * n + k] = c * apk - s * aqk;
+          a[q * n + k] = s * apk + c * aqk;
+        }
+        for (int k = 0; k < n; k++) {
+          const double vkp = rotations[k * n + p], vkq = rotations[k * n + q];
+          rotations[k * n + p] = c * vkp - s * vkq;
+          rotations[k * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  std::vector<std::pair<double, int> > eigenvalues(n);
+  for (int i = 0; i < n; i++)
+    eigenvalues[i] = std::make_pair(-a[i * n + i], i);
+  std::sort(eigenvalues.begin(), eigenvalues.end());
+  for (int k = 0; k < n; k++)
+    for (int d = 0; d < n; d++)
+      v[k * n + d] = rotations[d * n + eigenvalues[k].second];
+}
+}
 
 namespace hmat {
 
@@ -110,6 +166,15 @@ DofData::copy() const
   return result;
 }
 
+void
+DofData::coordinates(const DofCoordinates& coordinates)
+{
+  HMAT_ASSERT_MSG(coordinates.numberOfDof() == coordinates_->numberOfDof(),
+                  "Expected %d DOFs, got %d", (int) coordinates_->numberOfDof(), (int) coordinates.numberOfDof());
+  delete coordinates_;
+  coordinates_ = new DofCoordinates(coordinates);
+}
+
 void ClusterData::moveDoF(int index, ClusterData* right)
 {
   HMAT_ASSERT(offset_ + size_ == right->offset_ );
@@ -191,6 +256,11 @@ ClusterTree* ClusterTree::copy(const ClusterTree* copyFather) const {
   return result;
 }
 
+void ClusterTree::coordinates(const DofCoordinates& coordinates) {
+  HMAT_ASSERT_MSG(father == NULL, "Only the root of a ClusterTree can be moved");
+  const_cast<DofData*>(data.dofData_)->coordinates(coordinates);
+}
+
 void ClusterTree::swap(ClusterTree* other) {
   HMAT_ASSERT(father == NULL && other->father == NULL);
   std::swap(data, other->data);
@@ -219,13 +289,30 @@ AxisAlignedBoundingBox::AxisAlignedBoundingBox(const ClusterData& data)
         bb_[i + dimension_] = bb_[i];
     }
 
-    for (unsigned i = 1; i < data.size(); ++i) {
-        int dof = myIndices[i];
-        for (unsigned pointId = 0; pointId < coords.spanSize(dof); pointId++)
-            coords.spanAABB(dof, bb_);
+    coords.spanAABB(myIndices + 1, data.size() - 1, bb_);
+}
+
+AxisAlignedBoundingBox::AxisAlignedBoundingBox(unsigned dimension)
+    : dimension_(dimension)
+    , bb_(new double[2 * dimension_])
+{
+    std::fill(bb_, bb_ + dimension_, std::numeric_limits<double>::infinity());
+    std::fill(bb_ + dimension_, bb_ + 2 * dimension_, -std::numeric_limits<double>::infinity());
+}
+
+void AxisAlignedBoundingBox::merge(const AxisAlignedBoundingBox& other) {
+    assert(other.dimension_ == dimension_);
+    for (unsigned i = 0; i < dimension_; i++) {
+        bb_[i] = std::min(bb_[i], other.bb_[i]);
+        bb_[i + dimension_] = std::max(bb_[i + dimension_], other.bb_[i + dimension_]);
     }
 }
 
+void AxisAlignedBoundingBox::merge(const DofCoordinates& coordinates, const int * dofs, int n) {
+    assert(coordinates.dimension() == dimension_);
+    coordinates.spanAABB(dofs, n, bb_);
+}
+
 AxisAlignedBoundingBox::~AxisAlignedBoundingBox() {
     delete[] bb_;
 }
@@ -295,5 +382,84 @@ void AxisAlignedBoundingBox::bbMax(const double * bbMax) {
         bb_[i + dimension_] = bbMax[i];
 }
 
+void principalAxes(const ClusterData& data, double * center, double * axes) {
+  const DofCoordinates& coords = *data.coordinates();
+  const int dimension = coords.dimension();
+  const int* myIndices = data.indices() + data.offset();
+  coords.centroid(myIndices, data.size(), center);
+  std::vector<double> cov(dimension * dimension);
+  coords.covariance(myIndices, data.size(), center, cov.data());
+  symmetricEigenvectors(dimension, cov.data(), axes);
+}
+
+OrientedBoundingBox::OrientedBoundingBox(const ClusterData& data)
+    : dimension_(data.coordinates()->dimension()), center_(dimension_), axes_(dimension_ * dimension_),
+      halfExtents_(dimension_, 0.0)
+{
+  principalAxes(data, center_.data(), axes_.data());
+  if (data.size() == 0)
+    return;
+  const DofCoordinates& coords = *data.coordinates();
+  const int* myIndices = data.indices() + data.offset();
+  std::vector<double> lower(dimension_, std::numeric_limits<double>::infinity());
+  std::vector<double> upper(dimension_, -std::numeric_limits<double>::infinity());
+  std::vector<double> point(dimension_);
+  for (int i = 0; i < data.size(); i++) {
+    const unsigned dof = myIndices[i];
+    for (unsigned p = 0; p < coords.spanSize(dof); p++) {
+      for (unsigned d = 0; d < dimension_; d++)
+        point[d] = coords.spanPoint(dof, p, d) - center_[d];
+      for (unsigned k = 0; k < dimension_; k++) {
+        double projection = 0;
+        for (unsigned d = 0; d < dimension_; d++)
+          projection += point[d] * axes_[k * dimension_ + d];
+        lower[k] = std::min(lower[k], projection);
+        upper[k] = std::max(upper[k], projection);
+      }
+    }
+  }
+  // Center the box on the extents
+  for (unsigned k = 0; k < dimension_; k++) {
+    const double middle = (lower[k] + upper[k]) / 2;
+    for (unsigned d = 0; d < dimension_; d++)
+      center_[d] += middle * axes_[k * dimension_ + d];
+    halfExtents_[k] = (upper[k] - lower[k]) / 2;
+  }
+}
+
+double OrientedBoundingBox::diameter() const {
+  double result = 0;
+  for (unsigned k = 0; k < dimension_; k++)
+    result += halfExtents_[k] * halfExtents_[k];
+  return 2 * sqrt(result);
+}
+
+double OrientedBoundingBox::radius(const double * u) const {
+  double result = 0;
+  for (unsigned k = 0; k < dimension_; k++) {
+    double dot = 0;
+    for (unsigned d = 0; d < dimension_; d++)
+      dot += axes_[k * dimension_ + d] * u[d];
+    result += halfExtents_[k] * fabs(dot);
+  }
+  return result;
+}
+
+double OrientedBoundingBox::distanceTo(const OrientedBoundingBox& other) const {
+  assert(other.dimension_ == dimension_);
+  double result = 0;
+  for (int box = 0; box < 2; box++) {
+    const OrientedBoundingBox& b = box == 0 ? *this : other;
+    for (unsigned k = 0; k < dimension_; k++) {
+      const double * u = b.axis(k);
+      double centers = 0;
+      for (unsigned d = 0; d < dimension_; d++)
+        centers += (other.center_[d] - center_[d]) * u[d];
+      result = std::max(result, fabs(centers) - radius(u) - other.radius(u));
+    }
+  }
+  return result;
+}
+
 }  // end namespace hmat
 
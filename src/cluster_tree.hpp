@@ -106,6 +106,8 @@ public:
 
   DofData* copy() const;
   inline int size() const { return coordinates_->numberOfDof(); }
+  /** @brief Replace the coordinates by new ones with the same number of DOFs */
+  void coordinates(const DofCoordinates& coordinates);
 
 private:
   /// Indices array
@@ -186,6 +188,13 @@ public:
    */
   void swap(ClusterTree* other);
 
+  /*! \brief Move the DOFs of a root ClusterTree, keeping its partition.
+
+      The new coordinates must have the same number of DOFs. The partition is
+      not updated, only the geometry seen by the admissibility conditions.
+   */
+  void coordinates(const DofCoordinates& coordinates);
+
   /*! \brief Return a short string describing the content of this ClusterTree for debug (like: "[320, 452]")
     */
   std::string description() const {
@@ -200,7 +209,14 @@ class AxisAlignedBoundingBox
     double * bb_;
 public:
     explicit AxisAlignedBoundingBox(const ClusterData& node);
+    /** @brief Empty box, to be extended with merge() */
+    explicit AxisAlignedBoundingBox(unsigned dimension);
     ~AxisAlignedBoundingBox();
+    unsigned dimension() const { return dimension_; }
+    /** @brief Extend this box so that it contains other */
+    void merge(const AxisAlignedBoundingBox& other);
+    /** @brief Extend this box so that it contains all the spans of n DOFs */
+    void merge(const DofCoordinates& coordinates, const int * dofs, int n);
     double extends(int dim) const;
     int greatestDim() const;
     double diameter() const;
@@ -222,6 +238,43 @@ public:
     }
 };
 
+/*! \brief Principal axes of the span centers of a node.
+
+  \param center receives the mean of the span centers (dimension values)
+  \param axes receives dimension orthonormal vectors, axes[k * dimension + d]
+  being the coordinate d of the k-th axis, by decreasing variance
+ */
+void principalAxes(const ClusterData& data, double * center, double * axes);
+
+/*! \brief Bounding box aligned on the principal axes of a node.
+
+  It contains all the span points of the DOFs. For thin slanted clusters, it
+  is much smaller than the AxisAlignedBoundingBox.
+ */
+class OrientedBoundingBox
+{
+    const unsigned dimension_;
+    /// Center of the box
+    std::vector<double> center_;
+    /// Orthonormal axes, axes_[k * dimension_ + d]
+    std::vector<double> axes_;
+    /// Half length of the box along each axis
+    std::vector<double> halfExtents_;
+    /// Half length of the projection of this box on u
+    double radius(const double * u) const;
+public:
+    explicit OrientedBoundingBox(const ClusterData& node);
+    double diameter() const;
+    /** @brief Lower bound of the distance between 2 boxes.
+
+        This is the largest gap between the projections of the boxes on the
+        axes of both boxes (separating axes).
+     */
+    double distanceTo(const OrientedBoundingBox& other) const;
+    const double * axis(int k) const { return &axes_[k * dimension_]; }
+    double halfExtent(int k) const { return halfExtents_[k]; }
+};
+
 }  // end namespace hmat
 
 #endif
@@ -22,11 +22,18 @@
 
 #include "clustering.hpp"
 #include "cluster_tree.hpp"
+#include "admissibility.hpp"
 #include "common/my_assert.h"
 #include "hmat_cpp_interface.hpp"
 
 #include <algorithm>
+#include <map>
 #include <cstring>
+#include <sstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace {
 
@@ -35,25 +42,174 @@ namespace {
 class IndicesComparator
 {
 private:
-  const hmat::DofCoordinates * coordinates_;
+  const double * centers_;
   const int* group_index_;
-  const int dimension_;
-  const int axis_;
 
 public:
   IndicesComparator(int axis, const hmat::ClusterData& data)
-    : coordinates_(data.coordinates())
+    : centers_(data.coordinates()->spanCenters(axis))
     , group_index_(data.group_index())
-    , dimension_(data.coordinates()->dimension())
-    , axis_(axis)
   {}
   bool operator() (int i, int j) {
     if (group_index_ == NULL || group_index_[i] == group_index_[j])
-      return coordinates_->spanCenter(i, axis_) < coordinates_->spanCenter(j, axis_);
+      return centers_[i] < centers_[j];
     return group_index_[i] < group_index_[j];
   }
 };
 
+/*! \brief Compare two DOF indices as sortByDimension would order them
+    after the sorts along sortAxes (see ClusteringAlgorithm::selectPartition).
+
+    Without group index, a stable sort along axis a of a node sorted along b
+    orders its DOF by their coordinate along a, then along b, and so on up to
+    the root, where they are ordered by number.
+ */
+class AxisChainComparator
+{
+private:
+  const hmat::DofCoordinates * coordinates_;
+  const std::vector<int>& sortAxes_;
+  const int axis_;
+
+public:
+  AxisChainComparator(int axis, const std::vector<int>& sortAxes, const hmat::ClusterData& data)
+    : coordinates_(data.coordinates())
+    , sortAxes_(sortAxes)
+    , axis_(axis)
+  {}
+  bool operator() (int i, int j) const {
+    if (axis_ >= 0) {
+      const double * c = coordinates_->spanCenters(axis_);
+      if (c[i] < c[j]) return true;
+      if (c[j] < c[i]) return false;
+    }
+    for (int k = (int)sortAxes_.size() - 1; k >= 0; --k) {
+      const double * c = coordinates_->spanCenters(sortAxes_[k]);
+      if (c[i] < c[j]) return true;
+      if (c[j] < c[i]) return false;
+    }
+    return i < j;
+  }
+};
+
+/** @brief Compare a DOF coordinate to a threshold */
+class BelowPosition
+{
+  const double * centers_;
+  const double position_;
+public:
+  BelowPosition(const hmat::DofCoordinates& coordinates, int axis, double position)
+    : centers_(coordinates.spanCenters(axis)), position_(position) {}
+  bool operator()(int i) const {
+    return centers_[i] < position_;
+  }
+};
+
+/** Nodes smaller than this are split in the task of their parent */
+const int SELECT_TASK_MIN_SIZE = 8192;
+
+/** Insert two 0 bits between each of the 21 lowest bits of x */
+inline uint64_t spreadBits3(uint32_t x)
+{
+  uint64_t v = x & 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
+}
+
+/** Number of bits sorted by each pass of radixSortByCode */
+const int RADIX_BITS = 11;
+const int RADIX_BUCKETS = 1 << RADIX_BITS;
+
+/** Arrays smaller than this are radix sorted by a single thread */
+const int RADIX_TASK_MIN_SIZE = 65536;
+
+/*! \brief Stable LSD radix sort of DOF indices by their 64 bits code.
+
+    Codes are copied next to the indices so the passes read memory
+    sequentially. Each pass sorts RADIX_BITS bits: threads count the digits of a
+    chunk of the array, then scatter this chunk after the chunks of the
+    previous threads, which keeps the sort stable. Passes where all the codes
+    have the same digit are skipped.
+ */
+void radixSortByCode(int* indices, int n, const std::vector<uint64_t>& codes)
+{
+  std::vector<std::pair<uint64_t, int> > buffer1(n), buffer2(n);
+  std::pair<uint64_t, int>* src = buffer1.data();
+  std::pair<uint64_t, int>* dst = buffer2.data();
+  int maxThreads = 1;
+#ifdef _OPENMP
+  if (n > RADIX_TASK_MIN_SIZE)
+    maxThreads = omp_get_max_threads();
+#endif
+  std::vector<size_t> counts(RADIX_BUCKETS * maxThreads);
+  bool skip = false;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(maxThreads)
+#endif
+  {
+    int thread = 0, nbThreads = 1;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+    nbThreads = omp_get_num_threads();
+#endif
+    const int begin = (int)((long)n * thread / nbThreads);
+    const int end = (int)((long)n * (thread + 1) / nbThreads);
+    size_t* myCounts = &counts[RADIX_BUCKETS * thread];
+    for (int i = begin; i < end; i++)
+      src[i] = std::make_pair(codes[indices[i]], indices[i]);
+    for (int shift = 0; shift < 64; shift += RADIX_BITS) {
+      std::fill(myCounts, myCounts + RADIX_BUCKETS, 0);
+      for (int i = begin; i < end; i++)
+        myCounts[(src[i].first >> shift) & (RADIX_BUCKETS - 1)]++;
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+      {
+        // Turn the counts into the scatter positions of each thread
+        size_t position = 0;
+        skip = false;
+        for (int digit = 0; digit < RADIX_BUCKETS; digit++) {
+          size_t total = 0;
+          for (int t = 0; t < nbThreads; t++) {
+            size_t c = counts[RADIX_BUCKETS * t + digit];
+            counts[RADIX_BUCKETS * t + digit] = position + total;
+            total += c;
+          }
+          skip = skip || total == (size_t) n;
+          position += total;
+        }
+      }
+      if (!skip) {
+        for (int i = begin; i < end; i++)
+          dst[myCounts[(src[i].first >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+      }
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+      if (!skip)
+        std::swap(src, dst);
+    }
+    for (int i = begin; i < end; i++)
+      indices[i] = src[i].second;
+  }
+}
+
+/** @brief Compare two DOF indices based on their code */
+class CodeComparator {
+    const std::vector<uint64_t>& codes_;
+public:
+    explicit CodeComparator(const std::vector<uint64_t>& codes) : codes_(codes) {}
+    bool operator()(int i, int j) const {
+        return codes_[i] < codes_[j];
+    }
+};
+
 /** @brief Compare two DOF based on their "large span" status */
 class LargeSpanComparator {
     const hmat::DofCoordinates& coordinates_;
@@ -70,6 +226,75 @@ public:
     }
 };
 
+/** @brief Append the leaves of node, from left to right */
+void collectLeaves(const hmat::ClusterTree& node, std::vector<const hmat::ClusterTree*>& leaves) {
+    if (node.isLeaf()) {
+        leaves.push_back(&node);
+        return;
+    }
+    for (int i = 0; i < node.nrChild(); ++i) {
+        if (node.getChild(i))
+            collectLeaves(*node.getChild(i), leaves);
+    }
+}
+
+/** @brief Bounding box of a node, computed on first use */
+const hmat::AxisAlignedBoundingBox& cachedBoundingBox(const hmat::ClusterTree& node,
+    std::map<const hmat::ClusterTree*, hmat::AxisAlignedBoundingBox*>& boxes) {
+    hmat::AxisAlignedBoundingBox*& box = boxes[&node];
+    if (box == NULL)
+        box = new hmat::AxisAlignedBoundingBox(node.data);
+    return *box;
+}
+
+/** @brief Go down from root to the leaf whose boxes are the nearest to dof */
+const hmat::ClusterTree* nearestLeaf(const hmat::ClusterTree& root, const hmat::AxisAlignedBoundingBox& dof,
+    std::map<const hmat::ClusterTree*, hmat::AxisAlignedBoundingBox*>& boxes) {
+    const hmat::ClusterTree* node = &root;
+    while (!node->isLeaf()) {
+        const hmat::ClusterTree* best = NULL;
+        double bestDistance = 0, bestCenterDistance = 0;
+        for (int i = 0; i < node->nrChild(); ++i) {
+            const hmat::ClusterTree* child = node->getChild(i);
+            if (child == NULL || child->data.size() == 0)
+                continue;
+            const hmat::AxisAlignedBoundingBox& box = cachedBoundingBox(*child, boxes);
+            // Ties, such as a DOF inside several boxes, are broken by the distance to the centers
+            const double distance = dof.distanceToSqr(box);
+            const double centerDistance = dof.ccDistSqr(box);
+            if (best == NULL || distance < bestDistance ||
+                (distance == bestDistance && centerDistance < bestCenterDistance)) {
+                best = child;
+                bestDistance = distance;
+                bestCenterDistance = centerDistance;
+            }
+        }
+        if (best == NULL)
+            break;
+        node = best;
+    }
+    return node;
+}
+
+/** @brief Compute the number of DOFs of each node of the updated tree */
+int countUpdatedDofs(const hmat::ClusterTree& node,
+    const std::map<const hmat::ClusterTree*, std::vector<int> >& content,
+    std::map<const hmat::ClusterTree*, int>& sizes) {
+    int result = 0;
+    if (node.isLeaf()) {
+        std::map<const hmat::ClusterTree*, std::vector<int> >::const_iterator it = content.find(&node);
+        if (it != content.end())
+            result = it->second.size();
+    } else {
+        for (int i = 0; i < node.nrChild(); ++i) {
+            if (node.getChild(i))
+                result += countUpdatedDofs(*node.getChild(i), content, sizes);
+        }
+    }
+    sizes[&node] = result;
+    return result;
+}
+
 }
 
 namespace hmat {
@@ -82,6 +307,16 @@ const
   std::stable_sort(myIndices, myIndices + node.data.size(), IndicesComparator(dim, node.data));
 }
 
+void
+AxisAlignClusteringAlgorithm::selectByDimension(ClusterTree& node, int dim, const std::vector<int>& sortAxes,
+                                                int begin, int nth)
+const
+{
+  int* myIndices = node.data.indices() + node.data.offset();
+  std::nth_element(myIndices + begin, myIndices + nth, myIndices + node.data.size(),
+                   AxisChainComparator(dim, sortAxes, node.data));
+}
+
 AxisAlignedBoundingBox*
 AxisAlignClusteringAlgorithm::getAxisAlignedBoundingbox(const ClusterTree& node)
 const
@@ -133,6 +368,13 @@ const
   return result;
 }
 
+int
+ClusteringAlgorithm::selectPartition(ClusterTree&, std::vector<ClusterTree*>&, int, const std::vector<int>&) const
+{
+  HMAT_ASSERT_MSG(false, "%s does not support selectPartition", str().c_str());
+  return -1;
+}
+
 void
 ClusteringAlgorithm::setMaxLeafSize(int maxLeafSize)
 {
@@ -160,6 +402,85 @@ ClusteringAlgorithm::setDivider(int divider) const
   divider_ = divider;
 }
 
+std::string
+ClusteringAlgorithm::classCacheKey(const std::type_info& cls, const std::string& parameters) const
+{
+  if (typeid(*this) != cls)
+    return std::string();
+  std::ostringstream oss;
+  oss << parameters << " maxLeafSize=" << getMaxLeafSize() << " divider=" << getDivider();
+  return oss.str();
+}
+
+namespace {
+/** Key of a wrapped algorithm, or an empty string if the wrapping algorithm cannot be identified */
+std::string
+wrappedCacheKey(const char * name, const std::string& parameters, const ClusteringAlgorithm& algo)
+{
+  const std::string algoKey = algo.cacheKey();
+  if (algoKey.empty())
+    return std::string();
+  return std::string(name) + parameters + " algo=(" + algoKey + ")";
+}
+}
+
+std::string
+GeometricBisectionAlgorithm::cacheKey() const
+{
+  return classCacheKey(typeid(GeometricBisectionAlgorithm), x0_ ? "Geometric x0=1" : "Geometric x0=0");
+}
+
+std::string
+MedianBisectionAlgorithm::cacheKey() const
+{
+  return classCacheKey(typeid(MedianBisectionAlgorithm), "Median");
+}
+
+std::string
+HybridBisectionAlgorithm::cacheKey() const
+{
+  std::ostringstream oss;
+  oss.precision(17);
+  oss << "Hybrid thresholdRatio=" << thresholdRatio_;
+  return classCacheKey(typeid(HybridBisectionAlgorithm), oss.str());
+}
+
+std::string
+MortonClusteringAlgorithm::cacheKey() const
+{
+  return classCacheKey(typeid(MortonClusteringAlgorithm), "Morton");
+}
+
+std::string
+PrincipalAxisBisectionAlgorithm::cacheKey() const
+{
+  return classCacheKey(typeid(PrincipalAxisBisectionAlgorithm), "PrincipalAxis");
+}
+
+std::string
+VoidClusteringAlgorithm::cacheKey() const
+{
+  const std::string key = wrappedCacheKey("Void", "", *algo_);
+  return key.empty() ? key : classCacheKey(typeid(VoidClusteringAlgorithm), key);
+}
+
+std::string
+ShuffleClusteringAlgorithm::cacheKey() const
+{
+  std::ostringstream oss;
+  oss << " fromDivider=" << fromDivider_ << " toDivider=" << toDivider_;
+  const std::string key = wrappedCacheKey("Shuffle", oss.str(), *algo_);
+  return key.empty() ? key : classCacheKey(typeid(ShuffleClusteringAlgorithm), key);
+}
+
+std::string
+NTilesRecursiveAlgorithm::cacheKey() const
+{
+  std::ostringstream oss;
+  oss << "NTiles tileSize=" << tileSize_;
+  return classCacheKey(typeid(NTilesRecursiveAlgorithm), oss.str());
+}
+
 int
 GeometricBisectionAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree*>& children,
                                        int currentAxis) const
@@ -223,6 +544,35 @@ GeometricBisectionAlgorithm::partition(ClusterTree& current, std::vector<Cluster
   return dim;
 }
 
+int
+GeometricBisectionAlgorithm::selectPartition(ClusterTree& current, std::vector<ClusterTree*>& children,
+                                             int currentAxis, const std::vector<int>&) const
+{
+  bool x0 = x0_ && current.depth == 0;
+  int dim = x0 ? 0 : largestDimension(current, currentAxis);
+  AxisAlignedBoundingBox* bbox = getAxisAlignedBoundingbox(current);
+  int* myIndices = current.data.indices() + current.data.offset();
+  const DofCoordinates & coord = *current.data.coordinates();
+  int previousIndex = 0;
+  for (int i=1 ; i<divider_ ; i++) {
+    double middlePosition;
+    if(x0) {
+      middlePosition = 0;
+    } else {
+      middlePosition = bbox->bbMin()[dim] + (i / (double)divider_) *
+        (bbox->bbMax()[dim] - bbox->bbMin()[dim]);
+    }
+    // Same DOFs as the linear search of partition() in the sorted indices
+    int middleIndex = std::partition(myIndices + previousIndex, myIndices + current.data.size(),
+                                     BelowPosition(coord, dim, middlePosition)) - myIndices;
+    if (middleIndex > previousIndex)
+      children.push_back(current.slice(current.data.offset()+previousIndex, middleIndex-previousIndex));
+    previousIndex = middleIndex;
+  }
+  children.push_back(current.slice(current.data.offset()+ previousIndex, current.data.size() - previousIndex));
+  return dim;
+}
+
 int
 MedianBisectionAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree*>& children,
                                     int currentAxis) const
@@ -269,6 +619,24 @@ MedianBisectionAlgorithm::partition(ClusterTree& current, std::vector<ClusterTre
   return dim;
 }
 
+int
+MedianBisectionAlgorithm::selectPartition(ClusterTree& current, std::vector<ClusterTree*>& children,
+                                          int currentAxis, const std::vector<int>& sortAxes) const
+{
+  int dim = largestDimension(current, currentAxis);
+  int previousIndex = 0;
+  for (int i=1 ; i<divider_ ; i++) {
+    int middleIndex = current.data.size() * i / divider_;
+    if (middleIndex < current.data.size())
+      selectByDimension(current, dim, sortAxes, previousIndex, middleIndex);
+    if (middleIndex > previousIndex)
+      children.push_back(current.slice(current.data.offset()+previousIndex, middleIndex-previousIndex));
+    previousIndex = middleIndex;
+  }
+  children.push_back(current.slice(current.data.offset()+ previousIndex, current.data.size() - previousIndex));
+  return dim;
+}
+
 int
 HybridBisectionAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree*>& children,
                                     int currentAxis) const
@@ -295,6 +663,37 @@ HybridBisectionAlgorithm::partition(ClusterTree& current, std::vector<ClusterTre
   return dim;
 }
 
+int
+HybridBisectionAlgorithm::selectPartition(ClusterTree& current, std::vector<ClusterTree*>& children,
+                                          int currentAxis, const std::vector<int>& sortAxes) const
+{
+  // Same as partition(). The rejected children are freed here because
+  // they are not in the tree and would not be cleaned.
+  int dim = medianAlgorithm_.selectPartition(current, children, currentAxis, sortAxes);
+  if (children.size() < 2)
+    return dim;
+  double currentVolume = volume(current);
+  double maxVolume = 0.0;
+  for (std::vector<ClusterTree*>::const_iterator cit = children.begin(); cit != children.end(); ++cit)
+  {
+    if (*cit != NULL)
+      maxVolume = std::max(maxVolume, volume(**cit));
+  }
+  if (maxVolume > thresholdRatio_*currentVolume)
+  {
+    for (std::vector<ClusterTree*>::iterator it = children.begin(); it != children.end(); ++it)
+    {
+      clean(**it);
+      // avoid dofData_ deletion
+      (*it)->father = *it;
+      delete *it;
+    }
+    children.clear();
+    dim = geometricAlgorithm_.selectPartition(current, children, currentAxis, sortAxes);
+  }
+  return dim;
+}
+
 void
 HybridBisectionAlgorithm::clean(ClusterTree& current) const
 {
@@ -317,6 +716,301 @@ VoidClusteringAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree
   }
 }
 
+ClusteringAlgorithm*
+MortonClusteringAlgorithm::clone() const
+{
+  // Copy the settings, not the codes of a build
+  MortonClusteringAlgorithm* result = new MortonClusteringAlgorithm();
+  static_cast<ClusteringAlgorithm&>(*result) = *this;
+  return result;
+}
+
+bool
+MortonClusteringAlgorithm::hasCodes(const ClusterTree& node) const
+{
+  return codesRoot_ == node.data.indices() && node.data.offset() >= codesOffset_ &&
+    node.data.offset() + node.data.size() <= codesOffset_ + codesSize_;
+}
+
+void
+MortonClusteringAlgorithm::computeCodes(ClusterTree& node) const
+{
+  HMAT_ASSERT_MSG(node.data.group_index() == NULL, "MortonClusteringAlgorithm does not support group index");
+  const DofCoordinates& coord = *node.data.coordinates();
+  const int dimension = coord.dimension();
+  HMAT_ASSERT(dimension < 64);
+  const int n = node.data.size();
+  int* myIndices = node.data.indices() + node.data.offset();
+  // Quantize on a cubic grid so the cells are not stretched
+  AxisAlignedBoundingBox bbox(node.data);
+  double extent = 0;
+  for (int d = 0; d < dimension; d++)
+    extent = std::max(extent, bbox.bbMax()[d] - bbox.bbMin()[d]);
+  const int bits = std::min(63 / std::max(dimension, 1), 31);
+  const double scale = extent > 0 ? ((1u << bits) - 1) / extent : 0;
+  codes_.resize(coord.numberOfDof());
+  const double * centers[64];
+  for (int d = 0; d < dimension; d++)
+    centers[d] = coord.spanCenters(d);
+#ifdef _OPENMP
+#pragma omp parallel for if(n > RADIX_TASK_MIN_SIZE)
+#endif
+  for (int i = 0; i < n; i++) {
+    const int dof = myIndices[i];
+    uint32_t q[64];
+    for (int d = 0; d < dimension; d++)
+      q[d] = (uint32_t) ((centers[d][dof] - bbox.bbMin()[d]) * scale);
+    uint64_t code = 0;
+    if (dimension == 3) {
+      code = (spreadBits3(q[0]) << 2) | (spreadBits3(q[1]) << 1) | spreadBits3(q[2]);
+    } else {
+      for (int b = bits - 1; b >= 0; b--)
+        for (int d = 0; d < dimension; d++)
+          code = (code << 1) | ((q[d] >> b) & 1);
+    }
+    codes_[dof] = code;
+  }
+  codesRoot_ = node.data.indices();
+  codesOffset_ = node.data.offset();
+  codesSize_ = n;
+  radixSortByCode(myIndices, n, codes_);
+}
+
+int
+MortonClusteringAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree*>& children,
+                                     int) const
+{
+  const int offset = current.data.offset();
+  const int n = current.data.size();
+  int* myIndices = current.data.indices() + offset;
+  if (!hasCodes(current))
+    computeCodes(current);
+  // Nodes are ranges of the sorted DOFs. Wrappers like SpanClusteringAlgorithm
+  // only move DOFs with stable partitions, which keep them sorted.
+  assert(std::is_sorted(myIndices, myIndices + n, CodeComparator(codes_)));
+  const uint64_t first = codes_[myIndices[0]];
+  const uint64_t last = codes_[myIndices[n - 1]];
+  int middleIndex = n / 2;
+  int axis = -1;
+  if (first != last) {
+    // The leading bit where the codes differ
+    int bit = 63;
+    while (!(((first ^ last) >> bit) & 1))
+      bit--;
+    int lower = 0, upper = n - 1;
+    while (lower < upper) {
+      const int middle = (lower + upper) / 2;
+      if ((codes_[myIndices[middle]] >> bit) & 1)
+        upper = middle;
+      else
+        lower = middle + 1;
+    }
+    middleIndex = lower;
+    const int dimension = current.data.coordinates()->dimension();
+    axis = dimension - 1 - bit % dimension;
+  }
+  children.push_back(current.slice(offset, middleIndex));
+  children.push_back(current.slice(offset + middleIndex, n - middleIndex));
+  return axis;
+}
+
+void
+MortonClusteringAlgorithm::clean(ClusterTree& current) const
+{
+  if (codesRoot_ == current.data.indices() && codesOffset_ == current.data.offset() &&
+      codesSize_ == current.data.size()) {
+    std::vector<uint64_t>().swap(codes_);
+    codesRoot_ = NULL;
+  }
+}
+
+int
+PrincipalAxisBisectionAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree*>& children,
+                                           int) const
+{
+  HMAT_ASSERT_MSG(current.data.group_index() == NULL, "PrincipalAxisBisectionAlgorithm does not support group index");
+  const DofCoordinates& coord = *current.data.coordinates();
+  const int dimension = coord.dimension();
+  std::vector<double> center(dimension), axes(dimension * dimension);
+  principalAxes(current.data, center.data(), axes.data());
+  const int n = current.data.size();
+  int* myIndices = current.data.indices() + current.data.offset();
+  // Sort by projection on the first axis, then by DOF number
+  std::vector<std::pair<double, int> > projections(n);
+  for (int i = 0; i < n; ++i) {
+    double projection = 0;
+    for (int d = 0; d < dimension; ++d)
+      projection += (coord.spanCenter(myIndices[i], d) - center[d]) * axes[d];
+    projections[i] = std::make_pair(projection, myIndices[i]);
+  }
+  std::sort(projections.begin(), projections.end());
+  for (int i = 0; i < n; ++i)
+    myIndices[i] = projections[i].second;
+  int previousIndex = 0;
+  // Loop on 'divider_' = the number of children created
+  for (int i = 1; i < divider_; i++) {
+    const int middleIndex = n * i / divider_;
+    if (middleIndex > previousIndex)
+      children.push_back(current.slice(current.data.offset() + previousIndex, middleIndex - previousIndex));
+    previousIndex = middleIndex;
+  }
+  // Add the last child
+  children.push_back(current.slice(current.data.offset() + previousIndex, n - previousIndex));
+  // Not an axis of the coordinates
+  return -1;
+}
+
+ClusteringAlgorithm*
+WorkBalancedClusteringAlgorithm::clone() const
+{
+  // Copy the settings, not the weights of a build
+  WorkBalancedClusteringAlgorithm* result =
+    new WorkBalancedClusteringAlgorithm(eta_, pilotLeaves_, approximateRank_);
+  static_cast<ClusteringAlgorithm&>(*result) = *this;
+  return result;
+}
+
+std::string
+WorkBalancedClusteringAlgorithm::str() const
+{
+  std::ostringstream oss;
+  oss << "WorkBalancedClusteringAlgorithm(eta=" << eta_ << ", pilotLeaves=" << pilotLeaves_
+      << ", approximateRank=" << approximateRank_ << ")";
+  return oss.str();
+}
+
+std::string
+WorkBalancedClusteringAlgorithm::cacheKey() const
+{
+  std::ostringstream oss;
+  oss.precision(17);
+  oss << "WorkBalanced eta=" << eta_ << " pilotLeaves=" << pilotLeaves_
+      << " approximateRank=" << approximateRank_;
+  return classCacheKey(typeid(WorkBalancedClusteringAlgorithm), oss.str());
+}
+
+bool
+WorkBalancedClusteringAlgorithm::hasWeights(const ClusterTree& node) const
+{
+  return weightsRoot_ == node.data.indices() && node.data.offset() >= weightsOffset_ &&
+    node.data.offset() + node.data.size() <= weightsOffset_ + weightsSize_;
+}
+
+void
+WorkBalancedClusteringAlgorithm::pilotWork(const ClusterTree& rows, const ClusterTree& cols,
+                                           const AdmissibilityCondition& admissibility,
+                                           std::vector<double>& leafWork) const
+{
+  const double m = rows.data.size();
+  const double n = cols.data.size();
+  double cost;
+  if (admissibility.isLowRank(rows, cols))
+    cost = std::min((double) approximateRank_, std::min(m, n)) * (m + n);
+  else if (rows.isLeaf() || cols.isLeaf())
+    cost = m * n;
+  else {
+    for (int i = 0; i < rows.nrChild(); ++i)
+      for (int j = 0; j < cols.nrChild(); ++j)
+        pilotWork(*rows.getChild(i), *cols.getChild(j), admissibility, leafWork);
+    return;
+  }
+  // Half of the cost goes to the rows, half to the columns. Work is per DOF.
+  const double rowsShare = cost / (2 * m), colsShare = cost / (2 * n);
+  for (int i = 0; i < rows.data.size(); ++i)
+    leafWork[rows.data.offset() + i] += rowsShare;
+  for (int i = 0; i < cols.data.size(); ++i)
+    leafWork[cols.data.offset() + i] += colsShare;
+}
+
+void
+WorkBalancedClusteringAlgorithm::computeWeights(ClusterTree& node) const
+{
+  HMAT_ASSERT_MSG(node.data.group_index() == NULL, "WorkBalancedClusteringAlgorithm does not support group index");
+  const DofCoordinates& coord = *node.data.coordinates();
+  // The pilot tree holds all the DOFs, so the weights are valid for any node
+  MedianBisectionAlgorithm median;
+  median.setMaxLeafSize(std::max((int) coord.numberOfDof() / std::max(pilotLeaves_, 1), std::max(getMaxLeafSize(), 1)));
+  ClusterTree* pilot = ClusterTreeBuilder(median).build(coord);
+  StandardAdmissibilityCondition admissibility(eta_);
+  admissibility.prepare(*pilot, *pilot);
+  // Work indexed by position in the pilot tree
+  std::vector<double> work(pilot->data.size(), 0.0);
+  pilotWork(*pilot, *pilot, admissibility, work);
+  admissibility.clean(*pilot, *pilot);
+  // Share the work of each pilot leaf evenly between its DOFs
+  std::vector<const ClusterTree*> leaves;
+  std::vector<const ClusterTree*> stack(1, pilot);
+  while (!stack.empty()) {
+    const ClusterTree* current = stack.back();
+    stack.pop_back();
+    if (current->isLeaf())
+      leaves.push_back(current);
+    for (int i = 0; i < current->nrChild(); ++i)
+      if (current->getChild(i))
+        stack.push_back(current->getChild(i));
+  }
+  weights_.assign(coord.numberOfDof(), 0.0);
+  const int* pilotIndices = pilot->data.indices();
+  for (size_t l = 0; l < leaves.size(); ++l) {
+    const int offset = leaves[l]->data.offset();
+    const int size = leaves[l]->data.size();
+    double leafWork = 0;
+    for (int i = 0; i < size; ++i)
+      leafWork += work[offset + i];
+    for (int i = 0; i < size; ++i)
+      weights_[pilotIndices[offset + i]] = leafWork / size;
+  }
+  delete pilot;
+  weightsRoot_ = node.data.indices();
+  weightsOffset_ = node.data.offset();
+  weightsSize_ = node.data.size();
+}
+
+int
+WorkBalancedClusteringAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree*>& children,
+                                           int currentAxis) const
+{
+  if (!hasWeights(current))
+    computeWeights(current);
+  int dim = largestDimension(current, currentAxis);
+  sortByDimension(current, dim);
+  const int n = current.data.size();
+  const int* myIndices = current.data.indices() + current.data.offset();
+  double total = 0;
+  for (int i = 0; i < n; ++i)
+    total += weights_[myIndices[i]];
+  int previousIndex = 0;
+  int index = 0;
+  double cumulated = 0;
+  // Loop on 'divider_' = the number of children created
+  for (int i = 1; i < divider_; i++) {
+    const double target = total * i / divider_;
+    while (index < n && cumulated + weights_[myIndices[index]] <= target)
+      cumulated += weights_[myIndices[index++]];
+    // Children must not be empty
+    const int middleIndex = std::min(std::max(index, previousIndex + 1), n - 1);
+    while (index < middleIndex)
+      cumulated += weights_[myIndices[index++]];
+    if (middleIndex > previousIndex)
+      children.push_back(current.slice(current.data.offset() + previousIndex, middleIndex - previousIndex));
+    previousIndex = middleIndex;
+  }
+  // Add the last child
+  children.push_back(current.slice(current.data.offset() + previousIndex, n - previousIndex));
+  return dim;
+}
+
+void
+WorkBalancedClusteringAlgorithm::clean(ClusterTree& current) const
+{
+  AxisAlignClusteringAlgorithm::clean(current);
+  if (weightsRoot_ == current.data.indices() && weightsOffset_ == current.data.offset() &&
+      weightsSize_ == current.data.size()) {
+    std::vector<double>().swap(weights_);
+    weightsRoot_ = NULL;
+  }
+}
+
 void
 VoidClusteringAlgorithm::clean(ClusterTree& current) const
 {
@@ -421,7 +1115,74 @@ ClusterTreeBuilder::build(const DofCoordinates& coordinates, int* group_index) c
   DofData* dofData = new DofData(coordinates, group_index);
   ClusterTree* rootNode = new ClusterTree(dofData);
 
-  divide_recursive(*rootNode, -1);
+  if (group_index == NULL && canSelect()) {
+    // O(n log n): nodes are split with nth_element instead of being sorted,
+    // and only the leaves are sorted at the end. Subtrees are independent
+    // so they are built by concurrent tasks.
+    std::vector<int> sortAxes;
+#ifdef _OPENMP
+#pragma omp parallel if(rootNode->data.size() > SELECT_TASK_MIN_SIZE)
+#pragma omp single
+#endif
+    select_recursive(*rootNode, -1, sortAxes);
+  } else {
+    divide_recursive(*rootNode, -1);
+  }
+  clean_recursive(*rootNode);
+  // Update reverse mapping
+  int* indices_i2e = rootNode->data.indices();
+  int* indices_e2i = rootNode->data.indices_rev();
+
+  for (int i = 0; i < rootNode->data.size(); ++i) {
+    indices_e2i[indices_i2e[i]] = i;
+  }
+  return rootNode;
+}
+
+ClusterTree*
+ClusterTreeBuilder::update(const ClusterTree& previous, const DofCoordinates& coordinates, const int* oldToNew) const
+{
+  HMAT_ASSERT_MSG(previous.father == NULL, "Only the root of a ClusterTree can be updated");
+  HMAT_ASSERT_MSG(previous.data.group_index() == NULL, "A ClusterTree with a group index cannot be updated");
+  HMAT_ASSERT(coordinates.dimension() == previous.data.coordinates()->dimension());
+  const int n = coordinates.numberOfDof();
+
+  // Remaining DOFs stay in their leaf, in the same order
+  std::vector<const ClusterTree*> leaves;
+  collectLeaves(previous, leaves);
+  std::map<const ClusterTree*, std::vector<int> > content;
+  std::vector<char> placed(n, 0);
+  const int* previousIndices = previous.data.indices();
+  for (size_t l = 0; l < leaves.size(); ++l) {
+    std::vector<int>& dofs = content[leaves[l]];
+    const int offset = leaves[l]->data.offset();
+    for (int i = offset; i < offset + leaves[l]->data.size(); ++i) {
+      const int dof = oldToNew[previousIndices[i]];
+      if (dof < 0)
+        continue;
+      HMAT_ASSERT_MSG(dof < n && !placed[dof], "Invalid new index %d for DOF %d", dof, previousIndices[i]);
+      placed[dof] = 1;
+      dofs.push_back(dof);
+    }
+  }
+
+  // New DOFs are appended to the nearest leaf
+  std::map<const ClusterTree*, AxisAlignedBoundingBox*> boxes;
+  for (int dof = 0; dof < n; ++dof) {
+    if (placed[dof])
+      continue;
+    AxisAlignedBoundingBox box(coordinates.dimension());
+    box.merge(coordinates, &dof, 1);
+    content[nearestLeaf(previous, box, boxes)].push_back(dof);
+  }
+  for (std::map<const ClusterTree*, AxisAlignedBoundingBox*>::iterator it = boxes.begin(); it != boxes.end(); ++it)
+    delete it->second;
+
+  std::map<const ClusterTree*, int> sizes;
+  countUpdatedDofs(previous, content, sizes);
+  DofData* dofData = new DofData(coordinates);
+  ClusterTree* rootNode = new ClusterTree(dofData);
+  update_recursive(previous, *rootNode, content, sizes);
   clean_recursive(*rootNode);
   // Update reverse mapping
   int* indices_i2e = rootNode->data.indices();
@@ -433,6 +1194,36 @@ ClusterTreeBuilder::build(const DofCoordinates& coordinates, int* group_index) c
   return rootNode;
 }
 
+void
+ClusterTreeBuilder::update_recursive(const ClusterTree& previous, ClusterTree& current,
+                                     const std::map<const ClusterTree*, std::vector<int> >& content,
+                                     const std::map<const ClusterTree*, int>& sizes) const
+{
+  if (previous.isLeaf()) {
+    std::map<const ClusterTree*, std::vector<int> >::const_iterator it = content.find(&previous);
+    if (it != content.end() && !it->second.empty())
+      std::copy(it->second.begin(), it->second.end(), current.data.indices() + current.data.offset());
+    // Only the leaves which grew beyond the maximum leaf size are split again
+    if (current.data.size() > previous.data.size())
+      divide_recursive(current, -1);
+    return;
+  }
+  int offset = current.data.offset();
+  int index = 0;
+  for (int i = 0; i < previous.nrChild(); ++i) {
+    const ClusterTree* previousChild = previous.getChild(i);
+    if (previousChild == NULL)
+      continue;
+    const int size = sizes.find(previousChild)->second;
+    if (size == 0)
+      continue;
+    ClusterTree* child = current.slice(offset, size);
+    current.insertChild(index++, child);
+    update_recursive(*previousChild, *child, content, sizes);
+    offset += size;
+  }
+}
+
 void
 ClusterTreeBuilder::clean_recursive(ClusterTree& current) const
 {
@@ -448,6 +1239,17 @@ ClusterTreeBuilder::clean_recursive(ClusterTree& current) const
   }
 }
 
+bool
+ClusterTreeBuilder::canSelect() const
+{
+  for (std::list<std::pair<int, ClusteringAlgorithm*> >::const_iterator it = algo_.begin(); it != algo_.end(); ++it)
+  {
+    if (!it->second->canSelect())
+      return false;
+  }
+  return true;
+}
+
 ClusteringAlgorithm*
 ClusterTreeBuilder::getAlgorithm(int depth) const
 {
@@ -462,6 +1264,32 @@ ClusterTreeBuilder::getAlgorithm(int depth) const
   return last;
 }
 
+std::string
+ClusterTreeBuilder::str() const
+{
+  std::ostringstream oss;
+  for (std::list<std::pair<int, ClusteringAlgorithm*> >::const_iterator it = algo_.begin(); it != algo_.end(); ++it)
+  {
+    oss << it->first << ":" << it->second->str() << " maxLeafSize=" << it->second->getMaxLeafSize()
+        << " divider=" << it->second->getDivider() << ";";
+  }
+  return oss.str();
+}
+
+std::string
+ClusterTreeBuilder::cacheKey() const
+{
+  std::ostringstream oss;
+  for (std::list<std::pair<int, ClusteringAlgorithm*> >::const_iterator it = algo_.begin(); it != algo_.end(); ++it)
+  {
+    const std::string algoKey = it->second->cacheKey();
+    if (algoKey.empty())
+      return std::string();
+    oss << it->first << ":" << algoKey << ";";
+  }
+  return oss.str();
+}
+
 ClusterTreeBuilder&
 ClusterTreeBuilder::addAlgorithm(int depth, const ClusteringAlgorithm& algo)
 {
@@ -494,6 +1322,37 @@ ClusterTreeBuilder::divide_recursive(ClusterTree& current, int currentAxis) cons
   }
 }
 
+void
+ClusterTreeBuilder::select_recursive(ClusterTree& current, int currentAxis, const std::vector<int>& sortAxes) const
+{
+  ClusteringAlgorithm* algo = getAlgorithm(current.depth);
+  if (current.data.size() <= algo->getMaxLeafSize())
+  {
+    // Restore the order partition() would have left
+    int* myIndices = current.data.indices() + current.data.offset();
+    std::sort(myIndices, myIndices + current.data.size(), AxisChainComparator(-1, sortAxes, current.data));
+    return;
+  }
+
+  std::vector<ClusterTree*> children;
+  int childrenAxis = algo->selectPartition(current, children, currentAxis, sortAxes);
+  std::vector<int> childrenSortAxes(sortAxes);
+  childrenSortAxes.push_back(childrenAxis);
+  for (size_t i = 0; i < children.size(); ++i)
+    current.insertChild(i, children[i]);
+  for (size_t i = 0; i < children.size(); ++i)
+  {
+    ClusterTree* child = children[i];
+#ifdef _OPENMP
+#pragma omp task firstprivate(child) shared(childrenSortAxes) if(child->data.size() > SELECT_TASK_MIN_SIZE)
+#endif
+    select_recursive(*child, childrenAxis, childrenSortAxes);
+  }
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
+}
+
 SpanClusteringAlgorithm::SpanClusteringAlgorithm(
     const ClusteringAlgorithm &algo, double ratio):
     algo_(algo), ratio_(ratio){
@@ -503,6 +1362,13 @@ SpanClusteringAlgorithm::SpanClusteringAlgorithm(
 std::string SpanClusteringAlgorithm::str() const {
     return "SpanClusteringAlgorithm";
 }
+std::string SpanClusteringAlgorithm::cacheKey() const {
+    std::ostringstream oss;
+    oss.precision(17);
+    oss << " ratio=" << ratio_;
+    const std::string key = wrappedCacheKey("Span", oss.str(), algo_);
+    return key.empty() ? key : classCacheKey(typeid(SpanClusteringAlgorithm), key);
+}
 ClusteringAlgorithm* SpanClusteringAlgorithm::clone() const {
     return new SpanClusteringAlgorithm(algo_, ratio_);
 }
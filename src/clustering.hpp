@@ -29,7 +29,10 @@
 
 #include <vector>
 #include <list>
+#include <map>
 #include <string>
+#include <typeinfo>
+#include <stdint.h>
 
 namespace hmat {
 
@@ -38,6 +41,7 @@ class ClusterTree;
 class DofCoordinates;
 class ClusteringAlgorithm;
 class AxisAlignedBoundingBox;
+class AdmissibilityCondition;
 
 class ClusterTreeBuilder {
 public:
@@ -55,8 +59,42 @@ public:
    */
   ClusterTree* build(const DofCoordinates& coordinates, int* group_index = NULL) const;
 
+  /*! \brief Create the ClusterTree of a modified set of DOFs from the tree of the previous ones.
+
+      The partition of previous is kept: the remaining DOFs stay in their leaf,
+      in the same order, and each new DOF is added to the leaf found by going
+      down to the nearest child bounding box. Only the leaves which become
+      larger than the maximum leaf size are split again, and the nodes which
+      become empty are removed. So clusters without added or removed DOFs hold
+      the same DOFs in the same order as in previous.
+
+      \param previous the root of the tree of the previous DOFs, without group index
+      \param coordinates the new DOFs coordinates
+      \param oldToNew oldToNew[i] is the index in coordinates of the previous DOF i,
+      or -1 if it has been removed. The DOFs of coordinates which no previous DOF
+      maps to are the new ones.
+      \return a ClusterTree instance
+   */
+  ClusterTree* update(const ClusterTree& previous, const DofCoordinates& coordinates, const int* oldToNew) const;
+
+  /*! \brief String representation of the algorithms, with their depth, leaf size and divider */
+  std::string str() const;
+
+  /*! \brief Identify the trees built by this builder, from the
+      ClusteringAlgorithm::cacheKey() of its algorithms and their depth.
+
+      \return an empty string if one of the algorithms cannot be identified
+   */
+  std::string cacheKey() const;
+
 private:
   void divide_recursive(ClusterTree& current, int axis) const;
+  void update_recursive(const ClusterTree& previous, ClusterTree& current,
+                        const std::map<const ClusterTree*, std::vector<int> >& content,
+                        const std::map<const ClusterTree*, int>& sizes) const;
+  void select_recursive(ClusterTree& current, int axis, const std::vector<int>& sortAxes) const;
+  /*! \brief Return true if all algorithms support ClusteringAlgorithm::selectPartition */
+  bool canSelect() const;
   void clean_recursive(ClusterTree& current) const;
   ClusteringAlgorithm* getAlgorithm(int depth) const;
 
@@ -80,6 +118,18 @@ public:
   /*! \brief  String representation */
   virtual std::string str() const = 0;
 
+  /*!
+   * \brief Identify the trees built by this algorithm.
+   *
+   * Two algorithms with the same key must build the same tree from the same
+   * coordinates, so the key holds every parameter, including the leaf size
+   * and the divider (unlike str(), which is only a description). It is used
+   * by the structure cache (see structureKey()). The default returns an
+   * empty string, which means the algorithm cannot be identified and its
+   * trees are never cached.
+   */
+  virtual std::string cacheKey() const { return std::string(); }
+
   /*!
    * \brief Split cluster node
    * \param currentAxis the axis used before, to split do the current.
@@ -88,6 +138,23 @@ public:
    */
   virtual int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const = 0;
 
+  /*!
+   * \brief Split cluster node like partition(), without sorting it
+   *
+   * This is only called by ClusterTreeBuilder::build when all the algorithms
+   * support it and there is no group index. Children must contain the same
+   * DOFs as with partition(), in any order: the builder sorts the leaves at
+   * the end, so the tree is the same.
+   * \param sortAxes axes of the partitions of the ancestors of current, from
+   * the root. partition() would find current ordered by the coordinates along
+   * these axes, the last one first, then by DOF number.
+   * \return the axis of the partition
+   */
+  virtual int selectPartition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis,
+                              const std::vector<int>& sortAxes) const;
+  /*! \brief Return true if selectPartition is implemented */
+  virtual bool canSelect() const { return false; }
+
   /*! \brief Called by ClusterTreeBuilder::clean_recursive to free data which may be allocated by partition  */
   virtual void clean(ClusterTree&) const {}
 
@@ -97,6 +164,18 @@ public:
   int getDivider() const;
   virtual void setDivider(int divider) const;
 
+protected:
+  /*!
+   * \brief cacheKey() of the algorithms of this library
+   *
+   * \param cls the class defining cacheKey()
+   * \param parameters the parameters of this class
+   * \return parameters followed by the leaf size and the divider, or an empty
+   * string if this object is a subclass of cls, which may partition differently
+   * unless it defines its own cacheKey()
+   */
+  std::string classCacheKey(const std::type_info& cls, const std::string& parameters) const;
+
 private:
   int maxLeafSize_;
 protected:
@@ -110,6 +189,14 @@ public:
   void clean(ClusterTree& current) const;
 protected:
   void sortByDimension(ClusterTree& node, int dim) const;
+  /*!
+   * \brief Partial counterpart of sortByDimension for selectPartition
+   *
+   * Reorder the indices of node from position begin, so that the one at
+   * position nth is the one sortByDimension would put there, with smaller
+   * ones before and larger ones after.
+   */
+  void selectByDimension(ClusterTree& node, int dim, const std::vector<int>& sortAxes, int begin, int nth) const;
   /*!
    * \brief Return the largest dimension of node which is not toAvoid
    * \param toAvoid a dimension which should not be chosen as the largest
@@ -139,8 +226,12 @@ public:
   explicit GeometricBisectionAlgorithm(bool x0 = false): x0_(x0) {}
   ClusteringAlgorithm* clone() const { return new GeometricBisectionAlgorithm(*this); }
   std::string str() const { return "GeometricBisectionAlgorithm"; }
+  std::string cacheKey() const;
 
   int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const;
+  int selectPartition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis,
+                      const std::vector<int>& sortAxes) const;
+  bool canSelect() const { return true; }
 };
 
 /*! \brief Creating tree by median division.
@@ -161,8 +252,12 @@ class MedianBisectionAlgorithm : public AxisAlignClusteringAlgorithm
 public:
   ClusteringAlgorithm* clone() const { return new MedianBisectionAlgorithm(*this); }
   std::string str() const { return "MedianBisectionAlgorithm"; }
+  std::string cacheKey() const;
 
   int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const;
+  int selectPartition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis,
+                      const std::vector<int>& sortAxes) const;
+  bool canSelect() const { return true; }
 };
 
 /*! \brief Hybrid algorithm.
@@ -180,8 +275,12 @@ public:
 
   ClusteringAlgorithm* clone() const { return new HybridBisectionAlgorithm(*this); }
   std::string str() const { return "HybridBisectionAlgorithm"; }
+  std::string cacheKey() const;
 
   int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const;
+  int selectPartition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis,
+                      const std::vector<int>& sortAxes) const;
+  bool canSelect() const { return true; }
   void clean(ClusterTree& current) const;
 
 private:
@@ -202,9 +301,118 @@ public:
     SpanClusteringAlgorithm(const ClusteringAlgorithm &algo, double ratio);
     std::string str() const;
     ClusteringAlgorithm* clone() const;
+    std::string cacheKey() const;
     int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const;
 };
 
+/*! \brief Creating tree from the Morton order of the DOFs.
+
+  The span centers are quantized on a grid spanning the bounding box of the
+  node where the algorithm is first applied (usually the root), and the DOFs
+  are sorted along the Morton (Z-order) curve of this grid with a radix sort,
+  once. Each node is then split in two where the leading bit of the Morton
+  codes of its DOFs changes, which is a bisection of an octree cell (or of a
+  quadtree cell in 2D), so nodes are contiguous in the Morton order and no
+  further sorting is needed. DOFs with the same code are split at the median.
+
+  The tree is binary (the divider is ignored) and the group index is not
+  supported. This algorithm keeps state during ClusterTreeBuilder::build, so
+  an instance cannot be used by several builds at the same time.
+ */
+class MortonClusteringAlgorithm : public ClusteringAlgorithm
+{
+public:
+  MortonClusteringAlgorithm() : codesRoot_(NULL), codesOffset_(0), codesSize_(0) {}
+  ClusteringAlgorithm* clone() const;
+  std::string str() const { return "MortonClusteringAlgorithm"; }
+  std::string cacheKey() const;
+
+  int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const;
+  void clean(ClusterTree& current) const;
+
+private:
+  /*! \brief Compute the codes of the DOFs of node, and sort them */
+  void computeCodes(ClusterTree& node) const;
+  /*! \brief Return true if the codes of the DOFs of node are known */
+  bool hasCodes(const ClusterTree& node) const;
+  /// Morton code of each DOF number, valid for the DOFs of the node described by the 3 next attributes
+  mutable std::vector<uint64_t> codes_;
+  /// Indices array of the tree of this node, as a key
+  mutable const int* codesRoot_;
+  mutable int codesOffset_;
+  mutable int codesSize_;
+};
+
+/*! \brief Creating tree by median division along the principal axis.
+
+  The principal axis of a node is the direction of largest variance of the
+  span centers of its DOFs. The DOFs are sorted by their projection on this
+  axis and split at the median. Unlike axis aligned algorithms, thin slanted
+  geometries get thin clusters; OrientedAdmissibilityCondition takes
+  advantage of their small oriented bounding boxes.
+
+  The group index is not supported.
+ */
+class PrincipalAxisBisectionAlgorithm : public ClusteringAlgorithm
+{
+public:
+  ClusteringAlgorithm* clone() const { return new PrincipalAxisBisectionAlgorithm(*this); }
+  std::string str() const { return "PrincipalAxisBisectionAlgorithm"; }
+  std::string cacheKey() const;
+
+  int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const;
+};
+
+/*! \brief Creating tree by bisection at the weighted median of the work.
+
+  A pilot pass estimates the work of each DOF: a coarse median cluster tree is
+  built (about pilotLeaves leaves) and a standard admissibility condition with
+  the given eta is applied on it. An admissible block costs
+  approximateRank * (m + n), the other blocks reached at the coarse leaves
+  cost m * n (near field). The cost of each block is shared evenly by its rows
+  and by its columns, and the work of a coarse leaf is shared evenly by its DOFs.
+
+  Nodes are then split along their largest dimension like
+  MedianBisectionAlgorithm, but at the position where the cumulated work
+  reaches 1/divider of the work of the node instead of the number of DOFs, so
+  that subtrees handed to different threads take comparable time.
+
+  The group index is not supported. This algorithm keeps state during
+  ClusterTreeBuilder::build, so an instance cannot be used by several builds
+  at the same time.
+ */
+class WorkBalancedClusteringAlgorithm : public AxisAlignClusteringAlgorithm
+{
+public:
+  explicit WorkBalancedClusteringAlgorithm(double eta = 2.0, int pilotLeaves = 256, int approximateRank = 25)
+    : eta_(eta), pilotLeaves_(pilotLeaves), approximateRank_(approximateRank),
+      weightsRoot_(NULL), weightsOffset_(0), weightsSize_(0) {}
+  ClusteringAlgorithm* clone() const;
+  std::string str() const;
+  std::string cacheKey() const;
+
+  int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const;
+  void clean(ClusterTree& current) const;
+
+private:
+  /*! \brief Run the pilot pass to compute the work of the DOFs */
+  void computeWeights(ClusterTree& node) const;
+  /*! \brief Return true if the work of the DOFs of node is known */
+  bool hasWeights(const ClusterTree& node) const;
+  /*! \brief Add the cost of the block rows x cols to the work of the coarse leaves */
+  void pilotWork(const ClusterTree& rows, const ClusterTree& cols, const AdmissibilityCondition& admissibility,
+                 std::vector<double>& leafWork) const;
+  double eta_;
+  int pilotLeaves_;
+  int approximateRank_;
+  /// Estimated work of each DOF number, valid for the DOFs of the node described by the 3 next attributes
+  mutable std::vector<double> weights_;
+  /// Indices array of the tree of this node, as a key
+  mutable const int* weightsRoot_;
+  mutable int weightsOffset_;
+  mutable int weightsSize_;
+};
+
 class VoidClusteringAlgorithm : public ClusteringAlgorithm
 {
 public:
@@ -214,6 +422,7 @@ public:
   ClusteringAlgorithm* clone() const { return new VoidClusteringAlgorithm(*algo_); }
   virtual ~VoidClusteringAlgorithm() { delete algo_; }
   std::string str() const { return "VoidClusteringAlgorithm"; }
+  std::string cacheKey() const;
 
   int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const;
   void clean(ClusterTree& current) const;
@@ -231,6 +440,7 @@ public:
   ClusteringAlgorithm* clone() const { return new ShuffleClusteringAlgorithm(*algo_, fromDivider_, toDivider_); }
   virtual ~ShuffleClusteringAlgorithm() { delete algo_; }
   std::string str() const { return "ShuffleClusteringAlgorithm"; }
+  std::string cacheKey() const;
 
   int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const;
   void clean(ClusterTree& current) const;
@@ -253,6 +463,7 @@ public:
 
     ClusteringAlgorithm* clone() const { return new NTilesRecursiveAlgorithm(*this); }
     std::string str() const { return "NTilesRecursiveAlgorithm"; }
+    std::string cacheKey() const;
 
     int subpartition( ClusterTree& father, ClusterTree *current, std::vector<ClusterTree*>& children, int currentAxis ) const;
     int partition(ClusterTree& current, std::vector<ClusterTree*>& children, int currentAxis) const;
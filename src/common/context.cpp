@@ -52,12 +52,34 @@ namespace trace {
     nodeIndexFunction = nodeIndexFunc;
   }
 
+  /** The trace trees of a worker.
+
+      There is one tree per enclosing context. Only current is used when
+      entering and leaving contexts; trees is searched when the enclosing
+      context changes. Each worker is on its own cache lines so workers do not
+      invalidate each other's lines.
+   */
+  struct alignas(64) Node::Worker {
+    struct Tree {
+      void* enclosing;
+      Node* root;
+      /// Current node of the tree, when it is not the active one
+      Node* current;
+    };
+    /// Current node of the active tree, NULL until its root is created
+    Node* current;
+    void* enclosing;
+    /// Index of the active tree in trees, -1 until its root is created
+    int active;
+    std::vector<Tree> trees;
+    Worker() : current(NULL), enclosing(NULL), active(-1) {}
+  };
+
   bool Node::enabled = true;
-  UM_NS::unordered_map<void*, Node*> Node::currentNodes[MAX_ROOTS];
-  void* Node::enclosingContext[MAX_ROOTS] = {};
+  Node::Worker Node::workers[MAX_ROOTS];
 
   Node::Node(const char* _name, Node* _parent)
-    : name_(_name), data(), parent(_parent), children() {}
+    : name_(_name), data(), parent(_parent), children(), lastChild_(NULL) {}
 
   Node::~Node() {
     for (std::vector<Node*>::iterator it = children.begin(); it != children.end(); ++it) {
@@ -66,35 +88,44 @@ namespace trace {
   }
 
   void Node::enterContext(const char* name) {
-    Node* current = currentNode();
-    assert(current);
-    Node* child = current->findChild(name);
     int index = currentNodeIndex();
-    void* enclosing = enclosingContext[index];
+    Worker& worker = workers[index];
+    Node* current = currentNode(worker, index);
+    Node* child = current->findChild(name);
 
     if (!child) {
       child = new Node(name, current);
       current->children.push_back(child);
+      current->lastChild_ = child;
     }
-    assert(child);
-    currentNodes[index][enclosing] = child;
-    current = child;
-    current->data.lastEnterTime = now();
-    current->data.n += 1;
+    worker.current = child;
+    child->data.n += 1;
+    // The counters are read out of the timed section as it is a system call
+    if (hmat::PerfCounters::enabled())
+      hmat::PerfCounters::read(child->data.lastEnterPerf, &child->data.lastEnterPerfGroup);
+    child->data.lastEnterTime = now();
   }
 
   void Node::leaveContext() {
-    int index = currentNodeIndex();
-    void* enclosing = enclosingContext[index];
-    Node* current = currentNodes[index][enclosing];
+    Worker& worker = workers[currentNodeIndex()];
+    Node* current = worker.current;
     assert(current);
 
     current->data.totalTime += time_diff_in_nanos(current->data.lastEnterTime, now());
+    if (hmat::PerfCounters::enabled()) {
+      int64_t perf[hmat::PerfCounters::NB_EVENT];
+      int group;
+      hmat::PerfCounters::read(perf, &group);
+      // The sample is dropped if the context was entered by another thread
+      if (group >= 0 && group == current->data.lastEnterPerfGroup)
+        for (int i = 0; i < hmat::PerfCounters::NB_EVENT; i++)
+          current->data.totalPerf[i] += perf[i] - current->data.lastEnterPerf[i];
+    }
 
     if (!(current->parent)) {
       std::cout << "Warning! Closing root node." << std::endl;
     } else {
-      currentNodes[index][enclosing] = current->parent;
+      worker.current = current->parent;
     }
   }
 
@@ -103,12 +134,28 @@ namespace trace {
   }
 
   void Node::setEnclosingContext(void* enclosing) {
-    int index = currentNodeIndex();
-    enclosingContext[index] = enclosing;
+    Worker& worker = workers[currentNodeIndex()];
+    if (enclosing == worker.enclosing)
+      return;
+    // Save the current node of the active tree and restore the one of the new tree
+    if (worker.active >= 0)
+      worker.trees[worker.active].current = worker.current;
+    worker.enclosing = enclosing;
+    worker.current = NULL;
+    worker.active = -1;
+    for (size_t i = 0; i < worker.trees.size(); i++) {
+      if (worker.trees[i].enclosing == enclosing) {
+        worker.active = i;
+        worker.current = worker.trees[i].current;
+        break;
+      }
+    }
   }
 
-  void Node::incrementFlops(int64_t flops) {
-    currentNode()->data.totalFlops += flops;
+  void Node::incrementFlops(int64_t flops, int64_t bytes) {
+    NodeData & d = currentNode()->data;
+    d.totalFlops += flops;
+    d.totalBytes += bytes;
   }
 
   void Node::startComm() {
@@ -117,16 +164,19 @@ namespace trace {
 
   void Node::endComm() {
     Node* current = currentNode();
-    current->data.totalCommTime += time_diff_in_nanos(current->data.lastEnterTime, now());
+    current->data.totalCommTime += time_diff_in_nanos(current->data.lastCommInitiationTime, now());
   }
 
   Node* Node::findChild(const char* name) const {
+    if (lastChild_ && lastChild_->name_ == name)
+      return lastChild_;
     for (std::vector<Node*>::const_iterator it = children.begin(); it != children.end(); ++it) {
       // On cherche la correspondance avec le pointeur. Puisqu'on demande que
       // tous les noms soient des pointeurs qui existent tout le long de
       // l'execution, on peut forcer l'unicite.
       if ((*it)->name_ == name) {
-	return *it;
+        lastChild_ = *it;
+        return *it;
       }
     }
     return NULL;
@@ -139,9 +189,18 @@ namespace trace {
       << "\"n\": " << data.n << ", "
       << "\"totalTime\": " << data.totalTime / 1e9 << ", "
       << "\"totalFlops\": " << data.totalFlops << ", "
+      << "\"totalBytes\": " << data.totalBytes << ", "
       << "\"totalBytesSent\": " << data.totalBytesSent << ", "
       << "\"totalBytesReceived\": " << data.totalBytesReceived << ", "
-      << "\"totalCommTime\": " << data.totalCommTime / 1e9 << "," << std::endl;
+      << "\"totalCommTime\": " << data.totalCommTime / 1e9 << ", ";
+    if (hmat::PerfCounters::enabled()) {
+      for (int i = 0; i < hmat::PerfCounters::NB_EVENT; i++) {
+        hmat::PerfCounters::Event e = hmat::PerfCounters::Event(i);
+        if (hmat::PerfCounters::available(e))
+          f << "\"" << hmat::PerfCounters::name(e) << "\": " << data.totalPerf[i] << ", ";
+      }
+    }
+    f << std::endl;
     f << "\"children\": [";
     std::string delimiter("");
     for (std::vector<Node*>::const_iterator it = children.begin(); it != children.end(); ++it) {
@@ -158,46 +217,44 @@ namespace trace {
     f << "[";
     std::string delimiter("");
     for (int i = 0; i < MAX_ROOTS; i++) {
-      if (!currentNodes[i].empty()) {
-        UM_NS::unordered_map<void*, Node*>::iterator p = currentNodes[i].begin();
-        for(; p != currentNodes[i].end(); ++p) {
-          Node* root = p->second;
-          f << delimiter << std::endl;
-          root->jsonDump(f);
-          delimiter = ", ";
-        }
+      for (size_t t = 0; t < workers[i].trees.size(); t++) {
+        f << delimiter << std::endl;
+        workers[i].trees[t].root->jsonDump(f);
+        delimiter = ", ";
       }
     }
     f << std::endl << "]" << std::endl;
   }
 
-  /** Find the current node, allocating one if necessary.
-   */
   Node* Node::currentNode() {
     int index = currentNodeIndex();
-    void* enclosing = enclosingContext[index];
-    UM_NS::unordered_map<void*, Node*>::iterator it = currentNodes[index].find(enclosing);
-    Node* current;
-    if (it == currentNodes[index].end()) {
-      // TODO : avec toyrt, les threads 1 et 2 ne sont pas des workers, ce sont les threads IO & MPI
-      // Il faudrait que le code appelant donne le nom du noeud plutot qu'un index
-      char *name = const_cast<char*>("root");
-      if (index != 0) {
-        name = strdup("Worker #XXX - 0xXXXXXXXXXXXXXXXX"); // Worker ID - enclosing
-        assert(name);
+    return currentNode(workers[index], index);
+  }
+
+  /** Find the current node, allocating the root if necessary.
+   */
+  Node* Node::currentNode(Worker& worker, int index) {
+    if (worker.current)
+      return worker.current;
+    // TODO : avec toyrt, les threads 1 et 2 ne sont pas des workers, ce sont les threads IO & MPI
+    // Il faudrait que le code appelant donne le nom du noeud plutot qu'un index
+    char *name = const_cast<char*>("root");
+    if (index != 0) {
+      name = strdup("Worker #XXX - 0xXXXXXXXXXXXXXXXX"); // Worker ID - enclosing
+      assert(name);
 #ifdef _MSC_VER
-        // old Visual C++ do not have snprintf
-        sprintf(name,
+      // old Visual C++ do not have snprintf
+      sprintf(name,
 #else
-        snprintf(name, strlen(name)+1,
+      snprintf(name, strlen(name)+1,
 #endif
-        "Worker #%03d - %p", index, enclosing);
-      }
-      current = new Node(name, NULL);
-      currentNodes[index][enclosing] = current;
-    } else {
-      current = it->second;
+      "Worker #%03d - %p", index, worker.enclosing);
     }
-    return current;
+    Node* root = new Node(name, NULL);
+    Worker::Tree tree = { worker.enclosing, root, root };
+    worker.active = worker.trees.size();
+    worker.trees.push_back(tree);
+    worker.current = root;
+    return root;
   }
 }
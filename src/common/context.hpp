@@ -28,17 +28,10 @@
 
 #include "hmat/config.h"
 #include "common/chrono.h"
+#include "common/perf_counters.hpp"
 #include <vector>
 #include <fstream>
 
-#if (__cplusplus > 201103L) || defined(HAVE_CPP11) || defined(_MSC_VER) || defined(_LIBCPP_VERSION)
-  #include <unordered_map>
-  #define UM_NS std
-#else
-  #include <tr1/unordered_map>
-  #define UM_NS std::tr1
-#endif
-
 namespace hmat {
 
 // See http://herbsutter.com/2009/10/18/mailbag-shutting-up-compiler-warnings/
@@ -54,11 +47,18 @@ namespace trace {
     unsigned int n;
     int64_t totalTime; // ns
     int64_t totalFlops;
+    /// Memory traffic of the BLAS and LAPACK calls, see hmat::FlopCounter
+    int64_t totalBytes;
     int totalBytesSent;
     int totalBytesReceived;
     int64_t totalCommTime;
     Time lastEnterTime;
     Time lastCommInitiationTime;
+    /// Hardware counters, only read if hmat::PerfCounters is enabled
+    int64_t totalPerf[hmat::PerfCounters::NB_EVENT];
+    int64_t lastEnterPerf[hmat::PerfCounters::NB_EVENT];
+    /// Counters read by lastEnterPerf, see hmat::PerfCounters::read
+    int lastEnterPerfGroup;
   };
 
   // Maximum number of parallel workers + 1 (for the main non-parallel context)
@@ -92,9 +92,11 @@ namespace trace {
     Node* parent;
     /// Ordered list of children nodes.
     std::vector<Node*> children;
-    /// List of trace trees.
-    static UM_NS::unordered_map<void*, Node*> currentNodes[MAX_ROOTS]; // TODO: padding to avoid false sharing ?
-    static void* enclosingContext[MAX_ROOTS]; // TODO: padding to avoid false sharing ?
+    /// Last child found by findChild, as a context is usually entered many times in a row.
+    mutable Node* lastChild_;
+    /// Trace trees and current node of a worker, padded to a cache line.
+    struct Worker;
+    static Worker workers[MAX_ROOTS];
 
   public:
     /** Enter a context noted by a name.
@@ -113,7 +115,7 @@ namespace trace {
     static void setEnclosingContext(void* enclosing);
     static void enable() {enabled = true;}
     static void disable() {enabled = false;}
-    static void incrementFlops(int64_t flops);
+    static void incrementFlops(int64_t flops, int64_t bytes = 0);
     static void startComm();
     static void endComm();
     /** Dumps the trace trees to a JSON file.
@@ -125,6 +127,8 @@ namespace trace {
     ~Node();
     Node* findChild(const char* name) const;
     void jsonDump(std::ofstream& f) const;
+    /** The current node of a worker, creating its root if needed */
+    static Node* currentNode(Worker & worker, int index);
     static Node* currentNode();
   };
 }
@@ -0,0 +1,181 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "common/flop_counter.hpp"
+#include "common/context.hpp"
+#include "common/chrono.h"
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace hmat {
+
+namespace {
+
+/** Counters of a thread */
+struct ThreadCounters {
+  FlopCounter::Counters phases[FlopCounter::NB_PHASE];
+  /// Start of the current phase, or of the last nested scope
+  int64_t since;
+  ThreadCounters() : since(0) {
+    memset(phases, 0, sizeof(phases));
+  }
+};
+
+/** The counters of all the threads, they are never freed so they outlive the threads */
+struct Registry {
+  std::mutex mutex;
+  std::vector<ThreadCounters*> threads;
+};
+
+Registry & registry() {
+  static Registry r;
+  return r;
+}
+
+thread_local FlopCounter::Phase threadPhase = FlopCounter::OTHER;
+
+#ifdef HAVE_CONTEXT
+ThreadCounters & local() {
+  static thread_local ThreadCounters * counters = NULL;
+  if (counters == NULL) {
+    counters = new ThreadCounters();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    registry().threads.push_back(counters);
+  }
+  return *counters;
+}
+
+int64_t nanoseconds() {
+  Time t = now();
+  return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+/** Add the time since the last change to the current phase */
+void updateTime(ThreadCounters & c, int64_t t) {
+  if (threadPhase != FlopCounter::OTHER)
+    c.phases[threadPhase].time += t - c.since;
+  c.since = t;
+}
+#endif
+
+}
+
+const char * FlopCounter::name(Phase phase) {
+  static const char * names[NB_PHASE] = {
+    "other", "assembly", "compression", "truncate", "gemm", "trsm", "factorization"};
+  return names[phase];
+}
+
+FlopCounter::Scope::Scope(Phase phase) : previous_(threadPhase) {
+#ifdef HAVE_CONTEXT
+  updateTime(local(), nanoseconds());
+#endif
+  threadPhase = phase;
+}
+
+FlopCounter::Scope::~Scope() {
+#ifdef HAVE_CONTEXT
+  updateTime(local(), nanoseconds());
+#endif
+  threadPhase = previous_;
+}
+
+FlopCounter::Phase FlopCounter::currentPhase() {
+  return threadPhase;
+}
+
+#ifdef HAVE_CONTEXT
+void FlopCounter::count(int64_t flops, int64_t bytes) {
+  Counters & c = local().phases[threadPhase];
+  c.flops += flops;
+  c.bytes += bytes;
+  c.calls++;
+  trace::Node::incrementFlops(flops, bytes);
+}
+
+void FlopCounter::threadTotals(int64_t & flops, int64_t & bytes) {
+  const ThreadCounters & c = local();
+  flops = 0;
+  bytes = 0;
+  for (int i = 0; i < NB_PHASE; i++) {
+    flops += c.phases[i].flops;
+    bytes += c.phases[i].bytes;
+  }
+}
+#endif
+
+void FlopCounter::totals(Counters result[NB_PHASE]) {
+  memset(result, 0, NB_PHASE * sizeof(Counters));
+  std::lock_guard<std::mutex> lock(registry().mutex);
+  for (size_t t = 0; t < registry().threads.size(); t++) {
+    const ThreadCounters & c = *registry().threads[t];
+    for (int i = 0; i < NB_PHASE; i++) {
+      result[i].flops += c.phases[i].flops;
+      result[i].bytes += c.phases[i].bytes;
+      result[i].calls += c.phases[i].calls;
+      result[i].time += c.phases[i].time;
+    }
+  }
+}
+
+void FlopCounter::reset() {
+  std::lock_guard<std::mutex> lock(registry().mutex);
+  for (size_t t = 0; t < registry().threads.size(); t++)
+    memset(registry().threads[t]->phases, 0, sizeof(registry().threads[t]->phases));
+}
+
+void FlopCounter::report(FILE * out) {
+  Counters c[NB_PHASE];
+  totals(c);
+#ifndef HAVE_CONTEXT
+  fprintf(out, "# Flop accounting is disabled, build hmat with HMAT_CONTEXT=ON\n");
+#endif
+  fprintf(out, "# Time is summed over the threads, the rates are per thread\n");
+  fprintf(out, "%-14s %12s %10s %12s %12s %10s %10s %10s\n", "phase", "calls", "time (s)",
+          "GFlop", "GB", "GFlop/s", "GB/s", "flop/byte");
+  Counters total;
+  memset(&total, 0, sizeof(total));
+  for (int i = 0; i <= NB_PHASE; i++) {
+    const Counters & p = i < NB_PHASE ? c[i] : total;
+    if (i < NB_PHASE) {
+      total.flops += p.flops;
+      total.bytes += p.bytes;
+      total.calls += p.calls;
+      total.time += p.time;
+    }
+    const double time = p.time * 1e-9;
+    fprintf(out, "%-14s %12ld %10.3f %12.3f %12.3f", i < NB_PHASE ? name(Phase(i)) : "total",
+            (long) p.calls, time, p.flops * 1e-9, p.bytes * 1e-9);
+    // Time is not measured outside the scopes
+    if (time > 0 && i != OTHER && i < NB_PHASE)
+      fprintf(out, " %10.3f %10.3f", p.flops * 1e-9 / time, p.bytes * 1e-9 / time);
+    else
+      fprintf(out, " %10s %10s", "-", "-");
+    if (p.bytes > 0)
+      fprintf(out, " %10.3f\n", double(p.flops) / p.bytes);
+    else
+      fprintf(out, " %10s\n", "-");
+  }
+}
+
+}  // end namespace hmat
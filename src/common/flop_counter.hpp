@@ -0,0 +1,169 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Flop and memory traffic accounting of the BLAS and LAPACK calls.
+*/
+#pragma once
+
+#include "config.h"
+#include "data_types.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <stdint.h>
+
+namespace hmat {
+
+/*! \brief Flops and bytes of the BLAS and LAPACK calls, by phase of the computation.
+
+  Every call of the proxy_cblas and proxy_lapack wrappers counts its flops
+  (with the Multipliers of its scalar type) and the memory traffic of its
+  operands: each input read once, each output read and written once. The
+  counts are added to the current trace context (see trace::Node) and to
+  the current phase of the calling thread, which is set by a Scope.
+  Time is only measured inside a Scope, and the time of a nested scope is
+  not counted in the enclosing one, so flops / time is the rate achieved by
+  one thread in a phase, and flops / bytes its arithmetic intensity.
+
+  The accounting is only compiled with HAVE_CONTEXT (HMAT_CONTEXT cmake option).
+  The phase is always tracked, it is also used by MemoryInstrumenter.
+ */
+class FlopCounter {
+public:
+  enum Phase { OTHER, ASSEMBLY, COMPRESSION, TRUNCATE, GEMM, TRSM, FACTORIZATION, NB_PHASE };
+  struct Counters {
+    int64_t flops;
+    int64_t bytes;
+    /// Number of BLAS and LAPACK calls
+    int64_t calls;
+    /// Time spent in the phase in ns, summed over the threads
+    int64_t time;
+  };
+  static const char * name(Phase phase);
+
+  /*! \brief Set the phase of the calling thread until the end of the scope */
+  class Scope {
+    Phase previous_;
+  public:
+    explicit Scope(Phase phase);
+    ~Scope();
+  };
+  /** Phase of the calling thread, also maintained without HAVE_CONTEXT */
+  static Phase currentPhase();
+
+#ifdef HAVE_CONTEXT
+  static void count(int64_t flops, int64_t bytes);
+  /** Flops and bytes counted by the calling thread since its start */
+  static void threadTotals(int64_t & flops, int64_t & bytes);
+#else
+  static void count(int64_t, int64_t) {}
+  static void threadTotals(int64_t & flops, int64_t & bytes) { flops = 0; bytes = 0; }
+#endif
+  /** Sum of the counters of all the threads. Should not be called during a computation. */
+  static void totals(Counters result[NB_PHASE]);
+  /** Clear the counters of all the threads. Should not be called during a computation. */
+  static void reset();
+  /** Write a table with the rate and arithmetic intensity of each phase */
+  static void report(FILE * out);
+};
+
+/** Count adds additions and muls multiplications of T, on elements values of T */
+template<typename T> inline void countFlops(int64_t adds, int64_t muls, int64_t elements) {
+  // The formulas may be slightly negative for tiny sizes
+  FlopCounter::count(Multipliers<T>::add * (adds > 0 ? adds : 0) + Multipliers<T>::mul * (muls > 0 ? muls : 0),
+                     sizeof(T) * elements);
+}
+
+/** Operation counts of the BLAS and LAPACK functions, from LAPACK Working Note 41 */
+namespace flops {
+
+template<typename T> inline void axpy(int64_t n) {
+  countFlops<T>(n, n, 3 * n);
+}
+template<typename T> inline void dot(int64_t n) {
+  countFlops<T>(n, n, 2 * n);
+}
+template<typename T> inline void iamax(int64_t n) {
+  countFlops<T>(n, 0, n);
+}
+template<typename T> inline void scal(int64_t n) {
+  countFlops<T>(0, n, 2 * n);
+}
+template<typename T> inline void gemv(int64_t m, int64_t n) {
+  countFlops<T>(m * n, m * n, m * n + n + 2 * m);
+}
+template<typename T> inline void ger(int64_t m, int64_t n) {
+  countFlops<T>(m * n, m * n, 2 * m * n + m + n);
+}
+template<typename T> inline void gemm(int64_t m, int64_t n, int64_t k) {
+  countFlops<T>(m * n * k, m * n * k, m * k + k * n + 2 * m * n);
+}
+/** trmm and trsm of a m x n matrix */
+template<typename T> inline void triangular(char side, int64_t m, int64_t n) {
+  const int64_t k = side == 'L' ? m : n;
+  const int64_t other = side == 'L' ? n : m;
+  countFlops<T>(other * k * (k - 1) / 2, other * k * (k + 1) / 2, k * (k + 1) / 2 + 2 * m * n);
+}
+template<typename T> inline void getrf(int64_t m, int64_t n) {
+  const int64_t k = m < n ? m : n;
+  const int64_t l = m < n ? n : m;
+  countFlops<T>(l * k * k / 2 - k * k * k / 6 - l * k / 2 + k / 6,
+                l * k * k / 2 - k * k * k / 6 + l * k / 2 - k * k / 2 + 2 * k / 3,
+                2 * m * n);
+}
+template<typename T> inline void getri(int64_t n) {
+  countFlops<T>(2 * n * n * n / 3 - 3 * n * n / 2 + 5 * n / 6,
+                2 * n * n * n / 3 + n * n / 2 + 5 * n / 6, 2 * n * n);
+}
+template<typename T> inline void getrs(int64_t n, int64_t nrhs) {
+  countFlops<T>(n * n * nrhs, (n * n - n) * nrhs, n * n + 2 * n * nrhs);
+}
+template<typename T> inline void potrf(int64_t n) {
+  countFlops<T>(n * n * n / 6 - n / 6, n * n * n / 6 + n * n / 2 + n / 3, n * n);
+}
+template<typename T> inline void geqrf(int64_t m, int64_t n) {
+  const int64_t k = m < n ? m : n;
+  const int64_t l = m < n ? n : m;
+  countFlops<T>(l * k * k + k * k * k / 3 + 2 * l * k - k * k / 2 + 5 * k / 6,
+                l * k * k - k * k * k / 3 + l * k + k * k / 2 + 29 * k / 6, 2 * m * n);
+}
+/** ormqr and unmqr, product of a m x n matrix by k reflectors */
+template<typename T> inline void ormqr(char side, int64_t m, int64_t n, int64_t k) {
+  const int64_t r = side == 'L' ? m : n;
+  const int64_t c = side == 'L' ? n : m;
+  countFlops<T>(2 * r * c * k - c * k * k + c * k, 2 * r * c * k - c * k * k + 2 * c * k, 2 * m * n + r * k);
+}
+/** gesdd and gesvd. This is a rough approximation (Golub gives 14 mn^2 + 8 n^3 for real numbers) */
+template<typename T> inline void svd(int64_t m, int64_t n) {
+  const int64_t k = m < n ? m : n;
+  const int64_t l = m < n ? n : m;
+  countFlops<T>(7 * l * k * k + 4 * k * k * k, 7 * l * k * k + 4 * k * k * k, 2 * m * n + (m + n) * k);
+}
+/** Copies and permutations */
+template<typename T> inline void copy(int64_t n) {
+  countFlops<T>(0, 0, 2 * n);
+}
+
+}  // end namespace flops
+
+}  // end namespace hmat
@@ -25,8 +25,10 @@
   \brief Memory Allocation tracking.
 */
 #include "memory_instrumentation.hpp"
+#include "common/flop_counter.hpp"
 #include "common/my_assert.h"
 #include <algorithm>
+#include <atomic>
 
 #if defined(HAVE_JEMALLOC) && defined(__linux__)
 #define JEMALLOC_NO_DEMANGLE
@@ -51,6 +53,98 @@ static size_t jemalloc_heapdump_trigger = (size_t)-1;
 
 namespace hmat {
 
+namespace {
+
+/**
+ * Counters of a category, on its own cache line. The peak of the process is
+ * needed so the live bytes are a shared atomic rather than per-thread
+ * counters, but they are updated without lock.
+ */
+struct alignas(64) CategoryCounters {
+    std::atomic<int64_t> live;
+    std::atomic<int64_t> peak;
+    /// Total bytes allocated
+    std::atomic<int64_t> allocated;
+    std::atomic<int> peakPhase;
+};
+
+/// The categories, then the total
+CategoryCounters categories[MemoryInstrumenter::NB_CATEGORY + 1];
+
+thread_local MemoryInstrumenter::Category threadCategory = MemoryInstrumenter::OTHER;
+
+void update(CategoryCounters & c, int64_t size) {
+    const int64_t live = c.live.fetch_add(size, std::memory_order_relaxed) + size;
+    if(size <= 0)
+        return;
+    c.allocated.fetch_add(size, std::memory_order_relaxed);
+    int64_t peak = c.peak.load(std::memory_order_relaxed);
+    while(live > peak) {
+        if(c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+            // Not atomic with the peak, another thread may set a higher peak in between
+            c.peakPhase.store(FlopCounter::currentPhase(), std::memory_order_relaxed);
+            break;
+        }
+    }
+}
+
+void writeCounters(FILE * out, const CategoryCounters & c) {
+    fprintf(out, "{\"live\": %ld, \"peak\": %ld, \"peakPhase\": \"%s\", \"allocated\": %ld}",
+            (long) c.live.load(), (long) c.peak.load(),
+            FlopCounter::name(FlopCounter::Phase(c.peakPhase.load())), (long) c.allocated.load());
+}
+
+}
+
+const char * MemoryInstrumenter::name(Category category) {
+    static const char * names[NB_CATEGORY] = {
+        "other", "rkFactors", "fullLeaves", "acaTemporary", "gemmTemporary", "serialization"};
+    return names[category];
+}
+
+MemoryInstrumenter::Scope::Scope(Category category) : previous_(threadCategory) {
+    threadCategory = category;
+}
+
+MemoryInstrumenter::Scope::~Scope() {
+    threadCategory = previous_;
+}
+
+MemoryInstrumenter::Category MemoryInstrumenter::currentCategory() {
+    return threadCategory;
+}
+
+void MemoryInstrumenter::accountImpl(mem_t size, int category) {
+    update(categories[category], size);
+    update(categories[NB_CATEGORY], size);
+}
+
+void MemoryInstrumenter::writeReport(const char * filename) {
+    FILE * out = fopen(filename, "w");
+    HMAT_ASSERT_MSG(out, "Cannot open %s", filename);
+    fprintf(out, "{\n\"categories\": {");
+    for(int i = 0; i < NB_CATEGORY; i++) {
+        fprintf(out, "%s\n  \"%s\": ", i == 0 ? "" : ",", name(Category(i)));
+        writeCounters(out, categories[i]);
+    }
+    fprintf(out, "\n},\n\"total\": ");
+    writeCounters(out, categories[NB_CATEGORY]);
+    fprintf(out, "\n}\n");
+    HMAT_ASSERT_MSG(fclose(out) == 0, "Cannot write %s", filename);
+}
+
+void MemoryInstrumenter::usage(mem_t & live, mem_t & peak) const {
+    live = categories[NB_CATEGORY].live.load();
+    peak = categories[NB_CATEGORY].peak.load();
+}
+
+void MemoryInstrumenter::resetPeaks() {
+    for(int i = 0; i <= NB_CATEGORY; i++) {
+        categories[i].peak.store(categories[i].live.load());
+        categories[i].peakPhase.store(FlopCounter::currentPhase());
+    }
+}
+
 #ifdef __GLIBC__
 static size_t get_res_mem(void *)
 {
@@ -73,7 +167,12 @@ static size_t get_res_mem(void *)
 }
 #endif
 
-MemoryInstrumenter::MemoryInstrumenter(): enabled_(false) {
+MemoryInstrumenter::MemoryInstrumenter(): enabled_(false), reportEnabled_(false) {
+    char * report = getenv("HMAT_MEMORY_REPORT");
+    if(report) {
+        reportFile_ = report;
+        reportEnabled_ = true;
+    }
     char * ws = getenv("HMAT_MEMINSTR_WS");
     write_sampling = ws ? atoi(ws) : 1;
     char * mi = getenv("HMAT_MEMINSTR_MI");
@@ -238,6 +337,13 @@ void MemoryInstrumenter::finish() {
 
 MemoryInstrumenter::~MemoryInstrumenter() {
     finish();
+    if(!reportFile_.empty()) {
+        try {
+            writeReport(reportFile_.c_str());
+        } catch (const std::exception & e) {
+            fprintf(stderr, "%s\n", e.what());
+        }
+    }
 }
 
 void MemoryInstrumenter::enable() {
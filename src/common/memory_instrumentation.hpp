@@ -37,6 +37,14 @@
 /*! \brief Memory Tracking.
 
   This system is only suited for the specific purpose of the \a HMatrix code.
+
+  Two mechanisms are available:
+  - with HMAT_MEM_INSTR at build time, alloc() and free() write a binary time
+    series of the memory of each type to the file given to setFile().
+  - when the HMAT_MEMORY_REPORT environment variable is set to a file name,
+    account() keeps the live and peak bytes of each Category, and the phase
+    (see FlopCounter) in which the peak happened. They are written to this
+    file in JSON at exit, or by writeReport().
  */
 namespace hmat {
 
@@ -56,7 +64,27 @@ private:
     bool enabled_;
     Time start_;
     mem_t fullMatrixMem_;
+    bool reportEnabled_;
+    std::string reportFile_;
+    void accountImpl(mem_t size, int category);
 public:
+    /** Accounting categories of the ScalarArray and QuantizedArray memory */
+    enum Category { OTHER, RK_FACTORS, FULL_LEAVES, ACA_TEMPORARY, GEMM_TEMPORARY, SERIALIZATION, NB_CATEGORY };
+    static const char * name(Category category);
+
+    /*! \brief Category of the arrays allocated by the calling thread until the end of the scope.
+
+      Arrays given to a leaf (see HMatrix::rk and HMatrix::full) are moved to
+      RK_FACTORS or FULL_LEAVES, whatever their allocation category.
+     */
+    class Scope {
+        Category previous_;
+    public:
+        explicit Scope(Category category);
+        ~Scope();
+    };
+    static Category currentCategory();
+
     static const char FULL_MATRIX = 1;
     static const char FIRST_AVAIL = 11;
     MemoryInstrumenter();
@@ -81,6 +109,29 @@ public:
 #endif
     }
 
+    /** Add size bytes (negative when freed) to a category */
+    void account(mem_t size, Category category) {
+        if(reportEnabled_)
+            accountImpl(size, category);
+    }
+    /** Move size bytes from a category to another one */
+    void move(mem_t size, Category from, Category to) {
+        if(reportEnabled_ && from != to) {
+            accountImpl(size, to);
+            accountImpl(-size, from);
+        }
+    }
+    /** Write the live and peak bytes of each category to a JSON file */
+    void writeReport(const char * filename);
+    /** Start or stop the accounting of the categories, which HMAT_MEMORY_REPORT enables */
+    void enableReport(bool enabled) {
+        reportEnabled_ = enabled;
+    }
+    /** Live and peak bytes of all the categories */
+    void usage(mem_t & live, mem_t & peak) const;
+    /** Restart the peaks from the live bytes */
+    void resetPeaks();
+
     void trig() {
 #ifdef MEM_INSTR
         allocImpl(size, -1);
@@ -0,0 +1,175 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "config.h"
+#include "common/perf_counters.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <atomic>
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace hmat {
+
+const char * PerfCounters::name(Event event) {
+  static const char * names[NB_EVENT] = {"cycles", "instructions", "llcMisses", "stalledCycles"};
+  return names[event];
+}
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+
+namespace {
+
+/** Bit i is set if event i is available, -1 until the first thread opened its counters */
+std::atomic<int> availableEvents(-1);
+/** Identifier of the next ThreadEvents */
+std::atomic<int> nextGroup(0);
+
+/** The counters of a thread, in a single group so they are read with one system call */
+struct ThreadEvents {
+  /// File descriptor of the group leader, -1 if the thread could not open it
+  int leader;
+  int fds[PerfCounters::NB_EVENT];
+  /// Position of each event in the values read from the group, -1 if not available
+  int position[PerfCounters::NB_EVENT];
+  int count;
+  /// Identifier of these counters, see PerfCounters::read
+  int group;
+  ThreadEvents();
+  ~ThreadEvents();
+};
+
+int openEvent(uint64_t config, int group) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // Allowed with perf_event_paranoid <= 2
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  // pid 0 and cpu -1: the calling thread on any CPU
+  return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+ThreadEvents::ThreadEvents() : leader(-1), count(0), group(nextGroup.fetch_add(1)) {
+  static const uint64_t configs[PerfCounters::NB_EVENT] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_STALLED_CYCLES_BACKEND};
+  int available = 0;
+  for (int i = 0; i < PerfCounters::NB_EVENT; i++) {
+    position[i] = -1;
+    const int fd = openEvent(configs[i], leader);
+    if (fd < 0)
+      continue;
+    if (leader < 0)
+      leader = fd;
+    fds[count] = fd;
+    position[i] = count++;
+    available |= 1 << i;
+  }
+  int expected = -1;
+  if (availableEvents.compare_exchange_strong(expected, available)) {
+    if (available == 0) {
+      fprintf(stderr, "Hardware performance counters are not available (%s), "
+              "check /proc/sys/kernel/perf_event_paranoid. HMAT_PERF_COUNTERS is ignored.\n",
+              strerror(errno));
+      PerfCounters::enable(false);
+    } else {
+      for (int i = 0; i < PerfCounters::NB_EVENT; i++)
+        if (position[i] < 0)
+          fprintf(stderr, "Hardware performance counter %s is not available, it will be 0.\n",
+                  PerfCounters::name(PerfCounters::Event(i)));
+    }
+  }
+}
+
+ThreadEvents::~ThreadEvents() {
+  for (int i = 0; i < count; i++)
+    close(fds[i]);
+}
+
+}
+
+std::atomic<bool> PerfCounters::enabled_(getenv("HMAT_PERF_COUNTERS") != NULL);
+
+void PerfCounters::enable(bool enabled) {
+  enabled_ = enabled;
+}
+
+bool PerfCounters::available(Event event) {
+  const int a = availableEvents.load();
+  return a > 0 && (a & (1 << event));
+}
+
+bool PerfCounters::read(int64_t values[NB_EVENT], int * group) {
+  memset(values, 0, NB_EVENT * sizeof(int64_t));
+  if (group != NULL)
+    *group = -1;
+  if (!enabled())
+    return false;
+  static thread_local ThreadEvents events;
+  if (events.leader < 0)
+    return enabled();
+  // nr, time enabled, time running, values
+  uint64_t buffer[3 + NB_EVENT];
+  if (::read(events.leader, buffer, sizeof(buffer)) < 0)
+    return true;
+  if (group != NULL)
+    *group = events.group;
+  // The group did not always run if there are more events than hardware counters
+  const double scale = buffer[2] > 0 ? double(buffer[1]) / buffer[2] : 0;
+  for (int i = 0; i < NB_EVENT; i++)
+    if (events.position[i] >= 0)
+      values[i] = int64_t(buffer[3 + events.position[i]] * scale);
+  return true;
+}
+
+#else
+
+std::atomic<bool> PerfCounters::enabled_(false);
+
+void PerfCounters::enable(bool enabled) {
+  if (enabled)
+    fprintf(stderr, "Hardware performance counters need Linux perf_event, HMAT_PERF_COUNTERS is ignored.\n");
+}
+
+bool PerfCounters::available(Event) {
+  return false;
+}
+
+bool PerfCounters::read(int64_t values[NB_EVENT], int * group) {
+  memset(values, 0, NB_EVENT * sizeof(int64_t));
+  if (group != NULL)
+    *group = -1;
+  return false;
+}
+
+#endif
+
+}  // end namespace hmat
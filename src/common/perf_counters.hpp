@@ -0,0 +1,69 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Hardware performance counters of the calling thread.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+namespace hmat {
+
+/*! \brief Hardware counters read with the Linux perf_event_open interface.
+
+  The collection is enabled by setting the HMAT_PERF_COUNTERS environment
+  variable. Each thread opens its counters the first time it reads them; they
+  only count user space events of this thread. When perf_event_open is not
+  available (other OS, perf_event_paranoid, virtual machine without PMU) the
+  collection is disabled after a warning, and the counters which are not
+  supported by the processor are always 0.
+  Reading the counters is a system call, so they are only read around trace
+  contexts (see trace::Node) and timeline tasks.
+ */
+class PerfCounters {
+public:
+  enum Event { CYCLES, INSTRUCTIONS, LLC_MISSES, STALLED_CYCLES, NB_EVENT };
+  /** Name of an event in the JSON files */
+  static const char * name(Event event);
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+  /** Enable or disable the collection, overriding HMAT_PERF_COUNTERS */
+  static void enable(bool enabled);
+  /** True if the event could be opened by the first thread which read the counters */
+  static bool available(Event event);
+  /**
+   * Read the counters of the calling thread, scaled if they were multiplexed.
+   * @param group if not NULL, set to the identifier of the counters of the
+   * calling thread, or -1 if none were read. Two readings can only be
+   * subtracted if they have the same identifier: a task which migrated to
+   * another thread between them must drop its sample.
+   * @return false and zeros if the collection is disabled
+   */
+  static bool read(int64_t values[NB_EVENT], int * group = NULL);
+private:
+  static std::atomic<bool> enabled_;
+};
+
+}  // end namespace hmat
@@ -1,72 +1,177 @@
 #include "timeline.hpp"
 #include "common/my_assert.h"
+#include <chrono>
+#include <cstring>
 #include <iomanip>
+#include <sstream>
 
 namespace hmat {
 
-#ifndef __GNUG__
-// fwrite is not thread safe in C99 but it is in POSIX and WIN32.
-// libstdc++ use a FILE* as backend
-#error possibly not thread safe ofstream implementation
-#endif
+namespace {
+/** Default number of records of each ring, can be changed with HMAT_TIMELINE_BUFFER */
+const size_t DEFAULT_RING_SIZE = 1 << 14;
+}
+
+struct Timeline::Ring {
+    /// Size of records, a power of 2
+    std::vector<Record> records;
+    /// Number of records written by the owner thread
+    std::atomic<uint64_t> head;
+    /// Number of records written to the file by the flusher
+    std::atomic<uint64_t> tail;
+    int thread;
+    Ring(size_t size, int _thread) : records(size), head(0), tail(0), thread(_thread) {}
+};
 
 Timeline::Task::~Task() {
-    if(workerId_ >= 0) {
-        timestamp();
-        fwrite(buffer, buffer_size, 1, timeline_.files_[workerId_]);
+    if(enabled_) {
+        if(outputRank_)
+            record_.payload[4] = outputRank_(output_);
+        record_.end = timestamp();
+        if(PerfCounters::enabled()) {
+            int64_t perf[PerfCounters::NB_EVENT];
+            int group;
+            PerfCounters::read(perf, &group);
+            // The sample is dropped if the task migrated to another thread
+            for(int i = 0; i < PerfCounters::NB_EVENT; i++)
+                record_.perf[i] = group >= 0 && group == perfGroup_ ? perf[i] - record_.perf[i] : 0;
+        }
+        int64_t flops, bytes;
+        FlopCounter::threadTotals(flops, bytes);
+        record_.flops = flops - record_.flops;
+        record_.bytes = bytes - record_.bytes;
+        timeline_.push(record_);
     }
 }
 
-void Timeline::Task::timestamp() {
+int64_t Timeline::Task::timestamp() {
     Time t = now();
-    int64_t tt = t.tv_sec * 1000000000L + t.tv_nsec;
-    write(tt);
+    return t.tv_sec * 1000000000L + t.tv_nsec;
 }
 
 bool Timeline::Task::init(int workerId, Operation op){
-    if(timeline_.enabled_ && timeline_.opMask_[op]) {
-        if(workerId < 0 && !timeline_.onlyWorker_)
-            workerId_ = timeline_.files_.size() - 1;
-        else
-            workerId_=workerId;
-        assert(workerId_ >= 0 && workerId_ < timeline_.files_.size());
-        write(op);
-        return true;
-    } else {
-        workerId_ = -1;
-        return false;
+    enabled_ = timeline_.enabled_ && timeline_.opMask_[op];
+    if(enabled_) {
+        assert(workerId >= 0 || !timeline_.onlyWorker_);
+        record_.op = op;
+        record_.worker = workerId < 0 ? timeline_.numberOfWorker_ : workerId;
+        record_.blocks = 0;
+        record_.values = 0;
+        FlopCounter::threadTotals(record_.flops, record_.bytes);
+        PerfCounters::read(record_.perf, &perfGroup_);
     }
+    return enabled_;
 }
 
-void Timeline::Task::addBlock(const IndexSet * rows, const IndexSet * cols) {
-    write(rows->offset());
-    write(rows->size());
-    write(cols->offset());
-    write(cols->size());
+void Timeline::Task::write(int value) {
+    const int i = record_.blocks * Record::BLOCK_FIELDS + record_.values;
+    assert(i < Record::PAYLOAD_SIZE);
+    record_.payload[i] = value;
+    record_.values++;
+}
+
+void Timeline::Task::addBlock(const IndexSet * rows, const IndexSet * cols, int rank) {
+    assert(record_.values == 0 && (record_.blocks + 1) * Record::BLOCK_FIELDS <= Record::PAYLOAD_SIZE);
+    int32_t * p = record_.payload + record_.blocks * Record::BLOCK_FIELDS;
+    p[0] = rows->offset();
+    p[1] = rows->size();
+    p[2] = cols->offset();
+    p[3] = cols->size();
+    p[4] = rank;
+    record_.blocks++;
 }
 
 void Timeline::Task::addBlock(int rows, int cols) {
-    write(0);
-    write(rows);
-    write(0);
-    write(cols);
+    assert(record_.values == 0 && (record_.blocks + 1) * Record::BLOCK_FIELDS <= Record::PAYLOAD_SIZE);
+    int32_t * p = record_.payload + record_.blocks * Record::BLOCK_FIELDS;
+    p[0] = 0;
+    p[1] = rows;
+    p[2] = 0;
+    p[3] = cols;
+    p[4] = Record::ARRAY;
+    record_.blocks++;
+}
+
+Timeline::Ring * Timeline::ring() {
+    // Rings are owned by the timeline so they outlive the threads
+    static thread_local Ring * ring = NULL;
+    if(ring == NULL) {
+        size_t size = DEFAULT_RING_SIZE;
+        const char * s = getenv("HMAT_TIMELINE_BUFFER");
+        if(s)
+            size = std::max(atol(s), 2L);
+        // Round up to a power of 2
+        size_t p = 2;
+        while(p < size)
+            p *= 2;
+        std::lock_guard<std::mutex> lock(mutex_);
+        ring = new Ring(p, rings_.size());
+        rings_.push_back(ring);
+    }
+    return ring;
+}
+
+void Timeline::push(Record & record) {
+    Ring * r = ring();
+    const uint64_t size = r->records.size();
+    const uint64_t head = r->head.load(std::memory_order_relaxed);
+    // The ring is full, wait for the flusher
+    while(head - r->tail.load(std::memory_order_acquire) >= size) {
+        wakeUp_.notify_one();
+        std::this_thread::yield();
+    }
+    record.thread = r->thread;
+    r->records[head & (size - 1)] = record;
+    r->head.store(head + 1, std::memory_order_release);
+    // Wake up the flusher when the ring is half full
+    if(((head + 1) & (size / 2 - 1)) == 0)
+        wakeUp_.notify_one();
+}
+
+void Timeline::drain() {
+    for(size_t i = 0; i < rings_.size(); i++) {
+        Ring & r = *rings_[i];
+        const uint64_t size = r.records.size();
+        uint64_t tail = r.tail.load(std::memory_order_relaxed);
+        const uint64_t head = r.head.load(std::memory_order_acquire);
+        while(tail < head) {
+            // Up to the end of the ring, then from its beginning
+            const uint64_t begin = tail & (size - 1);
+            const uint64_t n = std::min(head - tail, size - begin);
+            fwrite(&r.records[begin], sizeof(Record), n, file_);
+            tail += n;
+        }
+        r.tail.store(tail, std::memory_order_release);
+    }
+}
+
+void Timeline::flusherLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(!stop_) {
+        wakeUp_.wait_for(lock, std::chrono::milliseconds(100));
+        drain();
+    }
+    drain();
 }
 
 void Timeline::init(int numberOfWorker, int rank, bool onlyWorker) {
     char * prefix = getenv("HMAT_TIMELINE");
-    if(prefix == NULL)
+    if(prefix == NULL || enabled_)
         return;
-    if(!onlyWorker_)
-        numberOfWorker++;
     assert(numberOfWorker > 0);
-    for(int i = 0; i < numberOfWorker; i++) {
-        std::ostringstream ss;
-        ss << std::setfill('0') << prefix;
-        ss << std::setw(2) << rank << "_" << std::setw(2) << i << ".bin";
-        FILE * f = fopen(ss.str().c_str(), "wb");
-        HMAT_ASSERT(f);
-        files_.push_back(f);
-    }
+    std::ostringstream ss;
+    ss << std::setfill('0') << prefix << std::setw(2) << rank << ".bin";
+    file_ = fopen(ss.str().c_str(), "wb");
+    HMAT_ASSERT_MSG(file_, "Cannot open %s", ss.str().c_str());
+    numberOfWorker_ = numberOfWorker;
+    onlyWorker_ = onlyWorker;
+    FileHeader header;
+    memcpy(header.magic, "HMTL", 4);
+    header.version = 3;
+    header.rank = rank;
+    header.numberOfWorker = onlyWorker ? numberOfWorker : numberOfWorker + 1;
+    fwrite(&header, sizeof(header), 1, file_);
+    flusher_ = std::thread(&Timeline::flusherLoop, this);
     enabled_ = true;
     opMask_.set();
     opMask_[Operation::BLASGEMM] = getenv("HMAT_TIMELINE_GEMM");
@@ -81,13 +186,26 @@ void Timeline::setPackEnabled(bool enabled) {
 }
 
 Timeline::~Timeline() {
-    for(int i = 0; i < files_.size(); i++)
-        fclose(files_[i]);
+    if(!enabled_)
+        return;
+    enabled_ = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wakeUp_.notify_one();
+    flusher_.join();
+    fclose(file_);
+    for(size_t i = 0; i < rings_.size(); i++)
+        delete rings_[i];
 }
 
 void Timeline::flush() {
-    for(int i = 0; i < files_.size(); i++)
-        fflush(files_[i]);
+    if(!enabled_)
+        return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    drain();
+    fflush(file_);
 }
 
 }
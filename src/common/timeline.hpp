@@ -4,50 +4,138 @@
 #include "h_matrix.hpp"
 #include "common/chrono.h"
 #include "common/context.hpp"
+#include "common/flop_counter.hpp"
 #include <bitset>
+#include <stdint.h>
+#ifdef HMAT_TIMELINE
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
 
 namespace hmat {
 
+/**
+ * Record the tasks of the computation in a timeline.
+ *
+ * When HMAT_TIMELINE is enabled at build time and the HMAT_TIMELINE
+ * environment variable is set, each thread appends its tasks to its own
+ * in-memory ring buffer, without lock. A background thread writes the rings
+ * to the binary file $HMAT_TIMELINE<rank>.bin, which writeTrace() converts
+ * to the Chrome trace event format (chrome://tracing, https://ui.perfetto.dev).
+ */
 class Timeline {
+    public:
+    enum Operation { GEMM, AXPY, SOLVE_UPPER, LLT, LDLT, MDMT, M_DIAG,
+                     SOLVE_UPPER_LEFT, ASM, ASM_SYM, SOLVE_LOWER_LEFT,
+                     PACK, UNPACK, INIT, PACK_COUNT, EXTRACT_RK, ASSEMBLE_RK,
+                     MGS, QR, BLASGEMM, COPY_TRUNCATE, COARSEN, PRODUCTQ, SVD,
+                     READ, WRITE, LU, NB_TASK_TYPE};
+    /** Name of an operation in the exported traces */
+    static const char * name(Operation op);
+
+    /** Header of the binary timeline files */
+    struct FileHeader {
+        char magic[4];
+        int32_t version;
+        int32_t rank;
+        int32_t numberOfWorker;
+    };
+    /** A task, as stored in the ring buffers and the binary timeline files */
+    struct Record {
+        /// Fields of each block in payload: rows offset, rows, cols offset, cols, rank
+        static const int BLOCK_FIELDS = 5;
+        static const int PAYLOAD_SIZE = 16;
+        /// Values of the rank field which are not a rank
+        enum { FULL = -1, NOT_LEAF = -2, ARRAY = -3 };
+        int16_t op;
+        int16_t worker;
+        int16_t thread;
+        /// Number of blocks at the beginning of payload
+        int8_t blocks;
+        /// Number of integer values after the blocks
+        int8_t values;
+        int32_t payload[PAYLOAD_SIZE];
+        /// Start and end dates in ns
+        int64_t start;
+        int64_t end;
+        /// Flops and bytes counted by FlopCounter during the task, 0 without HAVE_CONTEXT
+        int64_t flops;
+        int64_t bytes;
+        /// Hardware counters during the task, 0 if PerfCounters is disabled
+        int64_t perf[PerfCounters::NB_EVENT];
+    };
+
+    /**
+     * @brief Convert a binary timeline file to the Chrome trace event JSON format.
+     * Each thread is a track of the process of the file rank. The events hold
+     * the blocks (offsets, sizes and ranks), the integer parameters and the
+     * flops, bytes and hardware counters of the tasks.
+     */
+    static void writeTrace(const char * binaryFile, const char * jsonFile);
+
+    private:
 #ifdef HMAT_TIMELINE
-    std::vector<FILE *> files_;
+    /** Single producer single consumer ring of records */
+    struct Ring;
+    std::vector<Ring *> rings_;
+    /** Protect rings_ and the consumer side of the rings */
+    std::mutex mutex_;
+    std::condition_variable wakeUp_;
+    std::thread flusher_;
+    bool stop_;
+    FILE * file_;
+    int numberOfWorker_;
     bool enabled_;
     bool onlyWorker_;
-    Timeline() : enabled_(false) {}
+    Timeline() : stop_(false), file_(NULL), numberOfWorker_(0), enabled_(false), onlyWorker_(false) {}
     ~Timeline();
+    /** The ring of the calling thread */
+    Ring * ring();
+    void push(Record & record);
+    /** Write the content of the rings to file_, mutex_ must be locked */
+    void drain();
+    void flusherLoop();
 #endif
     public:
-    enum Operation { GEMM, AXPY, SOLVE_UPPER, LLT, LDLT, MDMT, M_DIAG,
-                     SOLVE_UPPER_LEFT, ASM, ASM_SYM, SOLVE_LOWER_LEFT,
-                     PACK, UNPACK, INIT, PACK_COUNT, EXTRACT_RK, ASSEMBLE_RK,
-                     MGS, QR, BLASGEMM, COPY_TRUNCATE, COARSEN, PRODUCTQ, SVD,
-                     READ, WRITE, NB_TASK_TYPE};
     std::bitset<NB_TASK_TYPE> opMask_;
     class Task {
 #ifdef HMAT_TIMELINE
-        char buffer[68]; // 68 bytes = 'op' (4 bytes) + payload (48 bytes max) + 2 timestamps (2x8 bytes)
-        int buffer_size;
+        Record record_;
         Timeline & timeline_;
-        int workerId_;
-        template<typename T> void write(T num) {
-            *reinterpret_cast<T*>(buffer+buffer_size) = num;
-            buffer_size += sizeof(T);
-        }
+        bool enabled_;
+        /// Hardware counters read at the start of the task, see PerfCounters::read
+        int perfGroup_;
+        /// The first block, whose rank is read again at the end of the task
+        const void * output_;
+        int (*outputRank_)(const void *);
         bool init(int workerId, Operation op);
-        void timestamp();
-        void addBlock(const IndexSet * rows, const IndexSet * cols);
+        int64_t timestamp();
+        void write(int value);
+        void addBlock(const IndexSet * rows, const IndexSet * cols, int rank);
         void addBlock(int rows, int cols);
-        template<typename T> void addBlock(HMatrix<T> * m) {
-            addBlock(m->rows(), m->cols());
+        template<typename T> static int blockRank(const void * block) {
+            const HMatrix<T> * m = static_cast<const HMatrix<T> *>(block);
+            if (!m->isLeaf())
+                return Record::NOT_LEAF;
+            return m->isRkMatrix() ? m->rank() : Record::FULL;
+        }
+        template<typename T> void addBlock(const HMatrix<T> * m) {
+            if (record_.blocks == 0) {
+                output_ = m;
+                outputRank_ = &blockRank<T>;
+            }
+            addBlock(m->rows(), m->cols(), blockRank<T>(m));
         }
-        template<typename T> void addBlock(ScalarArray<T> * m) {
+        template<typename T> void addBlock(const ScalarArray<T> * m) {
             addBlock(m->rows, m->cols);
         }
     public:
         /** Shortcut API to record a new Task with blocks */
-        template<typename T> Task(Operation op, HMatrix<T> * block1,
-            HMatrix<T> * block2 = NULL, HMatrix<T> * block3 = NULL):
-            buffer_size(0), timeline_(instance()) {
+        template<typename T> Task(Operation op, const HMatrix<T> * block1,
+            const HMatrix<T> * block2 = NULL, const HMatrix<T> * block3 = NULL):
+            timeline_(instance()), output_(NULL), outputRank_(NULL) {
           // I use trace::currentNodeIndex() to get the worker id for any runtime.
           // I do '-1' to get a value of -1 for sequential section.
             if(init(trace::currentNodeIndex()-1, op)) {
@@ -57,13 +145,13 @@ class Timeline {
                     addBlock(block2);
                 if(block3)
                     addBlock(block3);
-                timestamp();
+                record_.start = timestamp();
             }
         }
         /** Shortcut API to record a new Task with blocks */
-        template<typename T> Task(Operation op, ScalarArray<T> * block1,
-            HMatrix<T> * block2 = NULL, ScalarArray<T> * block3 = NULL):
-            buffer_size(0), timeline_(instance()) {
+        template<typename T> Task(Operation op, const ScalarArray<T> * block1,
+            const HMatrix<T> * block2 = NULL, const ScalarArray<T> * block3 = NULL):
+            timeline_(instance()), output_(NULL), outputRank_(NULL) {
             if(init(trace::currentNodeIndex()-1, op)) {
                 if(block1)
                     addBlock(block1);
@@ -71,28 +159,28 @@ class Timeline {
                     addBlock(block2);
                 if(block3)
                     addBlock(block3);
-                timestamp();
+                record_.start = timestamp();
             }
         }
         /** Constructor to record a new Task with integers parameters (QR, MGS, BLASGEMM, ...) */
         Task(Operation op, const int *a=NULL, const int *b=NULL, const int *c=NULL, const int *d=NULL, const int *e=NULL):
-          buffer_size(0), timeline_(instance()) {
+          timeline_(instance()), output_(NULL), outputRank_(NULL) {
           if(init(trace::currentNodeIndex()-1, op)) {
             if (a) write(*a);
             if (b) write(*b);
             if (c) write(*c);
             if (d) write(*d);
             if (e) write(*e);
-            timestamp();
+            record_.start = timestamp();
           }
         }
         ~Task();
 #else
     public:
-        template<typename T> Task(Operation op, HMatrix<T> * block1,
-            HMatrix<T> * block2 = NULL, HMatrix<T> * block3 = NULL){}
-        template<typename T> Task(Operation op, ScalarArray<T> * block1,
-            HMatrix<T> * block2 = NULL, ScalarArray<T> * block3 = NULL){}
+        template<typename T> Task(Operation op, const HMatrix<T> * block1,
+            const HMatrix<T> * block2 = NULL, const HMatrix<T> * block3 = NULL){}
+        template<typename T> Task(Operation op, const ScalarArray<T> * block1,
+            const HMatrix<T> * block2 = NULL, const ScalarArray<T> * block3 = NULL){}
         Task(Operation op, const int *a=NULL, const int *b=NULL, const int *c=NULL, const int *d=NULL, const int *e=NULL) {
             (void)op, (void)a, (void)b, (void)c, (void)d, (void)e; // unused
         }
@@ -120,6 +208,7 @@ class Timeline {
         static Timeline instance;
         return instance;
     }
+    /** Write the recorded tasks to the timeline file */
     void flush();
 };
 
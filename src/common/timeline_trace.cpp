@@ -0,0 +1,134 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Conversion of the binary timeline files to the Chrome trace event format.
+
+  This file is built even without HMAT_TIMELINE, so the files of an
+  instrumented build can be converted by any build.
+*/
+#include "common/timeline.hpp"
+#include "common/my_assert.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <set>
+
+namespace hmat {
+
+const char * Timeline::name(Operation op) {
+    static const char * names[NB_TASK_TYPE] = {
+        "GEMM", "AXPY", "SOLVE_UPPER", "LLT", "LDLT", "MDMT", "M_DIAG",
+        "SOLVE_UPPER_LEFT", "ASM", "ASM_SYM", "SOLVE_LOWER_LEFT",
+        "PACK", "UNPACK", "INIT", "PACK_COUNT", "EXTRACT_RK", "ASSEMBLE_RK",
+        "MGS", "QR", "BLASGEMM", "COPY_TRUNCATE", "COARSEN", "PRODUCTQ", "SVD",
+        "READ", "WRITE", "LU"};
+    return op >= 0 && op < NB_TASK_TYPE ? names[op] : "UNKNOWN";
+}
+
+namespace {
+
+void writeBlock(FILE * out, const int32_t * b) {
+    fprintf(out, "{\"rowsOffset\":%d,\"rows\":%d,\"colsOffset\":%d,\"cols\":%d", b[0], b[1], b[2], b[3]);
+    switch(b[4]) {
+    case Timeline::Record::FULL:
+        fprintf(out, ",\"type\":\"full\"}");
+        break;
+    case Timeline::Record::NOT_LEAF:
+        fprintf(out, ",\"type\":\"hmatrix\"}");
+        break;
+    case Timeline::Record::ARRAY:
+        fprintf(out, ",\"type\":\"array\"}");
+        break;
+    default:
+        fprintf(out, ",\"type\":\"rk\",\"rank\":%d}", b[4]);
+    }
+}
+
+}
+
+void Timeline::writeTrace(const char * binaryFile, const char * jsonFile) {
+    FILE * in = fopen(binaryFile, "rb");
+    HMAT_ASSERT_MSG(in, "Cannot open %s", binaryFile);
+    FileHeader header;
+    if(fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, "HMTL", 4) != 0 || header.version != 3) {
+        fclose(in);
+        HMAT_ASSERT_MSG(false, "%s is not a timeline file", binaryFile);
+    }
+    std::vector<Record> records;
+    Record r;
+    while(fread(&r, sizeof(r), 1, in) == 1)
+        records.push_back(r);
+    fclose(in);
+
+    FILE * out = fopen(jsonFile, "w");
+    HMAT_ASSERT_MSG(out, "Cannot open %s", jsonFile);
+    int64_t origin = std::numeric_limits<int64_t>::max();
+    std::set<int> threads;
+    for(size_t i = 0; i < records.size(); i++) {
+        origin = std::min(origin, records[i].start);
+        threads.insert(records[i].thread);
+    }
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"hmat rank %d\"}}",
+            header.rank, header.rank);
+    for(std::set<int>::const_iterator it = threads.begin(); it != threads.end(); ++it)
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                header.rank, *it, *it);
+    for(size_t i = 0; i < records.size(); i++) {
+        const Record & e = records[i];
+        // Complete events, dates in µs
+        fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"hmat\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                "\"args\":{\"worker\":%d", name(Operation(e.op)), header.rank, e.thread,
+                (e.start - origin) * 1e-3, (e.end - e.start) * 1e-3, e.worker);
+        const int blocks = std::min<int>(e.blocks, Record::PAYLOAD_SIZE / Record::BLOCK_FIELDS);
+        if(blocks > 0) {
+            fprintf(out, ",\"blocks\":[");
+            for(int b = 0; b < blocks; b++) {
+                if(b > 0)
+                    fprintf(out, ",");
+                writeBlock(out, e.payload + b * Record::BLOCK_FIELDS);
+            }
+            fprintf(out, "]");
+        }
+        const int first = blocks * Record::BLOCK_FIELDS;
+        const int values = std::min<int>(e.values, Record::PAYLOAD_SIZE - first);
+        if(values > 0) {
+            fprintf(out, ",\"values\":[");
+            for(int v = 0; v < values; v++)
+                fprintf(out, v > 0 ? ",%d" : "%d", e.payload[first + v]);
+            fprintf(out, "]");
+        }
+        if(e.flops > 0 || e.bytes > 0)
+            fprintf(out, ",\"flops\":%ld,\"bytes\":%ld", (long) e.flops, (long) e.bytes);
+        for(int p = 0; p < PerfCounters::NB_EVENT; p++)
+            if(e.perf[p] > 0)
+                fprintf(out, ",\"%s\":%ld", PerfCounters::name(PerfCounters::Event(p)), (long) e.perf[p]);
+        fprintf(out, "}}");
+    }
+    fprintf(out, "\n]}\n");
+    HMAT_ASSERT_MSG(fclose(out) == 0, "Cannot write %s", jsonFile);
+}
+
+}
@@ -40,8 +40,10 @@
 #include "blas_overloads.hpp"
 #include "full_matrix.hpp"
 #include "common/context.hpp"
+#include "common/flop_counter.hpp"
 #include "common/my_assert.h"
 #include "cluster_assembly_function.hpp"
+#include "assembly_stats.hpp"
 #include "random_pivot_manager.hpp"
 
 using std::vector;
@@ -721,11 +723,15 @@ RkMatrix<typename Types<T>::dp>* compress(
         nloop = block.info.number_of_strata;
     }
     RkMatrix<dp_t>* rk = compressOneStratum(method, block);
-    rk->truncate(epsilon);
+    {
+        AssemblyStats::Timer timer(AssemblyStats::TRUNCATE);
+        rk->truncate(epsilon);
+    }
     for(block.stratum = 1; block.stratum < nloop; block.stratum++) {
         assert(method->isIncremental(*rows, *cols));
         RkMatrix<dp_t>* stratumRk = compressOneStratum(method, block);
         if(stratumRk->rank() > 0) {
+            AssemblyStats::Timer timer(AssemblyStats::TRUNCATE);
             // Pass a negative value to tell formattedAddParts to not call truncate()
             // FIXME: investigate why calling truncate from formattedAddParts or here
             //        gives different results
@@ -741,6 +747,10 @@ template<typename T> RkMatrix<typename Types<T>::dp>* compressOneStratum(
     const CompressionAlgorithm* method, const ClusterAssemblyFunction<T> & block) {
 
   typedef typename Types<T>::dp dp_t;
+  FlopCounter::Scope phase(FlopCounter::COMPRESSION);
+  MemoryInstrumenter::Scope memory(MemoryInstrumenter::ACA_TEMPORARY);
+  AssemblyStats::Timer timer(AssemblyStats::COMPRESSION);
+  AssemblyStats::setAlgorithm(method->name());
   RkMatrix<dp_t>* rk = method->compress(block);
 
   if (HMatrix<T>::validateCompression) {
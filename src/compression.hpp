@@ -90,6 +90,8 @@ public:
     virtual double getEpsilon() const { return epsilon_; }
     // Tell whether algorithm needs the whole block or works incrementally.
     virtual bool isIncremental(const ClusterData&, const ClusterData&) const { return true; }
+    // Name of the algorithm in the statistics, must be a static string
+    virtual const char* name() const { return "custom"; }
 protected:
     double epsilon_;
 };
@@ -100,6 +102,7 @@ class CompressionSVD : public CompressionAlgorithm
 public:
     explicit CompressionSVD(double epsilon) : CompressionAlgorithm(epsilon) {}
     CompressionSVD* clone() const { return new CompressionSVD(epsilon_); }
+    const char* name() const { return "svd"; }
     RkMatrix<Types<S_t>::dp>* compress(const ClusterAssemblyFunction<S_t>& block) const;
     RkMatrix<Types<D_t>::dp>* compress(const ClusterAssemblyFunction<D_t>& block) const;
     RkMatrix<Types<C_t>::dp>* compress(const ClusterAssemblyFunction<C_t>& block) const;
@@ -113,6 +116,7 @@ class CompressionAcaFull : public CompressionAlgorithm
 public:
     explicit CompressionAcaFull(double epsilon) : CompressionAlgorithm(epsilon) {}
     CompressionAcaFull* clone() const { return new CompressionAcaFull(epsilon_); }
+    const char* name() const { return "aca_full"; }
     RkMatrix<Types<S_t>::dp>* compress(const ClusterAssemblyFunction<S_t>& block) const;
     RkMatrix<Types<D_t>::dp>* compress(const ClusterAssemblyFunction<D_t>& block) const;
     RkMatrix<Types<C_t>::dp>* compress(const ClusterAssemblyFunction<C_t>& block) const;
@@ -126,6 +130,7 @@ class CompressionAcaPartial : public CompressionAlgorithm
 public:
     explicit CompressionAcaPartial(double epsilon) : CompressionAlgorithm(epsilon), useRandomPivots_(false) {}
     CompressionAcaPartial* clone() const { return new CompressionAcaPartial(epsilon_); }
+    const char* name() const { return "aca_partial"; }
     RkMatrix<Types<S_t>::dp>* compress(const ClusterAssemblyFunction<S_t>& block) const;
     RkMatrix<Types<D_t>::dp>* compress(const ClusterAssemblyFunction<D_t>& block) const;
     RkMatrix<Types<C_t>::dp>* compress(const ClusterAssemblyFunction<C_t>& block) const;
@@ -141,6 +146,7 @@ public:
     explicit CompressionAcaPlus(double epsilon) : CompressionAlgorithm(epsilon), delegate_(new CompressionAcaPartial(epsilon)) {}
     ~CompressionAcaPlus() { delete delegate_; }
     CompressionAcaPlus* clone() const { return new CompressionAcaPlus(epsilon_); }
+    const char* name() const { return "aca_plus"; }
     RkMatrix<Types<S_t>::dp>* compress(const ClusterAssemblyFunction<S_t>& block) const;
     RkMatrix<Types<D_t>::dp>* compress(const ClusterAssemblyFunction<D_t>& block) const;
     RkMatrix<Types<C_t>::dp>* compress(const ClusterAssemblyFunction<C_t>& block) const;
@@ -157,6 +163,7 @@ class CompressionAcaRandom : public CompressionAcaPartial
 public:
     explicit CompressionAcaRandom(double epsilon) : CompressionAcaPartial(epsilon) { this->useRandomPivots_ = true; }
     CompressionAcaRandom* clone() const { return new CompressionAcaRandom(epsilon_); }
+    const char* name() const { return "aca_random"; }
 };
 
 
@@ -165,6 +172,7 @@ class CompressionRRQR : public CompressionAlgorithm
     public :
         explicit CompressionRRQR (double epsilon) : CompressionAlgorithm(epsilon){}
         CompressionRRQR* clone() const { return new CompressionRRQR(epsilon_); }
+        const char* name() const { return "rrqr"; }
         RkMatrix<Types<S_t>::dp>* compress(const ClusterAssemblyFunction<S_t>& block) const;
         RkMatrix<Types<D_t>::dp>* compress(const ClusterAssemblyFunction<D_t>& block) const;
         RkMatrix<Types<C_t>::dp>* compress(const ClusterAssemblyFunction<C_t>& block) const;
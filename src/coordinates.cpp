@@ -49,26 +49,35 @@ void DofCoordinates::init(double* coord, unsigned* span_offsets, unsigned* spans
         spanOffsets_ = span_offsets;
         spans_ = spans;
     }
+    const unsigned nDof = numberOfDof();
+    centers_ = new double[nDof * dimension_];
     if(spanOffsets_) {
-        spanAABBs_ = new double[numberOfDof_ * dimension_ * 2];
-        double * aabb = spanAABBs_;
-        for(int dof = 0; dof < numberOfDof_; dof++) {
+        spanBounds_ = new double[nDof * dimension_ * 2];
+        double * lower = spanBounds_;
+        double * upper = spanBounds_ + nDof * dimension_;
+        for(unsigned dof = 0; dof < nDof; dof++) {
             unsigned offset = dof == 0 ? 0 : spanOffsets_[dof - 1];
             int n = spanSize(dof);
             double * v = v_ + spans_[offset] * dimension_;
-            memcpy(aabb, v, dimension_ * sizeof(double));
-            memcpy(aabb + dimension_, v, dimension_ * sizeof(double));
+            for(unsigned dim = 0; dim < dimension_; dim++) {
+                lower[dim * nDof + dof] = v[dim];
+                upper[dim * nDof + dof] = v[dim];
+            }
             for(int i = 1; i < n; i++) {
                 v = v_ + spans_[offset + i] * dimension_;
-                for(int dim = 0; dim < dimension_; dim++) {
-                    aabb[dim] = std::min(aabb[dim], v[dim]);
-                    aabb[dim + dimension_] = std::max(aabb[dim + dimension_], v[dim]);
+                for(unsigned dim = 0; dim < dimension_; dim++) {
+                    lower[dim * nDof + dof] = std::min(lower[dim * nDof + dof], v[dim]);
+                    upper[dim * nDof + dof] = std::max(upper[dim * nDof + dof], v[dim]);
                 }
             }
-            aabb += 2 * dimension_;
         }
+        for(unsigned i = 0; i < nDof * dimension_; i++)
+            centers_[i] = (lower[i] + upper[i]) / 2;
     } else {
-        spanAABBs_ = NULL;
+        spanBounds_ = NULL;
+        for(unsigned dof = 0; dof < nDof; dof++)
+            for(unsigned dim = 0; dim < dimension_; dim++)
+                centers_[dim * nDof + dof] = v_[dof * dimension_ + dim];
     }
 }
 
@@ -98,8 +107,55 @@ DofCoordinates::~DofCoordinates()
       delete[] spans_;
     }
   }
-  if(spanOffsets_ != NULL)
-    delete[] spanAABBs_;
+  delete[] centers_;
+  delete[] spanBounds_;
+}
+
+void DofCoordinates::spanAABB(const int * dofs, int n, double * bb) const {
+    for (unsigned dim = 0; dim < dimension_; ++dim) {
+        const double * lower = spanMin(dim);
+        const double * upper = spanMax(dim);
+        double vmin = bb[dim];
+        double vmax = bb[dim + dimension_];
+#ifdef _OPENMP
+#pragma omp simd reduction(min:vmin) reduction(max:vmax)
+#endif
+        for (int i = 0; i < n; i++) {
+            vmin = std::min(vmin, lower[dofs[i]]);
+            vmax = std::max(vmax, upper[dofs[i]]);
+        }
+        bb[dim] = vmin;
+        bb[dim + dimension_] = vmax;
+    }
+}
+
+void DofCoordinates::centroid(const int * dofs, int n, double * center) const {
+    for (unsigned dim = 0; dim < dimension_; ++dim) {
+        const double * c = spanCenters(dim);
+        double sum = 0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sum)
+#endif
+        for (int i = 0; i < n; i++)
+            sum += c[dofs[i]];
+        center[dim] = n > 0 ? sum / n : 0;
+    }
+}
+
+void DofCoordinates::covariance(const int * dofs, int n, const double * center, double * cov) const {
+    for (unsigned i = 0; i < dimension_; ++i) {
+        const double * ci = spanCenters(i);
+        for (unsigned j = 0; j <= i; ++j) {
+            const double * cj = spanCenters(j);
+            double sum = 0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sum)
+#endif
+            for (int k = 0; k < n; k++)
+                sum += (ci[dofs[k]] - center[i]) * (cj[dofs[k]] - center[j]);
+            cov[i * dimension_ + j] = cov[j * dimension_ + i] = n > 0 ? sum / n : 0;
+        }
+    }
 }
 
 int DofCoordinates::size() const {
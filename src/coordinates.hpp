@@ -82,28 +82,26 @@ public:
 
   /** Enlarge the given AABB so it include the given DOF */
   void spanAABB(unsigned dof, double * bb) const {
-      int n = dof * dimension_;
-      if(spanOffsets_ == NULL) {
-          for (unsigned dim = 0; dim < dimension_; ++dim) {
-              double v = v_[n + dim];
-              bb[dim] = std::min(bb[dim], v);
-              bb[dim + dimension_] = std::max(bb[dim + dimension_], v);
-          }
-      } else {
-          double * aabb = spanAABBs_ + 2 * n;
-          for (unsigned dim = 0; dim < dimension_; ++dim) {
-              bb[dim] = std::min(bb[dim], aabb[dim]);
-              bb[dim + dimension_] = std::max(bb[dim + dimension_],
-                                     aabb[dim + dimension_]);
-          }
+      for (unsigned dim = 0; dim < dimension_; ++dim) {
+          bb[dim] = std::min(bb[dim], spanMin(dim)[dof]);
+          bb[dim + dimension_] = std::max(bb[dim + dimension_], spanMax(dim)[dof]);
       }
   }
 
+  /** Enlarge the given AABB so it include the n given DOFs */
+  void spanAABB(const int * dofs, int n, double * bb) const;
+
+  /** Compute the mean of the span centers of the n given DOFs */
+  void centroid(const int * dofs, int n, double * center) const;
+
+  /** Compute the covariance matrix (dimension x dimension, row major) of the
+      span centers of the n given DOFs, around the given center */
+  void covariance(const int * dofs, int n, const double * center, double * cov) const;
+
   double spanDiameter(unsigned dof, int dim) const {
       double d = 0;
       if(spanOffsets_ != NULL) {
-          double * aabb = spanAABBs_ + 2 * dof * dimension_;
-          d = std::max(aabb[dim + dimension_] - aabb[dim], d);
+          d = std::max(spanMax(dim)[dof] - spanMin(dim)[dof], d);
       }
       return d;
   }
@@ -126,12 +124,20 @@ public:
   }
 
   double spanCenter(unsigned dof, unsigned dim) const {
-      if(spanOffsets_ == NULL)
-          return v_[dof * dimension_ + dim];
-      else {
-          double * aabb = spanAABBs_ + dof * dimension_ * 2;
-          return (aabb[dim] + aabb[dim + dimension_]) / 2;
-      }
+      return centers_[dim * numberOfDof() + dof];
+  }
+
+  /** Span centers along the given axis, indexed by DOF */
+  const double * spanCenters(unsigned dim) const {
+      return centers_ + dim * numberOfDof();
+  }
+  /** Lower bounds of the spans along the given axis, indexed by DOF */
+  const double * spanMin(unsigned dim) const {
+      return (spanBounds_ == NULL ? centers_ : spanBounds_) + dim * numberOfDof();
+  }
+  /** Upper bounds of the spans along the given axis, indexed by DOF */
+  const double * spanMax(unsigned dim) const {
+      return spanBounds_ == NULL ? spanCenters(dim) : spanBounds_ + (dimension_ + dim) * numberOfDof();
   }
 
 private:
@@ -155,11 +161,18 @@ private:
   // Array of size spanOffsets_[numberOfDof_-1], giving the position in v_[] of the span of each dof
   unsigned * spans_;
   /**
-   * @brief min_x, miny, ..., maxx, maxy, ... for each DOF.
-   * This is NULL if span is not supportedx else the size is
-   * 2*dimension()*numberOfDof_.
+   * @brief Span centers, stored by axis: the centers along axis d are
+   * centers_[d * numberOfDof()] to centers_[(d + 1) * numberOfDof() - 1].
+   * Clustering and bounding boxes read one axis at a time, so this is
+   * contiguous for them.
+   */
+  double * centers_;
+  /**
+   * @brief Lower bounds of the spans along each axis, then upper bounds,
+   * stored like centers_. This is NULL without spans, as the bounds are
+   * then the centers.
    */
-  double * spanAABBs_;
+  double * spanBounds_;
   void init(double* coord, unsigned * span_offsets, unsigned * spans);
 };
 
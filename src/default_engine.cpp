@@ -30,9 +30,13 @@
 namespace hmat {
 
 static void default_progress_update(hmat_progress_t * ctx) {
-    double progress = (100. * ctx->current) / ctx->max;
+    double progress = ctx->max_work > 0 ? (100. * ctx->current_work) / ctx->max_work
+                                        : (100. * ctx->current) / ctx->max;
     std::cout << '\r' << "Progress: " << progress << "% ("
-              << ctx->current << " / " << ctx->max << ")      ";
+              << ctx->current << " / " << ctx->max << ")";
+    if(ctx->eta >= 0 && ctx->current != ctx->max)
+        std::cout << ", " << (int) ctx->eta << " s left";
+    std::cout << "      ";
     if(ctx->current == ctx->max) {
         std::cout << std::endl;
     }
@@ -44,6 +48,11 @@ DefaultProgress::DefaultProgress() {
     delegate.current = 0;
     delegate.user_data = NULL;
     delegate.update = default_progress_update;
+    delegate.max_work = 0;
+    delegate.current_work = 0;
+    delegate.elapsed = 0;
+    delegate.throughput = 0;
+    delegate.eta = -1;
 }
 
 hmat_progress_t * DefaultProgress::getInstance()
@@ -92,9 +101,22 @@ int DefaultEngine<T>::init(){
 template<typename T>
 void DefaultEngine<T>::assembly(Assembly<T>& f, SymmetryFlag sym, bool ownAssembly) {
   if (sym == kLowerSymmetric || this->hmat->isLower || this->hmat->isUpper) {
-    this->hmat->assembleSymmetric(f, NULL, this->hmat->isLower || this->hmat->isUpper);
+    this->hmat->assembleSymmetric(f, NULL, this->hmat->isLower || this->hmat->isUpper,
+                                  AllocationObserver(), false, this->progress_);
   } else {
-    this->hmat->assemble(f);
+    this->hmat->assemble(f, AllocationObserver(), false, this->progress_);
+  }
+  if(ownAssembly)
+      delete &f;
+}
+
+template<typename T>
+void DefaultEngine<T>::partialAssembly(Assembly<T>& f, SymmetryFlag sym, bool ownAssembly) {
+  if (sym == kLowerSymmetric || this->hmat->isLower || this->hmat->isUpper) {
+    this->hmat->assembleSymmetric(f, NULL, this->hmat->isLower || this->hmat->isUpper,
+                                  AllocationObserver(), true, this->progress_);
+  } else {
+    this->hmat->assemble(f, AllocationObserver(), true, this->progress_);
   }
   if(ownAssembly)
       delete &f;
@@ -105,13 +127,13 @@ void DefaultEngine<T>::factorization(Factorization algo) {
   switch(algo)
   {
   case Factorization::LU:
-      this->hmat->luDecomposition(this->progress_);
+      this->hmat->luDecomposition(this->progress_, this->checkpoint_);
       break;
   case Factorization::LDLT:
-      this->hmat->ldltDecomposition(this->progress_);
+      this->hmat->ldltDecomposition(this->progress_, this->checkpoint_);
       break;
   case Factorization::LLT:
-      this->hmat->lltDecomposition(this->progress_);
+      this->hmat->lltDecomposition(this->progress_, this->checkpoint_);
       break;
   case Factorization::HODLR:
       this->hodlr.factorize(this->hmat, this->progress_);
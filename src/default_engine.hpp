@@ -43,6 +43,7 @@ public:
   static int init();
   static void finalize(){}
   void assembly(Assembly<T>& f, SymmetryFlag sym, bool ownAssembly) override;
+  void partialAssembly(Assembly<T>& f, SymmetryFlag sym, bool ownAssembly) override;
   void factorization(Factorization) override;
   void inverse() override ;
   void gemv(char trans, T alpha, ScalarArray<T>& x, T beta, ScalarArray<T>& y) const override;
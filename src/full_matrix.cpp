@@ -306,7 +306,7 @@ template<typename T> void FullMatrix<T>::toFile(const char *filename) const {
 }
 
 template<typename T> size_t FullMatrix<T>::memorySize() const {
-   return data.memorySize();
+   return data.memorySize() + (diagonal ? diagonal->memorySize() : 0);
 }
 
 template<typename T> void FullMatrix<T>::checkNan() const {
@@ -263,7 +263,8 @@ public:
   /*! Conjugate the content of the complex matrix */
   void conjugate();
 
-  size_t memorySize() const; //TODO not used
+  /*! \brief Return the size in bytes of the values and of the diagonal */
+  size_t memorySize() const;
 
   /*! \brief Return a short string describing the content of this FullMatrix for debug (like: "FullMatrix [320, 452]x[760, 890] norm=22.34758")
     */
@@ -36,9 +36,13 @@
 #include "admissibility.hpp"
 #include "data_types.hpp"
 #include "compression.hpp"
+#include "assembly_stats.hpp"
+#include "progress.hpp"
 #include "recursion.hpp"
 #include "common/context.hpp"
+#include "common/flop_counter.hpp"
 #include "common/my_assert.h"
+#include "common/timeline.hpp"
 #include "json.hpp"
 
 using namespace std;
@@ -152,25 +156,120 @@ HMatrix<T>::HMatrix(const ClusterTree* _rows, const ClusterTree* _cols, const hm
 {
   if (isVoid())
     return;
-  const bool lowRank = admissibilityCondition->isLowRank(*rows_, *cols_);
-  if (!split(admissibilityCondition, lowRank, symFlag)) {
-    // If we cannot split, we are on a leaf
-    const bool forceFull = admissibilityCondition->forceFull(*rows_, *cols_);
-    const bool forceRk   = admissibilityCondition->forceRk(*rows_, *cols_);
-    assert(!(forceFull && forceRk));
-    if (forceRk || (lowRank && !forceFull))
-      rk(NULL);
-    else
-      full(NULL);
-    approximateRank_ = admissibilityCondition->getApproximateRank(*(rows_), *(cols_));
-  }
+  buildStructure(admissibilityCondition, symFlag);
   assert(!this->isLeaf() || isAssembled());
 }
 
+template<typename T>
+HMatrix<T>::HMatrix(const ClusterTree* _rows, const ClusterTree* _cols, const hmat::MatrixSettings * settings,
+                    int _depth)
+  : Tree<HMatrix<T> >(NULL, _depth), RecursionMatrix<T, HMatrix<T> >(),
+    rows_(_rows), cols_(_cols), rk_(NULL),
+    rank_(UNINITIALIZED_BLOCK), approximateRank_(UNINITIALIZED_BLOCK),
+    isUpper(false), isLower(false),
+    isTriUpper(false), isTriLower(false), keepSameRows(true), keepSameCols(true), temporary_(false),
+    ownRowsClusterTree_(false), ownColsClusterTree_(false), localSettings(settings, 1e-4)
+{}
+
+namespace {
+/** Number of blocks of a level handled at once by HMatrix::buildStructure() */
+const int STRUCTURE_CHUNK_SIZE = 256;
+}
+
+template<typename T>
+void HMatrix<T>::buildStructure(AdmissibilityCondition * admissibilityCondition, SymmetryFlag symFlag) {
+  // The block tree is built level by level. The admissibility of all the
+  // blocks of a chunk is computed by AdmissibilityCondition batch calls on an
+  // AdmissibilityBatch, and the chunks of a level are processed concurrently
+  // since the blocks are independent, if the condition allows it (see
+  // AdmissibilityCondition::isThreadSafe()). Decisions are the same as a
+  // depth-first construction.
+#ifdef _OPENMP
+  const bool parallel = admissibilityCondition->isThreadSafe();
+#endif
+  std::vector<std::pair<HMatrix<T>*, SymmetryFlag> > level(1, std::make_pair(this, symFlag));
+  while (!level.empty()) {
+    const int nbChunks = (level.size() + STRUCTURE_CHUNK_SIZE - 1) / STRUCTURE_CHUNK_SIZE;
+    std::vector<std::vector<std::pair<HMatrix<T>*, SymmetryFlag> > > nextLevel(nbChunks);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if(parallel && nbChunks > 1)
+#endif
+    for (int chunk = 0; chunk < nbChunks; ++chunk) {
+      const int begin = chunk * STRUCTURE_CHUNK_SIZE;
+      const int n = std::min((int)level.size() - begin, STRUCTURE_CHUNK_SIZE);
+      const ClusterTree* rows[STRUCTURE_CHUNK_SIZE];
+      const ClusterTree* cols[STRUCTURE_CHUNK_SIZE];
+      bool lowRank[STRUCTURE_CHUNK_SIZE];
+      bool stopRecursion[STRUCTURE_CHUNK_SIZE];
+      for (int i = 0; i < n; ++i) {
+        rows[i] = level[begin + i].first->rows_;
+        cols[i] = level[begin + i].first->cols_;
+      }
+      AdmissibilityBatch batch(n, rows, cols);
+      admissibilityCondition->prepareBatch(batch);
+      admissibilityCondition->isLowRankBatch(batch, lowRank);
+      admissibilityCondition->stopRecursionBatch(batch, stopRecursion);
+      // Blocks which cannot be splitted, moved to the front of rows and cols
+      int nbLeaves = 0;
+      int leaves[STRUCTURE_CHUNK_SIZE];
+      for (int i = 0; i < n; ++i) {
+        HMatrix<T>* h = level[begin + i].first;
+        if (!h->splitNode(admissibilityCondition, lowRank[i], stopRecursion[i], level[begin + i].second, nextLevel[chunk])) {
+          rows[nbLeaves] = rows[i];
+          cols[nbLeaves] = cols[i];
+          leaves[nbLeaves++] = i;
+        }
+      }
+      bool forceFull[STRUCTURE_CHUNK_SIZE];
+      AdmissibilityBatch leavesBatch(nbLeaves, rows, cols);
+      admissibilityCondition->forceFullBatch(leavesBatch, forceFull);
+      for (int k = 0; k < nbLeaves; ++k) {
+        const int i = leaves[k];
+        level[begin + i].first->setLeafType(admissibilityCondition, lowRank[i], forceFull[k]);
+      }
+    }
+    level.clear();
+    for (int chunk = 0; chunk < nbChunks; ++chunk)
+      level.insert(level.end(), nextLevel[chunk].begin(), nextLevel[chunk].end());
+  }
+}
+
+template<typename T>
+void HMatrix<T>::setLeafType(AdmissibilityCondition * admissibilityCondition, bool lowRank) {
+  setLeafType(admissibilityCondition, lowRank, admissibilityCondition->forceFull(*rows_, *cols_));
+}
+
+template<typename T>
+void HMatrix<T>::setLeafType(AdmissibilityCondition * admissibilityCondition, bool lowRank, bool forceFull) {
+  // If we cannot split, we are on a leaf
+  const bool forceRk   = admissibilityCondition->forceRk(*rows_, *cols_);
+  assert(!(forceFull && forceRk));
+  if (forceRk || (lowRank && !forceFull))
+    rk(NULL);
+  else
+    full(NULL);
+  approximateRank_ = admissibilityCondition->getApproximateRank(*(rows_), *(cols_));
+}
+
 template<typename T>
 bool HMatrix<T>::split(AdmissibilityCondition * admissibilityCondition, bool lowRank,
                       SymmetryFlag symFlag) {
-  assert(rank_ == NONLEAF_BLOCK || rank_ == UNINITIALIZED_BLOCK || (this->isLeaf() && isNull()));
+  std::vector<std::pair<HMatrix<T>*, SymmetryFlag> > children;
+  if (!splitNode(admissibilityCondition, lowRank, symFlag, children))
+    return false;
+  for (size_t i = 0; i < children.size(); ++i)
+    children[i].first->buildStructure(admissibilityCondition, children[i].second);
+  return true;
+}
+
+template<typename T>
+bool HMatrix<T>::isLeafBlock(AdmissibilityCondition * admissibilityCondition, bool lowRank) const {
+  return isLeafBlock(admissibilityCondition, lowRank, admissibilityCondition->stopRecursion(*rows_, *cols_));
+}
+
+template<typename T>
+bool HMatrix<T>::isLeafBlock(AdmissibilityCondition * admissibilityCondition, bool lowRank,
+                             bool stopRecursion) const {
   // We would like to create a block of matrix in one of the following case:
   // - rows_->isLeaf() && cols_->isLeaf() : both rows and cols are leaves.
   // - Block is too small to recurse and compress (for performance)
@@ -179,11 +278,24 @@ bool HMatrix<T>::split(AdmissibilityCondition * admissibilityCondition, bool low
   //
   // FIXME: But in practice this does not work yet, so we stop recursion as soon as either rows
   // or cols is a leaf.
-  bool stopRecursion = admissibilityCondition->stopRecursion(*rows_, *cols_);
   bool forceRecursion = admissibilityCondition->forceRecursion(*rows_, *cols_, sizeof(T));
   assert(!(forceRecursion && stopRecursion));
+  return (rows_->isLeaf() && cols_->isLeaf()) || stopRecursion || (lowRank && !forceRecursion);
+}
+
+template<typename T>
+bool HMatrix<T>::splitNode(AdmissibilityCondition * admissibilityCondition, bool lowRank,
+                           SymmetryFlag symFlag, std::vector<std::pair<HMatrix<T>*, SymmetryFlag> > & children) {
+  return splitNode(admissibilityCondition, lowRank, admissibilityCondition->stopRecursion(*rows_, *cols_),
+                   symFlag, children);
+}
+
+template<typename T>
+bool HMatrix<T>::splitNode(AdmissibilityCondition * admissibilityCondition, bool lowRank, bool stopRecursion,
+                           SymmetryFlag symFlag, std::vector<std::pair<HMatrix<T>*, SymmetryFlag> > & children) {
+  assert(rank_ == NONLEAF_BLOCK || rank_ == UNINITIALIZED_BLOCK || (this->isLeaf() && isNull()));
   // check we can actually split
-  if ((rows_->isLeaf() && cols_->isLeaf()) || stopRecursion || (lowRank && !forceRecursion))
+  if (isLeafBlock(admissibilityCondition, lowRank, stopRecursion))
     return false;
   pair<bool, bool> splitRC = admissibilityCondition->splitRowsCols(*rows_, *cols_);
   assert(splitRC.first || splitRC.second);
@@ -199,11 +311,11 @@ bool HMatrix<T>::split(AdmissibilityCondition * admissibilityCondition, bool low
       if ((symFlag == kNotSymmetric) || (isUpper && (i <= j)) || (isLower && (i >= j))) {
         if (!admissibilityCondition->isInert(*rowChild, *colChild)) {
           // Create child only if not 'inert' (inert = will always be null)
-          this->insertChild(i, j,
-                            new HMatrix<T>(rowChild, colChild, localSettings.global,
-                                           this->depth + 1,
-                                           i == j ? symFlag : kNotSymmetric,
-                                           admissibilityCondition));
+          HMatrix<T>* child = new HMatrix<T>(rowChild, colChild, localSettings.global, this->depth + 1);
+          this->insertChild(i, j, child);
+          // Its structure is built by the caller
+          if (!child->isVoid())
+            children.push_back(std::make_pair(child, i == j ? symFlag : kNotSymmetric));
         } else
           // If 'inert', the child is NULL
           this->insertChild(i, j, NULL);
@@ -345,8 +457,14 @@ void HMatrix<T>::setClusterTrees(const ClusterTree* rows, const ClusterTree* col
 }
 
 template<typename T>
-void HMatrix<T>::assemble(Assembly<T>& f, const AllocationObserver & ao) {
+void HMatrix<T>::assemble(Assembly<T>& f, const AllocationObserver & ao, bool onlyNull,
+                          hmat_progress_t * progress) {
   if (this->isLeaf()) {
+    if (onlyNull && !isNull())
+      return;
+    Timeline::Task t(Timeline::ASM, this);
+    FlopCounter::Scope phase(FlopCounter::ASSEMBLY);
+    AssemblyStats::Leaf stats(rows(), cols());
     // If the leaf is admissible, matrix assembly and compression.
     // if not we keep the matrix.
     FullMatrix<T> * m = NULL;
@@ -358,18 +476,21 @@ void HMatrix<T>::assemble(Assembly<T>& f, const AllocationObserver & ao) {
         if(rk_)
             delete rk_;
         rk(assembledRk);
+        stats.setResult(rank(), rk()->compressedSize() * sizeof(T));
     } else {
         assert(!isRkMatrix());
         if(full_)
             delete full_;
         full(m);
+        stats.setResult(-1, m ? m->memorySize() : 0);
     }
+    Progress::assembled(progress, rows()->size(), cols()->size(), isRkMatrix(), isRkMatrix() ? rank() : -1);
   } else {
     full_ = NULL;
     rk_ = NULL;
     for (int i = 0; i < this->nrChild(); i++) {
       if (this->getChild(i))
-        this->getChild(i)->assemble(f, ao);
+        this->getChild(i)->assemble(f, ao, onlyNull, progress);
     }
     assembledRecurse();
     if (coarsening)
@@ -379,7 +500,8 @@ void HMatrix<T>::assemble(Assembly<T>& f, const AllocationObserver & ao) {
 
 template<typename T>
 void HMatrix<T>::assembleSymmetric(Assembly<T>& f,
-   HMatrix<T>* upper, bool onlyLower, const AllocationObserver & ao) {
+   HMatrix<T>* upper, bool onlyLower, const AllocationObserver & ao, bool onlyNull,
+   hmat_progress_t * progress) {
   if (!onlyLower) {
     if (!upper){
       upper = this;
@@ -389,9 +511,11 @@ void HMatrix<T>::assembleSymmetric(Assembly<T>& f,
   }
 
   if (this->isLeaf()) {
+    if (onlyNull && !isNull() && (onlyLower || upper == this || !upper->isNull()))
+      return;
     // If the leaf is admissible, matrix assembly and compression.
     // if not we keep the matrix.
-    this->assemble(f, ao);
+    this->assemble(f, ao, false, progress);
     if (isRkMatrix()) {
       if ((!onlyLower) && (upper != this)) {
         // Admissible leaf: a matrix represented by AB^t is transposed by exchanging A and B.
@@ -417,7 +541,7 @@ void HMatrix<T>::assembleSymmetric(Assembly<T>& f,
             continue;
           }
           if (get(i,j))
-            get(i,j)->assembleSymmetric(f, NULL, true, ao);
+            get(i,j)->assembleSymmetric(f, NULL, true, ao, onlyNull, progress);
         }
       }
     } else {
@@ -428,7 +552,7 @@ void HMatrix<T>::assembleSymmetric(Assembly<T>& f,
             HMatrix<T> *upperChild = get(j, i);
             assert((child != NULL) == (upperChild != NULL));
             if (child)
-              child->assembleSymmetric(f, upperChild, false, ao);
+              child->assembleSymmetric(f, upperChild, false, ao, onlyNull, progress);
           }
         }
       } else {
@@ -438,7 +562,7 @@ void HMatrix<T>::assembleSymmetric(Assembly<T>& f,
             HMatrix<T> *upperChild = upper->get(j, i);
             assert((child != NULL) == (upperChild != NULL));
             if (child)
-              child->assembleSymmetric(f, upperChild, false, ao);
+              child->assembleSymmetric(f, upperChild, false, ao, onlyNull, progress);
           }
         }
         upper->assembledRecurse();
@@ -450,6 +574,135 @@ void HMatrix<T>::assembleSymmetric(Assembly<T>& f,
   }
 }
 
+namespace {
+/** Return the offset of the DOFs of data in previous if previous holds them
+    contiguously and in the same order, or -1 */
+int previousOffset(const ClusterData& data, const ClusterData& previous, const int* newToOld) {
+  if (data.size() == 0)
+    return -1;
+  const int* indices = data.indices() + data.offset();
+  const int first = newToOld[indices[0]];
+  if (first < 0)
+    return -1;
+  const int offset = previous.indices_rev()[first];
+  if (offset < previous.offset() || offset + data.size() > previous.offset() + previous.size())
+    return -1;
+  const int* previousIndices = previous.indices() + offset;
+  for (int i = 1; i < data.size(); ++i) {
+    if (newToOld[indices[i]] != previousIndices[i])
+      return -1;
+  }
+  return offset;
+}
+}
+
+template<typename T>
+int HMatrix<T>::reuseLeaves(HMatrix<T>* previous, const int* rowsNewToOld, const int* colsNewToOld) {
+  if (!this->isLeaf()) {
+    int result = 0;
+    for (int i = 0; i < this->nrChild(); i++) {
+      if (this->getChild(i))
+        result += this->getChild(i)->reuseLeaves(previous, rowsNewToOld, colsNewToOld);
+    }
+    return result;
+  }
+  const int rowOffset = previousOffset(*rows(), *previous->rows(), rowsNewToOld);
+  if (rowOffset < 0)
+    return 0;
+  const int colOffset = previousOffset(*cols(), *previous->cols(), colsNewToOld);
+  if (colOffset < 0)
+    return 0;
+  const IndexSet previousRows(rowOffset, rows()->size());
+  const IndexSet previousCols(colOffset, cols()->size());
+  HMatrix<T>* leaf = previous;
+  while (!leaf->isLeaf()) {
+    HMatrix<T>* next = NULL;
+    for (int i = 0; i < leaf->nrChild() && next == NULL; i++) {
+      HMatrix<T>* child = leaf->getChild(i);
+      if (child && child->rows()->isSuperSet(previousRows) && child->cols()->isSuperSet(previousCols))
+        next = child;
+    }
+    if (next == NULL)
+      return 0;
+    leaf = next;
+  }
+  if (!(*leaf->rows() == previousRows) || !(*leaf->cols() == previousCols) ||
+      leaf->isRkMatrix() != isRkMatrix() || leaf->isNull())
+    return 0;
+  if (isRkMatrix()) {
+    RkMatrix<T>* m = leaf->rk();
+    // An evicted block has a rank but no data
+    if (m == NULL)
+      return 0;
+    leaf->rk(NULL);
+    m->rows = rows();
+    m->cols = cols();
+    rk(m);
+  } else {
+    FullMatrix<T>* m = leaf->full();
+    leaf->full(NULL);
+    m->rows_ = rows();
+    m->cols_ = cols();
+    full(m);
+  }
+  return 1;
+}
+
+namespace {
+/** Return true if the prefix count of dirty DOFs has a dirty DOF in set */
+inline bool hasDirty(const std::vector<int>& dirty, const IndexSet& set) {
+  return dirty[set.offset() + set.size()] > dirty[set.offset()];
+}
+}
+
+template<typename T>
+int HMatrix<T>::resetDirty(AdmissibilityCondition * admissibilityCondition, const std::vector<int>& rowsDirty,
+                           const std::vector<int>& colsDirty, SymmetryFlag symFlag) {
+  if (isVoid() || (!hasDirty(rowsDirty, *rows()) && !hasDirty(colsDirty, *cols())))
+    return 0;
+  const bool lowRank = admissibilityCondition->isLowRank(*rows_, *cols_);
+  if (this->isLeaf()) {
+    if (isRkMatrix()) {
+      delete rk_;
+      rk(NULL);
+    } else {
+      delete full_;
+      full(NULL);
+    }
+    std::vector<std::pair<HMatrix<T>*, SymmetryFlag> > children;
+    if (!splitNode(admissibilityCondition, lowRank, symFlag, children)) {
+      setLeafType(admissibilityCondition, lowRank);
+      return 1;
+    }
+    // The block is no longer admissible
+    for (size_t i = 0; i < children.size(); ++i)
+      children[i].first->buildStructure(admissibilityCondition, children[i].second);
+    std::deque<const HMatrix<T> *> leaves;
+    listAllLeaves(leaves);
+    return leaves.size();
+  }
+  if (isLeafBlock(admissibilityCondition, lowRank)) {
+    // The block became admissible
+    for (int i = 0; i < this->nrChild(); i++)
+      this->removeChild(i);
+    this->children.clear();
+    keepSameRows = true;
+    keepSameCols = true;
+    isLower = false;
+    setLeafType(admissibilityCondition, lowRank);
+    return 1;
+  }
+  int result = 0;
+  for (int i = 0; i < nrChildRow(); i++) {
+    for (int j = 0; j < nrChildCol(); j++) {
+      if (get(i, j))
+        result += get(i, j)->resetDirty(admissibilityCondition, rowsDirty, colsDirty,
+                                        isLower && i == j ? kLowerSymmetric : kNotSymmetric);
+    }
+  }
+  return result;
+}
+
 template<typename T> void HMatrix<T>::info(hmat_info_t & result) {
     result.nr_block_clusters++;
     int r = rows()->size();
@@ -476,8 +729,12 @@ template<typename T> void HMatrix<T>::info(hmat_info_t & result) {
             }
             result.rk_count++;
             result.rk_size += s;
+            if (rk())
+                result.compressed_bytes += rk()->packedSize();
         } else {
             result.compressed_size += s;
+            if (isFullMatrix())
+                result.compressed_bytes += full()->memorySize();
             result.full_count ++;
             result.full_size += s;
         }
@@ -1400,6 +1657,9 @@ HMatrix<T>::leafGemm(char transA, char transB, T alpha, const HMatrix<T>* a, con
 
     // One of the matrices is a leaf
     assert(this->isLeaf() || a->isLeaf() || b->isLeaf());
+    Timeline::Task t(Timeline::GEMM, this, a, b);
+    FlopCounter::Scope phase(FlopCounter::GEMM);
+    MemoryInstrumenter::Scope memory(MemoryInstrumenter::GEMM_TEMPORARY);
 
     // the resulting matrix is not a leaf.
     if (!this->isLeaf()) {
@@ -1851,6 +2111,27 @@ void HMatrix<T>::truncate() {
   }
 }
 
+template<typename T>
+void HMatrix<T>::packRk(bool pack) {
+  if (this->isLeaf()) {
+    if (this->isRkMatrix() && rk()) {
+      if (pack) {
+        rk()->pack(localSettings.epsilon_);
+      } else {
+        MemoryInstrumenter::Scope memory(MemoryInstrumenter::RK_FACTORS);
+        rk()->unpack();
+      }
+    }
+  } else {
+    for (int i = 0; i < this->nrChild(); i++) {
+      HMatrix<T>* child = this->getChild(i);
+      if (child) {
+        child->packRk(pack);
+      }
+    }
+  }
+}
+
 template<typename T>
 const ClusterData* HMatrix<T>::rows() const {
   return &(rows_->data);
@@ -2025,6 +2306,7 @@ void HMatrix<T>::inverse() {
 template<typename T>
 void HMatrix<T>::solveLowerTriangularLeft(HMatrix<T>* b, Factorization algo, Diag diag, Uplo uplo, MainOp) const {
   DECLARE_CONTEXT;
+  FlopCounter::Scope phase(FlopCounter::TRSM);
   if (isVoid()) return;
   // At first, the recursion one (simple case)
   if (!this->isLeaf() && !b->isLeaf()) {
@@ -2057,6 +2339,7 @@ void HMatrix<T>::solveLowerTriangularLeft(HMatrix<T>* b, Factorization algo, Dia
 template<typename T>
 void HMatrix<T>::solveLowerTriangularLeft(ScalarArray<T>* b, Factorization algo, Diag diag, Uplo uplo) const {
   DECLARE_CONTEXT;
+  FlopCounter::Scope phase(FlopCounter::TRSM);
   assert(*rows() == *cols());
   assert(cols()->size() == b->rows);
   if (isVoid()) return;
@@ -2099,6 +2382,7 @@ void HMatrix<T>::solveLowerTriangularLeft(FullMatrix<T>* b, Factorization algo,
 template<typename T>
 void HMatrix<T>::solveUpperTriangularRight(HMatrix<T>* b, Factorization algo, Diag diag, Uplo uplo) const {
   DECLARE_CONTEXT;
+  FlopCounter::Scope phase(FlopCounter::TRSM);
   if (rows()->size() == 0 || cols()->size() == 0) return;
   // The recursion one (simple case)
   if (!this->isLeaf() && !b->isLeaf()) {
@@ -2137,6 +2421,7 @@ void HMatrix<T>::solveUpperTriangularRight(HMatrix<T>* b, Factorization algo, Di
 template<typename T>
 void HMatrix<T>::solveUpperTriangularRight(ScalarArray<T>* b, Factorization algo, Diag diag, Uplo uplo) const {
   DECLARE_CONTEXT;
+  FlopCounter::Scope phase(FlopCounter::TRSM);
   assert(*rows() == *cols());
   assert(rows()->size() == b->cols);
   if (isVoid()) return;
@@ -2182,6 +2467,7 @@ void HMatrix<T>::solveUpperTriangularRight(FullMatrix<T>* b, Factorization algo,
 template<typename T>
 void HMatrix<T>::solveUpperTriangularLeft(HMatrix<T>* b, Factorization algo, Diag diag, Uplo uplo, MainOp) const {
   DECLARE_CONTEXT;
+  FlopCounter::Scope phase(FlopCounter::TRSM);
   if (rows()->size() == 0 || cols()->size() == 0) return;
   // At first, the recursion one (simple case)
   if (!this->isLeaf() && !b->isLeaf()) {
@@ -2214,6 +2500,7 @@ void HMatrix<T>::solveUpperTriangularLeft(HMatrix<T>* b, Factorization algo, Dia
 template<typename T>
 void HMatrix<T>::solveUpperTriangularLeft(ScalarArray<T>* b, Factorization algo, Diag diag, Uplo uplo) const {
   DECLARE_CONTEXT;
+  FlopCounter::Scope phase(FlopCounter::TRSM);
   assert(*rows() == *cols());
   assert(rows()->size() == b->rows || uplo == Uplo::UPPER);
   assert(cols()->size() == b->rows || uplo == Uplo::LOWER);
@@ -2255,40 +2542,38 @@ void HMatrix<T>::solveUpperTriangularLeft(FullMatrix<T>* b, Factorization algo,
   solveUpperTriangularLeft(&b->data, algo, diag, uplo);
 }
 
-template<typename T> void HMatrix<T>::lltDecomposition(hmat_progress_t * progress) {
+template<typename T> void HMatrix<T>::lltDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint) {
 
     assertLower(this);
     if (isVoid()) {
         // nothing to do
     } else if(this->isLeaf()) {
+        Timeline::Task t(Timeline::LLT, this);
+        FlopCounter::Scope phase(FlopCounter::FACTORIZATION);
         full()->lltDecomposition();
-        if(progress != NULL) {
-            progress->current= rows()->offset() + rows()->size();
-            progress->update(progress);
-        }
+        Progress::eliminated(progress, rows()->offset() + rows()->size());
     } else {
         HMAT_ASSERT(isLower);
-      this->recursiveLltDecomposition(progress);
+      this->recursiveLltDecomposition(progress, checkpoint);
     }
     isTriLower = true;
     isLower = false;
 }
 
 template<typename T>
-void HMatrix<T>::luDecomposition(hmat_progress_t * progress) {
+void HMatrix<T>::luDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint) {
   DECLARE_CONTEXT;
 
   if (rows()->size() == 0 || cols()->size() == 0) return;
   if (this->isLeaf()) {
     assert(isFullMatrix());
+    Timeline::Task t(Timeline::LU, this);
+    FlopCounter::Scope phase(FlopCounter::FACTORIZATION);
     full()->luDecomposition();
     full()->checkNan();
-    if(progress != NULL) {
-      progress->current= rows()->offset() + rows()->size();
-      progress->update(progress);
-    }
+    Progress::eliminated(progress, rows()->offset() + rows()->size());
   } else {
-    this->recursiveLuDecomposition(progress);
+    this->recursiveLuDecomposition(progress, checkpoint);
   }
 }
 
@@ -2455,7 +2740,7 @@ template<typename T> void assertUpper(const HMatrix<T> * me) {
 }
 
 template<typename T>
-void HMatrix<T>::ldltDecomposition(hmat_progress_t * progress) {
+void HMatrix<T>::ldltDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint) {
   DECLARE_CONTEXT;
   assertLower(this);
 
@@ -2466,14 +2751,13 @@ void HMatrix<T>::ldltDecomposition(hmat_progress_t * progress) {
     //since the recursion is done with *rows() == *cols().
 
     assert(isFullMatrix());
+    Timeline::Task t(Timeline::LDLT, this);
+    FlopCounter::Scope phase(FlopCounter::FACTORIZATION);
     full()->ldltDecomposition();
-    if(progress != NULL) {
-        progress->current= rows()->offset() + rows()->size();
-        progress->update(progress);
-    }
+    Progress::eliminated(progress, rows()->offset() + rows()->size());
     assert(full()->diagonal);
   } else {
-    this->recursiveLdltDecomposition(progress);
+    this->recursiveLdltDecomposition(progress, checkpoint);
   }
   isTriLower = true;
   isLower = false;
@@ -144,6 +144,24 @@ template<typename T> class HMatrix : public Tree<HMatrix<T> >, public RecursionM
 
   /** Only used by internalCopy */
   HMatrix(const MatrixSettings * settings);
+  /** Block whose type and children are set later by buildStructure() */
+  HMatrix(const ClusterTree* rows, const ClusterTree* cols, const MatrixSettings * settings, int depth);
+  /** Create the block tree below this block, level by level */
+  void buildStructure(AdmissibilityCondition * admissibilityCondition, SymmetryFlag symmetryFlag);
+  /** Set the type of a block which cannot be splitted */
+  void setLeafType(AdmissibilityCondition * admissibilityCondition, bool lowRank);
+  /** Same as setLeafType() with AdmissibilityCondition::forceFull() already evaluated */
+  void setLeafType(AdmissibilityCondition * admissibilityCondition, bool lowRank, bool forceFull);
+  /** Return true if a block with this admissibility cannot be splitted */
+  bool isLeafBlock(AdmissibilityCondition * admissibilityCondition, bool lowRank) const;
+  /** Same as isLeafBlock() with AdmissibilityCondition::stopRecursion() already evaluated */
+  bool isLeafBlock(AdmissibilityCondition * admissibilityCondition, bool lowRank, bool stopRecursion) const;
+  /** Same as split() but the structure of the children is not built, they are appended to children */
+  bool splitNode(AdmissibilityCondition * admissibilityCondition, bool lowRank, SymmetryFlag symmetryFlag,
+                 std::vector<std::pair<HMatrix<T>*, SymmetryFlag> > & children);
+  /** Same as splitNode() with AdmissibilityCondition::stopRecursion() already evaluated */
+  bool splitNode(AdmissibilityCondition * admissibilityCondition, bool lowRank, bool stopRecursion,
+                 SymmetryFlag symmetryFlag, std::vector<std::pair<HMatrix<T>*, SymmetryFlag> > & children);
   /** This <- This + alpha * b
 
       \param alpha
@@ -209,18 +227,56 @@ public:
    */
   bool coarsen(double epsilon, HMatrix<T>* upper = NULL, bool force=false) ;
   /*! \brief HMatrix assembly.
+
+    \param onlyNull if true, the leaves which already hold data are kept
+    \param progress if not NULL, the assembled leaves are reported to it (see Progress::assembled)
    */
-  void assemble(Assembly<T>& f, const AllocationObserver & = AllocationObserver());
+  void assemble(Assembly<T>& f, const AllocationObserver & = AllocationObserver(), bool onlyNull = false,
+                hmat_progress_t * progress = NULL);
   /*! \brief HMatrix assembly.
 
     \param f the assembly function
     \param upper the upper part of the matrix. If NULL, it is assumed
                  that upper=this (that is, the current block is on the diagonal)
     \param onlyLower if true, only assemble the lower part of the matrix, ie don't copy.
+    \param onlyNull if true, the leaves which already hold data (and their upper
+                    counterpart) are kept
+    \param progress if not NULL, the assembled leaves are reported to it
    */
   void assembleSymmetric(Assembly<T>& f,
      HMatrix<T>* upper=NULL, bool onlyLower=false,
-     const AllocationObserver & = AllocationObserver());
+     const AllocationObserver & = AllocationObserver(), bool onlyNull = false,
+     hmat_progress_t * progress = NULL);
+  /*! \brief Move the leaves of previous which are still valid into this.
+
+    A leaf of this is taken from previous when previous has a leaf of the same
+    type whose rows and columns are the same DOFs, in the same order. This
+    happens for the blocks of the clusters left untouched by
+    ClusterTreeBuilder::update. The moved leaves of previous become null.
+    The other leaves of this are left null, to be computed by assemble()
+    with onlyNull = true.
+
+    \param previous a non factorized matrix
+    \param rowsNewToOld rowsNewToOld[i] is the previous index of the row DOF i, or -1 for a new DOF
+    \param colsNewToOld the same for the column DOFs
+    \return the number of moved leaves
+   */
+  int reuseLeaves(HMatrix<T>* previous, const int* rowsNewToOld, const int* colsNewToOld);
+  /*! \brief Prepare the blocks touching moved DOFs for assemble() with onlyNull = true.
+
+    The admissibility of the blocks whose rows or columns hold a dirty DOF is
+    computed again: a leaf which must now be splitted is splitted, a non leaf
+    which must now be a leaf loses its children, and the other dirty leaves
+    are emptied. Blocks without dirty DOFs are left untouched.
+
+    \param admissibilityCondition a condition prepared with the current coordinates
+    \param rowsDirty rowsDirty[i] is the number of dirty DOFs among the first i rows
+    \param colsDirty the same for the columns
+    \param symFlag the symmetry flag this block was built with
+    \return the number of leaves to assemble
+   */
+  int resetDirty(AdmissibilityCondition * admissibilityCondition, const std::vector<int>& rowsDirty,
+                 const std::vector<int>& colsDirty, SymmetryFlag symFlag);
   /*! \brief Evaluate the HMatrix, ie converts it to a full matrix.
 
     This conversion does the reorderng of the unknowns such that the resulting
@@ -395,17 +451,26 @@ public:
    */
   void truncate();
 
+  /*! \brief Quantize (pack = true) or restore (pack = false) the Rk leaves
+
+    Packed leaves keep an error below their respective epsilon_ but only
+    support gemv and serialization, see RkMatrix::pack.
+   */
+  void packRk(bool pack);
+
   /*! \brief LU decomposition in place.
 
     \warning Do not use. Doesn't work
+    \param checkpoint if not NULL, used to save the progress and skip the
+    steps done by a previous run (see FactorizationCheckpoint)
    */
-  void luDecomposition(hmat_progress_t * progress);
+  void luDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint = NULL);
   /** \brief LDL^t decomposition in place
      \warning this has to be created with the flag lower
      \warning this has to be assembled with assembleSymmetric with onlyLower = true
    */
-  void ldltDecomposition(hmat_progress_t * progress);
-  void lltDecomposition(hmat_progress_t * progress);
+  void ldltDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint = NULL);
+  void lltDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint = NULL);
 
   /** This <- This + alpha * b
 
@@ -659,6 +724,12 @@ public:
   void rk(const ScalarArray<T> *a, const ScalarArray<T> *b);
 
   void rk(RkMatrix<T> * m) {
+      if (m != NULL) {
+          if (m->a)
+              m->a->setMemoryCategory(MemoryInstrumenter::RK_FACTORS);
+          if (m->b)
+              m->b->setMemoryCategory(MemoryInstrumenter::RK_FACTORS);
+      }
       rk_ = m;
       rank_ = m == NULL ? 0 : m->rank();
   }
@@ -671,6 +742,8 @@ public:
   void full(FullMatrix<T> * m) {
       assert(m == nullptr || *m->rows_ == *this->rows());
       assert(m == nullptr || *m->cols_ == *this->cols());
+      if (m != NULL)
+          m->data.setMemoryCategory(MemoryInstrumenter::FULL_LEAVES);
       full_ = m;
       rank_ = FULL_BLOCK;
   }
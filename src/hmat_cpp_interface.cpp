@@ -28,7 +28,11 @@
 #include "disable_threading.hpp"
 #include "json.hpp"
 #include "iengine.hpp"
+#include "checkpoint.hpp"
+#include "shared_matrix.hpp"
+#include "progress.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 
@@ -38,7 +42,8 @@ namespace hmat {
 template<typename T>
 HMatInterface<T>::HMatInterface(IEngine<T>* engine, const ClusterTree* _rows, const ClusterTree* _cols,
                                 SymmetryFlag sym, AdmissibilityCondition * admissibilityCondition) :
-  engine_(engine),factorizationType(Factorization::NONE)
+  engine_(engine),factorizationType(Factorization::NONE),
+  resumeRow_(0), resumeFactorization_(Factorization::NONE), segment_(NULL)
 {
   DECLARE_CONTEXT;
   admissibilityCondition->prepare(*_rows, *_cols);
@@ -51,33 +56,216 @@ HMatInterface<T>::~HMatInterface() {
   engine_->destroy();
   delete engine_->hmat;
   delete engine_;
+  delete segment_;
 }
 
 template<typename T>
 HMatInterface<T>::HMatInterface(IEngine<T>* engine, HMatrix<T>* h, Factorization factorization):
-  engine_(engine)
+  engine_(engine), resumeRow_(0), resumeFactorization_(Factorization::NONE), segment_(NULL)
 {
   engine_->setHMatrix(h);
       factorizationType = factorization;
 }
 
+namespace {
+/** Estimated work of the leaves computed by an assembly, and their number */
+template<typename T>
+int64_t assemblyWork(const HMatrix<T> * h, SymmetryFlag sym, bool onlyNull, int & leaves) {
+  // The symmetric assembly computes the stored half of the matrix and copies the other one
+  const bool symmetric = sym == kLowerSymmetric || h->isLower || h->isUpper;
+  std::deque<const HMatrix<T> *> all;
+  h->listAllLeaves(all);
+  int64_t work = 0;
+  leaves = 0;
+  for (typename std::deque<const HMatrix<T> *>::const_iterator it = all.begin(); it != all.end(); ++it) {
+    const HMatrix<T> * leaf = *it;
+    const int rowOffset = leaf->rows()->offset(), colOffset = leaf->cols()->offset();
+    if (symmetric && (h->isUpper ? rowOffset > colOffset : rowOffset < colOffset))
+      continue;
+    if (onlyNull && !leaf->isNull())
+      continue;
+    leaves++;
+    work += Progress::assemblyWork(leaf->rows()->size(), leaf->cols()->size(),
+                                   leaf->isRkMatrix() ? Progress::PREDICTED_RANK : -1);
+  }
+  return work;
+}
+
+/** Estimated work of the factorization for the leaves of h */
+template<typename T>
+int64_t leavesWork(const HMatrix<T> * h) {
+  if (h == NULL)
+    return 0;
+  if (h->isLeaf())
+    return Progress::factorizationWork(h->rows()->size(), h->cols()->size(), h->isRkMatrix() ? h->rank() : -1);
+  int64_t work = 0;
+  for (int i = 0; i < h->nrChildRow(); i++)
+    for (int j = 0; j < h->nrChildCol(); j++)
+      work += leavesWork(h->get(i, j));
+  return work;
+}
+
+/**
+ * Add the estimated work of the recursive factorization of h to work[i], the
+ * work done once the rows before offset + i are eliminated. After each
+ * diagonal block, the solves of its panels and the updates of the trailing
+ * blocks are done before the next rows are eliminated.
+ */
+template<typename T>
+void eliminationWork(const HMatrix<T> * h, int offset, std::vector<int64_t> & work) {
+  const int last = work.size() - 1;
+  if (h->isLeaf()) {
+    work[std::min(h->rows()->offset() + h->rows()->size() - offset, last)] += leavesWork(h);
+    return;
+  }
+  const int n = std::min(h->nrChildRow(), h->nrChildCol());
+  for (int k = 0; k < n; k++) {
+    const HMatrix<T> * d = h->get(k, k);
+    if (d == NULL)
+      continue;
+    eliminationWork(d, offset, work);
+    int64_t updates = 0;
+    for (int i = k; i < h->nrChildRow(); i++)
+      for (int j = k; j < h->nrChildCol(); j++)
+        if (i != k || j != k)
+          updates += leavesWork(h->get(i, j));
+    work[std::min(d->rows()->offset() + d->rows()->size() - offset + 1, last)] += updates;
+  }
+}
+
+/** Estimated work of a factorization done when the rows before the offset of h + i are eliminated */
+template<typename T>
+std::vector<int64_t> eliminationWork(const HMatrix<T> * h) {
+  const int n = h->rows()->size();
+  std::vector<int64_t> work(n + 1, 0);
+  eliminationWork(h, h->rows()->offset(), work);
+  for (int i = 1; i <= n; i++)
+    work[i] += work[i - 1];
+  return work;
+}
+
+/** Give the progress of an operation to an engine, and the user progress back at the end of the scope */
+template<typename T>
+class EngineProgress {
+  IEngine<T> * engine_;
+  hmat_progress_t * progress_;
+public:
+  EngineProgress(IEngine<T> * engine, Progress::Operation & operation, hmat_progress_t * progress)
+    : engine_(engine), progress_(progress) {
+    engine_->progress(operation.progress());
+  }
+  ~EngineProgress() {
+    engine_->progress(progress_);
+  }
+};
+}
+
 template<typename T>
 void HMatInterface<T>::assemble(Assembly<T>& f, SymmetryFlag sym, bool,
                                    hmat_progress_t * progress, bool ownAssembly) {
   DISABLE_THREADING_IN_BLOCK;
   DECLARE_CONTEXT;
-  engine_->progress(progress);
+  int leaves = 0;
+  const int64_t work = progress ? assemblyWork(engine_->hmat, sym, false, leaves) : 0;
+  Progress::Operation operation(progress, leaves, work);
+  EngineProgress<T> engineProgress(engine_, operation, progress);
   engine_->assembly(f, sym, ownAssembly);
+  operation.finish();
 }
 
 template<typename T>
-void HMatInterface<T>::factorize(Factorization t, hmat_progress_t * progress) {
+void HMatInterface<T>::assemblePartial(Assembly<T>& f, SymmetryFlag sym,
+                                       hmat_progress_t * progress, bool ownAssembly) {
   DISABLE_THREADING_IN_BLOCK;
   DECLARE_CONTEXT;
-  engine_->progress(progress);
-  if(progress != NULL)
-    progress->max = engine_->hmat->rows()->size();
-  engine_->factorization(t);
+  int leaves = 0;
+  const int64_t work = progress ? assemblyWork(engine_->hmat, sym, true, leaves) : 0;
+  Progress::Operation operation(progress, leaves, work);
+  EngineProgress<T> engineProgress(engine_, operation, progress);
+  engine_->partialAssembly(f, sym, ownAssembly);
+  operation.finish();
+}
+
+namespace {
+/** Invert an index mapping, oldToNew[i] < 0 meaning that i has no new index */
+std::vector<int> invertMapping(const int* oldToNew, int oldSize, int newSize) {
+  std::vector<int> result(newSize, -1);
+  for (int i = 0; i < oldSize; ++i) {
+    if (oldToNew[i] >= 0) {
+      HMAT_ASSERT_MSG(oldToNew[i] < newSize, "Invalid new index %d for DOF %d", oldToNew[i], i);
+      result[oldToNew[i]] = i;
+    }
+  }
+  return result;
+}
+}
+
+template<typename T>
+int HMatInterface<T>::reuseBlocks(HMatInterface<T>& previous, const int* rowsOldToNew, const int* colsOldToNew) {
+  DECLARE_CONTEXT;
+  HMAT_ASSERT_MSG(previous.factorizationType == Factorization::NONE,
+                  "The blocks of a factorized matrix cannot be reused");
+  HMatrix<T>* h = engine_->hmat;
+  HMatrix<T>* p = previous.engine_->hmat;
+  const std::vector<int> rowsNewToOld = invertMapping(rowsOldToNew,
+      p->rows()->coordinates()->numberOfDof(), h->rows()->coordinates()->numberOfDof());
+  const std::vector<int> colsNewToOld = invertMapping(colsOldToNew,
+      p->cols()->coordinates()->numberOfDof(), h->cols()->coordinates()->numberOfDof());
+  return h->reuseLeaves(p, rowsNewToOld.data(), colsNewToOld.data());
+}
+
+namespace {
+/** Number of dirty DOFs among the first i DOFs of data, for each i */
+std::vector<int> dirtyPrefix(const ClusterData& data, const char* dirty) {
+  const int n = data.coordinates()->numberOfDof();
+  const int* indices = data.indices();
+  std::vector<int> result(n + 1, 0);
+  for (int i = 0; i < n; ++i)
+    result[i + 1] = result[i] + (dirty[indices[i]] ? 1 : 0);
+  return result;
+}
+}
+
+template<typename T>
+int HMatInterface<T>::resetDirtyBlocks(const char* rowsDirty, const char* colsDirty,
+                                       AdmissibilityCondition * admissibilityCondition) {
+  DECLARE_CONTEXT;
+  HMAT_ASSERT_MSG(factorizationType == Factorization::NONE,
+                  "The blocks of a factorized matrix cannot be reassembled");
+  HMatrix<T>* h = engine_->hmat;
+  const std::vector<int> rowsPrefix = dirtyPrefix(*h->rows(), rowsDirty);
+  const std::vector<int> colsPrefix = dirtyPrefix(*h->cols(), colsDirty);
+  admissibilityCondition->prepare(*h->rowsTree(), *h->colsTree());
+  int result = h->resetDirty(admissibilityCondition, rowsPrefix, colsPrefix,
+                             h->isLower ? kLowerSymmetric : kNotSymmetric);
+  admissibilityCondition->clean(*h->rowsTree(), *h->colsTree());
+  return result;
+}
+
+template<typename T>
+void HMatInterface<T>::factorize(Factorization t, hmat_progress_t * progress,
+                                 const hmat_checkpoint_t * checkpoint) {
+  DISABLE_THREADING_IN_BLOCK;
+  DECLARE_CONTEXT;
+  HMAT_ASSERT_MSG(resumeRow_ == 0 || t == resumeFactorization_,
+                  "The factorization to resume is %d, not %d",
+                  convert_factorization_to_int(resumeFactorization_), convert_factorization_to_int(t));
+  Progress::Operation operation(progress, engine_->hmat->rows()->size(), 0);
+  if(progress != NULL && t != Factorization::HODLR && t != Factorization::HODLRSYM)
+    operation.eliminationWork(engine_->hmat->rows()->offset(), eliminationWork(engine_->hmat), resumeRow_);
+  EngineProgress<T> engineProgress(engine_, operation, progress);
+  StreamCheckpoint<T> streamCheckpoint(engine_->hmat, t, checkpoint, resumeRow_);
+  if(checkpoint != NULL || resumeRow_ != 0)
+    engine_->checkpoint(&streamCheckpoint);
+  try {
+    engine_->factorization(t);
+  } catch(...) {
+    engine_->checkpoint(NULL);
+    throw;
+  }
+  engine_->checkpoint(NULL);
+  operation.finish();
+  resumeRow_ = 0;
   factorizationType = t;
   engine_->hmat->checkStructure();
 }
@@ -55,6 +55,7 @@ class AdmissibilityCondition;
 
 class DofCoordinates;
 class ClusteringAlgorithm;
+class SharedSegment;
 
 /** Settings for the HMatrix library.
 
@@ -135,6 +136,11 @@ class HMatInterface {
 private:
   IEngine<T>* engine_;
   Factorization factorizationType;
+  /// Where the next factorize() starts, see resumeFactorization()
+  int resumeRow_;
+  Factorization resumeFactorization_;
+  /// Mapping of the leaves of a shared matrix, see attachShared()
+  SharedSegment * segment_;
 
 public:
   /** Build a new HMatrix from two cluster sets.
@@ -175,6 +181,43 @@ public:
                 hmat_progress_t * progress = DefaultProgress::getInstance(),
                 bool ownAssembly=false);
 
+  /** Same as assemble() but only the null leaves are computed.
+
+      This completes a matrix whose valid blocks have been taken from a
+      previous one with reuseBlocks().
+   */
+  void assemblePartial(Assembly<T>& f, SymmetryFlag sym,
+                       hmat_progress_t * progress = DefaultProgress::getInstance(),
+                       bool ownAssembly=false);
+
+  /** Move into this the blocks of previous which are still valid.
+
+      This is meant for a matrix built on trees returned by
+      ClusterTreeBuilder::update(): the blocks whose rows and columns hold the
+      same DOFs, in the same order, are moved from previous, which should then
+      only be destroyed. The other blocks are left null for assemblePartial().
+
+      @param previous a non factorized matrix
+      @param rowsOldToNew new index of each row DOF of previous, or -1 if it has been removed
+      @param colsOldToNew the same for the columns
+      @return the number of moved leaves
+   */
+  int reuseBlocks(HMatInterface<T>& previous, const int* rowsOldToNew, const int* colsOldToNew);
+
+  /** Empty the blocks touching moved DOFs, so that assemblePartial() computes them again.
+
+      The admissibility of these blocks is checked against the current
+      coordinates of the cluster trees (see ClusterTree::coordinates()), and
+      only the blocks whose admissibility changed are splitted or merged.
+
+      @param rowsDirty rowsDirty[i] is not 0 if the row DOF i moved
+      @param colsDirty the same for the columns
+      @param admissibilityCondition the condition the matrix was built with
+      @return the number of leaves to assemble
+   */
+  int resetDirtyBlocks(const char* rowsDirty, const char* colsDirty,
+                       AdmissibilityCondition * admissibilityCondition);
+
   /** Compute a \f$LU\f$ or \f$LDL^T\f$ decomposition of the HMatrix, in place.
 
       An LDL^T decomposition is done if the HMatrix is symmetric and has been
@@ -182,7 +225,26 @@ public:
       HMatInterface<T>::assemble()), and if HMatSettings::useLdlt is
       true. Otherwise an LU decomposition is done.
    */
-  void factorize(Factorization, hmat_progress_t * progress = DefaultProgress::getInstance());
+  void factorize(Factorization, hmat_progress_t * progress = DefaultProgress::getInstance(),
+                 const hmat_checkpoint_t * checkpoint = NULL);
+
+  /** Make the next factorize() resume a factorization loaded with readCheckpoint().
+
+      @param f the factorization in progress, factorize() must be called with the same value
+      @param row the row returned by readCheckpoint()
+   */
+  void resumeFactorization(Factorization f, int row) {
+      resumeFactorization_ = f;
+      resumeRow_ = row;
+  }
+
+  /** Take the ownership of the shared memory holding the leaves of this matrix.
+
+      The segment is unmapped after the matrix is deleted.
+   */
+  void ownSegment(SharedSegment * segment) {
+      segment_ = segment;
+  }
 
   /** Compute the inverse of the HMatrix, in place.
    */
@@ -35,13 +35,18 @@ namespace hmat {
     HMatrix<T> *hmat;
 
     virtual void destroy() = 0;
-    IEngine(): progress_(NULL) {}
+    IEngine(): progress_(NULL), checkpoint_(NULL) {}
     virtual ~IEngine(){}
 
     virtual IEngine<T>* clone() const = 0;
 
     virtual void assembly(Assembly<T> &f, SymmetryFlag sym, bool ownAssembly) = 0;
 
+    /*! \brief Same as assembly() but the leaves which already hold data are kept */
+    virtual void partialAssembly(Assembly<T> &, SymmetryFlag, bool) {
+      HMAT_ASSERT_MSG(false, "Partial assembly is not supported by this engine");
+    }
+
     virtual void factorization(Factorization) = 0;
 
     virtual void inverse() = 0;
@@ -68,6 +73,7 @@ namespace hmat {
 
     void progress(hmat_progress_t *p) { progress_ = p; }
     hmat_progress_t * progress() const { return progress_; }
+    void checkpoint(FactorizationCheckpoint *c) { checkpoint_ = c; }
     virtual void info(hmat_info_t &i) const =0;
 
     virtual EngineSettings &GetSettings() = 0;
@@ -83,6 +89,7 @@ namespace hmat {
     virtual double norm() const = 0;
   protected:
     hmat_progress_t *progress_;
+    FactorizationCheckpoint *checkpoint_;
   };
 
 }
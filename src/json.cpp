@@ -23,6 +23,8 @@
 #include "json.hpp"
 #include "cluster_tree.hpp"
 #include "h_matrix.hpp"
+#include "assembly_stats.hpp"
+#include <algorithm>
 
 using namespace std;
 
@@ -131,6 +133,22 @@ void JSONDumper::dump() {
 
 template<typename T> void HMatrixJSONDumper<T>::dumpMeta() {
     dumpPoints();
+    // Totals of the assembly statistics, to scale the heatmap of the leaves
+    const size_t n = AssemblyStats::count();
+    if (n > 0) {
+        double kernel = 0, compression = 0, truncate = 0, maxTime = 0;
+        for (size_t i = 0; i < n; i++) {
+            hmat_block_stats_t s;
+            AssemblyStats::get(i, s);
+            kernel += s.kernel_time;
+            compression += s.compression_time;
+            truncate += s.truncate_time;
+            maxTime = std::max(maxTime, s.kernel_time + s.compression_time + s.truncate_time);
+        }
+        out_ << " \"assembly\": {\"leaves\": " << n << ", \"kernel\": " << kernel
+             << ", \"compression\": " << compression << ", \"truncate\": " << truncate
+             << ", \"maxTime\": " << maxTime << "}," << endl;
+    }
 }
 
 template<typename T> void HMatrixJSONDumper<T>::update() {
@@ -144,6 +162,18 @@ template<typename T> void HMatrixJSONDumper<T>::update() {
         nodeInfo_ << " \"epsilon\": " << current_->lowRankEpsilon() << ",";
         nodeInfo_ << " \"approxK\": " << current_->approximateRank();
     }
+    hmat_block_stats_t s;
+    if (current_->isLeaf() && AssemblyStats::find(rows_, cols_, s)) {
+        // Heatmap of the assembly, time is the sum of the other times
+        if (!nodeInfo_.str().empty())
+            nodeInfo_ << ",";
+        nodeInfo_ << " \"assembly\": {\"time\": " << s.kernel_time + s.compression_time + s.truncate_time
+                  << ", \"kernel\": " << s.kernel_time << ", \"compression\": " << s.compression_time
+                  << ", \"truncate\": " << s.truncate_time << ", \"getRow\": " << s.get_row_count
+                  << ", \"getCol\": " << s.get_col_count << ", \"getElement\": " << s.get_element_count
+                  << ", \"assemble\": " << s.assemble_count << ", \"algorithm\": \"" << s.algorithm
+                  << "\", \"bytes\": " << s.bytes << "}";
+    }
 }
 
 template<typename T>
@@ -26,6 +26,7 @@
 #include "config.h"
 
 #include "data_types.hpp"
+#include "common/flop_counter.hpp"
 #include <algorithm>
 
 #ifdef HAVE_MKL_H
@@ -69,19 +70,23 @@ template <typename T> int getrf(int m, int n, T *a, int lda, int *ipiv);
 
 template <>
 inline int getrf<hmat::S_t>(int m, int n, hmat::S_t *a, int lda, int *ipiv) {
+  hmat::flops::getrf<hmat::S_t>(m, n);
   return LAPACKE_sgetrf(LAPACK_COL_MAJOR, m, n, a, lda, ipiv);
 }
 
 template <>
 inline int getrf<hmat::D_t>(int m, int n, hmat::D_t *a, int lda, int *ipiv) {
+  hmat::flops::getrf<hmat::D_t>(m, n);
   return LAPACKE_dgetrf(LAPACK_COL_MAJOR, m, n, a, lda, ipiv);
 }
 template <>
 inline int getrf<hmat::C_t>(int m, int n, hmat::C_t *a, int lda, int *ipiv) {
+  hmat::flops::getrf<hmat::C_t>(m, n);
   return LAPACKE_cgetrf(LAPACK_COL_MAJOR, m, n, a, lda, ipiv);
 }
 template <>
 inline int getrf<hmat::Z_t>(int m, int n, hmat::Z_t *a, int lda, int *ipiv) {
+  hmat::flops::getrf<hmat::Z_t>(m, n);
   return LAPACKE_zgetrf(LAPACK_COL_MAJOR, m, n, a, lda, ipiv);
 }
 
@@ -92,18 +97,22 @@ template <typename T> int getri(int n, T *a, int lda, const int *ipiv);
 
 template <>
 inline int getri<hmat::S_t>(int n, hmat::S_t *a, int lda, const int *ipiv) {
+  hmat::flops::getri<hmat::S_t>(n);
   return LAPACKE_sgetri(LAPACK_COL_MAJOR, n, a, lda, ipiv);
 }
 template <>
 inline int getri<hmat::D_t>(int n, hmat::D_t *a, int lda, const int *ipiv) {
+  hmat::flops::getri<hmat::D_t>(n);
   return LAPACKE_dgetri(LAPACK_COL_MAJOR, n, a, lda, ipiv);
 }
 template <>
 inline int getri<hmat::C_t>(int n, hmat::C_t *a, int lda, const int *ipiv) {
+  hmat::flops::getri<hmat::C_t>(n);
   return LAPACKE_cgetri(LAPACK_COL_MAJOR, n, a, lda, ipiv);
 }
 template <>
 inline int getri<hmat::Z_t>(int n, hmat::Z_t *a, int lda, const int *ipiv) {
+  hmat::flops::getri<hmat::Z_t>(n);
   return LAPACKE_zgetri(LAPACK_COL_MAJOR, n, a, lda, ipiv);
 }
 
@@ -118,21 +127,25 @@ int getrs(char trans, int n, int nrhs, const T *a, int lda, const int *ipiv,
 template <>
 inline int getrs<hmat::S_t>(char trans, int n, int nrhs, const hmat::S_t *a,
                             int lda, const int *ipiv, hmat::S_t *b, int ldb) {
+  hmat::flops::getrs<hmat::S_t>(n, nrhs);
   return LAPACKE_sgetrs(LAPACK_COL_MAJOR, trans, n, nrhs, a, lda, ipiv, b, ldb);
 }
 template <>
 inline int getrs<hmat::D_t>(char trans, int n, int nrhs, const hmat::D_t *a,
                             int lda, const int *ipiv, hmat::D_t *b, int ldb) {
+  hmat::flops::getrs<hmat::D_t>(n, nrhs);
   return LAPACKE_dgetrs(LAPACK_COL_MAJOR, trans, n, nrhs, a, lda, ipiv, b, ldb);
 }
 template <>
 inline int getrs<hmat::C_t>(char trans, int n, int nrhs, const hmat::C_t *a,
                             int lda, const int *ipiv, hmat::C_t *b, int ldb) {
+  hmat::flops::getrs<hmat::C_t>(n, nrhs);
   return LAPACKE_cgetrs(LAPACK_COL_MAJOR, trans, n, nrhs, a, lda, ipiv, b, ldb);
 }
 template <>
 inline int getrs<hmat::Z_t>(char trans, int n, int nrhs, const hmat::Z_t *a,
                             int lda, const int *ipiv, hmat::Z_t *b, int ldb) {
+  hmat::flops::getrs<hmat::Z_t>(n, nrhs);
   return LAPACKE_zgetrs(LAPACK_COL_MAJOR, trans, n, nrhs, a, lda, ipiv, b, ldb);
 }
 
@@ -144,21 +157,25 @@ template <typename T> int geqrf(int m, int n, T *a, int lda, T *tau);
 template <>
 inline int geqrf<hmat::S_t>(int m, int n, hmat::S_t *a, int lda,
                             hmat::S_t *tau) {
+  hmat::flops::geqrf<hmat::S_t>(m, n);
   return LAPACKE_sgeqrf(LAPACK_COL_MAJOR, m, n, a, lda, tau);
 }
 template <>
 inline int geqrf<hmat::D_t>(int m, int n, hmat::D_t *a, int lda,
                             hmat::D_t *tau) {
+  hmat::flops::geqrf<hmat::D_t>(m, n);
   return LAPACKE_dgeqrf(LAPACK_COL_MAJOR, m, n, a, lda, tau);
 }
 template <>
 inline int geqrf<hmat::C_t>(int m, int n, hmat::C_t *a, int lda,
                             hmat::C_t *tau) {
+  hmat::flops::geqrf<hmat::C_t>(m, n);
   return LAPACKE_cgeqrf(LAPACK_COL_MAJOR, m, n, a, lda, tau);
 }
 template <>
 inline int geqrf<hmat::Z_t>(int m, int n, hmat::Z_t *a, int lda,
                             hmat::Z_t *tau) {
+  hmat::flops::geqrf<hmat::Z_t>(m, n);
   return LAPACKE_zgeqrf(LAPACK_COL_MAJOR, m, n, a, lda, tau);
 }
 
@@ -175,6 +192,7 @@ template <>
 inline int gesdd<hmat::S_t, hmat::S_t>(char jobz, int m, int n, hmat::S_t *a,
                                        int lda, hmat::S_t *s, hmat::S_t *u,
                                        int ldu, hmat::S_t *vt, int ldvt) {
+  hmat::flops::svd<hmat::S_t>(m, n);
   return LAPACKE_sgesdd(LAPACK_COL_MAJOR, jobz, m, n, a, lda, s, u, ldu, vt,
                         ldvt);
 }
@@ -182,6 +200,7 @@ template <>
 inline int gesdd<hmat::D_t, hmat::D_t>(char jobz, int m, int n, hmat::D_t *a,
                                        int lda, hmat::D_t *s, hmat::D_t *u,
                                        int ldu, hmat::D_t *vt, int ldvt) {
+  hmat::flops::svd<hmat::D_t>(m, n);
   return LAPACKE_dgesdd(LAPACK_COL_MAJOR, jobz, m, n, a, lda, s, u, ldu, vt,
                         ldvt);
 }
@@ -189,6 +208,7 @@ template <>
 inline int gesdd<hmat::C_t, hmat::S_t>(char jobz, int m, int n, hmat::C_t *a,
                                        int lda, hmat::S_t *s, hmat::C_t *u,
                                        int ldu, hmat::C_t *vt, int ldvt) {
+  hmat::flops::svd<hmat::C_t>(m, n);
   return LAPACKE_cgesdd(LAPACK_COL_MAJOR, jobz, m, n, a, lda, s, u, ldu, vt,
                         ldvt);
 }
@@ -196,6 +216,7 @@ template <>
 inline int gesdd<hmat::Z_t, hmat::D_t>(char jobz, int m, int n, hmat::Z_t *a,
                                        int lda, hmat::D_t *s, hmat::Z_t *u,
                                        int ldu, hmat::Z_t *vt, int ldvt) {
+  hmat::flops::svd<hmat::Z_t>(m, n);
   return LAPACKE_zgesdd(LAPACK_COL_MAJOR, jobz, m, n, a, lda, s, u, ldu, vt,
                         ldvt);
 }
@@ -214,6 +235,7 @@ template <>
 inline int gesvd<hmat::S_t>(char jobu, char jobvt, int m, int n, hmat::S_t *a,
                             int lda, hmat::S_t *s, hmat::S_t *u, int ldu,
                             hmat::S_t *vt, int ldvt, hmat::S_t *superb) {
+  hmat::flops::svd<hmat::S_t>(m, n);
   return LAPACKE_sgesvd(LAPACK_COL_MAJOR, jobu, jobvt, m, n, a, lda, s, u, ldu,
                         vt, ldvt, superb);
 }
@@ -221,6 +243,7 @@ template <>
 inline int gesvd<hmat::D_t>(char jobu, char jobvt, int m, int n, hmat::D_t *a,
                             int lda, hmat::D_t *s, hmat::D_t *u, int ldu,
                             hmat::D_t *vt, int ldvt, hmat::D_t *superb) {
+  hmat::flops::svd<hmat::D_t>(m, n);
   return LAPACKE_dgesvd(LAPACK_COL_MAJOR, jobu, jobvt, m, n, a, lda, s, u, ldu,
                         vt, ldvt, superb);
 }
@@ -228,6 +251,7 @@ template <>
 inline int gesvd<hmat::C_t>(char jobu, char jobvt, int m, int n, hmat::C_t *a,
                             int lda, hmat::S_t *s, hmat::C_t *u, int ldu,
                             hmat::C_t *vt, int ldvt, hmat::S_t *superb) {
+  hmat::flops::svd<hmat::C_t>(m, n);
   return LAPACKE_cgesvd(LAPACK_COL_MAJOR, jobu, jobvt, m, n, a, lda, s, u, ldu,
                         vt, ldvt, superb);
 }
@@ -235,6 +259,7 @@ template <>
 inline int gesvd<hmat::Z_t>(char jobu, char jobvt, int m, int n, hmat::Z_t *a,
                             int lda, hmat::D_t *s, hmat::Z_t *u, int ldu,
                             hmat::Z_t *vt, int ldvt, hmat::D_t *superb) {
+  hmat::flops::svd<hmat::Z_t>(m, n);
   return LAPACKE_zgesvd(LAPACK_COL_MAJOR, jobu, jobvt, m, n, a, lda, s, u, ldu,
                         vt, ldvt, superb);
 }
@@ -259,11 +284,13 @@ int ormqr(char side, char trans, int m, int n, int k, const T* a, int lda, const
 
 template<>
 inline int ormqr<hmat::S_t>(char side, char trans, int m, int n, int k, const hmat::S_t* a, int lda, const hmat::S_t* tau, hmat::S_t* c, int ldc) {
+  hmat::flops::ormqr<hmat::S_t>(side, m, n, k);
   return LAPACKE_sormqr(LAPACK_COL_MAJOR, side, trans, m, n, k, a, lda, tau, c, ldc);
 }
 template<>
 inline int
 ormqr<hmat::D_t>(char side, char trans, int m, int n, int k, const hmat::D_t* a, int lda, const hmat::D_t* tau, hmat::D_t* c, int ldc) {
+  hmat::flops::ormqr<hmat::D_t>(side, m, n, k);
   return LAPACKE_dormqr(LAPACK_COL_MAJOR, side, trans, m, n, k, a, lda, tau, c, ldc);
 }
 
@@ -291,6 +318,7 @@ template <>
 inline int unmqr<hmat::C_t>(char side, char trans, int m, int n, int k,
                             const hmat::C_t *a, int lda, const hmat::C_t *tau,
                             hmat::C_t *c, int ldc) {
+  hmat::flops::ormqr<hmat::C_t>(side, m, n, k);
   return LAPACKE_cunmqr(LAPACK_COL_MAJOR, side, trans, m, n, k, a, lda, tau, c,
                         ldc);
 }
@@ -298,6 +326,7 @@ template <>
 inline int unmqr<hmat::Z_t>(char side, char trans, int m, int n, int k,
                             const hmat::Z_t *a, int lda, const hmat::Z_t *tau,
                             hmat::Z_t *c, int ldc) {
+  hmat::flops::ormqr<hmat::Z_t>(side, m, n, k);
   return LAPACKE_zunmqr(LAPACK_COL_MAJOR, side, trans, m, n, k, a, lda, tau, c,
                         ldc);
 }
@@ -308,21 +337,25 @@ void laswp(int n, T *a, int lda, int k1, int k2, const int *ipiv, int incx);
 template <>
 inline void laswp<hmat::S_t>(int n, hmat::S_t *a, int lda, int k1, int k2,
                              const int *ipiv, int incx) {
+  hmat::flops::copy<hmat::S_t>(int64_t(n) * (k2 - k1 + 1));
   LAPACKE_slaswp(LAPACK_COL_MAJOR, n, a, lda, k1, k2, ipiv, incx);
 }
 template <>
 inline void laswp<hmat::D_t>(int n, hmat::D_t *a, int lda, int k1, int k2,
                              const int *ipiv, int incx) {
+  hmat::flops::copy<hmat::D_t>(int64_t(n) * (k2 - k1 + 1));
   LAPACKE_dlaswp(LAPACK_COL_MAJOR, n, a, lda, k1, k2, ipiv, incx);
 }
 template <>
 inline void laswp<hmat::C_t>(int n, hmat::C_t *a, int lda, int k1, int k2,
                              const int *ipiv, int incx) {
+  hmat::flops::copy<hmat::C_t>(int64_t(n) * (k2 - k1 + 1));
   LAPACKE_claswp(LAPACK_COL_MAJOR, n, a, lda, k1, k2, ipiv, incx);
 }
 template <>
 inline void laswp<hmat::Z_t>(int n, hmat::Z_t *a, int lda, int k1, int k2,
                              const int *ipiv, int incx) {
+  hmat::flops::copy<hmat::Z_t>(int64_t(n) * (k2 - k1 + 1));
   LAPACKE_zlaswp(LAPACK_COL_MAJOR, n, a, lda, k1, k2, ipiv, incx);
 }
 
@@ -330,26 +363,36 @@ template <typename T> int potrf(char uplo, int n, T *a, int lda);
 
 template <>
 inline int potrf<hmat::S_t>(char uplo, int n, hmat::S_t *a, int lda) {
+  hmat::flops::potrf<hmat::S_t>(n);
   return LAPACKE_spotrf(LAPACK_COL_MAJOR, uplo, n, a, lda);
 }
 template <>
 inline int potrf<hmat::D_t>(char uplo, int n, hmat::D_t *a, int lda) {
+  hmat::flops::potrf<hmat::D_t>(n);
   return LAPACKE_dpotrf(LAPACK_COL_MAJOR, uplo, n, a, lda);
 }
 template <>
 inline int potrf<hmat::C_t>(char uplo, int n, hmat::C_t *a, int lda) {
+  hmat::flops::potrf<hmat::C_t>(n);
   return LAPACKE_cpotrf(LAPACK_COL_MAJOR, uplo, n, a, lda);
 }
 template <>
 inline int potrf<hmat::Z_t>(char uplo, int n, hmat::Z_t *a, int lda) {
+  hmat::flops::potrf<hmat::Z_t>(n);
   return LAPACKE_zpotrf(LAPACK_COL_MAJOR, uplo, n, a, lda);
 }
 
 template<typename T> void lacgv(int n, T* a, int incx);
 template<> inline void lacgv<hmat::S_t>(int, hmat::S_t*, int) {}
 template<> inline void lacgv<hmat::D_t>(int, hmat::D_t*, int) {}
-template<> inline void lacgv<hmat::C_t>(int n, hmat::C_t* a, int incx) { LAPACKE_clacgv(n, a, incx); }
-template<> inline void lacgv<hmat::Z_t>(int n, hmat::Z_t* a, int incx) { LAPACKE_zlacgv(n, a, incx); }
+template<> inline void lacgv<hmat::C_t>(int n, hmat::C_t* a, int incx) {
+  hmat::flops::copy<hmat::C_t>(n);
+  LAPACKE_clacgv(n, a, incx);
+}
+template<> inline void lacgv<hmat::Z_t>(int n, hmat::Z_t* a, int incx) {
+  hmat::flops::copy<hmat::Z_t>(n);
+  LAPACKE_zlacgv(n, a, incx);
+}
 
 }  // end namespace proxy_lapack
 
@@ -0,0 +1,161 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "progress.hpp"
+#include <algorithm>
+
+namespace hmat {
+
+Progress::Operation::Operation(hmat_progress_t * progress, int max, int64_t work)
+  : progress_(progress), start_(now()), current_(0), work_(0), maxWork_(work), startWork_(0),
+    publishedWork_(-1), publishedCurrent_(-1), offset_(0) {
+  publishing_.clear();
+  channel_.max = max;
+  channel_.current = 0;
+  channel_.update = forward;
+  channel_.user_data = this;
+  channel_.max_work = work;
+  channel_.current_work = 0;
+  channel_.elapsed = 0;
+  channel_.throughput = 0;
+  channel_.eta = -1;
+  if (progress_ == NULL)
+    return;
+  progress_->max = max;
+  progress_->current = 0;
+  progress_->max_work = work;
+  progress_->current_work = 0;
+  progress_->elapsed = 0;
+  progress_->throughput = 0;
+  progress_->eta = -1;
+}
+
+void Progress::Operation::forward(hmat_progress_t * channel) {
+  Operation * op = static_cast<Operation *>(channel->user_data);
+  op->current_.store(channel->current, std::memory_order_relaxed);
+  op->progress_->max = channel->max;
+  op->publish(true);
+}
+
+void Progress::Operation::eliminationWork(int offset, const std::vector<int64_t> & work, int resume) {
+  offset_ = offset;
+  eliminationWork_ = work;
+  maxWork_.store(work.back());
+  startWork_ = work[std::min(std::max(resume - offset, 0), (int) work.size() - 1)];
+  work_.store(startWork_);
+  current_.store(resume);
+}
+
+void Progress::Operation::finish() {
+  if (progress_ == NULL)
+    return;
+  current_.store(progress_->max);
+  work_.store(maxWork_.load());
+  publish(true);
+}
+
+void Progress::Operation::publish(bool force) {
+  const int64_t work = work_.load(std::memory_order_relaxed);
+  const int64_t maxWork = maxWork_.load(std::memory_order_relaxed);
+  if (!force && work - publishedWork_.load(std::memory_order_relaxed) < maxWork / 1000)
+    return;
+  if (force) {
+    while (publishing_.test_and_set(std::memory_order_acquire))
+      ;
+  } else if (publishing_.test_and_set(std::memory_order_acquire)) {
+    // Another thread is publishing
+    return;
+  }
+  const int current = current_.load(std::memory_order_relaxed);
+  if (work != publishedWork_.load(std::memory_order_relaxed) || current != publishedCurrent_) {
+    const double elapsed = time_diff(start_, now());
+    publishedWork_.store(work, std::memory_order_relaxed);
+    publishedCurrent_ = current;
+    progress_->current = current;
+    progress_->current_work = work;
+    progress_->max_work = maxWork;
+    progress_->elapsed = elapsed;
+    progress_->throughput = elapsed > 0 ? (work - startWork_) / elapsed : 0;
+    progress_->eta = progress_->throughput > 0 ? (maxWork - work) / progress_->throughput : -1;
+    progress_->update(progress_);
+  }
+  publishing_.clear(std::memory_order_release);
+}
+
+int64_t Progress::assemblyWork(int rows, int cols, int rank) {
+  // Number of computed entries, with the rows and columns computed by the ACA
+  if (rank < 0)
+    return (int64_t) rows * cols;
+  return (int64_t) (rows + cols) * std::min(std::max(rank, 1), std::min(rows, cols));
+}
+
+int64_t Progress::factorizationWork(int rows, int cols, int rank) {
+  // Flops of the factorizations, solves and products of full leaves, and of
+  // the recompressions of the updates of the Rk leaves
+  if (rank < 0)
+    return (int64_t) rows * cols * std::min(rows, cols);
+  const int64_t r = std::max(rank, 1);
+  return (rows + cols) * r * r;
+}
+
+Progress::Operation * Progress::operation(hmat_progress_t * progress) {
+  if (progress == NULL || progress->update != Operation::forward)
+    return NULL;
+  return static_cast<Operation *>(progress->user_data);
+}
+
+void Progress::assembled(hmat_progress_t * progress, int rows, int cols, bool admissible, int rank) {
+  Operation * op = operation(progress);
+  if (op == NULL)
+    return;
+  const int64_t predicted = assemblyWork(rows, cols, admissible ? PREDICTED_RANK : -1);
+  const int64_t actual = assemblyWork(rows, cols, admissible ? rank : -1);
+  // The estimate of the whole operation is corrected with the actual rank
+  op->maxWork_.fetch_add(actual - predicted, std::memory_order_relaxed);
+  op->work_.fetch_add(actual, std::memory_order_relaxed);
+  op->current_.fetch_add(1, std::memory_order_relaxed);
+  op->publish(false);
+}
+
+void Progress::eliminated(hmat_progress_t * progress, int position) {
+  if (progress == NULL)
+    return;
+  Operation * op = operation(progress);
+  if (op == NULL) {
+    progress->current = position;
+    progress->max_work = 0;
+    progress->current_work = 0;
+    progress->elapsed = 0;
+    progress->throughput = 0;
+    progress->eta = -1;
+    progress->update(progress);
+    return;
+  }
+  if (!op->eliminationWork_.empty()) {
+    const int i = std::min(std::max(position - op->offset_, 0), (int) op->eliminationWork_.size() - 1);
+    op->work_.store(op->eliminationWork_[i], std::memory_order_relaxed);
+  }
+  op->current_.store(position, std::memory_order_relaxed);
+  op->publish(false);
+}
+
+}  // end namespace hmat
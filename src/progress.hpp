@@ -0,0 +1,111 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Work-weighted progress of the assembly and of the factorizations.
+*/
+#pragma once
+
+#include "hmat/hmat.h"
+#include "common/chrono.h"
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+namespace hmat {
+
+/*! \brief Progress of an operation weighted by the estimated work of its leaves.
+
+  An Operation is created by HMatInterface around an assembly or a
+  factorization, with the work of each leaf estimated from its dimensions and
+  rank. The engine is given Operation::progress() instead of the user
+  progress, and passes it down to the leaves, which report their completion
+  with assembled() and eliminated(). Several operations on different matrices
+  may thus run at the same time. The leaves may report concurrently: the
+  counters are atomic and one thread at a time publishes them to the user
+  hmat_progress_t, at most once per thousandth of the work.
+ */
+class Progress {
+public:
+  class Operation {
+    hmat_progress_t * progress_;
+    /// Given to the engine, its user_data is this operation
+    hmat_progress_t channel_;
+    Time start_;
+    std::atomic<int> current_;
+    std::atomic<int64_t> work_;
+    std::atomic<int64_t> maxWork_;
+    /// Work done before the operation started, when a factorization is resumed
+    int64_t startWork_;
+    /// Work published by the last update, to throttle them
+    std::atomic<int64_t> publishedWork_;
+    int publishedCurrent_;
+    std::atomic_flag publishing_;
+    /// Offset of the matrix and work done when its rows before offset_ + i are eliminated
+    int offset_;
+    std::vector<int64_t> eliminationWork_;
+    friend class Progress;
+    void publish(bool force);
+    /// Update function of channel_, for the engines which update it directly
+    static void forward(hmat_progress_t * channel);
+    /// Disallow the copy, channel_ points to this
+    Operation(const Operation &);
+  public:
+    /** Start an operation of max steps and of an estimated work, progress may be NULL */
+    Operation(hmat_progress_t * progress, int max, int64_t work);
+    /** Progress to give to the engine instead of the user one, NULL if the user progress is NULL */
+    hmat_progress_t * progress() { return progress_ == NULL ? NULL : &channel_; }
+    /**
+     * Set the work of a factorization, which is done when the rows before
+     * offset + i are eliminated, and the rows before offset + resume already are.
+     */
+    void eliminationWork(int offset, const std::vector<int64_t> & work, int resume);
+    /** Publish the end of the operation */
+    void finish();
+  };
+
+  /** Rank of the admissible leaves, before they are assembled */
+  static const int PREDICTED_RANK = 16;
+
+  /** Estimated work of the assembly of a leaf, rank is -1 for full leaves */
+  static int64_t assemblyWork(int rows, int cols, int rank);
+  /** Estimated work of the factorization for a leaf, rank is -1 for full leaves */
+  static int64_t factorizationWork(int rows, int cols, int rank);
+
+  /**
+   * A leaf is assembled, with the rank of the assembled block if it is admissible.
+   * Nothing is done unless progress is given by an Operation.
+   */
+  static void assembled(hmat_progress_t * progress, int rows, int cols, bool admissible, int rank);
+  /**
+   * The rows before position are eliminated by a factorization. If progress
+   * is not given by an Operation, only its current field is updated.
+   */
+  static void eliminated(hmat_progress_t * progress, int position);
+
+private:
+  /** The operation which gave progress, or NULL */
+  static Operation * operation(hmat_progress_t * progress);
+};
+
+}  // end namespace hmat
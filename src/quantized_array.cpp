@@ -0,0 +1,221 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "quantized_array.hpp"
+#include "common/my_assert.h"
+#include "common/memory_instrumentation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+/** IEEE 754 layout of the real types */
+template<typename R> struct IeeeTraits;
+template<> struct IeeeTraits<float> {
+    typedef uint32_t word;
+    static const int exponentBits = 8;
+    static const int mantissaBits = 23;
+};
+template<> struct IeeeTraits<double> {
+    typedef uint64_t word;
+    static const int exponentBits = 11;
+    static const int mantissaBits = 52;
+};
+
+/** Number of bits used to store a value with the given mantissa width */
+template<typename R> int codeBits(int mantissaBits) {
+    return 1 + IeeeTraits<R>::exponentBits + mantissaBits;
+}
+
+/** Keep sign, exponent and the mantissaBits leading bits of x, rounded to nearest */
+template<typename R> uint64_t encodeReal(R x, int mantissaBits) {
+    typedef typename IeeeTraits<R>::word word;
+    const int drop = IeeeTraits<R>::mantissaBits - mantissaBits;
+    word w;
+    memcpy(&w, &x, sizeof(w));
+    if (drop == 0)
+        return w;
+    const word expMask = ((((word)1) << IeeeTraits<R>::exponentBits) - 1) << IeeeTraits<R>::mantissaBits;
+    const word rounded = w + (((word)1) << (drop - 1));
+    // Rounding may carry into the exponent, which is what we want, unless it
+    // turns a finite value into an infinite one (or x is already inf/nan).
+    if ((rounded & expMask) != expMask && (w & expMask) != expMask)
+        w = rounded;
+    return w >> drop;
+}
+
+template<typename R> R decodeReal(uint64_t code, int mantissaBits) {
+    typedef typename IeeeTraits<R>::word word;
+    const word w = ((word)code) << (IeeeTraits<R>::mantissaBits - mantissaBits);
+    R x;
+    memcpy(&x, &w, sizeof(x));
+    return x;
+}
+
+inline size_t wordCount(size_t values, int codeBits) {
+    return (values * codeBits + 63) / 64;
+}
+
+}  // end anonymous namespace
+
+namespace hmat {
+
+template<typename T>
+QuantizedArray<T>::QuantizedArray(const ScalarArray<T>& a, const std::vector<int>& mantissaBits)
+    : bits_(a.cols), accounted_(0), rows(a.rows), cols(a.cols) {
+    HMAT_ASSERT((int)mantissaBits.size() == cols);
+    for (int j = 0; j < cols; j++) {
+        bits_[j] = (unsigned char) std::max(0, std::min(mantissaBits[j], IeeeTraits<real_t>::mantissaBits));
+    }
+    computeOffsets();
+    const int components = sizeof(T) / sizeof(real_t);
+    const size_t n = ((size_t) rows) * components;
+    for (int j = 0; j < cols; j++) {
+        const real_t * column = reinterpret_cast<const real_t*>(a.const_ptr(0, j));
+        const int nb = codeBits<real_t>(bits_[j]);
+        uint64_t * words = &data_[offsets_[j]];
+        size_t pos = 0;
+        for (size_t i = 0; i < n; i++, pos += nb) {
+            const uint64_t code = encodeReal(column[i], bits_[j]);
+            const size_t w = pos / 64;
+            const int shift = pos % 64;
+            words[w] |= code << shift;
+            if (shift + nb > 64)
+                words[w + 1] |= code >> (64 - shift);
+        }
+    }
+    account();
+}
+
+template<typename T>
+QuantizedArray<T>::QuantizedArray(int _rows, int _cols)
+    : bits_(_cols), offsets_(_cols + 1, 0), accounted_(0), rows(_rows), cols(_cols) {
+    account();
+}
+
+template<typename T>
+QuantizedArray<T>::QuantizedArray(const QuantizedArray& o)
+    : bits_(o.bits_), offsets_(o.offsets_), data_(o.data_), accounted_(0), rows(o.rows), cols(o.cols) {
+    account();
+}
+
+template<typename T> QuantizedArray<T>::~QuantizedArray() {
+    MemoryInstrumenter::instance().account(-(MemoryInstrumenter::mem_t) accounted_, MemoryInstrumenter::RK_FACTORS);
+}
+
+template<typename T> void QuantizedArray<T>::account() {
+    const size_t size = memorySize();
+    MemoryInstrumenter::instance().account((MemoryInstrumenter::mem_t) size - (MemoryInstrumenter::mem_t) accounted_,
+                                           MemoryInstrumenter::RK_FACTORS);
+    accounted_ = size;
+}
+
+template<typename T> void QuantizedArray<T>::computeOffsets() {
+    const int components = sizeof(T) / sizeof(real_t);
+    offsets_.resize(cols + 1);
+    offsets_[0] = 0;
+    for (int j = 0; j < cols; j++)
+        offsets_[j + 1] = offsets_[j] + wordCount(((size_t) rows) * components, codeBits<real_t>(bits_[j]));
+    data_.assign(offsets_[cols], 0);
+}
+
+template<typename T>
+void QuantizedArray<T>::decode(int colOffset, ScalarArray<T>* out) const {
+    assert(out->rows == rows);
+    assert(colOffset >= 0 && colOffset + out->cols <= cols);
+    const int components = sizeof(T) / sizeof(real_t);
+    const size_t n = ((size_t) rows) * components;
+    for (int k = 0; k < out->cols; k++) {
+        const int j = colOffset + k;
+        real_t * column = reinterpret_cast<real_t*>(out->ptr(0, k));
+        const int nb = codeBits<real_t>(bits_[j]);
+        const uint64_t mask = nb == 64 ? ~((uint64_t)0) : (((uint64_t)1) << nb) - 1;
+        const uint64_t * words = &data_[offsets_[j]];
+        size_t pos = 0;
+        for (size_t i = 0; i < n; i++, pos += nb) {
+            const size_t w = pos / 64;
+            const int shift = pos % 64;
+            uint64_t code = words[w] >> shift;
+            if (shift + nb > 64)
+                code |= words[w + 1] << (64 - shift);
+            column[i] = decodeReal<real_t>(code & mask, bits_[j]);
+        }
+    }
+}
+
+template<typename T> ScalarArray<T>* QuantizedArray<T>::decode() const {
+    ScalarArray<T>* result = new ScalarArray<T>(rows, cols, false);
+    decode(0, result);
+    return result;
+}
+
+template<typename T> size_t QuantizedArray<T>::memorySize() const {
+    return data_.size() * sizeof(uint64_t) + bits_.size() * sizeof(unsigned char);
+}
+
+template<typename T>
+void QuantizedArray<T>::writeArray(hmat_iostream writeFunc, void * userData) const {
+    // writeFunc expects a void*, not a const void*
+    writeFunc(const_cast<unsigned char*>(bits_.data()), bits_.size(), userData);
+    writeFunc(const_cast<uint64_t*>(data_.data()), data_.size() * sizeof(uint64_t), userData);
+}
+
+template<typename T>
+void QuantizedArray<T>::readArray(hmat_iostream readFunc, void * userData) {
+    readFunc(bits_.data(), bits_.size(), userData);
+    computeOffsets();
+    account();
+    readFunc(data_.data(), data_.size() * sizeof(uint64_t), userData);
+}
+
+template<typename T>
+std::vector<int> QuantizedArray<T>::chooseMantissaBits(const ScalarArray<T>& a, const ScalarArray<T>& b, double epsilon) {
+    assert(a.cols == b.cols);
+    const int rank = a.cols;
+    const double normAB = sqrt(a.norm_abt_Sqr(b));
+    if (rank == 0 || normAB == 0)
+        return std::vector<int>();
+    std::vector<int> result(rank, IeeeTraits<real_t>::mantissaBits);
+    if (epsilon <= 0)
+        return result;
+    for (int k = 0; k < rank; k++) {
+        const double contribution = Vector<T>(a, k).norm() * Vector<T>(b, k).norm();
+        if (contribution == 0) {
+            result[k] = 0;
+            continue;
+        }
+        // 2^-bits * rank * contribution <= epsilon * normAB
+        const double bits = ceil(log2(rank * contribution / (epsilon * normAB)));
+        result[k] = (int) std::max(0., std::min(bits, (double) IeeeTraits<real_t>::mantissaBits));
+    }
+    return result;
+}
+
+// Templates declaration
+template class QuantizedArray<S_t>;
+template class QuantizedArray<D_t>;
+template class QuantizedArray<C_t>;
+template class QuantizedArray<Z_t>;
+
+}  // end namespace hmat
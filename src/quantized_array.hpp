@@ -0,0 +1,103 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Lossy storage of the Rk factors with a per-column mantissa width.
+*/
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "scalar_array.hpp"
+
+namespace hmat {
+
+/*! \brief Read-only, bit-packed copy of a ScalarArray.
+
+  Each real component is stored as its IEEE sign, its exponent and the
+  \a mantissaBits(j) most significant bits of its mantissa (rounded to
+  nearest), so that the relative error on any entry of column j is at most
+  2^-(mantissaBits(j)+1). Columns start on a 64 bits word boundary so they
+  can be decoded independently.
+ */
+template<typename T> class QuantizedArray {
+  typedef typename Types<T>::real real_t;
+  /// Mantissa width of each column
+  std::vector<unsigned char> bits_;
+  /// Index in data_ of the first word of each column (size cols + 1)
+  std::vector<size_t> offsets_;
+  std::vector<uint64_t> data_;
+  /// Bytes accounted to MemoryInstrumenter::RK_FACTORS
+  size_t accounted_;
+  void computeOffsets();
+  /// Account the changes of memorySize() since the last call
+  void account();
+  /// Disallow the assignment
+  QuantizedArray& operator=(const QuantizedArray&);
+public:
+  /// Number of rows
+  int rows;
+  /// Number of columns
+  int cols;
+
+  /** \brief Encode a with the given mantissa width for each column.
+
+      \param a the array to encode
+      \param mantissaBits width of each column, must contain a.cols values
+   */
+  QuantizedArray(const ScalarArray<T>& a, const std::vector<int>& mantissaBits);
+  /** \brief Create an empty array to be filled by readArray() */
+  QuantizedArray(int rows, int cols);
+  QuantizedArray(const QuantizedArray& o);
+  ~QuantizedArray();
+
+  /** \brief Decode columns [colOffset, colOffset + out->cols[ into out */
+  void decode(int colOffset, ScalarArray<T>* out) const;
+  /** \brief Return a new ScalarArray with all the columns decoded */
+  ScalarArray<T>* decode() const;
+
+  int mantissaBits(int col) const {
+      return bits_[col];
+  }
+
+  /** \brief Size of the encoded data in bytes */
+  size_t memorySize() const;
+
+  /*! \brief Write the encoded data in a stream (FILE*, unix fd, ...) */
+  void writeArray(hmat_iostream writeFunc, void * userData) const;
+  /*! \brief Read the encoded data from a stream */
+  void readArray(hmat_iostream readFunc, void * userData);
+
+  /** \brief Choose the mantissa width of the columns of the A and B factors of A.B^T.
+
+      The quantization error on column k of A or B is at most
+      2^-(bits[k]+1) times its norm, so the error on A.B^T is at most
+      sum_k 2 * 2^-(bits[k]+1) ||a_k|| ||b_k||. The widths are chosen so that
+      this bound is below epsilon * ||A.B^T||_F, the trailing columns of
+      a truncated Rk matrix (small singular values) getting fewer bits.
+      \return an empty vector if A.B^T is null
+   */
+  static std::vector<int> chooseMantissaBits(const ScalarArray<T>& a, const ScalarArray<T>& b, double epsilon);
+};
+
+}  // end namespace hmat
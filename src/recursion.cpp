@@ -34,7 +34,7 @@
 namespace hmat {
 
   template<typename T, typename Mat>
-  void RecursionMatrix<T, Mat>::recursiveLdltDecomposition(hmat_progress_t * progress) {
+  void RecursionMatrix<T, Mat>::recursiveLdltDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint) {
 
     //  Recursive LDLT factorization:
     //
@@ -58,8 +58,11 @@ namespace hmat {
                     me()->nrChildRow(), me()->nrChildCol(), me()->description().c_str());
 
     for (int k=0 ; k<me()->nrChildRow() ; k++) {
+      const int rowEnd = me()->get(k,k)->rows()->offset() + me()->get(k,k)->rows()->size();
+      if (checkpoint && checkpoint->skip(rowEnd))
+        continue;
       // Hkk <- Lkk * Dk * tLkk
-      me()->get(k,k)->ldltDecomposition(progress);
+      me()->get(k,k)->ldltDecomposition(progress, checkpoint);
       // Solve the rest of column k: solve Lik Dk tLkk = Hik and get Lik
       for (int i=k+1 ; i<me()->nrChildRow() ; i++) {
         if (!me()->get(i,k))
@@ -78,6 +81,9 @@ namespace hmat {
             me()->get(i,j)->mdntProduct(me()->get(i,k), me()->get(k,k), me()->get(j,k)); // hij -= Lik.Dk.tLjk
         me()->get(i,i)->mdmtProduct(me()->get(i,k), me()->get(k,k)); //  hii -= Lik.Dk.tLik
       }
+      // The last step is only complete when the caller has done its own update
+      if (checkpoint && k+1 < me()->nrChildRow())
+        checkpoint->stepDone(rowEnd);
     }
 
   }
@@ -235,7 +241,7 @@ namespace hmat {
   }
 
   template<typename T, typename Mat>
-  void RecursionMatrix<T, Mat>::recursiveLuDecomposition(hmat_progress_t * progress) {
+  void RecursionMatrix<T, Mat>::recursiveLuDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint) {
 
     // |     |     |    |     |     |   |     |     |
     // | h11 | h12 |    | L11 |     |   | U11 | U12 |
@@ -263,8 +269,11 @@ namespace hmat {
       if(me()->get(k,k) == nullptr)
         // inert diagonal block. The associated row & column are considered as also inert.
         continue;
+      const int rowEnd = me()->get(k,k)->rows()->offset() + me()->get(k,k)->rows()->size();
+      if (checkpoint && checkpoint->skip(rowEnd))
+        continue;
       // Hkk <- Lkk * Ukk
-      me()->get(k,k)->luDecomposition(progress);
+      me()->get(k,k)->luDecomposition(progress, checkpoint);
       // Solve the rest of line k: solve Lkk Uki = Hki and get Uki
       for (int i=k+1 ; i<me()->nrChildRow() ; i++)
         if (me()->get(k,i))
@@ -282,6 +291,9 @@ namespace hmat {
           if (me()->get(i,j) && me()->get(k,j))
             me()->get(i,j)->gemm('N', 'N', -1, me()->get(i,k), me()->get(k,j), 1);
       }
+      // The last step is only complete when the caller has done its own update
+      if (checkpoint && k+1 < me()->nrChildRow())
+        checkpoint->stepDone(rowEnd);
     }
 
   }
@@ -346,7 +358,7 @@ namespace hmat {
   }
 
   template<typename T, typename Mat>
-  void RecursionMatrix<T, Mat>::recursiveLltDecomposition(hmat_progress_t * progress) {
+  void RecursionMatrix<T, Mat>::recursiveLltDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint) {
 
     // |     |     |    |     |     |   |     |     |
     // | h11 | h21 |    | L1  |     |   | L1t | Lt  |
@@ -371,8 +383,11 @@ namespace hmat {
                     me()->nrChildRow(), me()->nrChildCol(), me()->description().c_str());
 
     for (int k=0 ; k<me()->nrChildRow() ; k++) {
+      const int rowEnd = me()->get(k,k)->rows()->offset() + me()->get(k,k)->rows()->size();
+      if (checkpoint && checkpoint->skip(rowEnd))
+        continue;
       // Hkk <- Lkk * tLkk
-      me()->get(k,k)->lltDecomposition(progress);
+      me()->get(k,k)->lltDecomposition(progress, checkpoint);
       // Solve the rest of column k: solve Lik tLkk = Hik and get Lik
       for (int i=k+1 ; i<me()->nrChildRow() ; i++)
         if (me()->get(i,k))
@@ -386,6 +401,9 @@ namespace hmat {
           if (me()->get(i,j) && me()->get(j,k))
             me()->get(i,j)->gemm('N', 'T', -1, me()->get(i,k), me()->get(j,k), 1);
       }
+      // The last step is only complete when the caller has done its own update
+      if (checkpoint && k+1 < me()->nrChildRow())
+        checkpoint->stepDone(rowEnd);
     }
   }
 
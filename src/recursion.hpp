@@ -37,6 +37,23 @@ enum class Diag;
 enum class Uplo;
 enum class Factorization;
 
+  /*! \brief Save and resume points of the recursive factorizations.
+
+  A step of a recursive factorization is the factorization of a diagonal
+  block followed by the solve and update of the trailing blocks. Steps are
+  identified by the last row (offset + size) of their diagonal block: when
+  a step ends at row r, every step whose diagonal block ends before or at r
+  is complete.
+ */
+  class FactorizationCheckpoint {
+  public:
+    virtual ~FactorizationCheckpoint() {}
+    /** Return true if the step ending at row rowEnd was done by a previous run */
+    virtual bool skip(int rowEnd) const = 0;
+    /** Called when the step ending at row rowEnd is complete */
+    virtual void stepDone(int rowEnd) = 0;
+  };
+
   /*! \brief Templated hierarchical matrix class.
 
   This class defines recursive algorithms used by H-Matrix.
@@ -48,13 +65,13 @@ enum class Factorization;
   public:
     RecursionMatrix() {}
     ~RecursionMatrix() {}
-    void recursiveLdltDecomposition(hmat_progress_t * progress) ;
+    void recursiveLdltDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint) ;
     void recursiveSolveUpperTriangularRight(Mat* b, Factorization algo, Diag diag, Uplo uplo) const;
     void recursiveMdmtProduct(const Mat* m, const Mat* d);
     void recursiveSolveLowerTriangularLeft(Mat* b, Factorization algo, Diag diag, Uplo uplo, MainOp=MainOp::OTHER) const;
-    void recursiveLuDecomposition(hmat_progress_t * progress) ;
+    void recursiveLuDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint) ;
     void recursiveInverseNosym() ;
-    void recursiveLltDecomposition(hmat_progress_t * progress) ;
+    void recursiveLltDecomposition(hmat_progress_t * progress, FactorizationCheckpoint * checkpoint) ;
     void recursiveSolveUpperTriangularLeft(Mat* b, Factorization algo, Diag diag, Uplo uplo, MainOp=MainOp::OTHER) const;
     void transposeMeta(bool temporaryOnly=false);
 
@@ -30,6 +30,7 @@
 #include "blas_overloads.hpp"
 #include "lapack_overloads.hpp"
 #include "common/context.hpp"
+#include "common/flop_counter.hpp"
 #include "common/my_assert.h"
 #include "common/timeline.hpp"
 #include "lapack_exception.hpp"
@@ -43,10 +44,21 @@ namespace hmat {
 /** RkApproximationControl */
 template<typename T> RkApproximationControl RkMatrix<T>::approx;
 
+/** Replace an array by a new one, which is accounted to the same memory category */
+template<typename T> static void replaceArray(ScalarArray<T>* & array, ScalarArray<T>* replacement) {
+  if (array != NULL) {
+    replacement->setMemoryCategory(array->memoryCategory());
+    delete array;
+  }
+  array = replacement;
+}
+
 /** RkMatrix */
 template<typename T> RkMatrix<T>::RkMatrix(ScalarArray<T>* _a, const IndexSet* _rows,
                                            ScalarArray<T>* _b, const IndexSet* _cols)
-  : rows(_rows),
+  : packedA_(NULL),
+    packedB_(NULL),
+    rows(_rows),
     cols(_cols),
     a(_a),
     b(_b)
@@ -66,6 +78,7 @@ template<typename T> RkMatrix<T>::~RkMatrix() {
 
 
 template<typename T> ScalarArray<T>* RkMatrix<T>::evalArray(ScalarArray<T>* result) const {
+  HMAT_ASSERT(!isPacked());
   if(result==NULL)
     result = new ScalarArray<T>(rows->size(), cols->size());
   if (rank())
@@ -83,10 +96,12 @@ template<typename T> FullMatrix<T>* RkMatrix<T>::eval() const {
 
 // Compute squared Frobenius norm
 template<typename T> double RkMatrix<T>::normSqr() const {
+  HMAT_ASSERT(!isPacked());
   return a->norm_abt_Sqr(*b);
 }
 
 template<typename T> void RkMatrix<T>::scale(T alpha) {
+  HMAT_ASSERT(!isPacked());
   // We need just to scale the first matrix, A.
   if (a) {
     a->scale(alpha);
@@ -95,6 +110,7 @@ template<typename T> void RkMatrix<T>::scale(T alpha) {
 
 template<typename T> void RkMatrix<T>::transpose() {
   std::swap(a, b);
+  std::swap(packedA_, packedB_);
   std::swap(rows, cols);
 }
 
@@ -103,6 +119,50 @@ template<typename T> void RkMatrix<T>::clear() {
   delete b;
   a = NULL;
   b = NULL;
+  delete packedA_;
+  delete packedB_;
+  packedA_ = NULL;
+  packedB_ = NULL;
+}
+
+template<typename T> void RkMatrix<T>::pack(double epsilon) {
+  if (isPacked() || rank() == 0)
+    return;
+  std::vector<int> bits = QuantizedArray<T>::chooseMantissaBits(*a, *b, epsilon);
+  if (bits.empty()) {
+    // A.B^T is null, keep only the exponents
+    bits.resize(rank(), 0);
+  }
+  packedA_ = new QuantizedArray<T>(*a, bits);
+  packedB_ = new QuantizedArray<T>(*b, bits);
+  delete a;
+  delete b;
+  a = NULL;
+  b = NULL;
+}
+
+template<typename T> void RkMatrix<T>::unpack() {
+  if (!isPacked())
+    return;
+  a = packedA_->decode();
+  b = packedB_->decode();
+  delete packedA_;
+  delete packedB_;
+  packedA_ = NULL;
+  packedB_ = NULL;
+}
+
+template<typename T> void RkMatrix<T>::packed(QuantizedArray<T>* qa, QuantizedArray<T>* qb) {
+  assert(rank() == 0);
+  assert(qa->rows == rows->size() && qb->rows == cols->size() && qa->cols == qb->cols);
+  packedA_ = qa;
+  packedB_ = qb;
+}
+
+template<typename T> size_t RkMatrix<T>::packedSize() const {
+  if (isPacked())
+    return packedA_->memorySize() + packedB_->memorySize();
+  return rank() == 0 ? 0 : a->memorySize() + b->memorySize();
 }
 
 template<typename T>
@@ -113,6 +173,23 @@ void RkMatrix<T>::gemv(char trans, T alpha, const ScalarArray<T>* x, T beta, Sca
     }
     return;
   }
+  if (isPacked()) {
+    // Decode the factors by panels of columns to keep the temporary memory
+    // small: A.B^T = sum_p A_p.B_p^T
+    if (beta != T(1)) {
+      y->scale(beta);
+    }
+    const int panelSize = 16;
+    for (int k = 0; k < rank(); k += panelSize) {
+      const int n = std::min(panelSize, rank() - k);
+      RkMatrix<T> panel(new ScalarArray<T>(rows->size(), n, false), rows,
+                        new ScalarArray<T>(cols->size(), n, false), cols);
+      packedA_->decode(k, panel.a);
+      packedB_->decode(k, panel.b);
+      panel.gemv(trans, alpha, x, 1, y, side);
+    }
+    return;
+  }
   if (side == Side::LEFT) {
     if (trans == 'N') {
       // Compute Y <- Y + alpha * A * B^T * X
@@ -160,6 +237,7 @@ void RkMatrix<T>::gemv(char trans, T alpha, const ScalarArray<T>* x, T beta, Sca
 
 template<typename T> const RkMatrix<T>* RkMatrix<T>::subset(const IndexSet* subRows,
                                                             const IndexSet* subCols) const {
+  HMAT_ASSERT(!isPacked());
   assert(subRows->isSubset(*rows));
   assert(subCols->isSubset(*cols));
   ScalarArray<T>* subA = NULL;
@@ -177,6 +255,7 @@ template<typename T> const RkMatrix<T>* RkMatrix<T>::subset(const IndexSet* subR
 template<typename T> RkMatrix<T>* RkMatrix<T>::truncatedSubset(const IndexSet* subRows,
                                                                const IndexSet* subCols,
                                                                double epsilon) const {
+  HMAT_ASSERT(!isPacked());
   assert(subRows->isSubset(*rows));
   assert(subCols->isSubset(*cols));
   RkMatrix<T> * r = new RkMatrix<T>(NULL, subRows, NULL, subCols);
@@ -201,6 +280,7 @@ template<typename T> size_t RkMatrix<T>::uncompressedSize() {
 
 template<typename T> void RkMatrix<T>::addRand(double epsilon) {
   DECLARE_CONTEXT;
+  HMAT_ASSERT(!isPacked());
   a->addRand(epsilon);
   b->addRand(epsilon);
   return;
@@ -251,6 +331,8 @@ ScalarArray<T> *truncatedAB(ScalarArray<T> *ab, const IndexSet *indexSet,
 
 template<typename T> void RkMatrix<T>::truncate(double epsilon, int initialPivotA, int initialPivotB) {
   DECLARE_CONTEXT;
+  FlopCounter::Scope phase(FlopCounter::TRUNCATE);
+  HMAT_ASSERT(!isPacked());
 
   if (rank() == 0) {
     assert(!(a || b));
@@ -332,16 +414,16 @@ template<typename T> void RkMatrix<T>::truncate(double epsilon, int initialPivot
   // (Not so great, because HMAT_TRUNC_INITPIV is checked at 2 different locations)
   static char *useInitPivot = getenv("HMAT_TRUNC_INITPIV");
   ScalarArray<T>* newA = truncatedAB(a, rows, newK, u, useInitPivot, initialPivotA);
-  delete a;
-  a = newA;
+  replaceArray(a, newA);
   ScalarArray<T>* newB = truncatedAB(b, cols, newK, v, useInitPivot, initialPivotB);
-  delete b;
-  b = newB;
+  replaceArray(b, newB);
 }
 
 template<typename T> 
 void RkMatrix<T>::truncateAlter(double epsilon)
 {
+  HMAT_ASSERT(!isPacked());
+  FlopCounter::Scope phase(FlopCounter::TRUNCATE);
   int *sigma_a=nullptr;
   int *sigma_b=nullptr;
   double *tau_a=nullptr;
@@ -393,10 +475,8 @@ void RkMatrix<T>::truncateAlter(double epsilon)
   }
   delete tau_a;
   delete tau_b;
-  delete a;
-  a=newA;
-  delete b;
-  b=newB;
+  replaceArray(a, newA);
+  replaceArray(b, newB);
 }
 
 template <typename T>
@@ -435,6 +515,8 @@ void RkMatrix<T>::validateRecompression(double epsilon , int initialPivotA , int
 }
 template<typename T> void RkMatrix<T>::mGSTruncate(double epsilon, int initialPivotA, int initialPivotB) {
   DECLARE_CONTEXT;
+  FlopCounter::Scope phase(FlopCounter::TRUNCATE);
+  HMAT_ASSERT(!isPacked());
   if (rank() == 0) {
     assert(!(a || b));
     return;
@@ -496,10 +578,8 @@ template<typename T> void RkMatrix<T>::mGSTruncate(double epsilon, int initialPi
   delete ur;
   delete vr;
 
-  delete a;
-  a = newA;
-  delete b;
-  b = newB;
+  replaceArray(a, newA);
+  replaceArray(b, newB);
 }
 
 // Swap members with members from another instance.
@@ -509,6 +589,8 @@ template<typename T> void RkMatrix<T>::swap(RkMatrix<T>& other)
   assert(*cols == *other.cols);
   std::swap(a, other.a);
   std::swap(b, other.b);
+  std::swap(packedA_, other.packedA_);
+  std::swap(packedB_, other.packedB_);
 }
 
 template<typename T> void RkMatrix<T>::axpy(double epsilon, T alpha, const FullMatrix<T>* mat) {
@@ -600,6 +682,9 @@ void RkMatrix<T>::formattedAddParts(double epsilon, const T* alpha, const RkMatr
                                     const int n, bool hook) {
   if(hook && formatedAddPartsHook && formatedAddPartsHook(this, epsilon, alpha, parts, n))
     return;
+  HMAT_ASSERT(!isPacked());
+  for (int i = 0; i < n; i++)
+    HMAT_ASSERT(parts[i] == NULL || !parts[i]->isPacked());
   // TODO check if formattedAddParts() actually uses sometimes this 'alpha' parameter (or is it always 1 ?)
   DECLARE_CONTEXT;
 
@@ -697,9 +782,8 @@ void RkMatrix<T>::formattedAddParts(double epsilon, const T* alpha, const RkMatr
   }
   assert(rankOffset==rankTotal);
 
-  if(!useRealloc && a != NULL)
-    delete a;
-  a = resultA;
+  if(!useRealloc)
+    replaceArray(a, resultA);
 
   if(useRealloc) {
     resultB = b;
@@ -719,9 +803,8 @@ void RkMatrix<T>::formattedAddParts(double epsilon, const T* alpha, const RkMatr
     rankOffset += usedParts[i]->b->cols;
   }
 
-  if(!useRealloc && b != NULL)
-    delete b;
-  b = resultB;
+  if(!useRealloc)
+    replaceArray(b, resultB);
 
   assert(rankOffset==rankTotal);
   // If only one of the parts is non-zero, then the recompression is not necessary
@@ -767,6 +850,7 @@ template<typename T> RkMatrix<T>* RkMatrix<T>::multiplyRkFull(char transR, char
                                                               const RkMatrix<T>* rk,
                                                               const FullMatrix<T>* m) {
   DECLARE_CONTEXT;
+  HMAT_ASSERT(!rk->isPacked());
 
   assert(((transR == 'N') ? rk->cols->size() : rk->rows->size()) == ((transM == 'N') ? m->rows() : m->cols()));
   const IndexSet *rkRows = ((transR == 'N')? rk->rows : rk->cols);
@@ -834,6 +918,7 @@ RkMatrix<T>* RkMatrix<T>::multiplyFullRk(char transM, char transR,
                                          const FullMatrix<T>* m,
                                          const RkMatrix<T>* rk) {
   DECLARE_CONTEXT;
+  HMAT_ASSERT(!rk->isPacked());
   // If transM is 'N' and transR is 'N', we compute
   //  M * A * B^T  ==> newA = M * A, newB = B
   // We can deduce all other cases from this one:
@@ -880,6 +965,7 @@ template<typename T>
 RkMatrix<T>* RkMatrix<T>::multiplyRkH(char transR, char transH,
                                       const RkMatrix<T>* rk, const HMatrix<T>* h) {
   DECLARE_CONTEXT;
+  HMAT_ASSERT(!rk->isPacked());
   assert(((transR == 'N') ? *rk->cols : *rk->rows) == ((transH == 'N')? *h->rows() : *h->cols()));
 
   const IndexSet* rkRows = ((transR == 'N')? rk->rows : rk->cols);
@@ -946,6 +1032,7 @@ RkMatrix<T>* RkMatrix<T>::multiplyHRk(char transH, char transR,
                                       const HMatrix<T>* h, const RkMatrix<T>* rk) {
 
   DECLARE_CONTEXT;
+  HMAT_ASSERT(!rk->isPacked());
   if (rk->rank() == 0) {
     const IndexSet* newRows = ((transH == 'N') ? h-> rows() : h->cols());
     const IndexSet* newCols = ((transR == 'N') ? rk->cols : rk->rows);
@@ -998,6 +1085,7 @@ template<typename T>
 RkMatrix<T>* RkMatrix<T>::multiplyRkRk(char trans1, char trans2,
                                        const RkMatrix<T>* r1, const RkMatrix<T>* r2, double epsilon) {
   DECLARE_CONTEXT;
+  HMAT_ASSERT(!r1->isPacked() && !r2->isPacked());
   assert(((trans1 == 'N') ? *r1->cols : *r1->rows) == ((trans2 == 'N') ? *r2->rows : *r2->cols));
   // It is possible to do the computation differently, yielding a
   // different rank and a different amount of computation.
@@ -1087,6 +1175,7 @@ RkMatrix<T>* RkMatrix<T>::multiplyRkRk(char trans1, char trans2,
 
 template<typename T>
 void RkMatrix<T>::multiplyWithDiagOrDiagInv(const HMatrix<T> * d, bool inverse, Side side) {
+  HMAT_ASSERT(!isPacked());
   assert(*d->rows() == *d->cols());
   assert(side == Side::RIGHT || (*rows == *d->cols()));
   assert(side == Side::LEFT  || (*cols == *d->rows()));
@@ -1105,6 +1194,7 @@ void RkMatrix<T>::multiplyWithDiagOrDiagInv(const HMatrix<T> * d, bool inverse,
 template<typename T> void RkMatrix<T>::gemmRk(double epsilon, char transHA, char transHB,
                                               T alpha, const HMatrix<T>* ha, const HMatrix<T>* hb) {
   DECLARE_CONTEXT;
+  HMAT_ASSERT(!isPacked());
   if (!ha->isLeaf() && !hb->isLeaf()) {
     // Recursion case
     int nbRows = transHA == 'N' ? ha->nrChildRow() : ha->nrChildCol() ; /* Row blocks of the product */
@@ -1168,10 +1258,14 @@ template<typename T> void RkMatrix<T>::gemmRk(double epsilon, char transHA, char
 }
 
 template<typename T> void RkMatrix<T>::copy(const RkMatrix<T>* o) {
-  delete a;
-  delete b;
+  clear();
   rows = o->rows;
   cols = o->cols;
+  if (o->isPacked()) {
+    packedA_ = new QuantizedArray<T>(*o->packedA_);
+    packedB_ = new QuantizedArray<T>(*o->packedB_);
+    return;
+  }
   a = (o->a ? o->a->copy() : NULL);
   b = (o->b ? o->b->copy() : NULL);
 }
@@ -1184,6 +1278,7 @@ template<typename T> RkMatrix<T>* RkMatrix<T>::copy() const {
 
 
 template<typename T> void RkMatrix<T>::checkNan() const {
+  HMAT_ASSERT(!isPacked());
   if (rank() == 0) {
     return;
   }
@@ -1192,19 +1287,34 @@ template<typename T> void RkMatrix<T>::checkNan() const {
 }
 
 template<typename T> void RkMatrix<T>::conjugate() {
+  HMAT_ASSERT(!isPacked());
   if (a) a->conjugate();
   if (b) b->conjugate();
 }
 
 template<typename T> T RkMatrix<T>::get(int i, int j) const {
+  HMAT_ASSERT(!isPacked());
   return a->dot_aibj(i, *b, j);
 }
 
 template<typename T> void RkMatrix<T>::writeArray(hmat_iostream writeFunc, void * userData) const{
+  HMAT_ASSERT(!isPacked());
   a->writeArray(writeFunc, userData);
   b->writeArray(writeFunc, userData);
 }
 
+template<typename T> void RkMatrix<T>::writePackedArray(double epsilon, hmat_iostream writeFunc, void * userData) const{
+  if (isPacked()) {
+    packedA_->writeArray(writeFunc, userData);
+    packedB_->writeArray(writeFunc, userData);
+  } else {
+    RkMatrix<T> tmp(NULL, rows, NULL, cols);
+    tmp.copy(this);
+    tmp.pack(epsilon);
+    tmp.writePackedArray(epsilon, writeFunc, userData);
+  }
+}
+
 template <typename T>
 bool (*RkMatrix<T>::formatedAddPartsHook)(RkMatrix<T> *me, double epsilon, const T *alpha,
                                                const RkMatrix<T> *const *parts,
@@ -26,6 +26,7 @@
 
 #include "full_matrix.hpp"
 #include "compression.hpp"
+#include "quantized_array.hpp"
 #include "common/my_assert.h"
 
 namespace hmat {
@@ -71,6 +72,9 @@ template<typename T> class RkMatrix {
       \param initialPivotA/B is the number of orthogonal columns in panels a and b
    */
   void mGSTruncate(double epsilon, int initialPivotA=0, int initialPivotB=0);
+  /// Quantized A and B when the matrix is packed (a and b are then NULL)
+  QuantizedArray<T>* packedA_;
+  QuantizedArray<T>* packedB_;
 public:
   /** @brief A hook which can be called at the begining of formatedAddParts */
   static bool (*formatedAddPartsHook)(RkMatrix<T> * me, double epsilon, const T* alpha, const RkMatrix<T>* const * parts, const int n);
@@ -100,9 +104,34 @@ public:
   ~RkMatrix();
 
   int rank() const {
-      return a ? a->cols : 0;
+      return a ? a->cols : (packedA_ ? packedA_->cols : 0);
   }
 
+  /** Replace A and B by quantized copies.
+
+      The mantissa width of each column is chosen so that the error on A.B^T
+      stays below epsilon * ||A.B^T||_F (see QuantizedArray::chooseMantissaBits).
+      While packed, only gemv(), rank(), compressedSize(), packedSize(),
+      copy(), transpose() and serialization are supported. a and b are NULL
+      until unpack() is called, and the other methods throw.
+   */
+  void pack(double epsilon);
+  /** Restore a and b from the quantized copies */
+  void unpack();
+  bool isPacked() const {
+      return packedA_ != NULL;
+  }
+  /** Set the quantized factors of an empty RkMatrix (used by deserialization) */
+  void packed(QuantizedArray<T>* qa, QuantizedArray<T>* qb);
+  const QuantizedArray<T>* packedA() const {
+      return packedA_;
+  }
+  const QuantizedArray<T>* packedB() const {
+      return packedB_;
+  }
+  /** Size in bytes of the factors, quantized or not */
+  size_t packedSize() const;
+
   /**  Returns a pointer to a new RkMatrix representing a subset of indices.
        The pointer is supposed to be read-only (for efficiency reasons).
 
@@ -112,7 +141,8 @@ public:
    */
   const RkMatrix* subset(const IndexSet* subRows, const IndexSet* subCols) const;
   RkMatrix* truncatedSubset(const IndexSet* subRows, const IndexSet* subCols, double epsilon) const;
-  /** Returns the compression ratio (stored_elements, total_elements).
+  /** Returns the number of stored elements, (rows + cols) * rank, packed or
+      not. packedSize() gives the bytes actually stored.
    */
   size_t compressedSize();
 
@@ -288,6 +318,10 @@ public:
   /*! \brief Write the RkMatrix data 'a' and 'b' in a stream (FILE*, unix fd, ...)
     */
   void writeArray(hmat_iostream writeFunc, void * userData) const;
+  /*! \brief Write quantized 'a' and 'b' in a stream, packing them first with
+      epsilon if needed (this is left unchanged)
+    */
+  void writePackedArray(double epsilon, hmat_iostream writeFunc, void * userData) const;
 };
 
 }  // end namespace hmat
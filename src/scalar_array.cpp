@@ -175,7 +175,7 @@ int convert_factorization_to_int(Factorization f) {
 /** ScalarArray */
 template<typename T>
 ScalarArray<T>::ScalarArray(T* _m, int _rows, int _cols, int _lda)
-  : ownsMemory(false), m(_m), rows(_rows), cols(_cols), lda(_lda) {
+  : ownsMemory(false), allocated(0), m(_m), rows(_rows), cols(_cols), lda(_lda) {
   if (lda == -1) {
     lda = rows;
   }
@@ -188,7 +188,9 @@ ScalarArray<T>::ScalarArray(T* _m, int _rows, int _cols, int _lda)
 
 template<typename T>
 ScalarArray<T>::ScalarArray(int _rows, int _cols, bool initzero)
-  : ownsMemory(true), ownsFlag(true), rows(_rows), cols(_cols), lda(_rows) {
+  : ownsMemory(true), category(MemoryInstrumenter::currentCategory()),
+    allocated(((size_t) _rows) * _cols),
+    ownsFlag(true), rows(_rows), cols(_cols), lda(_rows) {
   size_t size = sizeof(T) * rows * cols;
   if(size == 0) {
     m = nullptr;
@@ -207,12 +209,14 @@ ScalarArray<T>::ScalarArray(int _rows, int _cols, bool initzero)
 #endif
   HMAT_ASSERT_MSG(m, "Trying to allocate %ldb of memory failed (rows=%d cols=%d sizeof(T)=%d)", size, rows, cols, sizeof(T));
   MemoryInstrumenter::instance().alloc(size, MemoryInstrumenter::FULL_MATRIX);
+  MemoryInstrumenter::instance().account(size, memoryCategory());
 }
 
 template<typename T> ScalarArray<T>::~ScalarArray() {
   if (ownsMemory) {
-    size_t size = ((size_t) rows) * cols * sizeof(T);
+    size_t size = allocated * sizeof(T);
     MemoryInstrumenter::instance().free(size, MemoryInstrumenter::FULL_MATRIX);
+    MemoryInstrumenter::instance().account(-(MemoryInstrumenter::mem_t) size, memoryCategory());
 #ifdef HAVE_JEMALLOC
     je_free(m);
 #else
@@ -232,14 +236,17 @@ template<typename T> void ScalarArray<T>::resize(int col_num) {
   assert(ownsFlag);
   if(col_num > cols)
     setOrtho(0);
-  int diffcol = col_num - cols;
-  if(diffcol > 0)
-    MemoryInstrumenter::instance().alloc(sizeof(T) * rows * diffcol,
-                                         MemoryInstrumenter::FULL_MATRIX);
+  // The columns removed by modifiedGramSchmidt are still allocated
+  // Signed, the array may shrink
+  const MemoryInstrumenter::mem_t diff = MemoryInstrumenter::mem_t(sizeof(T)) *
+      (MemoryInstrumenter::mem_t(rows) * col_num - MemoryInstrumenter::mem_t(allocated));
+  if(diff > 0)
+    MemoryInstrumenter::instance().alloc(diff, MemoryInstrumenter::FULL_MATRIX);
   else
-    MemoryInstrumenter::instance().free(sizeof(T) * rows * -diffcol,
-                                        MemoryInstrumenter::FULL_MATRIX);
+    MemoryInstrumenter::instance().free(-diff, MemoryInstrumenter::FULL_MATRIX);
+  MemoryInstrumenter::instance().account(diff, memoryCategory());
   cols = col_num;
+  allocated = ((size_t) rows) * cols;
 #ifdef HAVE_JEMALLOC
   void * p = je_realloc(m, sizeof(T) * rows * cols);
 #else
@@ -248,6 +255,13 @@ template<typename T> void ScalarArray<T>::resize(int col_num) {
   m = static_cast<T*>(p);
 }
 
+template<typename T> void ScalarArray<T>::setMemoryCategory(MemoryInstrumenter::Category c) {
+  if (!ownsMemory)
+    return;
+  MemoryInstrumenter::instance().move(sizeof(T) * allocated, memoryCategory(), c);
+  category = c;
+}
+
 template<typename T> void ScalarArray<T>::clear() {
   assert(lda == rows);
   std::fill(m, m + ((size_t) rows) * cols, 0);
@@ -267,7 +281,6 @@ template<typename T> size_t ScalarArray<T>::storedZeros() const {
 }
 
 template<typename T> void ScalarArray<T>::scale(T alpha) {
-  increment_flops(Multipliers<T>::mul * ((size_t) rows) * cols);
   if (lda == rows) {
     if (alpha == T(0)) {
       this->clear();
@@ -405,12 +418,6 @@ void ScalarArray<T>::gemm(char transA, char transB, T alpha,
   assert(rows == aRows);
   assert(cols == n);
   assert(k == (transB == 'N' ? b->rows : b->cols));
-  {
-    const size_t _m = aRows, _n = n, _k = k;
-    const size_t adds = _m * _n * _k;
-    const size_t muls = _m * _n * _k;
-    increment_flops(Multipliers<T>::add * adds + Multipliers<T>::mul * muls);
-  }
   assert(a->lda >= a->rows);
   assert(b->lda >= b->rows);
   assert(a->lda > 0);
@@ -489,9 +496,6 @@ void ScalarArray<T>::axpy(T alpha, const ScalarArray<T>* a) {
   assert(rows == a->rows);
   assert(cols == a->cols);
   size_t size = ((size_t) rows) * cols;
-
-  increment_flops(Multipliers<T>::add * size
-		  + (alpha == T(1) ? 0 : Multipliers<T>::mul * size));
   // Fast path
   if ((lda == rows) && (a->lda == a->rows) && (size < 1000000000)) {
     proxy_cblas::axpy(size, alpha, a->const_ptr(), 1, ptr(), 1);
@@ -564,6 +568,11 @@ template<typename T> void ScalarArray<T>::fromFile(const char * filename) {
       free(m);
   size_t size = ((size_t) rows) * cols * sizeof(T);
   m = (T*) calloc(size, 1);
+  if (ownsMemory) {
+    MemoryInstrumenter::instance().account(MemoryInstrumenter::mem_t(size) - MemoryInstrumenter::mem_t(allocated * sizeof(T)),
+                                           memoryCategory());
+    allocated = ((size_t) rows) * cols;
+  }
   r = fread(ptr(), size, 1, f);
   fclose(f);
   HMAT_ASSERT(r == 1);
@@ -673,12 +682,6 @@ template<typename T> void ScalarArray<T>::readArray(hmat_iostream readFunc, void
 
 template<typename T> void ScalarArray<T>::luDecomposition(int *pivots) {
   int info;
-  {
-    const size_t _m = rows, _n = cols;
-    const size_t muls = _m * _n *_n / 2 - _n *_n*_n / 6 + _m * _n / 2 - _n*_n / 2 + 2 * _n / 3;
-    const size_t adds = _m * _n *_n / 2 - _n *_n*_n / 6 + _m * _n / 2 + _n / 6;
-    increment_flops(Multipliers<T>::add * adds + Multipliers<T>::mul * muls);
-  }
   info = proxy_lapack::getrf(rows, cols, ptr(), lda, pivots);
   if (info)
     throw LapackException("getrf", info);
@@ -766,13 +769,7 @@ void ScalarArray<T>::lltDecomposition() {
   //  L(j,j) = sqrt( A(j,j) - sum_{k < j} L(j,k)^2)
   //  L(i,j) = ( A(i,j) - sum_{k < j} L(i,k)L(j,k) ) / L(j,j)
 
-    // from http://www.netlib.org/lapack/lawnspdf/lawn41.pdf page 120
   int n = rows;
-  const size_t n2 = (size_t) n*n;
-  const size_t n3 = n2 * n;
-  const size_t muls = n3 / 6 + n2 / 2 + n / 3;
-  const size_t adds = n3 / 6 - n / 6;
-    increment_flops(Multipliers<T>::add * adds + Multipliers<T>::mul * muls);
   if(hmat::Types<T>::IS_REAL::value) {
     // For real matrices, we can use the lapack version.
     // (There is no L.Lt factorisation for complex matrices in lapack)
@@ -780,6 +777,8 @@ void ScalarArray<T>::lltDecomposition() {
     if(info != 0)
       assertPositive(T(-1), info, "potrf");
   } else {
+    // Same operations as potrf
+    flops::potrf<T>(n);
     for (int j = 0; j < n; j++) {
       for (int k = 0; k < j; k++)
         get(j,j) -= get(j,k) * get(j,k);
@@ -857,13 +856,6 @@ void ScalarArray<T>::solve(ScalarArray<T>* x, const FactorizationData<T>& contex
   if (x->rows == 0 || x->cols == 0) return;
 
   int ierr = 0;
-  {
-    const size_t nrhs = x->cols;
-    const size_t n = rows;
-    const size_t adds = n * n * nrhs;
-    const size_t muls = (n * n - n) * nrhs;
-    increment_flops(Multipliers<T>::add * adds + Multipliers<T>::mul * muls);
-  }
   HMAT_ASSERT(context.algo == Factorization::LU);
   ierr = proxy_lapack::getrs('N', rows, x->cols, const_ptr(), lda, context.data.pivots, x->ptr(), x->rows);
   if (ierr)
@@ -881,18 +873,6 @@ void ScalarArray<T>::inverse() {
 
   int *ipiv = new int[rows];
   int info;
-  {
-    size_t vn = cols, vm = cols;
-    // getrf
-    size_t additions = (vm*vn*vn)/2 - (vn*vn*vn)/6 - (vm*vn)/2 + vn/6;
-    size_t multiplications = (vm*vn*vn)/2 - (vn*vn*vn)/6 + (vm*vn)/2
-      - (vn*vn)/2 + 2*vn/3;
-    increment_flops(Multipliers<T>::add * additions + Multipliers<T>::mul * multiplications);
-    // getri
-    additions = (2*vn*vn*vn)/3 - (3*vn*vn)/2 + (5*vn)/6;
-    multiplications = (2*vn*vn*vn)/3 + (vn*vn)/2 + (5*vn)/6;
-    increment_flops(Multipliers<T>::add * additions + Multipliers<T>::mul * multiplications);
-  }
   info = proxy_lapack::getrf(rows, cols, ptr(), lda, ipiv);
   HMAT_ASSERT(!info);
   info = proxy_lapack::getri(rows, ptr(), lda, ipiv);
@@ -957,18 +937,6 @@ int ScalarArray<T>::svdDecomposition(ScalarArray<T> **u,
   char jobz = 'S';
   int info=0;
 
-  {
-    const size_t _m = rows, _n = cols;
-    // Warning: These quantities are a rough approximation.
-    // What's wrong with these estimates:
-    //  - Golub only gives 14 * M*N*N + 8 N*N*N
-    //  - This is for real numbers
-    //  - We assume the same number of * and +
-    size_t adds = 7 * _m * _n * _n + 4 * _n * _n * _n;
-    size_t muls = 7 * _m * _n * _n + 4 * _n * _n * _n;
-    increment_flops(Multipliers<T>::add * adds + Multipliers<T>::mul * muls);
-  }
-
   try {
     if(envSA.gessd)
       info = sddCall(jobz, rows, cols, ptr(), lda, (*sigma)->ptr(), (*u)->ptr(),
@@ -1072,13 +1040,6 @@ template<typename T> void ScalarArray<T>::qrDecomposition(ScalarArray<T> *result
 
   //  SUBROUTINE DGEQRF( M, N, A, LDA, TAU, WORK, LWORK, INFO )
   T* tau = (T*) calloc(std::min(a->rows, a->cols), sizeof(T));
-  {
-    size_t mm = std::max(a->rows, a->cols);
-    size_t n = std::min(a->rows, a->cols);
-    size_t multiplications = mm * n * n - (n * n * n) / 3 + mm * n + (n * n) / 2 + (29 * n) / 6;
-    size_t additions = mm * n * n + (n * n * n) / 3 + 2 * mm * n - (n * n) / 2 + (5 * n) / 6;
-    increment_flops(Multipliers<T>::mul * multiplications + Multipliers<T>::add * additions);
-  }
   int info = proxy_lapack::geqrf(a->rows, a->cols, a->ptr(), a->rows, tau);
   HMAT_ASSERT(!info);
 
@@ -1104,11 +1065,6 @@ template<typename T>
   void ScalarArray<T>::trmm(Side side, Uplo uplo,
     char transA, Diag diag, T alpha, const ScalarArray<T> * a) {
   DECLARE_CONTEXT;
-  {
-    size_t multiplications = (size_t)rows * cols * (cols + 1) / 2;
-    size_t additions = (size_t)rows * cols  * (cols - 1) / 2;
-    increment_flops(Multipliers<T>::mul * multiplications + Multipliers<T>::add * additions);
-  }
   proxy_cblas::trmm(to_blas(side), to_blas(uplo), transA, to_blas(diag),
     rows, cols, alpha, a->m, a->lda, this->m, this->lda);
 }
@@ -1118,11 +1074,6 @@ template<typename T>
     char transA, Diag diag, T alpha, const ScalarArray<T> * a) {
   if (rows == 0 || cols == 0) return;
   DECLARE_CONTEXT;
-  {
-    const size_t adds = cols * rows * (rows - 1) / 2;
-    const size_t muls = cols * rows * (rows + 1) / 2;
-    increment_flops(Multipliers<T>::add * adds + Multipliers<T>::mul * muls);
-  }
   proxy_cblas::trsm(to_blas(side), to_blas(uplo), transA, to_blas(diag),
     rows, cols, alpha, a->m, a->lda, this->m, this->lda);
 }
@@ -1133,12 +1084,6 @@ int ScalarArray<T>::productQ(char side, char trans, ScalarArray<T>* c) const {
   Timeline::Task t(Timeline::PRODUCTQ, &cols, &c->rows, &c->cols);
   (void)t;
   assert((side == 'L') ? rows == c->rows : rows == c->cols);
-  {
-    size_t _m = c->rows, _n = c->cols, _k = cols;
-    size_t muls = 2 * _m * _n * _k - _n * _k * _k + 2 * _n * _k;
-    size_t adds = 2 * _m * _n * _k - _n * _k * _k + _n * _k;
-    increment_flops(Multipliers<T>::mul * muls + Multipliers<T>::add * adds);
-  }
 
   // In qrDecomposition(), tau is stored in the last column of 'this'
   // it is not valid to work with 'tau' inside the array 'a' because zunmqr modifies 'a'
@@ -1254,14 +1199,6 @@ template<typename T> int ScalarArray<T>::modifiedGramSchmidt(ScalarArray<T> *res
   if (!envSA.initPivot) initialPivot=0;
   assert(initialPivot>=0 && initialPivot<=cols);
 
-
-  {
-    size_t mm = rows;
-    size_t n = cols;
-    size_t multiplications = mm*n*n;
-    size_t additions = mm*n*n;
-    increment_flops(Multipliers<T>::mul * multiplications + Multipliers<T>::add * additions);
-  }
   int rank=0;
   double relative_epsilon;
   static const double LOWEST_EPSILON = 1.0e-6;
@@ -1381,7 +1318,7 @@ template<typename T> int ScalarArray<T>::modifiedGramSchmidt(ScalarArray<T> *res
       break;
   } // for(int j = rank;
 
-  // Update matrix dimensions
+  // Update matrix dimensions, the memory of the removed columns is freed with the array
   cols = rank;
   result->rows = rank;
 
@@ -1404,11 +1341,8 @@ void ScalarArray<T>::multiplyWithDiagOrDiagInv(const ScalarArray<T>* d, bool inv
   assert(side == Side::RIGHT || (rows == d->rows));
   assert(d->cols==1);
 
-  {
-    const size_t _rows = rows, _cols = cols;
-    increment_flops(Multipliers<T>::mul * _rows * _cols);
-  }
   if (side == Side::LEFT) { // line i is multiplied by d[i] or 1/d[i]
+    countFlops<T>(0, (int64_t) rows * cols, 2 * (int64_t) rows * cols);
     // TODO: Test with scale to see if it is better.
     if (inverse) {
       ScalarArray<T> *d2 = new ScalarArray<T>(rows,1);
@@ -1436,10 +1370,6 @@ void ScalarArray<T>::multiplyWithDiag(const ScalarArray<typename hmat::Types<T>:
   assert(cols <= d->rows); // d can be larger than needed
   assert(d->cols==1);
 
-  {
-    const size_t _rows = rows, _cols = cols;
-    increment_flops(Multipliers<T>::mul * _rows * _cols);
-  }
   for (int j = 0; j < cols; j++) {
     // We don't use ptr() on purpose, because is_ortho is preserved here
     proxy_cblas::scal(rows, d->get(j), m+j*lda, 1);
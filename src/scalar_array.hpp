@@ -31,6 +31,7 @@
 #include "assert.h"
 #include "data_types.hpp"
 #include "hmat/hmat.h"
+#include "common/memory_instrumentation.hpp"
 
 namespace hmat {
 
@@ -90,6 +91,10 @@ template<typename T> class ScalarArray {
 private:
   /*! True if the matrix owns its memory, ie has to free it upon destruction */
   unsigned char ownsMemory:1;
+  /*! MemoryInstrumenter::Category of the memory, if owned */
+  unsigned char category:3;
+  /*! Number of allocated values if the memory is owned, cols may have been reduced */
+  size_t allocated;
 protected:
   /// Fortran style pointer (columnwise)
   T* m;
@@ -114,7 +119,7 @@ public:
 
       \param d a ScalarArray
    */
-  ScalarArray(const ScalarArray& d) : ownsMemory(false), m(d.m),
+  ScalarArray(const ScalarArray& d) : ownsMemory(false), allocated(0), m(d.m),
 #ifdef HMAT_SCALAR_ARRAY_ORTHO
     is_ortho(d.is_ortho),
 #endif
@@ -143,7 +148,7 @@ public:
    */
   ScalarArray(const ScalarArray &d, const int rowsOffset, const int rowsSize,
               const int colsOffset, const int colsSize)
-      : ownsMemory(false), m(d.m + rowsOffset + (size_t)colsOffset * d.lda),
+      : ownsMemory(false), allocated(0), m(d.m + rowsOffset + (size_t)colsOffset * d.lda),
 #ifdef HMAT_SCALAR_ARRAY_ORTHO
         is_ortho(d.is_ortho),
 #endif
@@ -151,6 +156,13 @@ public:
 
   ~ScalarArray();
 
+  /** The MemoryInstrumenter category of the memory, OTHER if it is not owned */
+  MemoryInstrumenter::Category memoryCategory() const {
+    return ownsMemory ? MemoryInstrumenter::Category(category) : MemoryInstrumenter::OTHER;
+  }
+  /** Account the memory to another category, if it is owned */
+  void setMemoryCategory(MemoryInstrumenter::Category category);
+
   /** This <- 0.
    */
   void clear();
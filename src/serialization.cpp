@@ -23,10 +23,13 @@
 #include "serialization.hpp"
 #include "compression.hpp"
 #include "rk_matrix.hpp"
+#include "hmat_cpp_interface.hpp"
 #include "common/my_assert.h"
 
 #include <cstdlib>
+#include <cstring>
 #include <vector>
+#include <stdint.h>
 
 namespace hmat {
 
@@ -135,14 +138,20 @@ ClusterTree * MatrixStructUnmarshaller<T>::readClusterTree() {
     int dim = readValue<int>();
     double * coordinates = new double[size * dim];
     readFunc_(coordinates, sizeof(double) * size * dim, userData_);
-    DofCoordinates * dofCoordinates = new DofCoordinates(coordinates, dim, size, true);
+    DofCoordinates * dofCoordinates = NULL;
+    if(coordinates_ == NULL) {
+        dofCoordinates = new DofCoordinates(coordinates, dim, size, true);
+    } else {
+        HMAT_ASSERT_MSG((int) coordinates_->numberOfDof() == size && coordinates_->dimension() == dim,
+                        "The coordinates do not match the stream");
+    }
     delete[] coordinates;
     int * group_index = NULL;
     if (readValue<int>()) {
         group_index = new int[size];
         readFunc_(group_index, sizeof(int) * size, userData_);
     }
-    dofData_ = new DofData(*dofCoordinates, group_index);
+    dofData_ = new DofData(coordinates_ == NULL ? *dofCoordinates : *coordinates_, group_index);
     delete dofCoordinates;
     delete[] group_index;
     // dummy cluster tree to access the indices array
@@ -250,6 +259,11 @@ void MatrixDataMarshaller<T>::writeLeaf(const HMatrix<T> * matrix) {
     if(!matrix->isAssembled()) {
         writeInt(UNINITIALIZED_BLOCK);
     } else if(matrix->isRkMatrix()){
+        if(!matrix->isNull() && (quantize_ || matrix->rk()->isPacked())) {
+          writeInt(matrix->rank() | QUANTIZED_RK_FLAG);
+          matrix->rk()->writePackedArray(matrix->lowRankEpsilon(), writeFunc_, userData_);
+          return;
+        }
         writeInt(matrix->rank());
         if(!matrix->isNull()) {
           matrix->rk()->writeArray(writeFunc_, userData_);
@@ -290,6 +304,7 @@ void MatrixDataMarshaller<T>::writeInt(int v) {
 
 template<typename T>
 void MatrixDataMarshaller<T>::write(const HMatrix<T> * matrix){
+    MemoryInstrumenter::Scope memory(MemoryInstrumenter::SERIALIZATION);
     std::vector<const HMatrix<T> *> stack;
     stack.push_back(matrix);
     while(!stack.empty()) {
@@ -315,8 +330,18 @@ void MatrixDataUnmarshaller<T>::readLeaf(HMatrix<T> * matrix) {
     if(matrix->isRkMatrix()) {
         if(matrix->rk() != NULL)
             delete matrix->rk();
-        int rank = header;
-        if(rank > 0) {
+        int rank = header & ~QUANTIZED_RK_FLAG;
+        if(rank > 0 && (header & QUANTIZED_RK_FLAG)) {
+            QuantizedArray<T> * a = new QuantizedArray<T>(r->size(), rank);
+            a->readArray(readFunc_, userData_);
+            QuantizedArray<T> * b = new QuantizedArray<T>(c->size(), rank);
+            b->readArray(readFunc_, userData_);
+            RkMatrix<T> * rk = new RkMatrix<T>(NULL, r, NULL, c);
+            rk->packed(a, b);
+            if(!keepPacked_)
+                rk->unpack();
+            matrix->rk(rk);
+        } else if(rank > 0) {
             ScalarArray<T> * a = readScalarArray(r->size(), rank);
             ScalarArray<T> * b = readScalarArray(c->size(), rank);
             matrix->rk(new RkMatrix<T>(a, r, b, c));
@@ -356,6 +381,7 @@ ScalarArray<T> * MatrixDataUnmarshaller<T>::readScalarArray(int rows, int cols)
 
 template<typename T>
 void MatrixDataUnmarshaller<T>::read(HMatrix<T> * matrix){
+    MemoryInstrumenter::Scope memory(MemoryInstrumenter::SERIALIZATION);
     std::vector<HMatrix<T> *> stack;
     stack.push_back(matrix);
     while(!stack.empty()) {
@@ -374,6 +400,166 @@ void MatrixDataUnmarshaller<T>::read(HMatrix<T> * matrix){
     readFunc_(&stack, 0, userData_);
 }
 
+namespace {
+const char FILE_MAGIC[8] = {'H', 'M', 'A', 'T', 'F', 'I', 'L', 'E'};
+
+bool hostIsLittleEndian() {
+    const uint16_t one = 1;
+    unsigned char first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+void putUInt(std::vector<unsigned char> & buffer, uint64_t v, int bytes) {
+    for(int i = 0; i < bytes; i++)
+        buffer.push_back((unsigned char)(v >> (8 * i)));
+}
+
+uint64_t getUInt(const unsigned char * buffer, int bytes) {
+    uint64_t v = 0;
+    for(int i = 0; i < bytes; i++)
+        v |= ((uint64_t)buffer[i]) << (8 * i);
+    return v;
+}
+
+uint64_t doubleBits(double d) {
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    return v;
+}
+
+double bitsDouble(uint64_t v) {
+    double d;
+    memcpy(&d, &v, sizeof(d));
+    return d;
+}
+
+/** Header fields in file order, each stored as 8 little endian bytes */
+enum FileHeaderField {
+    FIELD_VALUE_TYPE, FIELD_SCALAR_SIZE, FIELD_INT_SIZE, FIELD_DOUBLE_SIZE,
+    FIELD_LITTLE_ENDIAN, FIELD_FACTORIZATION, FIELD_MAX_LEAF_SIZE,
+    FIELD_COMPRESSION_MIN_LEAF_SIZE, FIELD_COARSENING, FIELD_COARSENING_EPSILON,
+    FIELD_STRUCT_SIZE, FIELD_DATA_SIZE, FIELD_LOW_RANK_EPSILON, FIELD_COUNT
+};
+
+/** Number of fields of the first files, the others are optional */
+const int FIELD_REQUIRED_COUNT = FIELD_LOW_RANK_EPSILON;
+
+void countBytes(void *, size_t n, void * user_data) {
+    *static_cast<uint64_t*>(user_data) += n;
+}
+
+/** A readfunc which counts the bytes read */
+struct CountingReader {
+    hmat_iostream readFunc;
+    void * userData;
+    uint64_t count;
+    static void read(void * buffer, size_t n, void * user_data) {
+        CountingReader * r = static_cast<CountingReader*>(user_data);
+        r->readFunc(buffer, n, r->userData);
+        r->count += n;
+    }
+};
+}  // end anonymous namespace
+
+void readFileHeader(hmat_iostream readfunc, void * user_data, hmat_file_header_t * header) {
+    unsigned char prefix[sizeof(FILE_MAGIC) + 8];
+    readfunc(prefix, sizeof(prefix), user_data);
+    HMAT_ASSERT_MSG(memcmp(prefix, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0, "Not a HMatrix file");
+    const int version = (int) getUInt(prefix + sizeof(FILE_MAGIC), 4);
+    const uint32_t fieldsSize = (uint32_t) getUInt(prefix + sizeof(FILE_MAGIC) + 4, 4);
+    HMAT_ASSERT_MSG(version <= MATRIX_FILE_VERSION,
+                    "HMatrix file version %d is not supported (max is %d)", version, MATRIX_FILE_VERSION);
+    HMAT_ASSERT_MSG(fieldsSize >= FIELD_REQUIRED_COUNT * 8 && fieldsSize % 8 == 0,
+                    "Invalid HMatrix file header size %u", fieldsSize);
+    std::vector<unsigned char> fields(fieldsSize);
+    readfunc(fields.data(), fieldsSize, user_data);
+    const unsigned char * f = fields.data();
+    header->version = version;
+    header->value_type = (hmat_value_t) getUInt(f + 8 * FIELD_VALUE_TYPE, 8);
+    header->scalar_size = (int) getUInt(f + 8 * FIELD_SCALAR_SIZE, 8);
+    header->int_size = (int) getUInt(f + 8 * FIELD_INT_SIZE, 8);
+    header->double_size = (int) getUInt(f + 8 * FIELD_DOUBLE_SIZE, 8);
+    header->little_endian = (int) getUInt(f + 8 * FIELD_LITTLE_ENDIAN, 8);
+    header->factorization = (hmat_factorization_t) (int64_t) getUInt(f + 8 * FIELD_FACTORIZATION, 8);
+    header->max_leaf_size = (int) getUInt(f + 8 * FIELD_MAX_LEAF_SIZE, 8);
+    header->compression_min_leaf_size = (int) getUInt(f + 8 * FIELD_COMPRESSION_MIN_LEAF_SIZE, 8);
+    header->coarsening = (int) getUInt(f + 8 * FIELD_COARSENING, 8);
+    header->coarsening_epsilon = bitsDouble(getUInt(f + 8 * FIELD_COARSENING_EPSILON, 8));
+    header->struct_size = getUInt(f + 8 * FIELD_STRUCT_SIZE, 8);
+    header->data_size = getUInt(f + 8 * FIELD_DATA_SIZE, 8);
+    header->low_rank_epsilon = fieldsSize > 8 * FIELD_LOW_RANK_EPSILON ?
+        bitsDouble(getUInt(f + 8 * FIELD_LOW_RANK_EPSILON, 8)) : 0.;
+}
+
+void checkFileHeader(const hmat_file_header_t & header) {
+    HMAT_ASSERT_MSG(header.little_endian == (hostIsLittleEndian() ? 1 : 0),
+                    "HMatrix file byte order does not match this host");
+    HMAT_ASSERT_MSG(header.int_size == (int) sizeof(int) && header.double_size == (int) sizeof(double),
+                    "HMatrix file int or double size (%d, %d) does not match this host",
+                    header.int_size, header.double_size);
+    HMAT_ASSERT_MSG(header.value_type >= HMAT_SIMPLE_PRECISION && header.value_type <= HMAT_DOUBLE_COMPLEX,
+                    "Invalid HMatrix file scalar type %d", header.value_type);
+}
+
+template<typename T> void writeMatrixFile(const HMatrix<T> * matrix, Factorization factorization,
+                                          hmat_iostream writefunc, void * user_data) {
+    uint64_t structSize = 0, dataSize = 0;
+    MatrixStructMarshaller<T>(countBytes, &structSize).write(matrix, factorization);
+    MatrixDataMarshaller<T>(countBytes, &dataSize).write(matrix);
+
+    // The settings the matrix was built with, which are the global ones
+    // unless the matrix was created with other settings
+    const HMatSettings & settings = *static_cast<const HMatSettings*>(matrix->localSettings.global);
+    std::vector<unsigned char> buffer(FILE_MAGIC, FILE_MAGIC + sizeof(FILE_MAGIC));
+    putUInt(buffer, MATRIX_FILE_VERSION, 4);
+    putUInt(buffer, FIELD_COUNT * 8, 4);
+    putUInt(buffer, Types<T>::TYPE, 8);
+    putUInt(buffer, sizeof(T), 8);
+    putUInt(buffer, sizeof(int), 8);
+    putUInt(buffer, sizeof(double), 8);
+    putUInt(buffer, hostIsLittleEndian() ? 1 : 0, 8);
+    putUInt(buffer, (uint64_t)(int64_t) convert_factorization_to_int(factorization), 8);
+    putUInt(buffer, settings.maxLeafSize, 8);
+    putUInt(buffer, settings.compressionMinLeafSize, 8);
+    putUInt(buffer, settings.coarsening ? 1 : 0, 8);
+    putUInt(buffer, doubleBits(settings.coarseningEpsilon), 8);
+    putUInt(buffer, structSize, 8);
+    putUInt(buffer, dataSize, 8);
+    putUInt(buffer, doubleBits(matrix->lowRankEpsilon()), 8);
+    writefunc(buffer.data(), buffer.size(), user_data);
+
+    MatrixStructMarshaller<T>(writefunc, user_data).write(matrix, factorization);
+    MatrixDataMarshaller<T>(writefunc, user_data).write(matrix);
+}
+
+template<typename T> HMatrix<T> * readMatrixFile(MatrixSettings * settings, hmat_iostream readfunc,
+                                                 void * user_data, Factorization * factorization) {
+    hmat_file_header_t header;
+    readFileHeader(readfunc, user_data, &header);
+    checkFileHeader(header);
+    HMAT_ASSERT_MSG((int) header.value_type == (int) Types<T>::TYPE && header.scalar_size == (int) sizeof(T),
+                    "Type mismatch. Reader type is %d while file type is %d",
+                    Types<T>::TYPE, header.value_type);
+    CountingReader reader = { readfunc, user_data, 0 };
+    MatrixStructUnmarshaller<T> unmarshaller(settings, CountingReader::read, &reader);
+    HMatrix<T> * m = unmarshaller.read();
+    if(reader.count != header.struct_size) {
+        delete m;
+        HMAT_ASSERT_MSG(false, "HMatrix file structure section is %llu bytes instead of %llu",
+                        (unsigned long long) reader.count, header.struct_size);
+    }
+    reader.count = 0;
+    MatrixDataUnmarshaller<T>(CountingReader::read, &reader).read(m);
+    if(reader.count != header.data_size) {
+        delete m;
+        HMAT_ASSERT_MSG(false, "HMatrix file data section is %llu bytes instead of %llu",
+                        (unsigned long long) reader.count, header.data_size);
+    }
+    *factorization = unmarshaller.factorization();
+    return m;
+}
+
 // Templates declaration
 template class MatrixStructMarshaller<S_t>;
 template class MatrixStructMarshaller<D_t>;
@@ -391,4 +577,13 @@ template class MatrixDataUnmarshaller<S_t>;
 template class MatrixDataUnmarshaller<D_t>;
 template class MatrixDataUnmarshaller<C_t>;
 template class MatrixDataUnmarshaller<Z_t>;
+
+template void writeMatrixFile(const HMatrix<S_t> *, Factorization, hmat_iostream, void *);
+template void writeMatrixFile(const HMatrix<D_t> *, Factorization, hmat_iostream, void *);
+template void writeMatrixFile(const HMatrix<C_t> *, Factorization, hmat_iostream, void *);
+template void writeMatrixFile(const HMatrix<Z_t> *, Factorization, hmat_iostream, void *);
+template HMatrix<S_t> * readMatrixFile(MatrixSettings *, hmat_iostream, void *, Factorization *);
+template HMatrix<D_t> * readMatrixFile(MatrixSettings *, hmat_iostream, void *, Factorization *);
+template HMatrix<C_t> * readMatrixFile(MatrixSettings *, hmat_iostream, void *, Factorization *);
+template HMatrix<Z_t> * readMatrixFile(MatrixSettings *, hmat_iostream, void *, Factorization *);
 }
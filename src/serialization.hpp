@@ -57,16 +57,29 @@ template<typename T> class MatrixStructUnmarshaller {
     DofData * dofData_;
     MatrixSettings * settings_;
     Factorization factorization_;
+    const DofCoordinates * coordinates_;
 public:
-    MatrixStructUnmarshaller(MatrixSettings * settings, hmat_iostream readfunc, void * user_data):
+    /**
+     * @param coordinates if not NULL, the cluster trees are built on these
+     * coordinates, with the permutation and the partition read from the
+     * stream. The stream only holds the span centers, so this keeps the spans.
+     */
+    MatrixStructUnmarshaller(MatrixSettings * settings, hmat_iostream readfunc, void * user_data,
+                             const DofCoordinates * coordinates = NULL):
         readFunc_(readfunc), userData_(user_data), settings_(settings),
-        factorization_(Factorization::NONE){}
+        factorization_(Factorization::NONE), coordinates_(coordinates){}
     HMatrix<T> * read();
     Factorization factorization() {
         return factorization_;
     }
 };
 
+/**
+ * Flag set in the header of a Rk leaf when its factors are stored as
+ * QuantizedArray instead of ScalarArray.
+ */
+static const int QUANTIZED_RK_FLAG = 1 << 30;
+
 /** Save matrix blocks to a stream */
 template<typename T> class MatrixDataMarshaller {
     void writeLeaf(const HMatrix<T> * matrix);
@@ -74,10 +87,15 @@ template<typename T> class MatrixDataMarshaller {
     void writeInt(int v);
     hmat_iostream writeFunc_;
     void * userData_;
+    bool quantize_;
 
 public:
-    MatrixDataMarshaller(hmat_iostream writefunc, void * user_data):
-        writeFunc_(writefunc), userData_(user_data){}
+    /**
+     * @param quantize if true Rk leaves are written quantized with their
+     * epsilon (see RkMatrix::pack). Packed leaves are always written quantized.
+     */
+    MatrixDataMarshaller(hmat_iostream writefunc, void * user_data, bool quantize = false):
+        writeFunc_(writefunc), userData_(user_data), quantize_(quantize){}
 
     void write(const HMatrix<T> * matrix);
 };
@@ -91,10 +109,51 @@ template<typename T> class MatrixDataUnmarshaller {
     ScalarArray<T> * readScalarArray(int rows, int cols);
     hmat_iostream readFunc_;
     void * userData_;
+    bool keepPacked_;
 public:
-    MatrixDataUnmarshaller(hmat_iostream readfunc, void * user_data):
-        readFunc_(readfunc), userData_(user_data){}
+    /**
+     * @param keepPacked if true quantized Rk leaves are kept packed in memory,
+     * else they are decoded.
+     */
+    MatrixDataUnmarshaller(hmat_iostream readfunc, void * user_data, bool keepPacked = false):
+        readFunc_(readfunc), userData_(user_data), keepPacked_(keepPacked){}
 
     void read(HMatrix<T> * matrix);
 };
+
+/**
+ * Version of the format written by writeMatrixFile. It changes when the
+ * structure or data sections change in an incompatible way. Fields appended
+ * to the header do not change it, readers skip the fields they do not know.
+ */
+static const int MATRIX_FILE_VERSION = 1;
+
+/**
+ * Read the header written by writeMatrixFile, without validating it against
+ * the host (see checkFileHeader). Throw if the stream is not a matrix file or
+ * if its version is too recent.
+ */
+void readFileHeader(hmat_iostream readfunc, void * user_data, hmat_file_header_t * header);
+
+/**
+ * Throw if the sections described by header cannot be read on this host
+ * (byte order, int or double size).
+ */
+void checkFileHeader(const hmat_file_header_t & header);
+
+/**
+ * Write a header, the structure section (MatrixStructMarshaller) and the
+ * data section (MatrixDataMarshaller). The size of the sections is computed
+ * by a first pass which writes nothing.
+ */
+template<typename T> void writeMatrixFile(const HMatrix<T> * matrix, Factorization factorization,
+                                          hmat_iostream writefunc, void * user_data);
+
+/**
+ * Read a stream written by writeMatrixFile. The header is checked against T
+ * and the host before the sections are read, and the size of each section
+ * is checked after it has been read.
+ */
+template<typename T> HMatrix<T> * readMatrixFile(MatrixSettings * settings, hmat_iostream readfunc,
+                                                 void * user_data, Factorization * factorization);
 }
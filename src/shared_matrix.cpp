@@ -0,0 +1,323 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "config.h"
+#include "shared_matrix.hpp"
+#include "serialization.hpp"
+#include "rk_matrix.hpp"
+#include "full_matrix.hpp"
+#include "common/context.hpp"
+#include "common/my_assert.h"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char SHARED_MAGIC[8] = "HMATSHM";
+
+/** Start of a shared segment. Offsets are relative to the segment start. */
+struct SharedHeader {
+    /// Written last, so a segment being published is not seen as valid
+    char magic[8];
+    int type;
+    int factorization;
+    uint64_t size;
+    uint64_t structOffset;
+    uint64_t structSize;
+    uint64_t leavesOffset;
+    uint64_t leafCount;
+};
+
+enum SharedLeafKind { SHARED_UNASSEMBLED, SHARED_NULL, SHARED_FULL, SHARED_RK };
+
+/** Leaf description. Array offsets are 0 when the array does not exist. */
+struct SharedLeaf {
+    int kind;
+    int rank;
+    /// data of a full leaf, or A of a Rk leaf
+    uint64_t a;
+    /// B of a Rk leaf
+    uint64_t b;
+    uint64_t pivots;
+    uint64_t diagonal;
+};
+
+/** Arrays are aligned for vectorized BLAS kernels */
+inline uint64_t alignOffset(uint64_t offset) {
+    return (offset + 63) & ~((uint64_t)63);
+}
+
+void vectorWrite(void * buffer, size_t n, void * user_data) {
+    std::vector<char> * v = static_cast<std::vector<char> *>(user_data);
+    v->insert(v->end(), static_cast<char *>(buffer), static_cast<char *>(buffer) + n);
+}
+
+void memoryRead(void * buffer, size_t n, void * user_data) {
+    const char ** cursor = static_cast<const char **>(user_data);
+    memcpy(buffer, *cursor, n);
+    *cursor += n;
+}
+
+/** Leaves in the order of MatrixDataMarshaller */
+template<typename M> void sharedLeaves(M * matrix, std::vector<M *> & leaves) {
+    std::vector<M *> stack;
+    stack.push_back(matrix);
+    while(!stack.empty()) {
+        M * m = stack.back();
+        stack.pop_back();
+        if(m->isLeaf()) {
+            leaves.push_back(m);
+        } else {
+            for(int i = m->nrChild() - 1; i >= 0; --i) {
+                if(m->getChild(i) != NULL && !m->getChild(i)->isVoid())
+                    stack.push_back(m->getChild(i));
+            }
+        }
+    }
+}
+
+/** Reserve room for a rows x cols array, and copy a to it if base is not NULL */
+template<typename T>
+uint64_t placeArray(const hmat::ScalarArray<T> * a, char * base, uint64_t & offset) {
+    const uint64_t result = alignOffset(offset);
+    offset = result + ((uint64_t) a->rows) * a->cols * sizeof(T);
+    if(base != NULL) {
+        T * dest = reinterpret_cast<T *>(base + result);
+        for(int j = 0; j < a->cols; j++)
+            memcpy(dest + ((size_t) j) * a->rows, a->const_ptr(0, j), a->rows * sizeof(T));
+    }
+    return result;
+}
+
+/**
+ * Compute the offsets of the leaf arrays starting at offset, and copy the
+ * arrays to base if it is not NULL.
+ */
+template<typename T>
+void placeLeaves(const std::vector<const hmat::HMatrix<T> *> & leaves, SharedLeaf * records,
+                 char * base, uint64_t & offset) {
+    for(size_t i = 0; i < leaves.size(); i++) {
+        const hmat::HMatrix<T> * m = leaves[i];
+        SharedLeaf & r = records[i];
+        memset(&r, 0, sizeof(r));
+        if(!m->isAssembled()) {
+            r.kind = SHARED_UNASSEMBLED;
+        } else if(m->isNull()) {
+            r.kind = SHARED_NULL;
+        } else if(m->isRkMatrix()) {
+            r.kind = SHARED_RK;
+            r.rank = m->rank();
+            const hmat::RkMatrix<T> * rk = m->rk();
+            if(rk->isPacked()) {
+                hmat::ScalarArray<T> * a = rk->packedA()->decode();
+                hmat::ScalarArray<T> * b = rk->packedB()->decode();
+                r.a = placeArray(a, base, offset);
+                r.b = placeArray(b, base, offset);
+                delete a;
+                delete b;
+            } else {
+                r.a = placeArray(rk->a, base, offset);
+                r.b = placeArray(rk->b, base, offset);
+            }
+        } else {
+            r.kind = SHARED_FULL;
+            const hmat::FullMatrix<T> * f = m->full();
+            r.a = placeArray(&f->data, base, offset);
+            const int n = m->rows()->size();
+            if(f->pivots != NULL) {
+                r.pivots = alignOffset(offset);
+                offset = r.pivots + n * sizeof(int);
+                if(base != NULL)
+                    memcpy(base + r.pivots, f->pivots, n * sizeof(int));
+            }
+            if(f->diagonal != NULL)
+                r.diagonal = placeArray(f->diagonal, base, offset);
+        }
+    }
+}
+
+}  // end anonymous namespace
+
+namespace hmat {
+
+#ifdef HAVE_SYS_MMAN_H
+
+SharedSegment::~SharedSegment() {
+    munmap(address_, size_);
+}
+
+template<typename T>
+void publishShared(const HMatrix<T> * matrix, Factorization factorization, const char * name) {
+    DECLARE_CONTEXT;
+    std::vector<char> structure;
+    MatrixStructMarshaller<T>(vectorWrite, &structure).write(matrix, factorization);
+    std::vector<const HMatrix<T> *> leaves;
+    sharedLeaves(matrix, leaves);
+    std::vector<SharedLeaf> records(leaves.size());
+
+    SharedHeader header;
+    memset(&header, 0, sizeof(header));
+    header.type = Types<T>::TYPE;
+    header.factorization = convert_factorization_to_int(factorization);
+    header.structOffset = alignOffset(sizeof(header));
+    header.structSize = structure.size();
+    header.leavesOffset = alignOffset(header.structOffset + header.structSize);
+    header.leafCount = leaves.size();
+    uint64_t offset = header.leavesOffset + leaves.size() * sizeof(SharedLeaf);
+    placeLeaves<T>(leaves, records.data(), NULL, offset);
+    header.size = offset;
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    HMAT_ASSERT_MSG(fd >= 0, "Cannot create shared memory segment %s: %s", name, strerror(errno));
+    void * address = MAP_FAILED;
+    if(ftruncate(fd, header.size) == 0)
+        address = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int error = errno;
+    close(fd);
+    if(address == MAP_FAILED) {
+        shm_unlink(name);
+        HMAT_ASSERT_MSG(false, "Cannot map shared memory segment %s of %lu bytes: %s",
+                        name, (unsigned long) header.size, strerror(error));
+    }
+    char * base = static_cast<char *>(address);
+    memcpy(base + header.structOffset, structure.data(), structure.size());
+    offset = header.leavesOffset + leaves.size() * sizeof(SharedLeaf);
+    placeLeaves<T>(leaves, reinterpret_cast<SharedLeaf *>(base + header.leavesOffset), base, offset);
+    memcpy(base, &header, sizeof(header));
+    // Publish the segment once everything else is written
+    __sync_synchronize();
+    memcpy(base, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+    munmap(address, header.size);
+}
+
+template<typename T>
+HMatrix<T> * attachShared(MatrixSettings * settings, const char * name,
+                          SharedSegment ** segment, Factorization * factorization) {
+    DECLARE_CONTEXT;
+    int fd = shm_open(name, O_RDONLY, 0);
+    HMAT_ASSERT_MSG(fd >= 0, "Cannot open shared memory segment %s: %s", name, strerror(errno));
+    struct stat st;
+    void * address = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(SharedHeader))
+        address = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    HMAT_ASSERT_MSG(address != MAP_FAILED, "Cannot map shared memory segment %s", name);
+    SharedSegment * result = new SharedSegment(address, st.st_size);
+    const char * base = result->address();
+    const SharedHeader * header = reinterpret_cast<const SharedHeader *>(base);
+    HMatrix<T> * m = NULL;
+    try {
+        HMAT_ASSERT_MSG(memcmp(header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) == 0 &&
+                        header->size == (uint64_t) st.st_size,
+                        "%s is not a complete shared HMatrix segment", name);
+        HMAT_ASSERT_MSG(header->type == Types<T>::TYPE,
+                        "Type mismatch. Shared matrix type is %d while expected type is %d",
+                        header->type, Types<T>::TYPE);
+        const char * cursor = base + header->structOffset;
+        MatrixStructUnmarshaller<T> unmarshaller(settings, memoryRead, &cursor);
+        m = unmarshaller.read();
+        *factorization = unmarshaller.factorization();
+        std::vector<HMatrix<T> *> leaves;
+        sharedLeaves(m, leaves);
+        HMAT_ASSERT(leaves.size() == header->leafCount);
+        const SharedLeaf * records = reinterpret_cast<const SharedLeaf *>(base + header->leavesOffset);
+        for(size_t i = 0; i < leaves.size(); i++) {
+            HMatrix<T> * leaf = leaves[i];
+            const SharedLeaf & r = records[i];
+            const IndexSet * rows = leaf->rows();
+            const IndexSet * cols = leaf->cols();
+            // The arrays do not own their memory, the const_cast is safe as
+            // the mapping is read-only anyway.
+            T * a = reinterpret_cast<T *>(const_cast<char *>(base + r.a));
+            if(r.kind == SHARED_RK) {
+                T * b = reinterpret_cast<T *>(const_cast<char *>(base + r.b));
+                leaf->rk(new RkMatrix<T>(new ScalarArray<T>(a, rows->size(), r.rank), rows,
+                                         new ScalarArray<T>(b, cols->size(), r.rank), cols));
+            } else if(r.kind == SHARED_NULL && leaf->isRkMatrix()) {
+                leaf->rk(NULL);
+            } else if(r.kind == SHARED_FULL) {
+                FullMatrix<T> * f = new FullMatrix<T>(a, rows, cols);
+                if(r.pivots) {
+                    // FullMatrix frees its pivots, so they are copied
+                    f->pivots = (int*) calloc(rows->size(), sizeof(int));
+                    memcpy(f->pivots, base + r.pivots, rows->size() * sizeof(int));
+                }
+                if(r.diagonal)
+                    f->diagonal = new Vector<T>(reinterpret_cast<T *>(const_cast<char *>(base + r.diagonal)), rows->size());
+                leaf->full(f);
+            }
+        }
+    } catch(...) {
+        delete m;
+        delete result;
+        throw;
+    }
+    *segment = result;
+    return m;
+}
+
+void unlinkShared(const char * name) {
+    HMAT_ASSERT_MSG(shm_unlink(name) == 0, "Cannot remove shared memory segment %s: %s", name, strerror(errno));
+}
+
+#else
+
+SharedSegment::~SharedSegment() {}
+
+template<typename T>
+void publishShared(const HMatrix<T> *, Factorization, const char *) {
+    HMAT_ASSERT_MSG(false, "Shared memory is not supported on this platform");
+}
+
+template<typename T>
+HMatrix<T> * attachShared(MatrixSettings *, const char *, SharedSegment **, Factorization *) {
+    HMAT_ASSERT_MSG(false, "Shared memory is not supported on this platform");
+    return NULL;
+}
+
+void unlinkShared(const char *) {
+    HMAT_ASSERT_MSG(false, "Shared memory is not supported on this platform");
+}
+
+#endif
+
+// Templates declaration
+template void publishShared(const HMatrix<S_t> *, Factorization, const char *);
+template void publishShared(const HMatrix<D_t> *, Factorization, const char *);
+template void publishShared(const HMatrix<C_t> *, Factorization, const char *);
+template void publishShared(const HMatrix<Z_t> *, Factorization, const char *);
+template HMatrix<S_t> * attachShared(MatrixSettings *, const char *, SharedSegment **, Factorization *);
+template HMatrix<D_t> * attachShared(MatrixSettings *, const char *, SharedSegment **, Factorization *);
+template HMatrix<C_t> * attachShared(MatrixSettings *, const char *, SharedSegment **, Factorization *);
+template HMatrix<Z_t> * attachShared(MatrixSettings *, const char *, SharedSegment **, Factorization *);
+
+}  // end namespace hmat
@@ -0,0 +1,83 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Read-only HMatrix shared between processes with POSIX shared memory.
+*/
+#pragma once
+
+#include "h_matrix.hpp"
+
+namespace hmat {
+
+/*! \brief Read-only mapping of a shared memory segment.
+
+  The segment is unmapped when this object is destroyed, so it must outlive
+  the HMatrix returned by attachShared().
+ */
+class SharedSegment {
+  void * address_;
+  size_t size_;
+  SharedSegment(const SharedSegment &);
+  void operator=(const SharedSegment &);
+public:
+  SharedSegment(void * address, size_t size): address_(address), size_(size) {}
+  ~SharedSegment();
+  const char * address() const {
+      return static_cast<const char *>(address_);
+  }
+  size_t size() const {
+      return size_;
+  }
+};
+
+/**
+ * Copy an assembled (and possibly factorized) matrix to a new POSIX shared
+ * memory segment.
+ *
+ * The segment holds the matrix structure, as written by
+ * MatrixStructMarshaller, and the leaf arrays. Leaves refer to their arrays
+ * by offsets from the start of the segment, so the segment can be mapped at
+ * any address.
+ * @param name the segment name, as in shm_open. It must not exist.
+ */
+template<typename T>
+void publishShared(const HMatrix<T> * m, Factorization factorization, const char * name);
+
+/**
+ * Map a segment written by publishShared() and build a HMatrix whose leaves
+ * point to the shared arrays.
+ *
+ * The segment is mapped read-only: the returned matrix can only be used by
+ * read-only operations such as gemv and solve.
+ * @param segment set to the mapping, to be deleted after the returned matrix
+ * @param factorization set to the factorization of the published matrix
+ */
+template<typename T>
+HMatrix<T> * attachShared(MatrixSettings * settings, const char * name,
+                          SharedSegment ** segment, Factorization * factorization);
+
+/** Remove a segment created by publishShared(). Processes which are attached keep their mapping. */
+void unlinkShared(const char * name);
+
+}  // end namespace hmat
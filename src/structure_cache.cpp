@@ -0,0 +1,153 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "structure_cache.hpp"
+#include "serialization.hpp"
+#include "coordinates.hpp"
+#include "clustering.hpp"
+#include "admissibility.hpp"
+#include "common/context.hpp"
+#include "common/my_assert.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char CACHE_MAGIC[8] = "HMATSTR";
+/// Increment when the content of the cache changes
+const int CACHE_VERSION = 3;
+
+void fileWrite(void * buffer, size_t n, void * user_data) {
+    if(n > 0)
+        HMAT_ASSERT(fwrite(buffer, n, 1, static_cast<FILE *>(user_data)) == 1);
+}
+
+void fileRead(void * buffer, size_t n, void * user_data) {
+    if(n > 0)
+        HMAT_ASSERT_MSG(fread(buffer, n, 1, static_cast<FILE *>(user_data)) == 1,
+                        "Truncated structure cache");
+}
+
+}  // end anonymous namespace
+
+namespace hmat {
+
+void StructureKey::add(const void * data, size_t size) {
+    const unsigned char * p = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < size; i++) {
+        hash_ ^= p[i];
+        hash_ *= 1099511628211ULL;
+    }
+}
+
+uint64_t structureKey(int scalarType, const DofCoordinates & coordinates, const int * groupIndex,
+                      const ClusterTreeBuilder & builder, const AdmissibilityCondition & admissibility,
+                      SymmetryFlag sym) {
+    DECLARE_CONTEXT;
+    StructureKey key;
+    key.add(CACHE_VERSION);
+    key.add(scalarType);
+    const unsigned dim = coordinates.dimension();
+    const unsigned n = coordinates.numberOfDof();
+    key.add(dim);
+    key.add(n);
+    for(unsigned i = 0; i < n; i++) {
+        const unsigned spanSize = coordinates.spanSize(i);
+        key.add(spanSize);
+        for(unsigned p = 0; p < spanSize; p++)
+            for(unsigned d = 0; d < dim; d++)
+                key.add(coordinates.spanPoint(i, p, d));
+    }
+    if(groupIndex != NULL)
+        key.add(groupIndex, n * sizeof(int));
+    const std::string builderKey = builder.cacheKey();
+    HMAT_ASSERT_MSG(!builderKey.empty(), "%s cannot be used by the structure cache", builder.str().c_str());
+    key.add(builderKey);
+    const std::string admissibilityKey = admissibility.cacheKey();
+    HMAT_ASSERT_MSG(!admissibilityKey.empty(), "%s cannot be used by the structure cache",
+                    admissibility.str().c_str());
+    key.add(admissibilityKey);
+    key.add((int) sym);
+    return key.value();
+}
+
+template<typename T>
+HMatrix<T> * readStructureCache(MatrixSettings * settings, const char * filename, uint64_t key,
+                               const DofCoordinates & coordinates) {
+    DECLARE_CONTEXT;
+    FILE * f = fopen(filename, "rb");
+    if(f == NULL)
+        return NULL;
+    char magic[sizeof(CACHE_MAGIC)];
+    uint64_t fileKey;
+    if(fread(magic, sizeof(magic), 1, f) != 1 || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+       fread(&fileKey, sizeof(fileKey), 1, f) != 1 || fileKey != key) {
+        fclose(f);
+        return NULL;
+    }
+    HMatrix<T> * m;
+    try {
+        m = MatrixStructUnmarshaller<T>(settings, fileRead, f, &coordinates).read();
+    } catch(...) {
+        fclose(f);
+        throw;
+    }
+    fclose(f);
+    // The rows and cols trees were written separately but are the same
+    const ClusterTree * cols = m->colsTree();
+    m->setClusterTrees(m->rowsTree(), m->rowsTree());
+    m->ownClusterTrees(true, false);
+    delete cols;
+    return m;
+}
+
+template<typename T>
+void writeStructureCache(const HMatrix<T> * m, const char * filename, uint64_t key) {
+    DECLARE_CONTEXT;
+    HMAT_ASSERT_MSG(m->rowsTree() == m->colsTree(), "The structure cache only supports square matrices");
+    const std::string tmp = std::string(filename) + ".tmp";
+    FILE * f = fopen(tmp.c_str(), "wb");
+    HMAT_ASSERT_MSG(f != NULL, "Cannot open %s", tmp.c_str());
+    try {
+        fileWrite(const_cast<char *>(CACHE_MAGIC), sizeof(CACHE_MAGIC), f);
+        fileWrite(&key, sizeof(key), f);
+        MatrixStructMarshaller<T>(fileWrite, f).write(m);
+    } catch(...) {
+        fclose(f);
+        remove(tmp.c_str());
+        throw;
+    }
+    HMAT_ASSERT_MSG(fclose(f) == 0 && rename(tmp.c_str(), filename) == 0, "Cannot write %s", filename);
+}
+
+// Templates declaration
+template HMatrix<S_t> * readStructureCache(MatrixSettings *, const char *, uint64_t, const DofCoordinates &);
+template HMatrix<D_t> * readStructureCache(MatrixSettings *, const char *, uint64_t, const DofCoordinates &);
+template HMatrix<C_t> * readStructureCache(MatrixSettings *, const char *, uint64_t, const DofCoordinates &);
+template HMatrix<Z_t> * readStructureCache(MatrixSettings *, const char *, uint64_t, const DofCoordinates &);
+template void writeStructureCache(const HMatrix<S_t> *, const char *, uint64_t);
+template void writeStructureCache(const HMatrix<D_t> *, const char *, uint64_t);
+template void writeStructureCache(const HMatrix<C_t> *, const char *, uint64_t);
+template void writeStructureCache(const HMatrix<Z_t> *, const char *, uint64_t);
+
+}  // end namespace hmat
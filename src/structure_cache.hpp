@@ -0,0 +1,93 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Cache of the cluster tree and block structure between runs.
+*/
+#pragma once
+
+#include "h_matrix.hpp"
+#include <stdint.h>
+#include <string>
+
+namespace hmat {
+
+class DofCoordinates;
+class ClusterTreeBuilder;
+class AdmissibilityCondition;
+
+/*! \brief 64 bits FNV-1a hash used to identify a block structure. */
+class StructureKey {
+  uint64_t hash_;
+public:
+  StructureKey(): hash_(14695981039346656037ULL) {}
+  void add(const void * data, size_t size);
+  template<typename V> void add(V v) {
+      add(&v, sizeof(v));
+  }
+  void add(const std::string & s) {
+      add(s.data(), s.size());
+  }
+  uint64_t value() const {
+      return hash_;
+  }
+};
+
+/**
+ * Hash of everything the block structure of a square matrix depends on:
+ * the scalar type, the coordinates (with spans), the group index, the
+ * clustering algorithms with their leaf size and divider, the admissibility
+ * condition and the symmetry.
+ *
+ * The clustering algorithms and the admissibility condition are identified by
+ * ClusterTreeBuilder::cacheKey() and AdmissibilityCondition::cacheKey(),
+ * which must not be empty.
+ */
+uint64_t structureKey(int scalarType, const DofCoordinates & coordinates, const int * groupIndex,
+                      const ClusterTreeBuilder & builder, const AdmissibilityCondition & admissibility,
+                      SymmetryFlag sym);
+
+/**
+ * Read a matrix structure written by writeStructureCache().
+ *
+ * The rows and columns of the returned matrix share the same cluster tree,
+ * which is owned by the matrix. It is built on coordinates, with the
+ * permutation and the partition read from the file, so the spans are kept.
+ * @param coordinates the coordinates the key was computed from
+ * @return NULL if the file does not exist or was written with another key
+ */
+template<typename T>
+HMatrix<T> * readStructureCache(MatrixSettings * settings, const char * filename, uint64_t key,
+                               const DofCoordinates & coordinates);
+
+/**
+ * Write the cluster tree (with its permutation) and the block structure of
+ * an empty matrix, without any leaf data.
+ *
+ * The file is written to a temporary file and then renamed, so concurrent
+ * runs never read a partial file.
+ */
+template<typename T>
+void writeStructureCache(const HMatrix<T> * m, const char * filename, uint64_t key);
+
+}  // end namespace hmat